@@ -0,0 +1,72 @@
+/**
+ * Ordered scans of an in memory store, with a std::map and a utils::btree:
+ * full in order iteration, and bounded range scans of 100 keys from a
+ * random start. The number of keys may be given on the command line.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <raft/store/memory.hh>
+#include <utils/btree.hh>
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t keys = 10000000;
+static std::uint64_t const scans = 100000;
+static std::size_t const scan_length = 100;
+
+template <typename Map>
+static void
+bench(char const * name)
+{
+  raft::store::memory<std::uint64_t, std::uint64_t, Map> store;
+  std::vector<std::uint64_t> order(keys);
+  std::mt19937_64 gen(42);
+
+  /* inserted in random order, as keys of a state machine would be */
+  for (std::uint64_t k = 0; k < keys; ++k)
+    order[ k ] = k;
+  std::shuffle(order.begin(), order.end(), gen);
+  for (auto k : order)
+    store.c(k, k);
+
+  std::uint64_t sum = 0;
+
+  auto start = clock_type::now();
+  std::size_t n = store.scan(0, keys, [&sum](std::uint64_t, std::uint64_t v) { sum += v; });
+  std::chrono::duration<double> full = clock_type::now() - start;
+
+  start = clock_type::now();
+  for (std::uint64_t i = 0; i < scans; ++i)
+  {
+    std::uint64_t from = gen() % keys;
+    store.scan(from, keys, [&sum](std::uint64_t, std::uint64_t v) { sum += v; }, scan_length);
+  }
+  std::chrono::duration<double> bounded = clock_type::now() - start;
+
+  std::printf("%-10s iteration %8.1f Mkeys/s, %zu key scans %10.0f/s (%zu, %llu)\n",
+              name,
+              double(n) / full.count() / 1e6,
+              scan_length,
+              double(scans) / bounded.count(),
+              n,
+              static_cast<unsigned long long>(sum));
+}
+
+int
+main(int argc, char ** argv)
+{
+  if (1 < argc)
+    keys = std::strtoull(argv[ 1 ], nullptr, 10);
+
+  bench<std::map<std::uint64_t, std::uint64_t>>("std::map");
+  bench<utils::btree<std::uint64_t, std::uint64_t>>("btree");
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Binary codec against the JSON path (operator<< then nlohmann::json) on
+ * appendentries requests: bytes per entry and encode/decode ns per entry.
+ */
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <raft/codec.hh>
+
+namespace codec = raft::codec;
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename T>
+using request_t = raft::rpc::appendentries_request_t<T, unsigned long int, unsigned long int, unsigned long int>;
+
+/* keep results alive */
+static volatile std::size_t sink;
+
+template <typename F>
+double
+ns_per(std::size_t n, unsigned int rounds, F && f)
+{
+  auto start = clock_type::now();
+
+  for (unsigned int i = 0; i < rounds; ++i)
+    f();
+
+  std::chrono::duration<double, std::nano> d = clock_type::now() - start;
+  return d.count() / double(n * rounds);
+}
+
+template <typename T>
+request_t<T>
+make_request(std::size_t n, T const & elt)
+{
+  request_t<T> req{42, 1000000, 41, 999990, {}};
+
+  for (std::size_t i = 0; i < n; ++i)
+    req.entries.push_back({raft::entry_type_t::regular, 42, 1000001 + i, elt});
+
+  return req;
+}
+
+template <typename T>
+void
+bench(char const * name, std::size_t n, T const & elt, unsigned int rounds)
+{
+  auto req = make_request(n, elt);
+
+  /* binary */
+  std::vector<std::uint8_t> buf(codec::size(req));
+  std::size_t written = 0, read = 0;
+
+  double bin_enc = ns_per(n, rounds, [&]() {
+    codec::encode(req, buf.data(), buf.size(), written);
+    sink = written;
+  });
+
+  request_t<T> out;
+  double bin_dec = ns_per(n, rounds, [&]() {
+    codec::decode(buf.data(), written, out, read);
+    sink = out.entries.size();
+  });
+
+  /* json */
+  std::string text;
+  double json_enc = ns_per(n, rounds, [&]() {
+    std::ostringstream os;
+    os << req;
+    text = os.str();
+    sink = text.size();
+  });
+
+  double json_dec = ns_per(n, rounds, [&]() {
+    auto j = nlohmann::json::parse(text);
+    request_t<T> r;
+
+    r.term = j.at("term").template get<unsigned long int>();
+    r.prev_log_idx = j.at("prev_log_idx").template get<unsigned long int>();
+    r.prev_log_term = j.at("prev_log_term").template get<unsigned long int>();
+    r.leader_commit = j.at("leader_commit").template get<unsigned long int>();
+    for (auto & e : j.at("entries"))
+      r.entries.push_back({raft::entry_type_t::regular,
+                           e.at("term").template get<unsigned long int>(),
+                           e.at("id").template get<unsigned long int>(),
+                           e.at("elt").template get<T>()});
+
+    sink = r.entries.size();
+  });
+
+  std::printf("%-10s %6zu entries | binary %7.1f B/entry %7.1f ns enc %7.1f ns dec"
+              " | json %7.1f B/entry %7.1f ns enc %7.1f ns dec\n",
+              name,
+              n,
+              double(written) / n,
+              bin_enc,
+              bin_dec,
+              double(text.size()) / n,
+              json_enc,
+              json_dec);
+}
+
+int
+main()
+{
+  for (std::size_t n : {1, 64, 4096})
+  {
+    unsigned int rounds = n < 64 ? 100000 : 1000000 / n;
+
+    bench("string16", n, std::string(16, 'x'), rounds);
+    bench("string256", n, std::string(256, 'x'), rounds);
+  }
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * Reads of a store::concurrent by 1 to 8 threads while another thread
+ * applies batches of updates, and the rate of updates under that load.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <raft/store/concurrent.hh>
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t const keys = 1000000;
+static std::uint64_t const batch_size = 64;
+static std::chrono::seconds const duration(2);
+
+static void
+bench(unsigned nreaders)
+{
+  raft::store::concurrent<std::uint64_t, std::uint64_t> store;
+  raft::store::write_batch<std::uint64_t, std::uint64_t> batch;
+
+  for (std::uint64_t k = 0; k < keys; ++k)
+    batch.put(k, k);
+  store.apply(batch, 1);
+
+  std::atomic<bool> done(false);
+  std::atomic<std::uint64_t> reads(0);
+  std::atomic<std::uint64_t> sink(0);
+  std::vector<std::thread> readers;
+
+  for (unsigned i = 0; i < nreaders; ++i)
+  {
+    readers.emplace_back([&store, &done, &reads, &sink, i]() {
+      auto reader = store.make_reader();
+      std::mt19937_64 gen(i);
+      std::uint64_t n = 0;
+      std::uint64_t sum = 0;
+
+      for (; !done.load(std::memory_order_relaxed); ++n)
+        sum += reader.r(gen() % keys);
+
+      reads += n;
+      sink += sum;
+    });
+  }
+
+  std::mt19937_64 gen(42);
+  std::uint64_t updates = 0;
+  auto start = clock_type::now();
+
+  while (clock_type::now() - start < duration)
+  {
+    batch.clear();
+    for (std::uint64_t i = 0; i < batch_size; ++i)
+      batch.put(gen() % keys, i);
+
+    store.apply(batch, updates += batch_size);
+  }
+
+  done = true;
+  for (auto & t : readers)
+    t.join();
+
+  std::chrono::duration<double> d = clock_type::now() - start;
+
+  std::printf("%u readers: %12.0f reads/s, %10.0f updates/s (%llu)\n",
+              nreaders,
+              double(reads.load()) / d.count(),
+              double(updates) / d.count(),
+              static_cast<unsigned long long>(sink.load()));
+}
+
+int
+main()
+{
+  for (unsigned n = 1; n <= 8; n *= 2)
+    bench(n);
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * Snapshots of a store under a light write load: each round changes one
+ * percent of the keys, then snapshots through a store::chain, as a delta
+ * holding the changed keys, against writing the whole store each time.
+ * The number of keys and the chain directory may be given on the command
+ * line.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raft/store/chain.hh>
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t keys = 1000000;
+static int const rounds = 8;
+
+int
+main(int argc, char ** argv)
+{
+  if (1 < argc)
+    keys = std::strtoull(argv[ 1 ], nullptr, 10);
+
+  raft::store::chain_options_t options;
+  options.path = 2 < argc ? argv[ 2 ] : "/tmp/raft-bench-delta";
+  options.max_deltas = rounds;
+  options.consolidate_ratio = 0;
+
+  raft::store::chain<std::uint64_t, std::uint64_t> chain(options);
+  raft::store::mapped<std::uint64_t, std::uint64_t> store;
+  std::string full = options.path + "/full";
+
+  if (!chain.open())
+  {
+    std::perror(options.path.c_str());
+    return 1;
+  }
+
+  std::uint64_t index = 0;
+  raft::store::write_batch<std::uint64_t, std::uint64_t> batch;
+
+  for (std::uint64_t k = 0; k < keys; ++k)
+    batch.put(k, k);
+  store.apply(batch, ++index);
+  chain.snapshot(store);
+
+  std::mt19937_64 gen(42);
+  std::chrono::duration<double> delta_time(0);
+  std::chrono::duration<double> full_time(0);
+  std::uint64_t full_bytes = 0;
+
+  for (int i = 0; i < rounds - 1; ++i)
+  {
+    batch.clear();
+    for (std::uint64_t n = 0; n < keys / 100; ++n)
+      batch.put(gen() % keys, n);
+    store.apply(batch, ++index);
+
+    auto start = clock_type::now();
+    store.save(full);
+    full_time += clock_type::now() - start;
+
+    struct stat st;
+    if (stat(full.c_str(), &st) == 0)
+      full_bytes += std::uint64_t(st.st_size);
+
+    start = clock_type::now();
+    chain.snapshot(store);
+    delta_time += clock_type::now() - start;
+  }
+
+  std::printf("%llu keys, %d snapshots at 1%% churn: full %.1f MB in %.2f s, deltas %.1f MB in %.2f s\n",
+              static_cast<unsigned long long>(keys),
+              rounds - 1,
+              double(full_bytes) / 1e6,
+              full_time.count(),
+              double(chain.deltas_size()) / 1e6,
+              delta_time.count());
+
+  std::remove(full.c_str());
+  for (auto const & p : chain.files())
+    std::remove(p.c_str());
+  rmdir(options.path.c_str());
+
+  return 0;
+}
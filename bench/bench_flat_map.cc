@@ -0,0 +1,73 @@
+/**
+ * Point reads of an in memory store with 10M keys, by map backend: load
+ * rate, random lookup rate and the rate of a mix of 95% lookups and 5%
+ * updates. The number of keys may be given on the command line.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <unordered_map>
+
+#include <raft/store/memory.hh>
+#include <utils/flat_map.hh>
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t keys = 10000000;
+static std::uint64_t const ops = 10000000;
+
+template <typename Map>
+static void
+bench(char const * name)
+{
+  raft::store::memory<std::uint64_t, std::uint64_t, Map> store;
+  std::mt19937_64 gen(42);
+
+  auto start = clock_type::now();
+  for (std::uint64_t k = 0; k < keys; ++k)
+    store.c(k * 7919, k);
+  std::chrono::duration<double> load = clock_type::now() - start;
+
+  std::uint64_t sum = 0;
+
+  start = clock_type::now();
+  for (std::uint64_t i = 0; i < ops; ++i)
+    sum += store.r(gen() % keys * 7919);
+  std::chrono::duration<double> read = clock_type::now() - start;
+
+  start = clock_type::now();
+  for (std::uint64_t i = 0; i < ops; ++i)
+  {
+    std::uint64_t r = gen();
+    std::uint64_t k = r % keys * 7919;
+
+    if (r % 100 < 95)
+      sum += store.r(k);
+    else
+      store.u(k, i);
+  }
+  std::chrono::duration<double> mixed = clock_type::now() - start;
+
+  std::printf("%-14s load %10.0f/s, lookups %10.0f/s, 95%% lookups %10.0f/s (%llu)\n",
+              name,
+              double(keys) / load.count(),
+              double(ops) / read.count(),
+              double(ops) / mixed.count(),
+              static_cast<unsigned long long>(sum));
+}
+
+int
+main(int argc, char ** argv)
+{
+  if (1 < argc)
+    keys = std::strtoull(argv[ 1 ], nullptr, 10);
+
+  bench<std::map<std::uint64_t, std::uint64_t>>("std::map");
+  bench<std::unordered_map<std::uint64_t, std::uint64_t>>("unordered_map");
+  bench<utils::flat_map<std::uint64_t, std::uint64_t>>("flat_map");
+
+  return 0;
+}
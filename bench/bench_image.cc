@@ -0,0 +1,69 @@
+/**
+ * Restart of an in memory store: replaying every key into a std::map, as
+ * replaying the log would, against opening a store::image of the same
+ * keys and serving lookups from the mapping right away. The number of
+ * keys and the image path may be given on the command line.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+
+#include <raft/store/mapped.hh>
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t keys = 10000000;
+static std::uint64_t const lookups = 100000;
+
+int
+main(int argc, char ** argv)
+{
+  if (1 < argc)
+    keys = std::strtoull(argv[ 1 ], nullptr, 10);
+
+  std::string path = 2 < argc ? argv[ 2 ] : "/tmp/raft-bench-image";
+  std::map<std::uint64_t, std::uint64_t> state;
+
+  auto start = clock_type::now();
+  for (std::uint64_t k = 0; k < keys; ++k)
+    state[ k ] = k;
+  std::chrono::duration<double> replay = clock_type::now() - start;
+
+  start = clock_type::now();
+  if (!raft::store::image<std::uint64_t, std::uint64_t>::write(path, state, keys))
+  {
+    std::perror(path.c_str());
+    return 1;
+  }
+  std::chrono::duration<double> save = clock_type::now() - start;
+
+  state.clear();
+
+  start = clock_type::now();
+  raft::store::mapped<std::uint64_t, std::uint64_t> store(path);
+  std::chrono::duration<double, std::milli> open = clock_type::now() - start;
+
+  std::mt19937_64 gen(42);
+  std::uint64_t sum = 0;
+
+  start = clock_type::now();
+  for (std::uint64_t i = 0; i < lookups; ++i)
+    sum += store.r(gen() % keys);
+  std::chrono::duration<double> read = clock_type::now() - start;
+
+  std::printf("%llu keys: replay %.2f s, image written in %.2f s, opened in %.3f ms, "
+              "%.0f lookups/s from the mapping (%llu)\n",
+              static_cast<unsigned long long>(keys),
+              replay.count(),
+              save.count(),
+              open.count(),
+              double(lookups) / read.count(),
+              static_cast<unsigned long long>(sum));
+
+  std::remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,62 @@
+/**
+ * Snapshot pause of an in memory store: the time apply is stopped to take
+ * a consistent view, with a std::map copied and with a utils::pmap shared,
+ * and the update rate while another thread serializes the view.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <thread>
+
+#include <raft/store/memory.hh>
+#include <utils/pmap.hh>
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t const keys = 1000000;
+static std::uint64_t const updates = 1000000;
+
+template <typename Map>
+static void
+bench(char const * name)
+{
+  raft::store::memory<std::uint64_t, std::uint64_t, Map> store;
+  std::mt19937_64 gen(42);
+
+  for (std::uint64_t k = 0; k < keys; ++k)
+    store.c(k, k);
+
+  auto start = clock_type::now();
+  auto view = store.snapshot();
+  std::chrono::duration<double, std::micro> pause = clock_type::now() - start;
+
+  std::uint64_t sum = 0;
+  std::thread serializer([&view, &sum]() {
+    for (auto const & it : view)
+      sum += it.second;
+  });
+
+  start = clock_type::now();
+  for (std::uint64_t i = 0; i < updates; ++i)
+    store.u(gen() % keys, i);
+  std::chrono::duration<double> d = clock_type::now() - start;
+
+  serializer.join();
+
+  std::printf("%-8s snapshot pause %10.1f us, %10.0f updates/s while serializing (%llu)\n",
+              name,
+              pause.count(),
+              double(updates) / d.count(),
+              static_cast<unsigned long long>(sum));
+}
+
+int
+main()
+{
+  bench<std::map<std::uint64_t, std::uint64_t>>("std::map");
+  bench<utils::pmap<std::uint64_t, std::uint64_t>>("pmap");
+
+  return 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * Replication throughput of a 3 nodes cluster whose servers run on their
+ * own thread and talk through shared memory rings: a baseline of the
+ * protocol cost of raft::server, free of network overhead.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <raft/codec.hh>
+#include <raft/server.hh>
+#include <raft/transport/shm.hh>
+
+namespace codec = raft::codec;
+
+using server_t = raft::server<std::uint64_t>;
+using clock_type = std::chrono::steady_clock;
+
+static std::size_t const nodes = 3;
+
+struct replica_t
+{
+  server_t server;
+  raft::transport::shm endpoint;
+
+  replica_t(raft::transport::shm_region & region, std::size_t id) : endpoint(region, id)
+  {
+    for (std::size_t j = 0; j < nodes; ++j)
+      server.node_add(j, j == id);
+
+    server.reserve(1 << 22);
+
+    server_t::callbacks_t cbs;
+    cbs.send_request_vote = [this](auto const & node, auto const & msg) { return send(node->id(), msg); };
+    cbs.send_heartbeat = [this](auto const & node, auto const & msg) { return send(node->id(), msg); };
+    cbs.send_appendentries_encoded = [this](auto const & node, auto iov, int iovcnt) {
+      while (endpoint.send(node->id(), iov, iovcnt) == raft::transport::status_t::full)
+        std::this_thread::yield();
+      return raft::status_t::ok;
+    };
+    server.callbacks(cbs);
+  }
+
+  template <typename msg_t>
+  raft::status_t
+  send(std::size_t to, msg_t const & msg)
+  {
+    std::uint8_t buf[ 64 ];
+    std::size_t len;
+
+    if (raft::any(codec::encode(msg, buf, sizeof(buf), len)))
+      return raft::status_t::fail;
+
+    /* rings are sized above the window, a peer always makes room */
+    while (endpoint.send(to, buf, len) == raft::transport::status_t::full)
+      std::this_thread::yield();
+
+    return raft::status_t::ok;
+  }
+
+  template <typename msg_t>
+  bool
+  decode(std::uint8_t const * data, std::size_t len, msg_t & msg)
+  {
+    std::size_t read;
+    return !raft::any(codec::decode(data, len, msg, read));
+  }
+
+  std::size_t
+  poll()
+  {
+    return endpoint.poll([this](std::size_t from, std::uint8_t const * data, std::size_t len) {
+      codec::type_t type;
+      if (raft::any(codec::peek(data, len, type)))
+        return;
+
+      auto node = server.node_get(from);
+
+      switch (type)
+      {
+        case codec::type_t::vote_request:
+        {
+          server_t::vote_request_t req{};
+          server_t::vote_response_t resp{};
+          if (decode(data, len, req))
+          {
+            server.recv_vote_request(node, req, resp);
+            send(from, resp);
+          }
+          break;
+        }
+        case codec::type_t::vote_response:
+        {
+          server_t::vote_response_t resp{};
+          if (decode(data, len, resp))
+            server.recv_vote_response(node, resp);
+          break;
+        }
+        case codec::type_t::appendentries_request:
+        {
+          server_t::appendentries_view_t req;
+          server_t::appendentries_response_t resp{};
+          if (decode(data, len, req))
+          {
+            server.recv_appendentries(node, req, resp);
+            send(from, resp);
+          }
+          break;
+        }
+        case codec::type_t::appendentries_response:
+        {
+          server_t::appendentries_response_t resp{};
+          if (decode(data, len, resp))
+            server.recv_appendentries_response(node, resp);
+          break;
+        }
+        case codec::type_t::heartbeat_request:
+        {
+          server_t::heartbeat_request_t req{};
+          server_t::heartbeat_response_t resp{};
+          if (decode(data, len, req))
+          {
+            server.recv_heartbeat(node, req, resp);
+            send(from, resp);
+          }
+          break;
+        }
+        case codec::type_t::heartbeat_response:
+        {
+          server_t::heartbeat_response_t resp{};
+          if (decode(data, len, resp))
+            server.recv_heartbeat_response(node, resp);
+          break;
+        }
+        default:
+          /* logs are never compacted here, no snapshot is sent */
+          break;
+      }
+    });
+  }
+};
+
+static void
+bench(std::size_t entries, std::size_t window)
+{
+  auto region = raft::transport::shm_region::create(nodes, 1 << 20);
+  std::vector<std::unique_ptr<replica_t>> cluster;
+
+  for (std::size_t i = 0; i < nodes; ++i)
+    cluster.push_back(std::make_unique<replica_t>(*region, i));
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> followers;
+
+  for (std::size_t i = 1; i < nodes; ++i)
+  {
+    followers.emplace_back([&, i]() {
+      while (!done)
+      {
+        if (cluster[ i ]->poll() == 0)
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  auto & leader = *cluster[ 0 ];
+
+  leader.server.election_start();
+  while (!leader.server.is_leader())
+  {
+    if (leader.poll() == 0)
+      std::this_thread::yield();
+  }
+
+  /* entries follow the noop of the election */
+  auto base = leader.server.current_index();
+  auto start = clock_type::now();
+  std::size_t submitted = 0;
+
+  while (leader.server.commit_index() < base + entries)
+  {
+    server_t::index_t idx;
+
+    while (submitted < entries && leader.server.current_index() - leader.server.commit_index() < window)
+    {
+      leader.server.recv_entry({raft::entry_type_t::regular, 0, 0, submitted}, idx);
+      ++submitted;
+    }
+
+    if (leader.poll() == 0)
+      std::this_thread::yield();
+  }
+
+  std::chrono::duration<double, std::nano> d = clock_type::now() - start;
+
+  done = true;
+  for (auto & t : followers)
+    t.join();
+
+  std::printf("%8zu entries, window %5zu: %8.1f ns/entry, %6.2f M entries/s\n",
+              entries,
+              window,
+              d.count() / double(entries),
+              double(entries) / d.count() * 1e3);
+}
+
+int
+main()
+{
+  for (std::size_t window : {1, 16, 256, 4096})
+    bench(200000, window);
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * Write-ahead log throughput: records made durable per second with the
+ * io_uring and worker thread backends, against a synchronous write and
+ * fdatasync per flush. Run it on the device to measure, the directory is
+ * given as first argument.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <raft/wal/journal.hh>
+
+namespace wal = raft::wal;
+
+using clock_type = std::chrono::steady_clock;
+
+static std::size_t const records = 20000;
+static std::size_t const record_size = 128;
+
+static void
+report(char const * name, std::size_t group, std::chrono::duration<double> d)
+{
+  std::printf("%-8s flush every %4zu: %10.0f records/s\n", name, group, double(records) / d.count());
+}
+
+template <typename backend_t>
+static void
+bench(char const * name, std::string const & dir, std::size_t group, bool direct)
+{
+  std::string path = dir + "/bench-wal";
+  std::system(("rm -rf " + path).c_str());
+
+  wal::options_t options;
+  options.path = path;
+  options.preallocate = true;
+  options.direct = direct;
+
+  wal::journal<backend_t> j(options);
+  if (!j.ok() || raft::any(j.open([](unsigned long int, std::uint8_t const *, std::size_t) {})))
+  {
+    std::printf("%-8s unavailable\n", name);
+    return;
+  }
+
+  std::vector<std::uint8_t> data(record_size, 'x');
+  auto start = clock_type::now();
+
+  for (std::size_t i = 1; i <= records; ++i)
+  {
+    while (j.append(i, data.data(), data.size()) == wal::status_t::full)
+      j.poll([](unsigned long int) {});
+
+    if (i % group == 0)
+      j.flush();
+
+    /* reap without waiting, as a raft loop would */
+    j.poll([](unsigned long int) {});
+  }
+
+  j.flush();
+  while (j.durable_index() != records && !j.failed())
+    j.poll([](unsigned long int) {});
+
+  report(name, group, clock_type::now() - start);
+  std::system(("rm -rf " + path).c_str());
+}
+
+static void
+bench_sync(std::string const & dir, std::size_t group)
+{
+  std::string path = dir + "/bench-wal-sync";
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+
+  std::vector<std::uint8_t> data(record_size * group, 'x');
+  auto start = clock_type::now();
+
+  for (std::size_t i = 0; i < records; i += group)
+  {
+    if (::write(fd, data.data(), data.size()) < 0 || fdatasync(fd) < 0)
+      break;
+  }
+
+  report("sync", group, clock_type::now() - start);
+
+  ::close(fd);
+  unlink(path.c_str());
+}
+
+int
+main(int argc, char ** argv)
+{
+  std::string dir = argc < 2 ? "/tmp" : argv[ 1 ];
+
+  for (std::size_t group : {1, 16, 256})
+  {
+    bench_sync(dir, group);
+    bench<wal::posix>("posix", dir, group, false);
+    bench<wal::uring>("uring", dir, group, false);
+    bench<wal::uring>("direct", dir, group, true);
+  }
+
+  return 0;
+}
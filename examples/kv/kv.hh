@@ -0,0 +1,437 @@
+#ifndef RAFT_EXAMPLES_KV_HH_
+#define RAFT_EXAMPLES_KV_HH_
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <raft/server.hh>
+#include <raft/store/batch.hh>
+#include <raft/store/memory.hh>
+
+/**
+ * Reference replicated key value service: raft::server replicating write
+ * batches, applied to a raft::store::memory on every replica.
+ */
+namespace kv
+{
+
+using key_t = std::string;
+using value_t = std::string;
+using batch_t = raft::store::write_batch<key_t, value_t>;
+using server_t = raft::server<batch_t>;
+using index_t = server_t::index_t;
+using term_t = server_t::term_t;
+using store_t = raft::store::memory<key_t, value_t>;
+
+/**
+ * @brief Replicas of the store, in process
+ *
+ * Each replica is a server whose entries are write batches, applied to its
+ * own store. Messages are delivered by direct calls, and dropped to and
+ * from disconnected replicas.
+ */
+class cluster
+{
+public:
+  static constexpr std::size_t none = std::size_t(-1);
+
+public:
+  explicit cluster(std::size_t n) : servers_(n), stores_(n), connected_(n, true), acks_(0)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      for (std::size_t j = 0; j < n; ++j)
+        servers_[ i ].node_add(j, i == j);
+
+      server_t::callbacks_t cbs;
+      cbs.send_request_vote = [this, i](auto const & node, auto const & req) {
+        auto & peer = servers_[ node->id() ];
+        server_t::vote_response_t resp;
+
+        if (!linked(i, node->id()))
+          return raft::status_t::ok;
+
+        peer.recv_vote_request(peer.node_get(i), req, resp);
+        return servers_[ i ].recv_vote_response(node, resp);
+      };
+      cbs.send_appendentries = [this, i](auto const & node, auto const & req) {
+        auto & peer = servers_[ node->id() ];
+        server_t::appendentries_response_t resp;
+
+        if (!linked(i, node->id()))
+          return raft::status_t::ok;
+
+        peer.recv_appendentries(peer.node_get(i), req, resp);
+        return servers_[ i ].recv_appendentries_response(node, resp);
+      };
+      cbs.send_heartbeat = [this, i](auto const & node, auto const & req) {
+        auto & peer = servers_[ node->id() ];
+        server_t::heartbeat_response_t resp;
+
+        if (!linked(i, node->id()))
+          return raft::status_t::ok;
+
+        peer.recv_heartbeat(peer.node_get(i), req, resp);
+        if (resp.success && resp.term == req.term)
+          ++acks_;
+
+        return servers_[ i ].recv_heartbeat_response(node, resp);
+      };
+      cbs.apply_log = [this, i](auto const & e, auto idx) {
+        stores_[ i ].apply(e.elt, idx);
+        if (applied_)
+          applied_(i, idx, e.term);
+
+        return raft::status_t::ok;
+      };
+      servers_[ i ].callbacks(cbs);
+    }
+  }
+
+  cluster(cluster const &) = delete;
+  cluster & operator=(cluster const &) = delete;
+
+public:
+  std::size_t
+  size() const noexcept
+  {
+    return servers_.size();
+  }
+
+  server_t &
+  server(std::size_t i)
+  {
+    return servers_[ i ];
+  }
+
+  store_t const &
+  store(std::size_t i) const
+  {
+    return stores_[ i ];
+  }
+
+  /**
+   * @brief Get the leader of the highest term among connected replicas,
+   * none if there is none
+   */
+  std::size_t
+  leader() const
+  {
+    std::size_t found = none;
+
+    for (std::size_t i = 0; i < servers_.size(); ++i)
+    {
+      if (!connected_[ i ] || !servers_[ i ].is_leader())
+        continue;
+
+      if (found == none || servers_[ found ].current_term() < servers_[ i ].current_term())
+        found = i;
+    }
+
+    return found;
+  }
+
+  /**
+   * @brief Start an election on a replica
+   *
+   * @return true if it won
+   */
+  bool
+  elect(std::size_t i)
+  {
+    servers_[ i ].election_start();
+
+    /* a single voter takes over on its own */
+    if (servers_.size() == 1)
+      servers_[ i ].periodic(std::chrono::milliseconds(0));
+
+    return servers_[ i ].is_leader();
+  }
+
+  /**
+   * @brief Let time pass on every replica
+   */
+  void
+  tick(std::chrono::milliseconds elapsed)
+  {
+    for (auto & s : servers_)
+      s.periodic(elapsed);
+  }
+
+  void
+  connect(std::size_t i, bool connected)
+  {
+    connected_[ i ] = connected;
+  }
+
+  /**
+   * @brief Check that a replica still leads a majority, with a round of
+   * heartbeats
+   */
+  bool
+  confirm(std::size_t i)
+  {
+    if (!servers_[ i ].is_leader())
+      return false;
+
+    acks_ = 0;
+    servers_[ i ].send_heartbeat_all();
+
+    return servers_[ i ].is_leader() && servers_.size() / 2 < acks_ + 1;
+  }
+
+  /**
+   * @brief Set the callback told of the entries each replica applies
+   */
+  void
+  on_applied(std::function<void(std::size_t, index_t, term_t)> f)
+  {
+    applied_ = std::move(f);
+  }
+
+private:
+  bool
+  linked(std::size_t a, std::size_t b) const
+  {
+    return connected_[ a ] && connected_[ b ];
+  }
+
+private:
+  std::vector<server_t> servers_;
+  std::vector<store_t> stores_;
+  std::vector<bool> connected_;
+
+  /* heartbeats acknowledged in the current round */
+  std::size_t acks_;
+
+  std::function<void(std::size_t, index_t, term_t)> applied_;
+};
+
+/**
+ * @brief Client side of the service
+ *
+ * Writes are queued and proposed to the leader together, one entry per
+ * batch, and completed once the leader applied it. Reads are linearizable
+ * with ReadIndex: the leader records its commit index, checks with a
+ * round of heartbeats that it still leads a majority, then serves the
+ * reads from its store once it has applied up to that index. One round
+ * serves a whole batch of reads, and no read goes through the log.
+ */
+class service
+{
+public:
+  /** told whether the write was applied, false if it may not have been */
+  using done_t = std::function<void(bool)>;
+
+private:
+  struct inflight_t
+  {
+    term_t term;
+    std::vector<done_t> done;
+  };
+
+public:
+  explicit service(cluster & c) : cluster_(c), leader_(cluster::none)
+  {
+    cluster_.on_applied([this](std::size_t node, index_t idx, term_t term) { applied(node, idx, term); });
+  }
+
+  service(service const &) = delete;
+  service & operator=(service const &) = delete;
+
+  ~service()
+  {
+    cluster_.on_applied(nullptr);
+  }
+
+public:
+  void
+  put(key_t const & k, value_t const & v, done_t done)
+  {
+    batch_.put(k, v);
+    done_.push_back(std::move(done));
+  }
+
+  void
+  del(key_t const & k, done_t done)
+  {
+    batch_.del(k);
+    done_.push_back(std::move(done));
+  }
+
+  /**
+   * @brief Get the number of writes queued
+   */
+  std::size_t
+  queued() const noexcept
+  {
+    return done_.size();
+  }
+
+  /**
+   * @brief Propose the queued writes to the leader, as one entry
+   *
+   * @return false if there is no leader, the writes staying queued
+   */
+  bool
+  flush()
+  {
+    if (done_.empty())
+      return true;
+
+    std::size_t l = cluster_.leader();
+    if (l == cluster::none)
+      return false;
+
+    follow(l);
+
+    server_t & s = cluster_.server(l);
+    index_t idx;
+
+    /* completions may be called from recv_entry, when a majority is in
+     * reach at once: they are registered first */
+    index_t next = s.current_index() + 1;
+    inflight_[ next ] = {s.current_term(), std::move(done_)};
+    done_.clear();
+
+    if (any(s.recv_entry({raft::entry_type_t::regular, 0, 0, batch_}, idx)) && inflight_.count(next))
+    {
+      fail(inflight_[ next ].done);
+      inflight_.erase(next);
+    }
+
+    batch_.clear();
+    return true;
+  }
+
+  /**
+   * @brief Read keys, linearizably
+   *
+   * @tparam F Callback function type (key_t, value_t const *) -> void,
+   * given nullptr for the keys not found
+   *
+   * @return false if there is no leader, or it could not confirm it leads
+   */
+  template <typename Keys, typename F>
+  bool
+  read(Keys const & keys, F && f)
+  {
+    std::size_t l = cluster_.leader();
+    if (l == cluster::none)
+      return false;
+
+    follow(l);
+
+    server_t & s = cluster_.server(l);
+    term_t term = 0;
+
+    /* a new leader knows the commit index once the noop of its election
+     * is committed */
+    if (!s.term_at(s.commit_index(), term) || term != s.current_term())
+      return false;
+
+    index_t read_index = s.commit_index();
+
+    if (!cluster_.confirm(l))
+      return false;
+
+    if (s.last_applied_index() < read_index && any(s.apply_all()))
+      return false;
+
+    store_t const & store = cluster_.store(l);
+
+    for (auto const & k : keys)
+    {
+      try
+      {
+        value_t v = store.r(k);
+        f(k, &v);
+      }
+      catch (std::out_of_range const &)
+      {
+        f(k, static_cast<value_t const *>(nullptr));
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Get the number of proposed writes not applied yet
+   */
+  std::size_t
+  inflight() const noexcept
+  {
+    std::size_t n = 0;
+
+    for (auto const & it : inflight_)
+      n += it.second.done.size();
+
+    return n;
+  }
+
+private:
+  /**
+   * @brief Writes proposed to a previous leader may never be applied
+   */
+  void
+  follow(std::size_t l)
+  {
+    if (l == leader_)
+      return;
+
+    for (auto & it : inflight_)
+      fail(it.second.done);
+
+    inflight_.clear();
+    leader_ = l;
+  }
+
+  void
+  applied(std::size_t node, index_t idx, term_t term)
+  {
+    if (node != leader_)
+      return;
+
+    auto it = inflight_.find(idx);
+    if (it == inflight_.end())
+      return;
+
+    bool ok = it->second.term == term;
+    std::vector<done_t> done = std::move(it->second.done);
+    inflight_.erase(it);
+
+    for (auto & f : done)
+      f(ok);
+  }
+
+  static void
+  fail(std::vector<done_t> & done)
+  {
+    for (auto & f : done)
+      f(false);
+
+    done.clear();
+  }
+
+private:
+  cluster & cluster_;
+  std::size_t leader_;
+
+  /* writes queued for the next entry */
+  batch_t batch_;
+  std::vector<done_t> done_;
+
+  /* writes proposed, by entry index */
+  std::map<index_t, inflight_t> inflight_;
+};
+
+} /** !kv  */
+
+#endif /** !RAFT_EXAMPLES_KV_HH_  */
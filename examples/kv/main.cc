@@ -0,0 +1,206 @@
+/**
+ * Throughput and latency driver of the reference key value service: a mix
+ * of writes and linearizable reads against an in process cluster, writes
+ * batched into entries and reads into rounds of heartbeats.
+ *
+ * usage: raft-example-kv [nodes] [ops] [batch] [read percent] [--check]
+ *
+ * With --check, the run fails unless every write is applied, every read
+ * returns the last write applied, the replicas end up identical, and a
+ * leader cut from the majority refuses reads while the next one serves
+ * them.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "kv.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+static std::size_t nodes = 3;
+static std::uint64_t ops = 1000000;
+static std::size_t batch = 64;
+static unsigned int read_percent = 50;
+static std::uint64_t const keys = 10000;
+
+static double
+percentile(std::vector<double> & v, double p)
+{
+  if (v.empty())
+    return 0;
+
+  std::size_t i = std::min(v.size() - 1, std::size_t(p * double(v.size())));
+  std::nth_element(v.begin(), v.begin() + std::ptrdiff_t(i), v.end());
+  return v[ i ];
+}
+
+int
+main(int argc, char ** argv)
+{
+  bool check = false;
+  std::vector<char const *> args;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[ i ], "--check") == 0)
+      check = true;
+    else
+      args.push_back(argv[ i ]);
+  }
+
+  if (0 < args.size())
+    nodes = std::strtoul(args[ 0 ], nullptr, 10);
+  if (1 < args.size())
+    ops = std::strtoull(args[ 1 ], nullptr, 10);
+  if (2 < args.size())
+    batch = std::max<std::size_t>(1, std::strtoul(args[ 2 ], nullptr, 10));
+  if (3 < args.size())
+    read_percent = unsigned(std::strtoul(args[ 3 ], nullptr, 10));
+
+  kv::cluster cluster(nodes);
+  if (!cluster.elect(0))
+  {
+    std::fprintf(stderr, "no leader elected\n");
+    return 1;
+  }
+
+  kv::service service(cluster);
+
+  std::mt19937_64 gen(42);
+  std::vector<double> write_latency;
+  std::vector<double> read_latency;
+  std::vector<std::pair<kv::key_t, clock_type::time_point>> reads;
+
+  /* last write applied, by key, to check reads against */
+  std::map<kv::key_t, kv::value_t> model;
+  std::uint64_t failed = 0;
+  std::uint64_t stale = 0;
+
+  auto serve_reads = [&]() {
+    std::vector<kv::key_t> batch_keys;
+    for (auto const & r : reads)
+      batch_keys.push_back(r.first);
+
+    std::size_t i = 0;
+    bool ok = service.read(batch_keys, [&](kv::key_t const & k, kv::value_t const * v) {
+      auto it = model.find(k);
+      if (check && (v == nullptr ? it != model.end() : it == model.end() || *v != it->second))
+        ++stale;
+
+      std::chrono::duration<double, std::micro> latency = clock_type::now() - reads[ i++ ].second;
+      read_latency.push_back(latency.count());
+    });
+
+    failed += ok ? 0 : reads.size();
+    reads.clear();
+  };
+
+  auto start = clock_type::now();
+
+  for (std::uint64_t n = 0; n < ops; ++n)
+  {
+    kv::key_t key = "key" + std::to_string(gen() % keys);
+
+    if (gen() % 100 < read_percent)
+    {
+      reads.emplace_back(key, clock_type::now());
+      if (batch <= reads.size())
+        serve_reads();
+    }
+    else
+    {
+      kv::value_t value = std::to_string(n);
+      auto issued = clock_type::now();
+
+      service.put(key, value, [&, key, value, issued](bool ok) {
+        std::chrono::duration<double, std::micro> latency = clock_type::now() - issued;
+        write_latency.push_back(latency.count());
+
+        if (ok)
+          model[ key ] = value;
+        else
+          ++failed;
+      });
+
+      if (batch <= service.queued())
+        service.flush();
+    }
+
+    if (n % 10000 == 0)
+      cluster.tick(std::chrono::milliseconds(10));
+  }
+
+  service.flush();
+  serve_reads();
+
+  std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+  std::printf("%zu nodes, %llu ops (%u%% reads), batches of %zu: %.0f ops/s\n",
+              nodes,
+              static_cast<unsigned long long>(ops),
+              read_percent,
+              batch,
+              double(ops) / elapsed.count());
+  std::printf("  writes: p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+              percentile(write_latency, 0.5),
+              percentile(write_latency, 0.99),
+              percentile(write_latency, 0.999));
+  std::printf("  reads:  p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+              percentile(read_latency, 0.5),
+              percentile(read_latency, 0.99),
+              percentile(read_latency, 0.999));
+
+  if (!check)
+    return 0;
+
+  /* followers learn the last commit index with the next heartbeats */
+  cluster.tick(std::chrono::milliseconds(200));
+
+  std::size_t leader = cluster.leader();
+  bool same = leader != kv::cluster::none;
+
+  for (std::size_t i = 0; same && i < nodes; ++i)
+    same = cluster.store(i).snapshot() == cluster.store(leader).snapshot();
+
+  bool complete = same && cluster.store(leader).snapshot() == model;
+  bool failover = true;
+
+  if (same && 1 < nodes)
+  {
+    std::vector<kv::key_t> all;
+    for (auto const & it : model)
+      all.push_back(it.first);
+
+    auto verify = [&](kv::key_t const & k, kv::value_t const * v) {
+      if (v == nullptr || *v != model[ k ])
+        ++stale;
+    };
+
+    cluster.connect(leader, false);
+    bool refused = !cluster.confirm(leader);
+
+    /* the others elect a leader once they stop hearing from it */
+    for (int t = 0; t < 100 && cluster.leader() == kv::cluster::none; ++t)
+      cluster.tick(std::chrono::milliseconds(50));
+
+    failover = refused && cluster.leader() != kv::cluster::none && service.read(all, verify);
+  }
+
+  std::printf("  check: %llu failed, %llu stale reads, replicas %s, state %s, failover %s\n",
+              static_cast<unsigned long long>(failed),
+              static_cast<unsigned long long>(stale),
+              same ? "identical" : "diverged",
+              complete ? "complete" : "incomplete",
+              failover ? "ok" : "failed");
+
+  return failed == 0 && stale == 0 && same && complete && failover ? 0 : 1;
+}
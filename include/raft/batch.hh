@@ -0,0 +1,191 @@
+#ifndef RAFT_BATCH_HH_
+#define RAFT_BATCH_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace raft
+{
+namespace batch
+{
+
+/**
+ * @brief Run of log entries encoded once, shared by the messages sent to
+ * all followers
+ */
+template <typename term_t, typename index_t>
+class encoded
+{
+public:
+  encoded() : first_(0), last_(0), term_(0) {}
+
+public:
+  /**
+   * @brief Get index of the first entry
+   */
+  index_t
+  first() const noexcept
+  {
+    return first_;
+  }
+
+  /**
+   * @brief Get index of the last entry
+   */
+  index_t
+  last() const noexcept
+  {
+    return last_;
+  }
+
+  /**
+   * @brief Get term of the last entry
+   */
+  term_t
+  term() const noexcept
+  {
+    return term_;
+  }
+
+  std::size_t
+  count() const noexcept
+  {
+    return last_ - first_ + 1;
+  }
+
+  std::uint8_t const *
+  data() const noexcept
+  {
+    return buf_.data();
+  }
+
+  std::size_t
+  bytes() const noexcept
+  {
+    return buf_.size();
+  }
+
+private:
+  template <typename, typename>
+  friend class cache;
+
+  std::vector<std::uint8_t> buf_;
+  index_t first_;
+  index_t last_;
+  term_t term_;
+};
+
+/**
+ * @brief Cache of encoded entry runs, keyed by index range
+ *
+ * A run is identified by its first and last indexes and by the term of its
+ * last entry: by the log matching property, an entry index and term pin
+ * down all the entries that precede it, so a run never has to be
+ * invalidated when the log is truncated.
+ *
+ * Runs are evicted round robin. An evicted run no longer referenced by a
+ * message in flight is recycled along with its buffer.
+ */
+template <typename term_t, typename index_t>
+class cache
+{
+public:
+  using encoded_t = encoded<term_t, index_t>;
+  using ptr_t = std::shared_ptr<encoded_t const>;
+
+  /** default number of runs held */
+  static constexpr std::size_t default_capacity = 8;
+
+public:
+  explicit cache(std::size_t capacity = default_capacity)
+    : runs_(capacity ? capacity : 1), next_(0), hits_(0), misses_(0)
+  {
+  }
+
+public:
+  /**
+   * @brief Get an encoded run, encoding it on a miss
+   *
+   * @tparam F Encoding function type (std::vector<std::uint8_t> &) -> bool
+   * @param first Index of the first entry
+   * @param last Index of the last entry
+   * @param term Term of the last entry
+   * @param f Encoding function, filling an empty buffer
+   *
+   * @return the run, or nullptr if f failed
+   */
+  template <typename F>
+  ptr_t
+  get(index_t const & first, index_t const & last, term_t const & term, F && f)
+  {
+    for (auto & run : runs_)
+    {
+      if (run && run->first_ == first && run->last_ == last && run->term_ == term)
+      {
+        ++hits_;
+        return run;
+      }
+    }
+
+    ++misses_;
+
+    auto & run = runs_[ next_ ];
+    next_ = (next_ + 1) % runs_.size();
+
+    /* recycle the buffer unless a message still refers to it */
+    if (run == nullptr || 1 < run.use_count())
+      run = std::make_shared<encoded_t>();
+
+    run->buf_.clear();
+    run->first_ = first;
+    run->last_ = last;
+    run->term_ = term;
+
+    if (!f(run->buf_))
+    {
+      run = nullptr;
+      return nullptr;
+    }
+
+    return run;
+  }
+
+  /**
+   * @brief Drop all runs
+   */
+  void
+  clear()
+  {
+    for (auto & run : runs_)
+      run = nullptr;
+  }
+
+  std::size_t
+  hits() const noexcept
+  {
+    return hits_;
+  }
+
+  std::size_t
+  misses() const noexcept
+  {
+    return misses_;
+  }
+
+private:
+  std::vector<std::shared_ptr<encoded_t>> runs_;
+  std::size_t next_;
+
+  std::size_t hits_;
+  std::size_t misses_;
+};
+
+template <typename term_t, typename index_t>
+constexpr std::size_t cache<term_t, index_t>::default_capacity;
+
+} /** !batch  */
+} /** !raft  */
+
+#endif /** !RAFT_BATCH_HH_  */
@@ -0,0 +1,1272 @@
+#ifndef RAFT_CODEC_HH_
+#define RAFT_CODEC_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include <raft/rpc.hh>
+#include <raft/traits.hh>
+
+namespace raft
+{
+namespace codec
+{
+
+/**
+ * @brief Binary wire format of the rpc messages
+ *
+ * A message starts with a version byte and a type byte. Terms, indexes and
+ * ids are then encoded as LEB128 varints, zigzag encoded when signed, and
+ * entry payloads through codec::traits. Payloads are prefixed with their
+ * length, so that entries can be sliced without decoding them. Heartbeats
+ * coalesced by peer are a count, then each group id and heartbeat.
+ */
+constexpr std::uint8_t version = 3;
+
+enum class type_t : std::uint8_t
+{
+  vote_request = 1,
+  vote_response = 2,
+  appendentries_request = 3,
+  appendentries_response = 4,
+  heartbeat_request = 5,
+  heartbeat_response = 6,
+  installsnapshot_request = 7,
+  installsnapshot_response = 8,
+  heartbeats_request = 9,
+  heartbeats_response = 10,
+};
+
+enum class status_t
+{
+  ok = 0,
+  short_buffer = 1,
+  malformed = 2,
+  bad_version = 3,
+  bad_type = 4,
+};
+
+} /** !codec  */
+
+template <>
+struct enum_traits<codec::status_t>
+{
+  static constexpr bool has_any = true;
+};
+
+namespace codec
+{
+
+/**
+ * @brief Bounded output buffer
+ *
+ * Writes past the end are dropped and flag the writer. A writer built over
+ * a null buffer only counts bytes, which is how encoded sizes are computed.
+ */
+class writer
+{
+public:
+  writer(void * buf, std::size_t len)
+    : begin_(static_cast<std::uint8_t *>(buf)), pos_(0), len_(len), ok_(true)
+  {
+  }
+
+  void
+  put(void const * data, std::size_t len)
+  {
+    if (len_ - pos_ < len)
+    {
+      ok_ = false;
+      pos_ = len_;
+      return;
+    }
+
+    if (begin_)
+      std::memcpy(begin_ + pos_, data, len);
+    pos_ += len;
+  }
+
+  void
+  put_byte(std::uint8_t b)
+  {
+    put(&b, 1);
+  }
+
+  void
+  put_varint(std::uint64_t v)
+  {
+    std::uint8_t buf[ 10 ];
+    std::size_t n = 0;
+
+    while (0x80 <= v)
+    {
+      buf[ n++ ] = std::uint8_t(v) | 0x80;
+      v >>= 7;
+    }
+    buf[ n++ ] = std::uint8_t(v);
+
+    put(buf, n);
+  }
+
+  /**
+   * @brief Leave room for a varint of a fixed width, written later
+   *
+   * @return the position of the slot
+   */
+  std::size_t
+  reserve_varint(std::size_t width)
+  {
+    std::uint8_t zero[ 10 ] = {};
+    std::size_t pos = pos_;
+
+    put(zero, width);
+    return pos;
+  }
+
+  /**
+   * @brief Write a varint padded to the width of a slot
+   *
+   * Readers take the padding as high order zero groups.
+   */
+  void
+  patch_varint(std::size_t pos, std::uint64_t v, std::size_t width)
+  {
+    if (width < 10 && (v >> (7 * width)) != 0)
+      ok_ = false;
+
+    if (!ok_ || begin_ == nullptr)
+      return;
+
+    for (std::size_t i = 0; i + 1 < width; ++i, v >>= 7)
+      begin_[ pos + i ] = std::uint8_t(v) | 0x80;
+    begin_[ pos + width - 1 ] = std::uint8_t(v);
+  }
+
+  /**
+   * @brief Get number of bytes written
+   */
+  std::size_t
+  size() const noexcept
+  {
+    return pos_;
+  }
+
+  bool
+  ok() const noexcept
+  {
+    return ok_;
+  }
+
+private:
+  std::uint8_t * begin_;
+  std::size_t pos_;
+  std::size_t len_;
+  bool ok_;
+};
+
+/**
+ * @brief Bounded input buffer
+ *
+ * Reads past the end yield zeroes and flag the reader.
+ */
+class reader
+{
+public:
+  reader(void const * buf, std::size_t len)
+    : begin_(static_cast<std::uint8_t const *>(buf)), pos_(0), len_(len), ok_(true)
+  {
+  }
+
+  void
+  get(void * data, std::size_t len)
+  {
+    if (len_ - pos_ < len)
+    {
+      ok_ = false;
+      pos_ = len_;
+      std::memset(data, 0, len);
+      return;
+    }
+
+    std::memcpy(data, begin_ + pos_, len);
+    pos_ += len;
+  }
+
+  std::uint8_t
+  get_byte()
+  {
+    std::uint8_t b;
+
+    get(&b, 1);
+    return b;
+  }
+
+  std::uint64_t
+  get_varint()
+  {
+    std::uint64_t v = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+      std::uint8_t b = get_byte();
+
+      v |= std::uint64_t(b & 0x7f) << shift;
+      if ((b & 0x80) == 0)
+        return v;
+    }
+
+    /* more than 10 bytes */
+    ok_ = false;
+    return 0;
+  }
+
+  /**
+   * @brief Skip bytes, returning a pointer to them or nullptr
+   */
+  std::uint8_t const *
+  skip(std::size_t len)
+  {
+    if (len_ - pos_ < len)
+    {
+      ok_ = false;
+      pos_ = len_;
+      return nullptr;
+    }
+
+    auto p = begin_ + pos_;
+    pos_ += len;
+    return p;
+  }
+
+  std::size_t
+  position() const noexcept
+  {
+    return pos_;
+  }
+
+  std::size_t
+  remaining() const noexcept
+  {
+    return len_ - pos_;
+  }
+
+  bool
+  ok() const noexcept
+  {
+    return ok_;
+  }
+
+  void
+  fail() noexcept
+  {
+    ok_ = false;
+  }
+
+private:
+  std::uint8_t const * begin_;
+  std::size_t pos_;
+  std::size_t len_;
+  bool ok_;
+};
+
+/**
+ * @brief Integer encoding, varint for integral and enum types
+ */
+template <typename I>
+typename std::enable_if<std::is_unsigned<I>::value>::type
+put_int(writer & w, I v)
+{
+  w.put_varint(std::uint64_t(v));
+}
+
+template <typename I>
+typename std::enable_if<std::is_integral<I>::value && std::is_signed<I>::value>::type
+put_int(writer & w, I v)
+{
+  auto s = static_cast<std::int64_t>(v);
+
+  /* zigzag: small negative numbers stay small */
+  w.put_varint((std::uint64_t(s) << 1) ^ std::uint64_t(s >> 63));
+}
+
+template <typename I>
+typename std::enable_if<std::is_enum<I>::value>::type
+put_int(writer & w, I v)
+{
+  put_int(w, static_cast<typename std::underlying_type<I>::type>(v));
+}
+
+template <typename I>
+typename std::enable_if<std::is_unsigned<I>::value>::type
+get_int(reader & r, I & v)
+{
+  std::uint64_t u = r.get_varint();
+
+  v = static_cast<I>(u);
+  if (std::uint64_t(v) != u)
+    r.fail();
+}
+
+template <typename I>
+typename std::enable_if<std::is_integral<I>::value && std::is_signed<I>::value>::type
+get_int(reader & r, I & v)
+{
+  std::uint64_t u = r.get_varint();
+  auto s = static_cast<std::int64_t>((u >> 1) ^ (~(u & 1) + 1));
+
+  v = static_cast<I>(s);
+  if (std::int64_t(v) != s)
+    r.fail();
+}
+
+template <typename I>
+typename std::enable_if<std::is_enum<I>::value>::type
+get_int(reader & r, I & v)
+{
+  typename std::underlying_type<I>::type u;
+
+  get_int(r, u);
+  v = static_cast<I>(u);
+}
+
+/**
+ * @brief Whether a payload type is copied as is
+ *
+ * Specialized to false by trivially copyable types that specialize traits
+ * themselves.
+ */
+template <typename T>
+struct raw_copy : std::is_trivially_copyable<T>
+{
+};
+
+/**
+ * @brief Payload encoding
+ *
+ * Integral and enum types are varints. Other trivially copyable types are
+ * copied as is, in host byte order, unless raw_copy says otherwise. Any
+ * other payload type must specialize this template, with encode() and
+ * decode(), and size() if its encoded size is cheap to tell: entries are
+ * then prefixed with the shortest length.
+ */
+template <typename T, typename = void>
+struct traits;
+
+template <typename T>
+struct traits<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+{
+  static void
+  encode(writer & w, T const & v)
+  {
+    put_int(w, v);
+  }
+
+  static std::size_t
+  size(T const & v)
+  {
+    writer w(nullptr, std::numeric_limits<std::size_t>::max());
+
+    put_int(w, v);
+    return w.size();
+  }
+
+  static void
+  decode(reader & r, T & v)
+  {
+    get_int(r, v);
+  }
+};
+
+template <typename T>
+struct traits<T,
+              typename std::enable_if<raw_copy<T>::value &&
+                                      !std::is_integral<T>::value && !std::is_enum<T>::value>::type>
+{
+  static void
+  encode(writer & w, T const & v)
+  {
+    w.put(&v, sizeof(T));
+  }
+
+  static constexpr std::size_t
+  size(T const &)
+  {
+    return sizeof(T);
+  }
+
+  static void
+  decode(reader & r, T & v)
+  {
+    r.get(&v, sizeof(T));
+  }
+};
+
+template <>
+struct traits<std::string>
+{
+  static void
+  encode(writer & w, std::string const & v)
+  {
+    w.put_varint(v.size());
+    w.put(v.data(), v.size());
+  }
+
+  static std::size_t
+  size(std::string const & v)
+  {
+    writer w(nullptr, std::numeric_limits<std::size_t>::max());
+
+    w.put_varint(v.size());
+    return w.size() + v.size();
+  }
+
+  static void
+  decode(reader & r, std::string & v)
+  {
+    std::uint64_t len = r.get_varint();
+    auto p = r.skip(len);
+
+    if (p)
+      v.assign(reinterpret_cast<char const *>(p), len);
+  }
+};
+
+/**
+ * @brief Check whether a payload type has codec::traits
+ */
+template <typename T, typename = void>
+struct is_encodable : std::false_type
+{
+};
+
+template <typename T>
+struct is_encodable<T,
+                    decltype(traits<T>::encode(std::declval<writer &>(), std::declval<T const &>()))>
+  : std::true_type
+{
+};
+
+/**
+ * @brief Check whether codec::traits tell the encoded size of a payload
+ */
+template <typename T, typename = void>
+struct is_sized : std::false_type
+{
+};
+
+template <typename T>
+struct is_sized<T, decltype(void(traits<T>::size(std::declval<T const &>())))> : std::true_type
+{
+};
+
+/**
+ * @brief Width of the length of payloads whose size is not known upfront
+ */
+constexpr std::size_t payload_length_width = 5;
+
+/**
+ * @brief Entry sliced out of a receive buffer
+ *
+ * The payload is left encoded. Pointers are valid as long as the buffer
+ * the message was decoded from.
+ */
+template <typename term_t, typename id_t>
+struct entry_view_t
+{
+  entry_type_t type;
+  term_t term;
+  id_t id;
+
+  /** encoded payload */
+  std::uint8_t const * data;
+  std::size_t size;
+
+  /** whole encoded entry, as laid out in an appendentries message */
+  std::uint8_t const * raw;
+  std::size_t raw_size;
+};
+
+/**
+ * @brief Decode the payload of an entry view
+ *
+ * @return ok if success, malformed if the payload is not a T
+ */
+template <typename T, typename term_t, typename id_t>
+status_t
+decode(entry_view_t<term_t, id_t> const & e, T & elt)
+{
+  reader r(e.data, e.size);
+
+  traits<T>::decode(r, elt);
+  if (!r.ok() || r.remaining())
+    return status_t::malformed;
+
+  return status_t::ok;
+}
+
+/**
+ * @brief Encoded entries of an appendentries message
+ *
+ * Entries are checked when the message is decoded, so that iterating over
+ * them cannot fail.
+ */
+template <typename term_t, typename id_t>
+class entries_view_t
+{
+public:
+  using entry_t = entry_view_t<term_t, id_t>;
+
+  class iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = entry_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = entry_t const *;
+    using reference = entry_t const &;
+
+    iterator(std::uint8_t const * p, std::uint8_t const * end) : p_(p), end_(end)
+    {
+      parse();
+    }
+
+    reference operator*() const noexcept
+    {
+      return e_;
+    }
+
+    pointer operator->() const noexcept
+    {
+      return &e_;
+    }
+
+    iterator &
+    operator++()
+    {
+      p_ += e_.raw_size;
+      parse();
+      return *this;
+    }
+
+    bool
+    operator==(iterator const & other) const noexcept
+    {
+      return p_ == other.p_;
+    }
+
+    bool
+    operator!=(iterator const & other) const noexcept
+    {
+      return p_ != other.p_;
+    }
+
+  private:
+    void
+    parse()
+    {
+      if (p_ == end_)
+        return;
+
+      reader r(p_, std::size_t(end_ - p_));
+
+      get_int(r, e_.type);
+      get_int(r, e_.term);
+      get_int(r, e_.id);
+      e_.size = r.get_varint();
+      e_.data = r.skip(e_.size);
+      e_.raw = p_;
+      e_.raw_size = r.position();
+    }
+
+    std::uint8_t const * p_;
+    std::uint8_t const * end_;
+    entry_t e_;
+  };
+
+public:
+  entries_view_t() : data_(nullptr), bytes_(0), count_(0) {}
+
+  entries_view_t(std::uint8_t const * data, std::size_t bytes, std::size_t count)
+    : data_(data), bytes_(bytes), count_(count)
+  {
+  }
+
+  iterator
+  begin() const
+  {
+    return iterator(data_, data_ + bytes_);
+  }
+
+  iterator
+  end() const
+  {
+    return iterator(data_ + bytes_, data_ + bytes_);
+  }
+
+  /**
+   * @brief Get number of entries
+   */
+  std::size_t
+  size() const noexcept
+  {
+    return count_;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return count_ == 0;
+  }
+
+  /**
+   * @brief Get encoded entries, back to back
+   */
+  std::uint8_t const *
+  data() const noexcept
+  {
+    return data_;
+  }
+
+  std::size_t
+  bytes() const noexcept
+  {
+    return bytes_;
+  }
+
+private:
+  std::uint8_t const * data_;
+  std::size_t bytes_;
+  std::size_t count_;
+};
+
+/**
+ * @brief Appendentries message whose entries are views over the receive
+ * buffer
+ */
+template <typename term_t, typename index_t, typename id_t>
+struct appendentries_view_t
+{
+  term_t term;
+  index_t prev_log_idx;
+  term_t prev_log_term;
+  index_t leader_commit;
+  entries_view_t<term_t, id_t> entries;
+};
+
+/**
+ * @brief Get type of a message
+ */
+template <typename term_t, typename index_t, typename node_id_t>
+constexpr type_t
+type_of(rpc::vote_request_t<term_t, index_t, node_id_t> const &)
+{
+  return type_t::vote_request;
+}
+
+template <typename term_t>
+constexpr type_t
+type_of(rpc::vote_response_t<term_t> const &)
+{
+  return type_t::vote_response;
+}
+
+template <typename T, typename term_t, typename index_t, typename index_id_t>
+constexpr type_t
+type_of(rpc::appendentries_request_t<T, term_t, index_t, index_id_t> const &)
+{
+  return type_t::appendentries_request;
+}
+
+template <typename term_t, typename index_t, typename id_t>
+constexpr type_t
+type_of(appendentries_view_t<term_t, index_t, id_t> const &)
+{
+  return type_t::appendentries_request;
+}
+
+template <typename term_t, typename index_t>
+constexpr type_t
+type_of(rpc::appendentries_response_t<term_t, index_t> const &)
+{
+  return type_t::appendentries_response;
+}
+
+template <typename term_t, typename index_t>
+constexpr type_t
+type_of(rpc::heartbeat_request_t<term_t, index_t> const &)
+{
+  return type_t::heartbeat_request;
+}
+
+template <typename term_t>
+constexpr type_t
+type_of(rpc::heartbeat_response_t<term_t> const &)
+{
+  return type_t::heartbeat_response;
+}
+
+template <typename term_t, typename index_t>
+constexpr type_t
+type_of(rpc::installsnapshot_request_t<term_t, index_t> const &)
+{
+  return type_t::installsnapshot_request;
+}
+
+template <typename term_t, typename index_t>
+constexpr type_t
+type_of(rpc::installsnapshot_response_t<term_t, index_t> const &)
+{
+  return type_t::installsnapshot_response;
+}
+
+template <typename group_id_t, typename term_t, typename index_t>
+constexpr type_t
+type_of(rpc::coalesced_t<group_id_t, rpc::heartbeat_request_t<term_t, index_t>> const &)
+{
+  return type_t::heartbeats_request;
+}
+
+template <typename group_id_t, typename term_t>
+constexpr type_t
+type_of(rpc::coalesced_t<group_id_t, rpc::heartbeat_response_t<term_t>> const &)
+{
+  return type_t::heartbeats_response;
+}
+
+/**
+ * @brief Message encoding
+ */
+template <typename T>
+void
+put_payload(writer & w, T const & elt, std::true_type)
+{
+  w.put_varint(traits<T>::size(elt));
+  traits<T>::encode(w, elt);
+}
+
+template <typename T>
+void
+put_payload(writer & w, T const & elt, std::false_type)
+{
+  /* encoded once, its length patched in afterwards */
+  std::size_t slot = w.reserve_varint(payload_length_width);
+  std::size_t start = w.size();
+
+  traits<T>::encode(w, elt);
+  w.patch_varint(slot, w.size() - start, payload_length_width);
+}
+
+template <typename T, typename term_t, typename id_t>
+void
+put(writer & w, entry<T, term_t, id_t> const & e)
+{
+  put_int(w, e.type);
+  put_int(w, e.term);
+  put_int(w, e.id);
+  put_payload(w, e.elt, is_sized<T>());
+}
+
+template <typename T, typename term_t, typename id_t>
+void
+get(reader & r, entry<T, term_t, id_t> & e)
+{
+  get_int(r, e.type);
+  get_int(r, e.term);
+  get_int(r, e.id);
+
+  std::uint64_t len = r.get_varint();
+  auto p = r.skip(len);
+  if (p == nullptr)
+    return;
+
+  reader payload(p, len);
+  traits<T>::decode(payload, e.elt);
+  if (!payload.ok() || payload.remaining())
+    r.fail();
+}
+
+template <typename term_t, typename index_t, typename node_id_t>
+void
+put(writer & w, rpc::vote_request_t<term_t, index_t, node_id_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_int(w, msg.term);
+  traits<node_id_t>::encode(w, msg.candidate_id);
+  put_int(w, msg.last_log_idx);
+  put_int(w, msg.last_log_term);
+}
+
+template <typename term_t, typename index_t, typename node_id_t>
+void
+get(reader & r, rpc::vote_request_t<term_t, index_t, node_id_t> & msg)
+{
+  get_int(r, msg.term);
+  traits<node_id_t>::decode(r, msg.candidate_id);
+  get_int(r, msg.last_log_idx);
+  get_int(r, msg.last_log_term);
+}
+
+template <typename term_t>
+void
+put(writer & w, rpc::vote_response_t<term_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_int(w, msg.term);
+  put_int(w, msg.vote);
+}
+
+template <typename term_t>
+void
+get(reader & r, rpc::vote_response_t<term_t> & msg)
+{
+  get_int(r, msg.term);
+  get_int(r, msg.vote);
+}
+
+/**
+ * @brief Longest appendentries header
+ */
+constexpr std::size_t appendentries_header_max = 2 + 5 * 10;
+
+/**
+ * @brief Encode an appendentries header
+ *
+ * Entries follow the header back to back, so that a message can be sent as
+ * a header and a run of entries encoded apart.
+ */
+template <typename term_t, typename index_t>
+void
+put_appendentries_header(writer & w,
+                         term_t const & term,
+                         index_t const & prev_log_idx,
+                         term_t const & prev_log_term,
+                         index_t const & leader_commit,
+                         std::size_t count)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_t::appendentries_request));
+  put_int(w, term);
+  put_int(w, prev_log_idx);
+  put_int(w, prev_log_term);
+  put_int(w, leader_commit);
+  w.put_varint(count);
+}
+
+template <typename T, typename term_t, typename index_t, typename index_id_t>
+void
+put(writer & w, rpc::appendentries_request_t<T, term_t, index_t, index_id_t> const & msg)
+{
+  put_appendentries_header(
+    w, msg.term, msg.prev_log_idx, msg.prev_log_term, msg.leader_commit, msg.entries.size());
+
+  for (auto & e : msg.entries)
+    put(w, e);
+}
+
+template <typename T, typename term_t, typename index_t, typename index_id_t>
+void
+get(reader & r, rpc::appendentries_request_t<T, term_t, index_t, index_id_t> & msg)
+{
+  get_int(r, msg.term);
+  get_int(r, msg.prev_log_idx);
+  get_int(r, msg.prev_log_term);
+  get_int(r, msg.leader_commit);
+
+  std::uint64_t n = r.get_varint();
+
+  /* an entry takes at least 4 bytes, do not trust n blindly */
+  if (r.remaining() / 4 < n)
+  {
+    r.fail();
+    return;
+  }
+
+  msg.entries.clear();
+  msg.entries.reserve(n);
+
+  for (std::uint64_t i = 0; i < n && r.ok(); ++i)
+  {
+    msg.entries.emplace_back();
+    get(r, msg.entries.back());
+  }
+}
+
+template <typename term_t, typename index_t, typename id_t>
+void
+get(reader & r, appendentries_view_t<term_t, index_t, id_t> & msg)
+{
+  get_int(r, msg.term);
+  get_int(r, msg.prev_log_idx);
+  get_int(r, msg.prev_log_term);
+  get_int(r, msg.leader_commit);
+
+  std::uint64_t n = r.get_varint();
+  std::size_t start = r.position();
+  auto data = r.skip(0);
+
+  for (std::uint64_t i = 0; i < n && r.ok(); ++i)
+  {
+    entry_type_t type;
+    term_t term;
+    id_t id;
+
+    get_int(r, type);
+    get_int(r, term);
+    get_int(r, id);
+    r.skip(r.get_varint());
+  }
+
+  if (r.ok())
+    msg.entries = entries_view_t<term_t, id_t>(data, r.position() - start, n);
+  else
+    msg.entries = entries_view_t<term_t, id_t>();
+}
+
+template <typename term_t, typename index_t>
+void
+put(writer & w, rpc::appendentries_response_t<term_t, index_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_int(w, msg.term);
+  w.put_byte(msg.success ? 1 : 0);
+  put_int(w, msg.current_idx);
+  put_int(w, msg.first_idx);
+}
+
+template <typename term_t, typename index_t>
+void
+get(reader & r, rpc::appendentries_response_t<term_t, index_t> & msg)
+{
+  get_int(r, msg.term);
+  msg.success = r.get_byte() != 0;
+  get_int(r, msg.current_idx);
+  get_int(r, msg.first_idx);
+}
+
+template <typename term_t, typename index_t>
+void
+put_fields(writer & w, rpc::heartbeat_request_t<term_t, index_t> const & msg)
+{
+  put_int(w, msg.term);
+  put_int(w, msg.leader_commit);
+  put_int(w, msg.interval);
+}
+
+template <typename term_t, typename index_t>
+void
+put(writer & w, rpc::heartbeat_request_t<term_t, index_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_fields(w, msg);
+}
+
+template <typename term_t, typename index_t>
+void
+get(reader & r, rpc::heartbeat_request_t<term_t, index_t> & msg)
+{
+  get_int(r, msg.term);
+  get_int(r, msg.leader_commit);
+  get_int(r, msg.interval);
+}
+
+template <typename term_t>
+void
+put_fields(writer & w, rpc::heartbeat_response_t<term_t> const & msg)
+{
+  put_int(w, msg.term);
+  w.put_byte(msg.success ? 1 : 0);
+}
+
+template <typename term_t>
+void
+put(writer & w, rpc::heartbeat_response_t<term_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_fields(w, msg);
+}
+
+template <typename term_t>
+void
+get(reader & r, rpc::heartbeat_response_t<term_t> & msg)
+{
+  get_int(r, msg.term);
+  msg.success = r.get_byte() != 0;
+}
+
+/**
+ * @brief Encode heartbeats coalesced by peer, as a count then (group,
+ * heartbeat) pairs without their own header
+ */
+template <typename group_id_t, typename msg_t>
+void
+put_coalesced(writer & w, rpc::coalesced_t<group_id_t, msg_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  w.put_varint(msg.msgs.size());
+
+  for (auto & it : msg.msgs)
+  {
+    traits<group_id_t>::encode(w, it.first);
+    put_fields(w, it.second);
+  }
+}
+
+/**
+ * @param min Fewest bytes a pair is encoded in, to bound the count read
+ */
+template <typename group_id_t, typename msg_t>
+void
+get_coalesced(reader & r, rpc::coalesced_t<group_id_t, msg_t> & msg, std::size_t min)
+{
+  std::uint64_t n = r.get_varint();
+
+  if (r.remaining() / min < n)
+  {
+    r.fail();
+    return;
+  }
+
+  msg.msgs.clear();
+  msg.msgs.reserve(n);
+
+  for (std::uint64_t i = 0; i < n && r.ok(); ++i)
+  {
+    msg.msgs.emplace_back();
+    traits<group_id_t>::decode(r, msg.msgs.back().first);
+    get(r, msg.msgs.back().second);
+  }
+}
+
+template <typename group_id_t, typename term_t, typename index_t>
+void
+put(writer & w, rpc::coalesced_t<group_id_t, rpc::heartbeat_request_t<term_t, index_t>> const & msg)
+{
+  put_coalesced(w, msg);
+}
+
+template <typename group_id_t, typename term_t, typename index_t>
+void
+get(reader & r, rpc::coalesced_t<group_id_t, rpc::heartbeat_request_t<term_t, index_t>> & msg)
+{
+  get_coalesced(r, msg, 4);
+}
+
+template <typename group_id_t, typename term_t>
+void
+put(writer & w, rpc::coalesced_t<group_id_t, rpc::heartbeat_response_t<term_t>> const & msg)
+{
+  put_coalesced(w, msg);
+}
+
+template <typename group_id_t, typename term_t>
+void
+get(reader & r, rpc::coalesced_t<group_id_t, rpc::heartbeat_response_t<term_t>> & msg)
+{
+  get_coalesced(r, msg, 3);
+}
+
+template <typename term_t, typename index_t>
+void
+put(writer & w, rpc::installsnapshot_request_t<term_t, index_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_int(w, msg.term);
+  put_int(w, msg.last_idx);
+  put_int(w, msg.last_term);
+  put_int(w, msg.size);
+  put_int(w, msg.offset);
+  put_int(w, msg.crc);
+  w.put_byte(msg.done ? 1 : 0);
+  w.put_varint(msg.data.size());
+  w.put(msg.data.data(), msg.data.size());
+}
+
+template <typename term_t, typename index_t>
+void
+get(reader & r, rpc::installsnapshot_request_t<term_t, index_t> & msg)
+{
+  get_int(r, msg.term);
+  get_int(r, msg.last_idx);
+  get_int(r, msg.last_term);
+  get_int(r, msg.size);
+  get_int(r, msg.offset);
+  get_int(r, msg.crc);
+  msg.done = r.get_byte() != 0;
+
+  std::uint64_t len = r.get_varint();
+  auto p = r.skip(len);
+
+  if (p)
+    msg.data.assign(p, p + len);
+  else
+    msg.data.clear();
+}
+
+template <typename term_t, typename index_t>
+void
+put(writer & w, rpc::installsnapshot_response_t<term_t, index_t> const & msg)
+{
+  w.put_byte(version);
+  w.put_byte(std::uint8_t(type_of(msg)));
+  put_int(w, msg.term);
+  put_int(w, msg.last_idx);
+  put_int(w, msg.offset);
+  w.put_byte(msg.success ? 1 : 0);
+}
+
+template <typename term_t, typename index_t>
+void
+get(reader & r, rpc::installsnapshot_response_t<term_t, index_t> & msg)
+{
+  get_int(r, msg.term);
+  get_int(r, msg.last_idx);
+  get_int(r, msg.offset);
+  msg.success = r.get_byte() != 0;
+}
+
+/**
+ * @brief Get number of bytes needed to encode a message
+ */
+template <typename msg_t>
+std::size_t
+size(msg_t const & msg)
+{
+  writer w(nullptr, std::numeric_limits<std::size_t>::max());
+
+  put(w, msg);
+  return w.size();
+}
+
+/**
+ * @brief Encode a message into a caller provided buffer
+ *
+ * @param msg Message
+ * @param buf Output buffer
+ * @param len Output buffer length
+ * @param written Number of bytes written
+ *
+ * @return ok if success, short_buffer if buf is too small
+ */
+template <typename msg_t>
+status_t
+encode(msg_t const & msg, void * buf, std::size_t len, std::size_t & written)
+{
+  writer w(buf, len);
+
+  put(w, msg);
+  if (!w.ok())
+    return status_t::short_buffer;
+
+  written = w.size();
+  return status_t::ok;
+}
+
+/**
+ * @brief Read the header of an encoded message
+ *
+ * @return ok if success, or why the message cannot be decoded
+ */
+inline status_t
+peek(void const * buf, std::size_t len, type_t & type)
+{
+  if (len < 2)
+    return status_t::short_buffer;
+
+  auto p = static_cast<std::uint8_t const *>(buf);
+
+  if (p[ 0 ] != version)
+    return status_t::bad_version;
+
+  if (p[ 1 ] < std::uint8_t(type_t::vote_request) ||
+      std::uint8_t(type_t::heartbeats_response) < p[ 1 ])
+    return status_t::bad_type;
+
+  type = type_t(p[ 1 ]);
+  return status_t::ok;
+}
+
+/**
+ * @brief Decode a message
+ *
+ * @param buf Input buffer
+ * @param len Input buffer length
+ * @param msg Message
+ * @param read Number of bytes consumed
+ *
+ * @return ok if success, or why the message cannot be decoded
+ */
+template <typename msg_t>
+status_t
+decode(void const * buf, std::size_t len, msg_t & msg, std::size_t & read)
+{
+  type_t type;
+
+  status_t ret = peek(buf, len, type);
+  if (any(ret))
+    return ret;
+
+  if (type != type_of(msg))
+    return status_t::bad_type;
+
+  reader r(static_cast<std::uint8_t const *>(buf) + 2, len - 2);
+
+  get(r, msg);
+  if (!r.ok())
+    return status_t::malformed;
+
+  read = 2 + r.position();
+  return status_t::ok;
+}
+
+/**
+ * @brief Encode as many entries as fit in a caller provided buffer
+ *
+ * Entries are laid out back to back, as in an appendentries message, so
+ * that a sender can fill a frame up to its size limit.
+ *
+ * @param first First entry
+ * @param last Past the last entry
+ * @param buf Output buffer
+ * @param len Output buffer length
+ * @param written Number of bytes written
+ *
+ * @return the number of entries encoded
+ */
+template <typename It>
+std::size_t
+encode_entries(It first, It last, void * buf, std::size_t len, std::size_t & written)
+{
+  std::size_t n = 0;
+
+  written = 0;
+
+  for (; first != last; ++first, ++n)
+  {
+    writer w(static_cast<std::uint8_t *>(buf) + written, len - written);
+
+    put(w, *first);
+    if (!w.ok())
+      break;
+
+    written += w.size();
+  }
+
+  return n;
+}
+
+} /** !codec  */
+} /** !raft  */
+
+#endif /** !RAFT_CODEC_HH_  */
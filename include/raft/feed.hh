@@ -0,0 +1,401 @@
+#ifndef RAFT_FEED_HH_
+#define RAFT_FEED_HH_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <utility>
+
+namespace raft
+{
+
+/**
+ * @brief Change feed of the entries applied by a server
+ *
+ * Subscribers, such as caches or indexers, register a cursor, the index of
+ * the last entry they consumed, and are handed the entries applied after
+ * it in batches. A batch is a range of the server log itself: entries are
+ * not copied, and stay valid until the callback returns. It includes the
+ * noop entries of elections, which subscribers skip by their type.
+ *
+ * A subscriber consumes as much of a batch as it can take and returns how
+ * many entries it did; a short count pauses it until resume(). Entries it
+ * has not consumed are read from the log when it resumes. Its capacity is
+ * the number of entries kept in the log for it: through the retain
+ * callback, the server keeps the entries it has not consumed, up to
+ * capacity entries behind the applied index. Beyond it, pressure() tells
+ * producers to slow down, and entries may be compacted, in which case the
+ * subscriber is told it lost them, to resync from a snapshot of the state
+ * machine and seek() past it.
+ *
+ * Wired to the server with callbacks:
+ * @code
+ *   cbs.applied = [&feed](auto) { feed.pump(); };
+ *   cbs.retain = [&feed]() { return feed.horizon(); };
+ * @endcode
+ *
+ * Not thread safe: subscribers are called from the thread applying
+ * entries, and hand them over to other threads if they need to. They must
+ * not subscribe or unsubscribe from their callbacks.
+ */
+template <typename Server>
+class feed
+{
+public:
+  using server_t = Server;
+  using index_t = typename Server::index_t;
+  using entry_t = typename Server::entry_t;
+  using id_t = std::size_t;
+
+  /** default maximum number of entries in a batch */
+  static constexpr std::size_t default_max_batch = 64;
+
+  /** default number of entries kept in the log for a subscriber */
+  static constexpr std::size_t default_capacity = 4096;
+
+  /**
+   * @brief Batch of applied entries, read in place from the log
+   */
+  class range_t
+  {
+  public:
+    class iterator
+    {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = entry_t;
+      using difference_type = std::ptrdiff_t;
+      using pointer = entry_t const *;
+      using reference = entry_t const &;
+
+      iterator(server_t const * server, index_t idx) : server_(server), idx_(idx) {}
+
+      /**
+       * @brief Get the log index of the entry
+       */
+      index_t
+      index() const noexcept
+      {
+        return idx_;
+      }
+
+      entry_t const & operator*() const
+      {
+        return *server_->get(idx_);
+      }
+
+      entry_t const * operator->() const
+      {
+        return server_->get(idx_);
+      }
+
+      iterator &
+      operator++()
+      {
+        ++idx_;
+        return *this;
+      }
+
+      bool
+      operator==(iterator const & other) const
+      {
+        return idx_ == other.idx_;
+      }
+
+      bool
+      operator!=(iterator const & other) const
+      {
+        return idx_ != other.idx_;
+      }
+
+    private:
+      server_t const * server_;
+      index_t idx_;
+    };
+
+  public:
+    range_t(server_t const * server, index_t first, index_t last) : server_(server), first_(first), last_(last)
+    {
+    }
+
+    /**
+     * @brief Get the index of the first entry
+     */
+    index_t
+    first() const noexcept
+    {
+      return first_;
+    }
+
+    /**
+     * @brief Get the index of the last entry
+     */
+    index_t
+    last() const noexcept
+    {
+      return last_;
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+      return std::size_t(last_ - first_ + 1);
+    }
+
+    /**
+     * @brief Get the entry at a log index of the range
+     */
+    entry_t const & operator[](index_t idx) const
+    {
+      return *server_->get(idx);
+    }
+
+    iterator
+    begin() const
+    {
+      return iterator(server_, first_);
+    }
+
+    iterator
+    end() const
+    {
+      return iterator(server_, last_ + 1);
+    }
+
+  private:
+    server_t const * server_;
+    index_t first_;
+    index_t last_;
+  };
+
+  /** consume a batch, returning the number of entries consumed from its
+   * start, fewer to pause */
+  using deliver_t = std::function<std::size_t(range_t const &)>;
+
+  /** told the entries after its cursor are no longer in the log, the
+   * subscriber is paused until seek() */
+  using lost_t = std::function<void(index_t cursor, index_t base)>;
+
+private:
+  struct subscriber_t
+  {
+    deliver_t deliver;
+    lost_t lost;
+    index_t cursor;
+    std::size_t capacity;
+    std::size_t max_batch;
+    bool paused;
+    bool lost_entries;
+  };
+
+public:
+  explicit feed(server_t const & server) : server_(server), next_id_(0) {}
+
+  feed(feed const &) = delete;
+  feed & operator=(feed const &) = delete;
+
+public:
+  /**
+   * @brief Register a subscriber
+   *
+   * @param after Index of the last entry it already knows of
+   * @param deliver Callback consuming batches
+   * @param lost Callback told about compacted entries, may be empty
+   * @param capacity Number of entries kept in the log for it
+   * @param max_batch Maximum number of entries in a batch
+   *
+   * @return its id
+   */
+  id_t
+  subscribe(index_t after,
+            deliver_t deliver,
+            lost_t lost = nullptr,
+            std::size_t capacity = default_capacity,
+            std::size_t max_batch = default_max_batch)
+  {
+    id_t id = next_id_++;
+
+    subscribers_[ id ] = {std::move(deliver), std::move(lost), after, capacity, std::max<std::size_t>(max_batch, 1),
+                          false, false};
+    return id;
+  }
+
+  void
+  unsubscribe(id_t id)
+  {
+    subscribers_.erase(id);
+  }
+
+  /**
+   * @brief Deliver the entries applied since the last pump to the
+   * subscribers not paused
+   */
+  void
+  pump()
+  {
+    for (auto & it : subscribers_)
+      deliver(it.second);
+  }
+
+  /**
+   * @brief Let a paused subscriber consume again, from its cursor
+   */
+  void
+  resume(id_t id)
+  {
+    auto it = subscribers_.find(id);
+    if (it == subscribers_.end() || it->second.lost_entries)
+      return;
+
+    it->second.paused = false;
+    deliver(it->second);
+  }
+
+  /**
+   * @brief Move the cursor of a subscriber, after it resynced from a
+   * snapshot, and resume it
+   */
+  void
+  seek(id_t id, index_t after)
+  {
+    auto it = subscribers_.find(id);
+    if (it == subscribers_.end())
+      return;
+
+    it->second.cursor = after;
+    it->second.lost_entries = false;
+    it->second.paused = false;
+    deliver(it->second);
+  }
+
+  /**
+   * @brief Get the index of the last entry a subscriber consumed
+   */
+  index_t
+  cursor(id_t id) const
+  {
+    return subscribers_.at(id).cursor;
+  }
+
+  /**
+   * @brief Get the number of applied entries a subscriber has not
+   * consumed yet
+   */
+  std::size_t
+  lag(id_t id) const
+  {
+    return lag(subscribers_.at(id));
+  }
+
+  bool
+  paused(id_t id) const
+  {
+    return subscribers_.at(id).paused;
+  }
+
+  /**
+   * @brief Tell whether a subscriber lost entries to compaction
+   */
+  bool
+  lost(id_t id) const
+  {
+    return subscribers_.at(id).lost_entries;
+  }
+
+  /**
+   * @brief Tell whether a subscriber lags behind its capacity, producers
+   * should slow down
+   */
+  bool
+  pressure() const
+  {
+    for (auto const & it : subscribers_)
+      if (!it.second.lost_entries && it.second.capacity <= lag(it.second))
+        return true;
+
+    return false;
+  }
+
+  /**
+   * @brief Get the index of the last entry the subscribers are done with,
+   * for the server to keep the entries after it in the log
+   *
+   * A subscriber holds at most its capacity of entries.
+   */
+  index_t
+  horizon() const
+  {
+    index_t applied = server_.last_applied_index();
+    index_t horizon = applied;
+
+    for (auto const & it : subscribers_)
+    {
+      auto const & s = it.second;
+
+      if (s.lost_entries)
+        continue;
+
+      index_t floor = s.capacity < applied ? applied - index_t(s.capacity) : 0;
+      horizon = std::min(horizon, std::max(s.cursor, floor));
+    }
+
+    return horizon;
+  }
+
+  std::size_t
+  size() const noexcept
+  {
+    return subscribers_.size();
+  }
+
+private:
+  std::size_t
+  lag(subscriber_t const & s) const
+  {
+    index_t applied = server_.last_applied_index();
+    return s.cursor < applied ? std::size_t(applied - s.cursor) : 0;
+  }
+
+  void
+  deliver(subscriber_t & s)
+  {
+    index_t applied = server_.last_applied_index();
+
+    while (!s.paused && !s.lost_entries && s.cursor < applied)
+    {
+      index_t first = s.cursor + 1;
+
+      if (server_.get(first) == nullptr)
+      {
+        s.lost_entries = true;
+        if (s.lost)
+          s.lost(s.cursor, server_.log_base());
+        return;
+      }
+
+      index_t last = std::min(applied, s.cursor + index_t(s.max_batch));
+      std::size_t n = s.deliver(range_t(&server_, first, last));
+
+      s.cursor += index_t(std::min(n, std::size_t(last - first + 1)));
+      if (n < std::size_t(last - first + 1))
+        s.paused = true;
+    }
+  }
+
+private:
+  server_t const & server_;
+  std::map<id_t, subscriber_t> subscribers_;
+  id_t next_id_;
+};
+
+template <typename Server>
+constexpr std::size_t feed<Server>::default_max_batch;
+
+template <typename Server>
+constexpr std::size_t feed<Server>::default_capacity;
+
+} /** !raft  */
+
+#endif /** !RAFT_FEED_HH_  */
@@ -0,0 +1,109 @@
+#ifndef RAFT_HEARTBEAT_HH_
+#define RAFT_HEARTBEAT_HH_
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include <raft/rpc.hh>
+#include <raft/traits.hh>
+
+namespace raft
+{
+namespace heartbeat
+{
+
+/**
+ * @brief Heartbeat coalescer
+ *
+ * Gathers the heartbeats emitted by all the groups of a host during a tick
+ * and sends a single message per peer host.
+ */
+template <typename group_id_t, typename node_id_t, typename term_t, typename index_t>
+class coalescer
+{
+public:
+  using heartbeat_t = rpc::heartbeat_request_t<term_t, index_t>;
+  using message_t = rpc::coalesced_t<group_id_t, heartbeat_t>;
+  using pending_t = std::unordered_map<node_id_t, message_t>;
+
+public:
+  /**
+   * @brief Queue a group heartbeat for a peer
+   *
+   * @param peer Destination host
+   * @param gid Group sending the heartbeat
+   * @param hb Heartbeat
+   */
+  void
+  add(node_id_t const & peer, group_id_t const & gid, heartbeat_t const & hb)
+  {
+    pending_[ peer ].msgs.emplace_back(gid, hb);
+  }
+
+  /**
+   * @brief Get number of queued heartbeats
+   */
+  std::size_t
+  count() const noexcept
+  {
+    std::size_t n = 0;
+
+    for (auto & it : pending_)
+      n += it.second.msgs.size();
+
+    return n;
+  }
+
+  /**
+   * @brief Send one message per peer
+   *
+   * Buffers are kept around so that steady state ticks do not allocate.
+   *
+   * @tparam F Callback function type (node_id_t, message_t) -> status_t
+   * @param f Callback function
+   *
+   * @return ok if success, or the last error returned by f
+   */
+  template <typename F>
+  auto
+  flush(F && f) -> decltype(f(std::declval<node_id_t>(), std::declval<message_t>()))
+  {
+    using status_t = decltype(f(std::declval<node_id_t>(), std::declval<message_t>()));
+
+    status_t ret = status_t::ok;
+
+    for (auto & it : pending_)
+    {
+      auto & msg = it.second;
+
+      if (msg.msgs.empty())
+        continue;
+
+      status_t r = f(it.first, static_cast<message_t const &>(msg));
+      if (any(r))
+        ret = r;
+
+      msg.msgs.clear();
+    }
+
+    return ret;
+  }
+
+  /**
+   * @brief Forget a peer and its buffer
+   */
+  void
+  remove(node_id_t const & peer)
+  {
+    pending_.erase(peer);
+  }
+
+private:
+  pending_t pending_;
+};
+
+} /** !heartbeat  */
+} /** !raft  */
+
+#endif /** !RAFT_HEARTBEAT_HH_  */
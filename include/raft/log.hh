@@ -2,10 +2,10 @@
 #define RAFT_LOG_HH_
 
 #include <cassert>
-#include <deque>
-#include <memory>
+#include <utility>
 
 #include <raft/traits.hh>
+#include <utils/ring.hh>
 
 namespace raft
 {
@@ -13,6 +13,9 @@ namespace raft
 enum class entry_type_t
 {
   regular,
+  /** appended by a new leader to commit the entries of earlier terms,
+   * never applied to the user state machine */
+  noop,
   user = 100,
 };
 
@@ -24,6 +27,8 @@ operator<<(ostream & os, entry_type_t const & t)
   {
     case entry_type_t::regular:
       return os << "regular", os;
+    case entry_type_t::noop:
+      return os << "noop", os;
     case entry_type_t::user:
       return os << "user", os;
     default:
@@ -71,11 +76,11 @@ public:
   using term_t = term_t_;
   using id_t = id_t_;
   using entry_t = entry<T, term_t, id_t>;
-  using logs_t = std::deque<std::shared_ptr<entry_t>>;
+  using logs_t = utils::ring<entry_t>;
   using index_t = typename logs_t::size_type;
 
 public:
-  log() : base_(0) {}
+  log() : base_(0), base_term_(0) {}
 
 public:
   /**
@@ -84,25 +89,53 @@ public:
   index_t
   count() const noexcept
   {
-    return deque_.size();
+    return entries_.size();
+  }
+
+  /**
+   * @brief Preallocate room for n entries
+   *
+   * Appending does not allocate as long as fewer entries are held.
+   */
+  void
+  reserve(index_t n)
+  {
+    entries_.reserve(n);
   }
 
 public:
   /**
    * @brief Get entry at an index
    *
-   * @return return a pointer to an entry, or nullptr
+   * @return return a pointer to an entry, valid until the log is modified,
+   * or nullptr
    */
-  std::shared_ptr<entry_t>
+  entry_t const *
   at(index_t idx) const noexcept
   {
-    int si = idx - base_ - 1;
-    auto ui = idx - base_ - 1;
-
-    if (si < 0 || deque_.size() <= ui)
+    if (idx <= base_ || base_ + entries_.size() < idx)
       return nullptr;
 
-    return deque_.at(ui);
+    return &entries_[ idx - base_ - 1 ];
+  }
+
+public:
+  /**
+   * @brief Get index of the last entry dropped, covered by a snapshot
+   */
+  index_t
+  base() const noexcept
+  {
+    return base_;
+  }
+
+  /**
+   * @brief Get term of the last entry dropped
+   */
+  term_t
+  base_term() const noexcept
+  {
+    return base_term_;
   }
 
 public:
@@ -112,22 +145,23 @@ public:
   index_t
   current() const noexcept
   {
-    return base_ + deque_.size();
+    return base_ + entries_.size();
   }
 
 public:
   /**
    * @brief Get youngest entry appended
    *
-   * @return return a pointer to an entry, or nullptr
+   * @return return a pointer to an entry, valid until the log is modified,
+   * or nullptr
    */
-  std::shared_ptr<entry_t>
+  entry_t const *
   tail() const noexcept
   {
-    if (deque_.size() == 0)
+    if (entries_.size() == 0)
       return nullptr;
 
-    return deque_.back();
+    return &entries_.back();
   }
 
 public:
@@ -144,13 +178,13 @@ public:
   log_status_t
   append(entry_t const & e, F && f)
   {
-    index_t idx = base_ + deque_.size() + 1;
+    index_t idx = base_ + entries_.size() + 1;
 
     log_status_t ret = f(e, idx);
     if (any(ret))
       return ret;
 
-    deque_.emplace_back(std::make_shared<entry_t>(e));
+    entries_.push_back(e);
 
     return log_status_t::ok;
   }
@@ -161,6 +195,14 @@ public:
     return append(e, [](auto, auto) { return log_status_t::ok; });
   }
 
+  log_status_t
+  append(entry_t && e)
+  {
+    entries_.emplace_back(std::move(e));
+
+    return log_status_t::ok;
+  }
+
 public:
   /**
    * @brief Clear logs
@@ -172,11 +214,11 @@ public:
   void
   clear(F && f)
   {
-    for (auto i = 0; deque_.size(); ++i)
+    for (auto i = 0; entries_.size(); ++i)
     {
-      f(*deque_.front(), base_ + i + 1);
+      f(entries_.front(), base_ + i + 1);
 
-      deque_.pop_front();
+      entries_.pop_front();
     }
   }
 
@@ -206,14 +248,14 @@ public:
     if (idx < base_)
       idx = base_;
 
-    while (idx <= (base_ + deque_.size()) && deque_.size())
+    while (idx <= (base_ + entries_.size()) && entries_.size())
     {
-      log_status_t ret = f(*deque_.back(), base_ + deque_.size());
+      log_status_t ret = f(entries_.back(), base_ + entries_.size());
 
       if (any(ret))
         return ret;
 
-      deque_.pop_back();
+      entries_.pop_back();
     }
 
     return log_status_t::ok;
@@ -238,14 +280,15 @@ public:
   log_status_t
   poll(F && f)
   {
-    if (deque_.size() == 0)
+    if (entries_.size() == 0)
       return log_status_t::fail;
 
-    log_status_t ret = f(*deque_.front(), base_ + 1);
+    log_status_t ret = f(entries_.front(), base_ + 1);
     if (any(ret))
       return ret;
 
-    deque_.pop_front();
+    base_term_ = entries_.front().term;
+    entries_.pop_front();
     ++base_;
 
     return log_status_t::ok;
@@ -257,6 +300,35 @@ public:
     return poll([](auto, auto) { return log_status_t::ok; });
   }
 
+  /**
+   * @brief Drop entries up to an index, once covered by a snapshot
+   *
+   * @tparam F Callback function type (entry_t, index_t) -> int
+   * @param idx Index of the last entry to drop
+   * @param f Callback function, called for each entry dropped
+   *
+   * @return ok if success, or a log_status_t error value
+   */
+  template <typename F>
+  log_status_t
+  compact(index_t idx, F && f)
+  {
+    while (base_ < idx && entries_.size())
+    {
+      log_status_t ret = poll(f);
+      if (any(ret))
+        return ret;
+    }
+
+    return log_status_t::ok;
+  }
+
+  log_status_t
+  compact(index_t idx)
+  {
+    return compact(idx, [](auto, auto) { return log_status_t::ok; });
+  }
+
 public:
   /**
    * @brief Load from a snapshot
@@ -265,10 +337,11 @@ public:
    * @param term New term
    */
   void
-  load(index_t idx, term_t)
+  load(index_t idx, term_t term)
   {
     clear();
     base_ = idx;
+    base_term_ = term;
   }
 
 public:
@@ -285,18 +358,18 @@ public:
   print(ostream & os) const
   {
     os << "{"
-       << "\"count\": " << deque_.size() << ", "
+       << "\"count\": " << entries_.size() << ", "
        << "\"base\": " << base_ << ", "
        << "\"entries\": [";
 
     auto first = true;
-    for (index_t i = 0; i < deque_.size(); ++i)
+    for (index_t i = 0; i < entries_.size(); ++i)
     {
       if (!first)
         os << ", ";
       first = false;
 
-      os << *deque_[ i ];
+      os << entries_[ i ];
     }
 
     os << "]}";
@@ -304,8 +377,9 @@ public:
   }
 
 private:
-  logs_t deque_;
+  logs_t entries_;
   index_t base_;
+  term_t base_term_;
 };
 
 template <typename ostream, typename T, typename term_t, typename id_t>
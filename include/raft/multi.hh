@@ -0,0 +1,491 @@
+#ifndef RAFT_MULTI_HH_
+#define RAFT_MULTI_HH_
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+#include <sys/uio.h>
+
+#include <raft/heartbeat.hh>
+#include <raft/server.hh>
+#include <utils/timer_wheel.hh>
+
+namespace raft
+{
+
+/**
+ * @brief Host of many raft groups living in the same process.
+ *
+ * Every group is a plain raft::server sharing the host random engine and
+ * driven by the host tick. Messages are routed by (group id, node id).
+ *
+ * Groups are only woken up when their next deadline expires, as tracked by
+ * a timer wheel, so idle groups cost nothing on a tick.
+ */
+template <typename T,
+          typename group_id_t = unsigned long int,
+          typename node_user_data_t = void,
+          typename node_id_t = unsigned long int,
+          typename term_t_ = unsigned long int,
+          typename index_id_t_ = unsigned long int>
+class multi
+{
+public:
+  using server_t = server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>;
+  using timers_t = utils::timer_wheel<group_id_t>;
+  using tick_t = typename timers_t::tick_t;
+
+  struct group_t
+  {
+    std::unique_ptr<server_t> server;
+
+    /** host time when the server was last brought up to date */
+    tick_t last;
+
+    /** hooks of the group itself, merged with the host routing */
+    typename server_t::callbacks_t cbs;
+  };
+
+  using groups_t = std::unordered_map<group_id_t, group_t>;
+
+  using vote_request_t = typename server_t::vote_request_t;
+  using vote_response_t = typename server_t::vote_response_t;
+  using heartbeat_request_t = typename server_t::heartbeat_request_t;
+  using heartbeat_response_t = typename server_t::heartbeat_response_t;
+  using appendentries_request_t = typename server_t::appendentries_request_t;
+  using appendentries_response_t = typename server_t::appendentries_response_t;
+  using appendentries_view_t = typename server_t::appendentries_view_t;
+  using installsnapshot_request_t = typename server_t::installsnapshot_request_t;
+  using installsnapshot_response_t = typename server_t::installsnapshot_response_t;
+
+  using coalescer_t = heartbeat::
+    coalescer<group_id_t, node_id_t, typename server_t::term_t, typename server_t::index_t>;
+  using heartbeats_request_t = typename coalescer_t::message_t;
+  using heartbeats_response_t = rpc::coalesced_t<group_id_t, heartbeat_response_t>;
+
+  /**
+   * @brief Hooks used by the host to reach other hosts
+   */
+  struct callbacks_t
+  {
+    std::function<status_t(group_id_t const &, node_id_t const &, vote_request_t const &)>
+      send_request_vote;
+    std::function<status_t(node_id_t const &, heartbeats_request_t const &)> send_heartbeats;
+    std::function<status_t(group_id_t const &, node_id_t const &, appendentries_request_t const &)>
+      send_appendentries;
+    std::function<
+      status_t(group_id_t const &, node_id_t const &, installsnapshot_request_t const &)>
+      send_installsnapshot;
+
+    /** send an encoded appendentries, used instead of send_appendentries when set */
+    std::function<status_t(group_id_t const &, node_id_t const &, struct iovec const *, int)>
+      send_appendentries_encoded;
+  };
+
+public:
+  /**
+   * @brief Build a host
+   *
+   * @param self Node id of this host, shared by all of its groups
+   */
+  explicit multi(node_id_t const & self)
+    : self_(self)
+    , gen_(std::make_shared<typename server_t::generator_t>(std::random_device()()))
+  {
+  }
+
+  multi(multi const &) = delete;
+  multi &
+  operator=(multi const &) = delete;
+
+public:
+  /**
+   * @brief Create a new group hosting this node
+   *
+   * The messages of the group go through the host. Its own hooks, such as
+   * apply_log or snapshot, are given here or with group_callbacks(), never
+   * with the callbacks() of the server, which would replace the routing.
+   *
+   * @param gid Group id
+   * @param cbs Hooks of the group; send hooks left empty route through
+   * the host
+   *
+   * @return the group server, or nullptr if the group already exists
+   */
+  server_t *
+  group_add(group_id_t const & gid, typename server_t::callbacks_t const & cbs = {})
+  {
+    if (groups_.count(gid))
+      return nullptr;
+
+    auto s = std::make_unique<server_t>(gen_);
+    s->node_add(self_, true);
+
+    auto ptr = s.get();
+    auto & g = groups_.emplace(gid, group_t{std::move(s), timers_.now(), cbs}).first->second;
+    wire(gid, g);
+
+    /* nodes are added afterwards, the first tick computes the real deadline */
+    timers_.schedule(gid, timers_.now());
+
+    return ptr;
+  }
+
+  /**
+   * @brief Set the hooks of a group, merged with the host routing
+   *
+   * @return false if the group does not exist
+   */
+  bool
+  group_callbacks(group_id_t const & gid, typename server_t::callbacks_t const & cbs)
+  {
+    auto it = groups_.find(gid);
+    if (it == groups_.end())
+      return false;
+
+    it->second.cbs = cbs;
+    wire(gid, it->second);
+    return true;
+  }
+
+  void
+  group_remove(group_id_t const & gid)
+  {
+    timers_.cancel(gid);
+    groups_.erase(gid);
+  }
+
+  server_t *
+  group_get(group_id_t const & gid) const
+  {
+    auto it = groups_.find(gid);
+
+    if (it == groups_.cend())
+      return nullptr;
+    else
+      return it->second.server.get();
+  }
+
+  typename groups_t::size_type
+  group_count() const
+  {
+    return groups_.size();
+  }
+
+  node_id_t
+  id() const
+  {
+    return self_;
+  }
+
+public:
+  /**
+   * @brief Set the hooks of the host, for the groups it holds and the
+   * ones added later
+   */
+  void
+  callbacks(callbacks_t const & cbs)
+  {
+    cbs_ = cbs;
+
+    for (auto & it : groups_)
+      wire(it.first, it.second);
+  }
+
+public:
+  /**
+   * @brief Drive all groups from a single tick
+   *
+   * Only the groups whose deadline expired are run. Heartbeats emitted by
+   * the groups are coalesced into one message per peer host, sent once
+   * every group has been run.
+   *
+   * @param p Time elapsed since the previous tick
+   */
+  status_t
+  periodic(std::chrono::milliseconds p)
+  {
+    status_t ret = status_t::ok;
+
+    timers_.advance(timers_.now() + p.count(), [this, &ret](group_id_t const & gid) {
+      status_t r = touch(gid);
+      if (any(r))
+        ret = r;
+    });
+
+    status_t r = flush_heartbeats();
+    if (any(r))
+      ret = r;
+
+    return ret;
+  }
+
+  /**
+   * @brief Get time left before the next group deadline
+   *
+   * The host may sleep that long before calling periodic().
+   */
+  std::chrono::milliseconds
+  next_deadline() const
+  {
+    tick_t next = timers_.next_expiry();
+
+    if (next == timers_t::never)
+      return std::chrono::milliseconds::max();
+
+    return std::chrono::milliseconds(next - timers_.now());
+  }
+
+  /**
+   * @brief Bring a group up to date and re-arm its timer
+   *
+   * Must be called after altering a group server directly, as its deadline
+   * may have changed.
+   */
+  status_t
+  touch(group_id_t const & gid)
+  {
+    return dispatch(gid, [](server_t &) { return status_t::ok; });
+  }
+
+  status_t
+  flush_heartbeats()
+  {
+    return heartbeats_.flush([this](node_id_t const & peer, heartbeats_request_t const & msg) {
+      return cbs_.send_heartbeats ? cbs_.send_heartbeats(peer, msg) : status_t::ok;
+    });
+  }
+
+public:
+  status_t
+  recv_vote_request(group_id_t const & gid,
+                    node_id_t const & from,
+                    vote_request_t const & req,
+                    vote_response_t & resp)
+  {
+    return dispatch(gid, [&](server_t & s) {
+      return s.recv_vote_request(s.node_get(from), req, resp);
+    });
+  }
+
+  status_t
+  recv_vote_response(group_id_t const & gid, node_id_t const & from, vote_response_t const & resp)
+  {
+    return dispatch(gid, [&](server_t & s) { return s.recv_vote_response(s.node_get(from), resp); });
+  }
+
+  /**
+   * @brief Fan a coalesced heartbeat out to the groups it targets
+   *
+   * Heartbeats for groups unknown to this host are dropped.
+   */
+  status_t
+  recv_heartbeats(node_id_t const & from,
+                  heartbeats_request_t const & req,
+                  heartbeats_response_t & resp)
+  {
+    status_t ret = status_t::ok;
+
+    resp.msgs.clear();
+    resp.msgs.reserve(req.msgs.size());
+
+    for (auto & it : req.msgs)
+    {
+      if (group_get(it.first) == nullptr)
+        continue;
+
+      heartbeat_response_t r;
+      status_t st = dispatch(it.first, [&](server_t & s) {
+        return s.recv_heartbeat(s.node_get(from), it.second, r);
+      });
+      if (any(st))
+        ret = st;
+
+      resp.msgs.emplace_back(it.first, r);
+    }
+
+    return ret;
+  }
+
+  status_t
+  recv_heartbeats_response(node_id_t const & from, heartbeats_response_t const & resp)
+  {
+    status_t ret = status_t::ok;
+
+    for (auto & it : resp.msgs)
+    {
+      if (group_get(it.first) == nullptr)
+        continue;
+
+      status_t st = dispatch(it.first, [&](server_t & s) {
+        return s.recv_heartbeat_response(s.node_get(from), it.second);
+      });
+      if (any(st))
+        ret = st;
+    }
+
+    return ret;
+  }
+
+  status_t
+  recv_appendentries(group_id_t const & gid,
+                     node_id_t const & from,
+                     appendentries_request_t const & req,
+                     appendentries_response_t & resp)
+  {
+    return dispatch(gid, [&](server_t & s) {
+      return s.recv_appendentries(s.node_get(from), req, resp);
+    });
+  }
+
+  /**
+   * @brief Receive an appendentries decoded in place, see
+   * server::recv_appendentries()
+   */
+  status_t
+  recv_appendentries(group_id_t const & gid,
+                     node_id_t const & from,
+                     appendentries_view_t const & req,
+                     appendentries_response_t & resp)
+  {
+    return dispatch(gid, [&](server_t & s) {
+      return s.recv_appendentries(s.node_get(from), req, resp);
+    });
+  }
+
+  status_t
+  recv_appendentries_response(group_id_t const & gid,
+                              node_id_t const & from,
+                              appendentries_response_t const & resp)
+  {
+    return dispatch(gid, [&](server_t & s) {
+      return s.recv_appendentries_response(s.node_get(from), resp);
+    });
+  }
+
+  status_t
+  recv_installsnapshot(group_id_t const & gid,
+                       node_id_t const & from,
+                       installsnapshot_request_t const & req,
+                       installsnapshot_response_t & resp)
+  {
+    return dispatch(gid, [&](server_t & s) {
+      return s.recv_installsnapshot(s.node_get(from), req, resp);
+    });
+  }
+
+  status_t
+  recv_installsnapshot_response(group_id_t const & gid,
+                                node_id_t const & from,
+                                installsnapshot_response_t const & resp)
+  {
+    return dispatch(gid, [&](server_t & s) {
+      return s.recv_installsnapshot_response(s.node_get(from), resp);
+    });
+  }
+
+private:
+  /**
+   * @brief Give a group server its own hooks, and route the messages it
+   * sends through the host
+   */
+  void
+  wire(group_id_t const & gid, group_t & g)
+  {
+    typename server_t::callbacks_t cbs = g.cbs;
+
+    if (!cbs.send_request_vote)
+      cbs.send_request_vote = [this, gid](auto const & node, vote_request_t const & msg) {
+        return cbs_.send_request_vote ? cbs_.send_request_vote(gid, node->id(), msg)
+                                      : status_t::ok;
+      };
+
+    /* heartbeats are held back until the end of the tick */
+    if (!cbs.send_heartbeat)
+      cbs.send_heartbeat = [this, gid](auto const & node, heartbeat_request_t const & msg) {
+        heartbeats_.add(node->id(), gid, msg);
+        return status_t::ok;
+      };
+
+    if (!cbs.send_appendentries)
+      cbs.send_appendentries = [this, gid](auto const & node,
+                                           appendentries_request_t const & msg) {
+        return cbs_.send_appendentries ? cbs_.send_appendentries(gid, node->id(), msg)
+                                       : status_t::ok;
+      };
+
+    if (!cbs.send_installsnapshot)
+      cbs.send_installsnapshot = [this, gid](auto const & node,
+                                             installsnapshot_request_t const & msg) {
+        return cbs_.send_installsnapshot ? cbs_.send_installsnapshot(gid, node->id(), msg)
+                                         : status_t::ok;
+      };
+
+    /* only set when the host sends encoded, the server checks for it */
+    if (!cbs.send_appendentries_encoded && cbs_.send_appendentries_encoded)
+      cbs.send_appendentries_encoded = [this, gid](auto const & node,
+                                                   struct iovec const * iov,
+                                                   int iovcnt) {
+        return cbs_.send_appendentries_encoded(gid, node->id(), iov, iovcnt);
+      };
+
+    g.server->callbacks(cbs);
+  }
+
+  /**
+   * @brief Run a handler against a group
+   *
+   * The group timeouts are brought up to date first, as handlers may reset
+   * them, and its timer is re-armed afterwards, even on failure.
+   */
+  template <typename F>
+  status_t
+  dispatch(group_id_t const & gid, F && f)
+  {
+    auto it = groups_.find(gid);
+    if (it == groups_.end())
+      return status_t::fail;
+
+    auto & g = it->second;
+    tick_t now = timers_.now();
+
+    status_t ret = g.server->periodic(std::chrono::milliseconds(now - g.last));
+    g.last = now;
+
+    /* the timer fired already: a group left unarmed would never run again */
+    if (!any(ret))
+      ret = f(*g.server);
+    rearm(gid, *g.server);
+
+    return ret;
+  }
+
+  void
+  rearm(group_id_t const & gid, server_t const & s)
+  {
+    auto d = s.next_deadline();
+
+    if (d == std::chrono::milliseconds::max())
+      timers_.cancel(gid);
+    else
+      timers_.schedule(gid, timers_.now() + d.count());
+  }
+
+private:
+  node_id_t self_;
+  std::shared_ptr<typename server_t::generator_t> gen_;
+
+  timers_t timers_;
+
+  groups_t groups_;
+  coalescer_t heartbeats_;
+  callbacks_t cbs_;
+};
+
+} /** !raft  */
+
+#endif /** !RAFT_MULTI_HH_  */
@@ -1,6 +1,8 @@
 #ifndef RAFT_NODE_HH_
 #define RAFT_NODE_HH_
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
 
 namespace raft
@@ -11,10 +13,20 @@ class node
 {
 public:
   using user_data_t = std::shared_ptr<T>;
+  using clock_t = std::chrono::steady_clock;
+  using rtt_t = std::chrono::microseconds;
 
 public:
   node(id_t const & id, user_data_t const & user_data = nullptr)
-    : id_(id), next_index_(1), match_index_(0), user_data_(user_data), flags_(NODE_VOTING)
+    : id_(id)
+    , next_index_(1)
+    , match_index_(0)
+    , snapshot_offset_(0)
+    , user_data_(user_data)
+    , flags_(NODE_VOTING)
+    , srtt_(0)
+    , rttvar_(0)
+    , rtt_samples_(0)
   {
   }
 
@@ -42,6 +54,21 @@ public:
     match_index_ = idx;
   }
 
+public:
+  /**
+   * @brief Get offset of the next snapshot chunk to send to the node
+   */
+  std::uint64_t
+  snapshot_offset() const
+  {
+    return snapshot_offset_;
+  }
+  void
+  snapshot_offset(std::uint64_t offset)
+  {
+    snapshot_offset_ = offset;
+  }
+
 public:
   id_t
   id() const
@@ -58,6 +85,8 @@ private:
     NODE_INACTIVE = (1 << 3),
     NODE_VOTING_COMMITED = (1 << 4),
     NODE_ADDITION_COMMITED = (1 << 5),
+    NODE_PROBING = (1 << 6),
+    NODE_PROBE_AMBIGUOUS = (1 << 7),
   };
 
   template <typename F>
@@ -147,6 +176,100 @@ public:
     _set_flag(NODE_ADDITION_COMMITED, v);
   }
 
+public:
+  /**
+   * @brief Record a round trip time sample
+   *
+   * Keeps smoothed round trip time and variation as TCP does (RFC 6298).
+   */
+  void
+  rtt_sample(rtt_t const & rtt)
+  {
+    if (rtt_samples_++ == 0)
+    {
+      srtt_ = rtt;
+      rttvar_ = rtt / 2;
+      return;
+    }
+
+    rtt_t delta = (srtt_ < rtt) ? rtt - srtt_ : srtt_ - rtt;
+
+    rttvar_ = (3 * rttvar_ + delta) / 4;
+    srtt_ = (7 * srtt_ + rtt) / 8;
+  }
+
+  /**
+   * @brief Get smoothed round trip time
+   */
+  rtt_t
+  rtt() const
+  {
+    return srtt_;
+  }
+
+  rtt_t
+  rtt_var() const
+  {
+    return rttvar_;
+  }
+
+  unsigned int
+  rtt_samples() const
+  {
+    return rtt_samples_;
+  }
+
+  /**
+   * @brief Get retransmission timeout, that is srtt + 4 * rttvar
+   */
+  rtt_t
+  rto() const
+  {
+    return srtt_ + 4 * rttvar_;
+  }
+
+public:
+  /**
+   * @brief Remember when a request expecting an answer was sent
+   *
+   * Responses do not tell which request they answer: when a request is
+   * sent while another one is pending, neither is measured (Karn's
+   * algorithm), so that lost messages do not turn into samples.
+   */
+  void
+  probe_sent(clock_t::time_point const & t)
+  {
+    if (_check_flag(NODE_PROBING))
+    {
+      _set_flag(NODE_PROBING, false);
+      _set_flag(NODE_PROBE_AMBIGUOUS, true);
+    }
+    else if (!_check_flag(NODE_PROBE_AMBIGUOUS))
+    {
+      probe_ = t;
+      _set_flag(NODE_PROBING, true);
+    }
+  }
+
+  /**
+   * @brief Record the round trip of the pending request, if any
+   */
+  void
+  probe_received(clock_t::time_point const & t)
+  {
+    if (_check_flag(NODE_PROBE_AMBIGUOUS))
+    {
+      _set_flag(NODE_PROBE_AMBIGUOUS, false);
+      return;
+    }
+
+    if (!_check_flag(NODE_PROBING))
+      return;
+
+    _set_flag(NODE_PROBING, false);
+    rtt_sample(std::chrono::duration_cast<rtt_t>(t - probe_));
+  }
+
 public:
   template <typename ostream>
   ostream &
@@ -161,9 +284,15 @@ private:
   id_t id_;
   index_t next_index_;
   index_t match_index_;
+  std::uint64_t snapshot_offset_;
   user_data_t user_data_;
 
   unsigned int flags_;
+
+  rtt_t srtt_;
+  rtt_t rttvar_;
+  unsigned int rtt_samples_;
+  clock_t::time_point probe_;
 };
 
 template <typename ostream,
@@ -1,6 +1,8 @@
 #ifndef RAFT_RPC_HH_
 #define RAFT_RPC_HH_
 
+#include <cstdint>
+#include <utility>
 #include <vector>
 
 #include <raft/log.hh>
@@ -176,6 +178,164 @@ operator<<(ostream & os, appendentries_response_t<term_t, index_t> const & msg)
          os;
 }
 
+/** Heartbeat message.
+ * Entry-less appendentries sent by a leader to keep its followers from
+ * starting an election. The commit index is bounded by the follower match
+ * index so that it can be trusted without the log consistency check. */
+template <typename term_t, typename index_t>
+struct heartbeat_request_t
+{
+  /** currentTerm, to force other leader/candidate to step down */
+  term_t term;
+
+  /** the index of the entry that has been appended to the majority of the
+   * cluster and that is known to be held by the receiver */
+  index_t leader_commit;
+
+  /** the leader heartbeat interval in milliseconds, for followers to
+   * derive their election timeout from, 0 if unknown */
+  std::uint32_t interval;
+};
+
+template <typename ostream, typename term_t, typename index_t>
+ostream &
+operator<<(ostream & os, heartbeat_request_t<term_t, index_t> const & msg)
+{
+  return os << "{"
+            << "\"term\": " << msg.term << ", "
+            << "\"leader_commit\": " << msg.leader_commit << ", "
+            << "\"interval\": " << msg.interval << "}",
+         os;
+}
+
+/** Heartbeat response message. */
+template <typename term_t>
+struct heartbeat_response_t
+{
+  /** currentTerm, to force other leader/candidate to step down */
+  term_t term;
+
+  /** true if the receiver has accepted the sender as its leader */
+  bool success;
+};
+
+template <typename ostream, typename term_t>
+ostream &
+operator<<(ostream & os, heartbeat_response_t<term_t> const & msg)
+{
+  return os << "{"
+            << "\"term\": " << msg.term << ", "
+            << "\"success\": " << msg.success << "}",
+         os;
+}
+
+/** Installsnapshot message.
+ * Sent by a leader to a follower missing entries that have been compacted
+ * away. The snapshot is streamed in chunks, each one carrying its offset
+ * and checksum, so that a transfer resumes where it stopped. */
+template <typename term_t, typename index_t>
+struct installsnapshot_request_t
+{
+  /** currentTerm, to force other leader/candidate to step down */
+  term_t term;
+
+  /** the snapshot replaces all entries up through and including this index */
+  index_t last_idx;
+
+  /** term of last_idx */
+  term_t last_term;
+
+  /** size of the whole snapshot, in bytes */
+  std::uint64_t size;
+
+  /** byte offset where the chunk is positioned in the snapshot */
+  std::uint64_t offset;
+
+  /** CRC-32C of the chunk */
+  std::uint32_t crc;
+
+  /** true if this is the last chunk */
+  bool done;
+
+  /** raw bytes of the chunk */
+  std::vector<std::uint8_t> data;
+};
+
+template <typename ostream, typename term_t, typename index_t>
+ostream &
+operator<<(ostream & os, installsnapshot_request_t<term_t, index_t> const & msg)
+{
+  return os << "{"
+            << "\"term\": " << msg.term << ", "
+            << "\"last_idx\": " << msg.last_idx << ", "
+            << "\"last_term\": " << msg.last_term << ", "
+            << "\"size\": " << msg.size << ", "
+            << "\"offset\": " << msg.offset << ", "
+            << "\"length\": " << msg.data.size() << ", "
+            << "\"done\": " << msg.done << "}",
+         os;
+}
+
+/** Installsnapshot response message.
+ * Tells the leader where to go on with the transfer. */
+template <typename term_t, typename index_t>
+struct installsnapshot_response_t
+{
+  /** currentTerm, for leader to update itself */
+  term_t term;
+
+  /** index of the snapshot being transferred */
+  index_t last_idx;
+
+  /** offset of the next chunk expected, the snapshot size once installed */
+  std::uint64_t offset;
+
+  /** true if the chunk has been accepted or was already held */
+  bool success;
+};
+
+template <typename ostream, typename term_t, typename index_t>
+ostream &
+operator<<(ostream & os, installsnapshot_response_t<term_t, index_t> const & msg)
+{
+  return os << "{"
+            << "\"term\": " << msg.term << ", "
+            << "\"last_idx\": " << msg.last_idx << ", "
+            << "\"offset\": " << msg.offset << ", "
+            << "\"success\": " << msg.success << "}",
+         os;
+}
+
+/** Coalesced message.
+ * Carries one message per raft group between a same pair of hosts. */
+template <typename group_id_t, typename msg_t>
+struct coalesced_t
+{
+  /** (group, message) tuples */
+  std::vector<std::pair<group_id_t, msg_t>> msgs;
+};
+
+template <typename ostream, typename group_id_t, typename msg_t>
+ostream &
+operator<<(ostream & os, coalesced_t<group_id_t, msg_t> const & msg)
+{
+  os << "[";
+
+  auto first = true;
+  for (auto & it : msg.msgs)
+  {
+    if (!first)
+      os << ", ";
+    first = false;
+
+    os << "{"
+       << "\"group\": " << it.first << ", "
+       << "\"msg\": " << it.second << "}";
+  }
+
+  return os << "]", os;
+}
+
 } /** !rpc  */
 } /** !raft  */
 
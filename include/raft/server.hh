@@ -1,16 +1,23 @@
 #ifndef RAFT_SERVER_HH_
 #define RAFT_SERVER_HH_
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <functional>
 #include <memory>
 #include <random>
 #include <unordered_map>
 
+#include <sys/uio.h>
+
+#include <raft/batch.hh>
+#include <raft/codec.hh>
 #include <raft/fsm.hh>
 #include <raft/log.hh>
 #include <raft/node.hh>
 #include <raft/rpc.hh>
+#include <raft/snapshot.hh>
 #include <raft/traits.hh>
 
 using namespace std::chrono_literals;
@@ -31,7 +38,7 @@ struct enum_traits<status_t>
   static constexpr bool has_any = true;
 };
 
-status_t
+inline status_t
 convert(log_status_t e)
 {
   switch (e)
@@ -68,21 +75,107 @@ public:
   using vote_response_t = rpc::vote_response_t<term_t>;
   using appendentries_request_t = rpc::appendentries_request_t<T, term_t, index_t, index_id_t>;
   using appendentries_response_t = rpc::appendentries_response_t<term_t, index_t>;
+  using appendentries_view_t = codec::appendentries_view_t<term_t, index_t, index_id_t>;
+  using heartbeat_request_t = rpc::heartbeat_request_t<term_t, index_t>;
+  using heartbeat_response_t = rpc::heartbeat_response_t<term_t>;
+  using installsnapshot_request_t = rpc::installsnapshot_request_t<term_t, index_t>;
+  using installsnapshot_response_t = rpc::installsnapshot_response_t<term_t, index_t>;
+
+  using generator_t = std::mt19937;
+  using batches_t = batch::cache<term_t, index_t>;
+
+  /**
+   * @brief Hooks used by the server to reach other nodes
+   */
+  struct callbacks_t
+  {
+    std::function<status_t(std::shared_ptr<node_t> const &, vote_request_t const &)>
+      send_request_vote;
+    std::function<status_t(std::shared_ptr<node_t> const &, heartbeat_request_t const &)>
+      send_heartbeat;
+    std::function<status_t(std::shared_ptr<node_t> const &, appendentries_request_t const &)>
+      send_appendentries;
+    std::function<status_t(std::shared_ptr<node_t> const &, installsnapshot_request_t const &)>
+      send_installsnapshot;
+
+    /** send an encoded appendentries, used instead of send_appendentries when set */
+    std::function<status_t(std::shared_ptr<node_t> const &, struct iovec const *, int)>
+      send_appendentries_encoded;
+
+    /** apply a committed entry to the user state machine */
+    std::function<status_t(entry_t const &, index_t)> apply_log;
+
+    /** entries were applied, up to an index, once per run of apply_all();
+     * see raft::feed */
+    std::function<void(index_t)> applied;
+
+    /** index of the last entry readers of the log are done with: compaction
+     * keeps the entries after it */
+    std::function<index_t()> retain;
+
+    /** save the user state machine, as of the entry at an index and term,
+     * into the snapshot store if one is set */
+    std::function<status_t(index_t, term_t)> snapshot;
+
+    /** reload the user state machine from a snapshot received from the
+     * leader, now installed in the snapshot store */
+    std::function<status_t(index_t, term_t)> install_snapshot;
+  };
+
+  /**
+   * @brief When to take snapshots and how much log to keep
+   *
+   * A snapshot is taken once the entries, or their bytes, appended since
+   * the last compaction exceed a threshold; a zero threshold is disabled.
+   * Compaction then keeps the trailing entries preceding the snapshot, so
+   * that slightly late followers catch up from the log.
+   */
+  struct snapshot_policy_t
+  {
+    index_t max_entries = 0;
+    std::size_t max_bytes = 0;
+    index_t trailing = 0;
+  };
+
+  /** default maximum number of entries sent in an appendentries message */
+  static constexpr index_t default_max_entries = 64;
+
+  /** default size of the snapshot chunks sent in an installsnapshot message */
+  static constexpr std::size_t default_snapshot_chunk = 1 << 20;
 
 public:
-  server()
+  server() : server(std::make_shared<generator_t>(std::random_device()())) {}
+
+  /**
+   * @brief Build a server drawing its election timeouts from a shared generator
+   *
+   * @param gen Random number engine, possibly shared with other servers
+   */
+  explicit server(std::shared_ptr<generator_t> const & gen)
     : current_term_(0)
     , commit_index_(0)
     , last_applied_index_(0)
     , elapsed_timeout_(0ms)
     , request_timeout_(200ms)
     , election_timeout_(1000ms)
-    , gen_(rd_())
+    , adaptive_(false)
+    , leader_interval_(0ms)
+    , gen_(gen)
     , state_(state_t::follower)
     , this_node_(nullptr)
     , voted_for_(nullptr)
     , leader_(nullptr)
+    , max_entries_(default_max_entries)
+    , snapshots_(nullptr)
+    , snapshot_chunk_(default_snapshot_chunk)
+    , snapshot_last_index_(0)
+    , snapshot_last_term_(0)
+    , log_bytes_(0)
+    , compacted_count_(0)
+    , compacted_bytes_(0)
   {
+    appendentries_.entries.reserve(max_entries_);
+
     randomize_election_timeout();
   }
 
@@ -187,7 +280,7 @@ public:
 
     for (auto & it : nodes_)
     {
-      auto node = it.second;
+      auto & node = it.second;
       if (node->is_active() && node->is_voting())
         ++num;
     }
@@ -202,7 +295,7 @@ public:
 
     for (auto & it : nodes_)
     {
-      auto node = it.second;
+      auto & node = it.second;
       if (node->is_active() && node->is_voting() && node->has_vote_for_me())
         ++num;
     }
@@ -284,17 +377,34 @@ public:
   term_t
   last_log_term() const
   {
-    index_t index = current_index();
+    term_t term = 0;
 
-    if (0 < index)
-    {
-      std::shared_ptr<entry_t> e = get(index);
+    term_at(current_index(), term);
+    return term;
+  }
 
-      if (e)
-        return e->term;
+  /**
+   * @brief Get term of the entry at an index, 0 for the empty log prefix
+   *
+   * The term of the last entry covered by the snapshot is known as well.
+   *
+   * @return false if the entry is not held
+   */
+  bool
+  term_at(index_t const & idx, term_t & term) const
+  {
+    if (idx == log_.base())
+    {
+      term = log_.base_term();
+      return true;
     }
 
-    return 0;
+    entry_t const * e = get(idx);
+    if (e == nullptr)
+      return false;
+
+    term = e->term;
+    return true;
   }
 
 public:
@@ -308,12 +418,18 @@ public:
       return status_t::fail;
 
     index_t log_index = last_applied_index_ + 1;
-    std::shared_ptr<entry_t> e = get(log_index);
+    entry_t const * e = get(log_index);
     if (e == nullptr)
       return status_t::fail;
 
+    if (cbs_.apply_log && e->type != entry_type_t::noop)
+    {
+      status_t ret = cbs_.apply_log(*e, log_index);
+      if (any(ret))
+        return ret;
+    }
+
     ++last_applied_index_;
-    // FIXME: apply log
 
     if (log_index == voting_cfg_change_log_index_)
       voting_cfg_change_log_index_ = -1;
@@ -321,19 +437,266 @@ public:
     return status_t::ok;
   }
 
+  /**
+   * @brief Apply all committed entries, then snapshot if the policy says so
+   */
+  status_t
+  apply_all()
+  {
+    index_t from = last_applied_index_;
+
+    while (last_applied_index_ < commit_index())
+    {
+      status_t ret = apply_entry();
+      if (any(ret))
+        return ret;
+    }
+
+    if (from < last_applied_index_ && cbs_.applied)
+      cbs_.applied(last_applied_index_);
+
+    if (should_snapshot())
+      return snapshot();
+
+    return status_t::ok;
+  }
+
+public:
+  /**
+   * @brief Set snapshot and compaction policy
+   */
+  void
+  snapshot_policy(snapshot_policy_t const & policy)
+  {
+    snapshot_policy_ = policy;
+  }
+
+  snapshot_policy_t const &
+  snapshot_policy() const noexcept
+  {
+    return snapshot_policy_;
+  }
+
+  /**
+   * @brief Snapshot the state machine as of the last applied entry, then
+   * compact the log
+   *
+   * @return fail if there is no snapshot callback or if it fails
+   */
+  status_t
+  snapshot()
+  {
+    index_t idx = last_applied_index_;
+    term_t term;
+
+    if (idx <= snapshot_last_index_)
+      return status_t::ok;
+
+    if (!cbs_.snapshot || !term_at(idx, term))
+      return status_t::fail;
+
+    status_t ret = cbs_.snapshot(idx, term);
+    if (any(ret))
+      return ret;
+
+    snapshot_last_index_ = idx;
+    snapshot_last_term_ = term;
+
+    index_t trailing = snapshot_policy_.trailing;
+    index_t upto = trailing < idx ? idx - trailing : 0;
+
+    if (cbs_.retain)
+      upto = std::min(upto, cbs_.retain());
+
+    return compact(upto);
+  }
+
+  /**
+   * @brief Restart from a snapshot of the state machine
+   *
+   * The log is emptied and continues after the snapshot, whose entries
+   * are committed and applied.
+   */
+  void
+  load_snapshot(index_t const & idx, term_t const & term)
+  {
+    log_.load(idx, term);
+    batches_.clear();
+
+    snapshot_last_index_ = idx;
+    snapshot_last_term_ = term;
+    commit_index_ = std::max(commit_index_, idx);
+    last_applied_index_ = std::max(last_applied_index_, idx);
+
+    log_bytes_ = 0;
+    compacted_count_ = 0;
+    compacted_bytes_ = 0;
+  }
+
+  index_t
+  snapshot_last_index() const noexcept
+  {
+    return snapshot_last_index_;
+  }
+
+  term_t
+  snapshot_last_term() const noexcept
+  {
+    return snapshot_last_term_;
+  }
+
+  /**
+   * @brief Get index of the last entry dropped from the log
+   */
+  index_t
+  log_base() const noexcept
+  {
+    return log_.base();
+  }
+
+  /**
+   * @brief Get number of entries held in the log
+   */
+  index_t
+  log_count() const noexcept
+  {
+    return log_.count();
+  }
+
+  /**
+   * @brief Get size of the entries held in the log, encoded if they can be
+   */
+  std::size_t
+  log_bytes() const noexcept
+  {
+    return log_bytes_;
+  }
+
+  /**
+   * @brief Set where snapshots are read from to be sent to lagging
+   * followers, and where snapshots received from the leader are installed
+   */
+  void
+  snapshot_store(snapshot::store * store)
+  {
+    snapshots_ = store;
+  }
+
+  snapshot::store *
+  snapshot_store() const noexcept
+  {
+    return snapshots_;
+  }
+
+  /**
+   * @brief Set size of the snapshot chunks sent to followers
+   */
+  void
+  snapshot_chunk(std::size_t n)
+  {
+    snapshot_chunk_ = std::max<std::size_t>(n, 1);
+    throttle_.rate(throttle_.rate(), snapshot_chunk_);
+  }
+
+  std::size_t
+  snapshot_chunk() const noexcept
+  {
+    return snapshot_chunk_;
+  }
+
+  /**
+   * @brief Bound the bandwidth used to send snapshots to all followers
+   *
+   * Chunks held back are sent on a later round. A zero rate is unlimited.
+   */
+  void
+  snapshot_rate(std::uint64_t bytes_per_second)
+  {
+    throttle_.rate(bytes_per_second, snapshot_chunk_);
+  }
+
+  std::uint64_t
+  snapshot_rate() const noexcept
+  {
+    return throttle_.rate();
+  }
+
 public:
   status_t
   append(entry_t const & e)
   {
+    log_bytes_ += entry_bytes(e, codec::is_encodable<T>());
     return convert(log_.append(e));
   }
 
-  std::shared_ptr<entry_t>
+  /**
+   * @brief Get entry at an index
+   *
+   * @return return a pointer to an entry, valid until the log is modified,
+   * or nullptr
+   */
+  entry_t const *
   get(index_t const & index) const
   {
     return log_.at(index);
   }
 
+  /**
+   * @brief Preallocate room for n log entries
+   */
+  void
+  reserve(index_t n)
+  {
+    log_.reserve(n);
+  }
+
+  /**
+   * @brief Submit a new entry to the cluster
+   *
+   * The entry is stamped with the current term, appended to the leader log
+   * and sent right away to the followers that are up to date.
+   *
+   * @param e Entry to replicate
+   * @param idx Index given to the entry
+   *
+   * @return fail if not leader, ok if success
+   */
+  status_t
+  recv_entry(entry_t e, index_t & idx)
+  {
+    if (!is_leader())
+      return status_t::fail;
+
+    e.term = current_term_;
+
+    status_t ret = append(e);
+    if (any(ret))
+      return ret;
+
+    idx = current_index();
+
+    for (auto & it : nodes_)
+    {
+      auto & node = it.second;
+
+      if (node == this_node_ || !node->is_active())
+        continue;
+
+      /* pipelining is left to the next round for lagging followers */
+      if (node->next_index() == idx)
+        send_appendentries(node);
+    }
+
+    /* a single voter commits on its own */
+    if (num_voting_nodes() == 1 && this_node_->is_voting())
+    {
+      commit_index(idx);
+      return apply_all();
+    }
+
+    return status_t::ok;
+  }
+
 public:
   void
   become_follower()
@@ -351,50 +714,79 @@ public:
       return ret;
 
     for (auto & p : nodes_)
-    {
-      auto node = p.second;
-
       p.second->has_vote_for_me(false);
-    }
 
     vote_for(this_node_);
     leader_ = nullptr;
+    leader_interval_ = 0ms;
     state_ = state_t::candidate;
 
     randomize_election_timeout();
     elapsed_timeout_ = 0ms;
 
+    /* a failed request does not stop the others, the first failure is told */
     for (auto & p : nodes_)
     {
-      auto node = p.second;
+      auto & node = p.second;
 
       if (node != this_node_ && node->is_active() && node->is_voting())
       {
-        send_request_vote(node);
+        status_t r = send_request_vote(node);
+        if (any(r) && !any(ret))
+          ret = r;
       }
     }
 
-    return status_t::ok;
+    return ret;
   }
 
+  /**
+   * @brief Take the lead, appending a noop entry of the new term
+   *
+   * Until an entry of its term is committed, a leader cannot commit the
+   * entries of earlier terms nor learn what its followers hold: the noop
+   * is sent to all of them right away, which finds their match index and
+   * repairs the lagging ones without waiting for a client entry. It is
+   * preceded by heartbeats, which tell followers the heartbeat interval
+   * appendentries do not carry.
+   */
   status_t
   become_leader()
   {
     state_ = state_t::leader;
     leader_ = this_node_;
 
-    elapsed_timeout_ = 0ms;
     for (auto & it : nodes_)
     {
-      auto node = it.second;
+      auto & node = it.second;
 
-      if (node == this_node_ || node->is_active())
+      if (node == this_node_ || !node->is_active())
         continue;
 
       node->next_index(current_index() + 1);
       node->match_index(0);
+    }
+
+    status_t ret = append({entry_type_t::noop, current_term_, 0, T()});
+    if (any(ret))
+      return ret;
+
+    /* assert leadership right away */
+    for (auto & it : nodes_)
+    {
+      auto & node = it.second;
+
+      if (node != this_node_ && node->is_active())
+        send_heartbeat(node);
+    }
+
+    send_appendentries_all();
 
-      // FIXME: send appendentries
+    /* a single voter commits on its own */
+    if (num_voting_nodes() == 1 && this_node_->is_voting())
+    {
+      commit_index(current_index());
+      return apply_all();
     }
 
     return status_t::ok;
@@ -415,7 +807,9 @@ public:
     assert(node != nullptr);
     assert(node != this_node_);
 
-    vote_request_t msg{current_term_, node->id(), current_index(), last_log_term()};
+    assert(this_node_ != nullptr);
+
+    vote_request_t msg{current_term_, this_node_->id(), current_index(), last_log_term()};
 
     return f(node, msg);
   }
@@ -423,7 +817,326 @@ public:
   status_t
   send_request_vote(std::shared_ptr<node_t> node)
   {
-    return send_request_vote(node, [](auto, auto) { return status_t::ok; });
+    node->probe_sent(node_t::clock_t::now());
+
+    return send_request_vote(node, [this](auto const & n, auto const & msg) {
+      return cbs_.send_request_vote ? cbs_.send_request_vote(n, msg) : status_t::ok;
+    });
+  }
+
+public:
+  /**
+   * @brief Send a heartbeat to a follower
+   *
+   * The advertised commit index never exceeds what the follower is known to
+   * hold, so the follower can apply it without checking its log.
+   */
+  template <typename F>
+  status_t
+  send_heartbeat(std::shared_ptr<node_t> const & node, F && f)
+  {
+    assert(node != nullptr);
+    assert(node != this_node_);
+
+    heartbeat_request_t msg{current_term_,
+                            std::min(commit_index_, node->match_index()),
+                            std::uint32_t(request_timeout_.count())};
+
+    return f(node, msg);
+  }
+
+  status_t
+  send_heartbeat(std::shared_ptr<node_t> const & node)
+  {
+    node->probe_sent(node_t::clock_t::now());
+
+    return send_heartbeat(node, [this](auto const & n, auto const & msg) {
+      return cbs_.send_heartbeat ? cbs_.send_heartbeat(n, msg) : status_t::ok;
+    });
+  }
+
+  void
+  send_heartbeat_all()
+  {
+    elapsed_timeout_ = 0ms;
+    adapt_timeouts();
+
+    for (auto & it : nodes_)
+    {
+      auto & node = it.second;
+
+      if (node != this_node_ && node->is_active())
+        send_heartbeat(node);
+    }
+  }
+
+public:
+  /**
+   * @brief Send the entries a follower is missing
+   *
+   * The message is built in a buffer owned by the server, valid for the
+   * duration of the callback only.
+   */
+  template <typename F>
+  status_t
+  send_appendentries(std::shared_ptr<node_t> const & node, F && f)
+  {
+    assert(node != nullptr);
+    assert(node != this_node_);
+
+    index_t next = node->next_index();
+    index_t prev = next - 1;
+
+    appendentries_.term = current_term_;
+    appendentries_.prev_log_idx = prev;
+    appendentries_.leader_commit = commit_index_;
+    appendentries_.entries.clear();
+
+    if (!term_at(prev, appendentries_.prev_log_term))
+      return status_t::fail;
+
+    for (index_t i = next; i <= current_index() && i < next + max_entries_; ++i)
+      appendentries_.entries.push_back(*get(i));
+
+    return f(node, static_cast<appendentries_request_t const &>(appendentries_));
+  }
+
+  status_t
+  send_appendentries(std::shared_ptr<node_t> const & node)
+  {
+    /* entries the follower misses have been compacted away */
+    if (node->next_index() <= log_.base() && snapshots_)
+      return send_installsnapshot(node);
+
+    if (cbs_.send_appendentries_encoded)
+      return send_encoded(node, codec::is_encodable<T>());
+
+    return send_appendentries(node, [this](auto const & n, auto const & msg) {
+      return cbs_.send_appendentries ? cbs_.send_appendentries(n, msg) : status_t::ok;
+    });
+  }
+
+  /**
+   * @brief Send the entries a follower is missing, encoded
+   *
+   * The message is a header specific to the follower followed by a run of
+   * entries encoded once and shared by all followers. Both are valid for
+   * the duration of the callback only.
+   *
+   * @tparam F Callback function type (node, struct iovec const *, int) -> status_t
+   */
+  template <typename F>
+  status_t
+  send_appendentries_encoded(std::shared_ptr<node_t> const & node, F && f)
+  {
+    assert(node != nullptr);
+    assert(node != this_node_);
+
+    index_t next = node->next_index();
+    index_t prev = next - 1;
+    index_t last = std::min(current_index(), next + max_entries_ - 1);
+    term_t prev_term;
+
+    if (!term_at(prev, prev_term))
+      return status_t::fail;
+
+    typename batches_t::ptr_t run;
+
+    if (next <= last)
+    {
+      term_t last_term;
+
+      term_at(last, last_term);
+      run = batches_.get(next, last, last_term, [this, next, last](auto & buf) {
+        std::size_t bytes = 0;
+
+        for (index_t i = next; i <= last; ++i)
+          bytes += codec::size(*get(i));
+
+        buf.resize(bytes);
+
+        codec::writer w(buf.data(), buf.size());
+        for (index_t i = next; i <= last; ++i)
+          codec::put(w, *get(i));
+
+        return w.ok();
+      });
+
+      if (run == nullptr)
+        return status_t::fail;
+    }
+
+    std::uint8_t header[ codec::appendentries_header_max ];
+    codec::writer w(header, sizeof(header));
+
+    codec::put_appendentries_header(
+      w, current_term_, prev, prev_term, commit_index_, run ? run->count() : 0);
+
+    struct iovec iov[ 2 ];
+    int iovcnt = 1;
+
+    iov[ 0 ].iov_base = header;
+    iov[ 0 ].iov_len = w.size();
+
+    if (run)
+    {
+      iov[ 1 ].iov_base = const_cast<std::uint8_t *>(run->data());
+      iov[ 1 ].iov_len = run->bytes();
+      ++iovcnt;
+    }
+
+    return f(node, static_cast<struct iovec const *>(iov), iovcnt);
+  }
+
+  /**
+   * @brief Send the next chunk of the installed snapshot to a follower
+   *
+   * The chunk starts at the offset last reported by the follower, and is
+   * held back while the snapshot rate is exceeded. The message is built in
+   * a buffer owned by the server, valid for the duration of the callback
+   * only.
+   *
+   * @return fail if there is no snapshot to send
+   */
+  template <typename F>
+  status_t
+  send_installsnapshot(std::shared_ptr<node_t> const & node, F && f)
+  {
+    assert(node != nullptr);
+    assert(node != this_node_);
+
+    if (snapshots_ == nullptr || snapshots_->current().term == 0)
+      return status_t::fail;
+
+    auto const & meta = snapshots_->current();
+    std::uint64_t offset = std::min(node->snapshot_offset(), meta.size);
+    auto len = std::size_t(std::min<std::uint64_t>(snapshot_chunk_, meta.size - offset));
+
+    if (!throttle_.take(len))
+      return status_t::ok;
+
+    auto & msg = installsnapshot_;
+
+    msg.data.resize(len);
+    if (snapshots_->read(offset, msg.data.data(), len) != len)
+      return status_t::fail;
+
+    msg.term = current_term_;
+    msg.last_idx = index_t(meta.index);
+    msg.last_term = term_t(meta.term);
+    msg.size = meta.size;
+    msg.offset = offset;
+    msg.crc = utils::crc32(msg.data.data(), len);
+    msg.done = offset + len == meta.size;
+
+    return f(node, static_cast<installsnapshot_request_t const &>(msg));
+  }
+
+  status_t
+  send_installsnapshot(std::shared_ptr<node_t> const & node)
+  {
+    return send_installsnapshot(node, [this](auto const & n, auto const & msg) {
+      return cbs_.send_installsnapshot ? cbs_.send_installsnapshot(n, msg) : status_t::ok;
+    });
+  }
+
+  /**
+   * @brief Receive a snapshot chunk
+   *
+   * Once the last chunk is in, the snapshot is installed and the user
+   * state machine reloaded from it. Log entries following the snapshot
+   * are kept if the log agrees with it, dropped otherwise.
+   */
+  status_t
+  recv_installsnapshot(std::shared_ptr<node_t> node,
+                       installsnapshot_request_t const & req,
+                       installsnapshot_response_t & resp);
+
+  status_t
+  recv_installsnapshot_response(std::shared_ptr<node_t> node,
+                                installsnapshot_response_t const & resp);
+
+  /**
+   * @brief Get cache of encoded entries shared by followers
+   */
+  batches_t const &
+  batches() const noexcept
+  {
+    return batches_;
+  }
+
+  /**
+   * @brief Send appendentries to followers missing entries, heartbeats to
+   * the others
+   */
+  void
+  send_appendentries_all()
+  {
+    elapsed_timeout_ = 0ms;
+    adapt_timeouts();
+
+    for (auto & it : nodes_)
+    {
+      auto & node = it.second;
+
+      if (node == this_node_ || !node->is_active())
+        continue;
+
+      if (node->next_index() <= current_index())
+        send_appendentries(node);
+      else
+        send_heartbeat(node);
+    }
+  }
+
+  status_t
+  recv_appendentries(std::shared_ptr<node_t> node,
+                     appendentries_request_t const & req,
+                     appendentries_response_t & resp);
+
+  /**
+   * @brief Receive appendentries straight from a network buffer
+   *
+   * Payloads are decoded once, into the log, and only for entries the log
+   * does not hold yet.
+   */
+  status_t
+  recv_appendentries(std::shared_ptr<node_t> node,
+                     appendentries_view_t const & req,
+                     appendentries_response_t & resp);
+
+  status_t
+  recv_appendentries_response(std::shared_ptr<node_t> node, appendentries_response_t const & resp);
+
+  /**
+   * @brief Set maximum number of entries sent in an appendentries message
+   */
+  void
+  max_entries(index_t n)
+  {
+    max_entries_ = n;
+    appendentries_.entries.reserve(max_entries_);
+  }
+
+  status_t
+  recv_heartbeat(std::shared_ptr<node_t> node,
+                 heartbeat_request_t const & req,
+                 heartbeat_response_t & resp);
+
+  status_t
+  recv_heartbeat_response(std::shared_ptr<node_t> node, heartbeat_response_t const & resp);
+
+public:
+  void
+  callbacks(callbacks_t const & cbs)
+  {
+    cbs_ = cbs;
+  }
+
+  callbacks_t const &
+  callbacks() const noexcept
+  {
+    return cbs_;
   }
 
 public:
@@ -471,6 +1184,7 @@ public:
   election_timeout(std::chrono::milliseconds t)
   {
     election_timeout_ = t;
+    randomize_election_timeout();
   }
 
   std::chrono::milliseconds
@@ -479,16 +1193,97 @@ public:
     return election_timeout_;
   }
 
+  void
+  request_timeout(std::chrono::milliseconds t)
+  {
+    request_timeout_ = t;
+  }
+
+  std::chrono::milliseconds
+  request_timeout() const
+  {
+    return request_timeout_;
+  }
+
   std::chrono::milliseconds
   elapsed_timeout() const
   {
     return elapsed_timeout_;
   }
 
+  /**
+   * @brief Derive election and heartbeat timeouts from measured round trips
+   *
+   * The election timeout is a multiple of the worst retransmission timeout
+   * (srtt + 4 * rttvar) among voting nodes, and the heartbeat timeout a
+   * fraction of it, both kept within the given bounds. Followers only
+   * measure round trips while candidates: their election timeout is never
+   * shorter than the one the leader derives from the heartbeat interval it
+   * advertises. Timeouts are updated when the election timeout is
+   * randomized and when heartbeats are sent. Until a round trip has been
+   * measured or a heartbeat received, the configured timeouts stay in use.
+   */
+  void
+  adaptive_timeouts(std::chrono::milliseconds election_min,
+                    std::chrono::milliseconds election_max,
+                    std::chrono::milliseconds request_min,
+                    std::chrono::milliseconds request_max)
+  {
+    assert(election_min <= election_max);
+    assert(request_min <= request_max);
+
+    adaptive_ = true;
+    election_bounds_ = {election_min, election_max};
+    request_bounds_ = {request_min, request_max};
+
+    randomize_election_timeout();
+  }
+
+  void
+  static_timeouts()
+  {
+    adaptive_ = false;
+  }
+
+  bool
+  is_adaptive() const
+  {
+    return adaptive_;
+  }
+
+  /**
+   * @brief Get time left before periodic() has something to do
+   *
+   * That is the heartbeat timeout for a leader, and the randomized election
+   * timeout otherwise. Servers that cannot start an election never expire.
+   */
+  std::chrono::milliseconds
+  next_deadline() const
+  {
+    if (this_node_ == nullptr)
+      return std::chrono::milliseconds::max();
+
+    if (is_leader())
+      return std::max(request_timeout_ - elapsed_timeout_, 0ms);
+
+    if (!this_node_->is_voting())
+      return std::chrono::milliseconds::max();
+
+    if (num_voting_nodes() == 1)
+      return 0ms;
+
+    /* an election starts once the elapsed time exceeds the timeout */
+    return std::max(election_timeout_rand_ - elapsed_timeout_ + 1ms, 0ms);
+  }
+
   status_t
   periodic(std::chrono::milliseconds p)
   {
     elapsed_timeout_ = elapsed_timeout_ + p;
+    throttle_.refill(p);
+
+    if (this_node_ == nullptr)
+      return status_t::ok;
 
     if (num_voting_nodes() == 1 && this_node_->is_voting() && !is_leader())
     {
@@ -498,24 +1293,165 @@ public:
     if (is_leader())
     {
       if (request_timeout_ <= elapsed_timeout_)
-      {
-        // FIXME: send_appendentries_all
-      }
+        send_appendentries_all();
     }
     else if (election_timeout_rand_ < elapsed_timeout_)
     {
+      if (1 < num_voting_nodes() && this_node_->is_voting())
+        return election_start();
     }
 
     return status_t::ok;
   }
 
 private:
+  status_t
+  send_encoded(std::shared_ptr<node_t> const & node, std::true_type)
+  {
+    return send_appendentries_encoded(node, [this](auto const & n, auto iov, auto iovcnt) {
+      return cbs_.send_appendentries_encoded(n, iov, iovcnt);
+    });
+  }
+
+  /* payloads without codec::traits cannot be sent encoded */
+  status_t
+  send_encoded(std::shared_ptr<node_t> const &, std::false_type)
+  {
+    return status_t::fail;
+  }
+
+  /**
+   * @brief Handle appendentries whatever the way entries are held
+   */
+  template <typename msg_t>
+  status_t
+  recv_entries(std::shared_ptr<node_t> const & node,
+               msg_t const & req,
+               appendentries_response_t & resp);
+
+  status_t
+  append_received(entry_t const & e)
+  {
+    return append(e);
+  }
+
+  template <typename view_t>
+  status_t
+  append_received(view_t const & e)
+  {
+    entry_t entry;
+
+    entry.type = e.type;
+    entry.term = e.term;
+    entry.id = e.id;
+    if (any(codec::decode(e, entry.elt)))
+      return status_t::fail;
+
+    log_bytes_ += e.raw_size;
+    return convert(log_.append(std::move(entry)));
+  }
+
+  /**
+   * @brief Drop entries from an index onwards, conflicting with the leader
+   */
+  void
+  truncate(index_t const & idx)
+  {
+    log_.remove(idx, [this](auto const & e, auto) {
+      log_bytes_ -= entry_bytes(e, codec::is_encodable<T>());
+      return log_status_t::ok;
+    });
+  }
+
+  /**
+   * @brief Drop entries up to an index
+   */
+  status_t
+  compact(index_t const & idx)
+  {
+    auto ret = log_.compact(idx, [this](auto const & e, auto) {
+      log_bytes_ -= entry_bytes(e, codec::is_encodable<T>());
+      return log_status_t::ok;
+    });
+
+    compacted_count_ = log_.count();
+    compacted_bytes_ = log_bytes_;
+
+    return convert(ret);
+  }
+
+  bool
+  should_snapshot() const
+  {
+    if (last_applied_index_ <= snapshot_last_index_)
+      return false;
+
+    auto const & p = snapshot_policy_;
+
+    return (p.max_entries && compacted_count_ + p.max_entries < log_.count()) ||
+           (p.max_bytes && compacted_bytes_ + p.max_bytes < log_bytes_);
+  }
+
+  static std::size_t
+  entry_bytes(entry_t const & e, std::true_type)
+  {
+    return codec::size(e);
+  }
+
+  static std::size_t
+  entry_bytes(entry_t const &, std::false_type)
+  {
+    return sizeof(entry_t);
+  }
+
+  void
+  adapt_timeouts()
+  {
+    /* election timeout, in retransmission timeouts */
+    unsigned int const election_rto_factor = 10;
+    /* heartbeats sent per election timeout */
+    unsigned int const election_request_ratio = 5;
+
+    if (!adaptive_)
+      return;
+
+    typename node_t::rtt_t rto(0);
+
+    for (auto & it : nodes_)
+    {
+      auto & node = it.second;
+
+      if (node != this_node_ && node->is_active() && node->is_voting() && node->rtt_samples())
+        rto = std::max(rto, node->rto());
+    }
+
+    /* the interval of the current leader, followers do not measure it */
+    auto interval = is_leader() ? 0ms : leader_interval_;
+
+    if (rto == typename node_t::rtt_t(0) && interval == 0ms)
+      return;
+
+    auto clamp = [](auto v, auto const & bounds) {
+      return std::min(std::max(v, bounds.first), bounds.second);
+    };
+
+    /* round up to the millisecond, the resolution of periodic() */
+    auto rto_ms = std::chrono::duration_cast<std::chrono::milliseconds>(rto + 999us);
+
+    auto election = std::max(rto_ms * election_rto_factor, interval * election_request_ratio);
+
+    election_timeout_ = clamp(election, election_bounds_);
+    request_timeout_ = clamp(election_timeout_ / election_request_ratio, request_bounds_);
+  }
+
   void
   randomize_election_timeout()
   {
+    adapt_timeouts();
+
     std::uniform_int_distribution<> dis(0, election_timeout_.count() - 1);
 
-    election_timeout_rand_ = election_timeout_ + std::chrono::milliseconds(dis(gen_));
+    election_timeout_rand_ = election_timeout_ + std::chrono::milliseconds(dis(*gen_));
   }
 
 private:
@@ -529,8 +1465,13 @@ private:
   std::chrono::milliseconds election_timeout_;
   std::chrono::milliseconds election_timeout_rand_;
 
-  std::random_device rd_; // Will be used to obtain a seed for the random number engine
-  std::mt19937 gen_;      // Standard mersenne_twister_engine seeded with rd()
+  bool adaptive_;
+  std::pair<std::chrono::milliseconds, std::chrono::milliseconds> election_bounds_;
+  std::pair<std::chrono::milliseconds, std::chrono::milliseconds> request_bounds_;
+  /* heartbeat interval advertised by the leader */
+  std::chrono::milliseconds leader_interval_;
+
+  std::shared_ptr<generator_t> gen_; // May be shared between servers of a same host
 
   log_t log_;
 
@@ -541,8 +1482,44 @@ private:
   std::shared_ptr<node_t> this_node_;
   std::shared_ptr<node_t> voted_for_;
   std::shared_ptr<node_t> leader_;
+
+  callbacks_t cbs_;
+
+  index_t max_entries_;
+  appendentries_request_t appendentries_;
+  batches_t batches_;
+
+  snapshot::store * snapshots_;
+  std::size_t snapshot_chunk_;
+  snapshot::throttle throttle_;
+  installsnapshot_request_t installsnapshot_;
+
+  snapshot_policy_t snapshot_policy_;
+  index_t snapshot_last_index_;
+  term_t snapshot_last_term_;
+
+  /* log size, and log size after the last compaction */
+  std::size_t log_bytes_;
+  index_t compacted_count_;
+  std::size_t compacted_bytes_;
 };
 
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+constexpr typename server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::index_t
+  server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::default_max_entries;
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+constexpr std::size_t
+  server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::default_snapshot_chunk;
+
 template <typename ostream, typename T>
 ostream &
 operator<<(ostream & os, server<T> const & server)
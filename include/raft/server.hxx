@@ -25,13 +25,7 @@ server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::should_grant_vote(
   if (idx == 0)
     return true;
 
-  std::shared_ptr<entry_t> entry = log_.at(idx);
-  term_t entry_term;
-
-  if (entry)
-    entry_term = entry->term;
-  else // FIXME if snapshot_last_term
-    return false;
+  term_t entry_term = last_log_term();
 
   if (entry_term < req.last_log_term)
     return true;
@@ -123,6 +117,9 @@ status_t
 server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_vote_response(
   std::shared_ptr<node_t> node, vote_response_t const & resp)
 {
+  if (node)
+    node->probe_received(node_t::clock_t::now());
+
   if (!is_candidate())
   {
     return status_t::ok;
@@ -172,4 +169,453 @@ server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_vote_response
   return status_t::ok;
 }
 
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_heartbeat(
+  std::shared_ptr<node_t> node, heartbeat_request_t const & req, heartbeat_response_t & resp)
+{
+  status_t ret = status_t::ok;
+
+  resp.success = false;
+
+  /* Stale leader */
+  if (req.term < current_term())
+    goto end;
+
+  if (current_term() < req.term)
+  {
+    ret = current_term(req.term);
+    if (any(ret))
+      goto end;
+  }
+
+  /* A leader or candidate of the same term steps down */
+  if (!is_follower())
+    become_follower();
+
+  leader_ = node;
+  elapsed_timeout_ = 0ms;
+
+  /* the election timeout must outlast a few heartbeats of this leader */
+  if (req.interval && leader_interval_ != std::chrono::milliseconds(req.interval))
+  {
+    leader_interval_ = std::chrono::milliseconds(req.interval);
+    if (adaptive_)
+      randomize_election_timeout();
+  }
+
+  resp.success = true;
+
+  if (commit_index() < req.leader_commit)
+  {
+    commit_index(std::min(req.leader_commit, current_index()));
+    ret = apply_all();
+  }
+
+end:
+  resp.term = current_term();
+  return ret;
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_heartbeat_response(
+  std::shared_ptr<node_t> node, heartbeat_response_t const & resp)
+{
+  if (node)
+    node->probe_received(node_t::clock_t::now());
+
+  if (!is_leader())
+    return status_t::ok;
+
+  if (current_term() < resp.term)
+  {
+    auto ret = current_term(resp.term);
+    if (any(ret))
+      return ret;
+
+    become_follower();
+    leader_ = nullptr;
+  }
+
+  return status_t::ok;
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_appendentries(
+  std::shared_ptr<node_t> node, appendentries_request_t const & req, appendentries_response_t & resp)
+{
+  return recv_entries(node, req, resp);
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_appendentries(
+  std::shared_ptr<node_t> node, appendentries_view_t const & req, appendentries_response_t & resp)
+{
+  return recv_entries(node, req, resp);
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+template <typename msg_t>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_entries(
+  std::shared_ptr<node_t> const & node, msg_t const & req, appendentries_response_t & resp)
+{
+  status_t ret = status_t::ok;
+
+  resp.success = false;
+  resp.first_idx = 0;
+
+  /* Stale leader */
+  if (req.term < current_term())
+    goto end;
+
+  if (current_term() < req.term)
+  {
+    ret = current_term(req.term);
+    if (any(ret))
+      goto end;
+  }
+
+  /* A leader or candidate of the same term steps down */
+  if (!is_follower())
+    become_follower();
+
+  leader_ = node;
+  elapsed_timeout_ = 0ms;
+
+  /* Our log must contain an entry at prev_log_idx whose term matches,
+   * entries covered by our snapshot are committed and do match */
+  if (log_.base() < req.prev_log_idx)
+  {
+    term_t term;
+
+    if (!term_at(req.prev_log_idx, term))
+      goto end;
+
+    if (term != req.prev_log_term)
+    {
+      /* Committed entries never conflict */
+      assert(commit_index() < req.prev_log_idx);
+
+      truncate(req.prev_log_idx);
+      goto end;
+    }
+  }
+
+  {
+    index_t idx = req.prev_log_idx;
+
+    for (auto & e : req.entries)
+    {
+      ++idx;
+
+      if (idx <= log_.base())
+        continue;
+
+      entry_t const * existing = get(idx);
+      if (existing)
+      {
+        if (existing->term == e.term)
+          continue;
+
+        /* Drop the conflicting entry and all that follow it */
+        assert(commit_index() < idx);
+        truncate(idx);
+      }
+
+      ret = append_received(e);
+      if (any(ret))
+      {
+        /* Report what has been appended so far */
+        resp.current_idx = idx - 1;
+        goto end;
+      }
+    }
+
+    if (!req.entries.empty())
+      resp.first_idx = req.prev_log_idx + 1;
+
+    /* Entries past the last new entry may not be the leader's */
+    index_t point = std::min(req.leader_commit, idx);
+    if (commit_index() < point)
+    {
+      commit_index(point);
+      ret = apply_all();
+    }
+
+    resp.success = true;
+    resp.term = current_term();
+    resp.current_idx = idx;
+    return ret;
+  }
+
+end:
+  resp.term = current_term();
+  if (!resp.success && ret == status_t::ok)
+    resp.current_idx = current_index();
+  return ret;
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_appendentries_response(
+  std::shared_ptr<node_t> node, appendentries_response_t const & resp)
+{
+  if (node == nullptr)
+    return status_t::fail;
+
+  if (!is_leader())
+    return status_t::ok;
+
+  if (current_term() < resp.term)
+  {
+    auto ret = current_term(resp.term);
+    if (any(ret))
+      return ret;
+
+    become_follower();
+    leader_ = nullptr;
+    return status_t::ok;
+  }
+  else if (current_term() != resp.term)
+  {
+    /* Old message */
+    return status_t::ok;
+  }
+
+  if (!resp.success)
+  {
+    /* Stale failure */
+    if (resp.current_idx < node->match_index())
+      return status_t::ok;
+
+    /* Walk back, jumping to the end of the follower log when shorter */
+    index_t next = node->next_index();
+    if (resp.current_idx + 1 < next)
+      node->next_index(resp.current_idx + 1);
+    else if (1 < next)
+      node->next_index(next - 1);
+
+    return send_appendentries(node);
+  }
+
+  if (resp.current_idx <= node->match_index())
+    return status_t::ok;
+
+  node->next_index(resp.current_idx + 1);
+  node->match_index(resp.current_idx);
+
+  /* Only entries of the current term are committed by counting replicas */
+  index_t point = resp.current_idx;
+  term_t term;
+
+  if (commit_index() < point && term_at(point, term) && term == current_term())
+  {
+    unsigned int votes = this_node_->is_voting() ? 1 : 0;
+
+    for (auto & it : nodes_)
+    {
+      auto & n = it.second;
+
+      if (n != this_node_ && n->is_active() && n->is_voting() && point <= n->match_index())
+        ++votes;
+    }
+
+    if (is_majority(num_voting_nodes(), votes))
+    {
+      commit_index(point);
+
+      auto ret = apply_all();
+      if (any(ret))
+        return ret;
+    }
+  }
+
+  /* Keep the follower busy until it catches up */
+  if (node->next_index() <= current_index())
+    return send_appendentries(node);
+
+  return status_t::ok;
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_installsnapshot(
+  std::shared_ptr<node_t> node, installsnapshot_request_t const & req, installsnapshot_response_t & resp)
+{
+  status_t ret = status_t::ok;
+  snapshot::meta_t meta;
+  std::uint64_t next = 0;
+
+  resp.success = false;
+  resp.last_idx = req.last_idx;
+  resp.offset = 0;
+
+  /* Stale leader */
+  if (req.term < current_term())
+    goto end;
+
+  if (current_term() < req.term)
+  {
+    ret = current_term(req.term);
+    if (any(ret))
+      goto end;
+  }
+
+  /* A leader or candidate of the same term steps down */
+  if (!is_follower())
+    become_follower();
+
+  leader_ = node;
+  elapsed_timeout_ = 0ms;
+
+  /* Entries covered by the snapshot are already committed here */
+  if (req.last_idx <= commit_index())
+  {
+    resp.success = true;
+    resp.offset = req.size;
+    goto end;
+  }
+
+  if (snapshots_ == nullptr)
+  {
+    ret = status_t::fail;
+    goto end;
+  }
+
+  meta.index = req.last_idx;
+  meta.term = req.last_term;
+  meta.size = req.size;
+
+  if (any(snapshots_->receive(
+        meta, req.offset, req.data.data(), req.data.size(), req.crc, req.done, next)))
+  {
+    resp.offset = next;
+    goto end;
+  }
+
+  resp.offset = next;
+
+  if (snapshots_->current() == meta)
+  {
+    if (cbs_.install_snapshot)
+    {
+      ret = cbs_.install_snapshot(req.last_idx, req.last_term);
+      if (any(ret))
+        goto end;
+    }
+
+    term_t term;
+
+    if (term_at(req.last_idx, term) && term == req.last_term)
+    {
+      /* The log agrees with the snapshot, entries past it may be kept */
+      ret = compact(req.last_idx);
+      if (any(ret))
+        goto end;
+
+      snapshot_last_index_ = req.last_idx;
+      snapshot_last_term_ = req.last_term;
+      commit_index_ = req.last_idx;
+      last_applied_index_ = req.last_idx;
+    }
+    else
+      load_snapshot(req.last_idx, req.last_term);
+  }
+
+  resp.success = true;
+
+end:
+  resp.term = current_term();
+  return ret;
+}
+
+template <typename T,
+          typename node_user_data_t,
+          typename node_id_t,
+          typename term_t_,
+          typename index_id_t_>
+status_t
+server<T, node_user_data_t, node_id_t, term_t_, index_id_t_>::recv_installsnapshot_response(
+  std::shared_ptr<node_t> node, installsnapshot_response_t const & resp)
+{
+  if (node == nullptr)
+    return status_t::fail;
+
+  if (!is_leader())
+    return status_t::ok;
+
+  if (current_term() < resp.term)
+  {
+    auto ret = current_term(resp.term);
+    if (any(ret))
+      return ret;
+
+    become_follower();
+    leader_ = nullptr;
+    return status_t::ok;
+  }
+  else if (current_term() != resp.term)
+  {
+    /* Old message */
+    return status_t::ok;
+  }
+
+  /* A response about a snapshot since replaced, the next round resends */
+  if (snapshots_ == nullptr || snapshots_->current().index != resp.last_idx)
+    return status_t::ok;
+
+  node->snapshot_offset(resp.offset);
+
+  /* The follower could not take the chunk, retry on the next round */
+  if (!resp.success)
+    return status_t::ok;
+
+  if (resp.offset < snapshots_->current().size)
+    return send_installsnapshot(node);
+
+  /* Installed, replication goes on from the log */
+  node->snapshot_offset(0);
+  if (node->match_index() < resp.last_idx)
+    node->match_index(resp.last_idx);
+  if (node->next_index() <= resp.last_idx)
+    node->next_index(resp.last_idx + 1);
+
+  if (node->next_index() <= current_index())
+    return send_appendentries(node);
+
+  return status_t::ok;
+}
+
 } /** !raft  */
@@ -0,0 +1,845 @@
+#ifndef RAFT_SNAPSHOT_HH_
+#define RAFT_SNAPSHOT_HH_
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raft/traits.hh>
+#include <utils/crc32.hh>
+
+namespace raft
+{
+namespace snapshot
+{
+
+enum class status_t
+{
+  ok = 0,
+  fail = 1,
+  corrupt = 2,
+};
+
+} /** !snapshot  */
+
+template <>
+struct enum_traits<snapshot::status_t>
+{
+  static constexpr bool has_any = true;
+};
+
+namespace snapshot
+{
+
+/**
+ * @brief What a snapshot covers
+ */
+struct meta_t
+{
+  /** index of the last entry covered */
+  std::uint64_t index = 0;
+
+  /** term of the last entry covered */
+  std::uint64_t term = 0;
+
+  /** size in bytes */
+  std::uint64_t size = 0;
+};
+
+inline bool
+operator==(meta_t const & a, meta_t const & b)
+{
+  return a.index == b.index && a.term == b.term && a.size == b.size;
+}
+
+inline bool
+operator!=(meta_t const & a, meta_t const & b)
+{
+  return !(a == b);
+}
+
+/**
+ * @brief Snapshot made of several files, transferred as one
+ *
+ * The stream starts with a header, the magic then the number of parts and
+ * the size of each, in host byte order, followed by the parts back to
+ * back. A store installs such a snapshot from the files themselves, see
+ * store::save_parts(); a follower receives the whole stream as a single
+ * file, split back with extract().
+ */
+class bundle
+{
+public:
+  bundle() : fd_(-1) {}
+
+  bundle(bundle const &) = delete;
+  bundle & operator=(bundle const &) = delete;
+
+  ~bundle()
+  {
+    if (0 <= fd_)
+      ::close(fd_);
+  }
+
+  /**
+   * @brief Encode the header of a bundle of parts of the given sizes
+   */
+  static std::vector<std::uint8_t>
+  header(std::vector<std::uint64_t> const & sizes)
+  {
+    std::vector<std::uint8_t> h(16 + 8 * sizes.size());
+    std::uint64_t count = sizes.size();
+
+    std::memcpy(h.data(), magic(), 8);
+    std::memcpy(h.data() + 8, &count, 8);
+    if (!sizes.empty())
+      std::memcpy(h.data() + 16, sizes.data(), 8 * sizes.size());
+
+    return h;
+  }
+
+  /**
+   * @brief Open a bundle received as a snapshot
+   *
+   * @return false if it cannot be read, is not a bundle, or is truncated
+   */
+  bool
+  open(std::string const & path)
+  {
+    if (0 <= fd_)
+      ::close(fd_);
+
+    sizes_.clear();
+    offsets_.clear();
+
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+      return false;
+
+    struct stat st;
+    char m[ 8 ];
+    std::uint64_t count = 0;
+
+    if (fstat(fd_, &st) < 0 || !read_at(fd_, m, 8, 0) || std::memcmp(m, magic(), 8) != 0 ||
+        !read_at(fd_, &count, 8, 8) || (std::uint64_t(st.st_size) - 16) / 8 < count)
+      return false;
+
+    sizes_.resize(std::size_t(count));
+    if (count && !read_at(fd_, sizes_.data(), 8 * sizes_.size(), 16))
+      return false;
+
+    std::uint64_t off = 16 + 8 * count;
+    for (auto size : sizes_)
+    {
+      offsets_.push_back(off);
+      off += size;
+    }
+
+    return off == std::uint64_t(st.st_size);
+  }
+
+  /**
+   * @brief Get the number of parts
+   */
+  std::size_t
+  size() const noexcept
+  {
+    return offsets_.size();
+  }
+
+  /**
+   * @brief Copy part i to a file, synced
+   *
+   * @return false on error
+   */
+  bool
+  extract(std::size_t i, std::string const & path) const
+  {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+
+    std::vector<std::uint8_t> buf(1 << 20);
+    std::uint64_t done = 0;
+    bool ok = true;
+
+    while (ok && done < sizes_[ i ])
+    {
+      auto len = std::size_t(std::min<std::uint64_t>(buf.size(), sizes_[ i ] - done));
+
+      ok = read_at(fd_, buf.data(), len, offsets_[ i ] + done) && write_at(fd, buf.data(), len, done);
+      done += len;
+    }
+
+    ok = ok && fdatasync(fd) == 0;
+    ::close(fd);
+
+    if (!ok)
+      unlink(path.c_str());
+
+    return ok;
+  }
+
+private:
+  static char const *
+  magic() noexcept
+  {
+    return "RAFTBND1";
+  }
+
+  static bool
+  read_at(int fd, void * buf, std::size_t len, std::uint64_t offset)
+  {
+    std::size_t done = 0;
+
+    while (done < len)
+    {
+      ssize_t n = pread(fd, static_cast<std::uint8_t *>(buf) + done, len - done, off_t(offset + done));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+
+      done += std::size_t(n);
+    }
+
+    return true;
+  }
+
+  static bool
+  write_at(int fd, void const * buf, std::size_t len, std::uint64_t offset)
+  {
+    std::size_t done = 0;
+
+    while (done < len)
+    {
+      ssize_t n = pwrite(fd, static_cast<std::uint8_t const *>(buf) + done, len - done, off_t(offset + done));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+
+      done += std::size_t(n);
+    }
+
+    return true;
+  }
+
+private:
+  int fd_;
+  std::vector<std::uint64_t> sizes_;
+  std::vector<std::uint64_t> offsets_;
+};
+
+/**
+ * @brief Snapshots of the state machine, kept as files of a directory
+ *
+ * The installed snapshot is named after the index and term of the last
+ * entry it covers. Snapshots being saved or received are written to a
+ * temporary file, synced, then renamed over: a crash leaves either the
+ * previous snapshot or the new one, never part of one.
+ *
+ * A snapshot is received chunk by chunk, each one checked against its
+ * CRC-32C and written in place. A chunk that does not start where the
+ * previous one ended is answered with the offset expected, so that the
+ * sender resumes from there after a lost message or a reconnection.
+ *
+ * A snapshot can also be installed from existing files, such as the base
+ * and delta images of a store::chain, which are then linked next to it as
+ * its parts and sent as a bundle.
+ */
+class store
+{
+public:
+  explicit store(std::string path) : path_(std::move(path)), tmp_fd_(-1), received_(0) {}
+
+  store(store const &) = delete;
+  store & operator=(store const &) = delete;
+
+  ~store()
+  {
+    close_segments();
+    abort_receive();
+  }
+
+public:
+  /**
+   * @brief Create the directory if needed and find the installed snapshot
+   *
+   * Leftovers of interrupted saves and transfers are removed.
+   */
+  status_t
+  open()
+  {
+    if (mkdir(path_.c_str(), 0755) < 0 && errno != EEXIST)
+      return status_t::fail;
+
+    DIR * dir = opendir(path_.c_str());
+    if (dir == nullptr)
+      return status_t::fail;
+
+    meta_t best;
+    std::vector<std::string> stale;
+    std::vector<std::string> parts;
+
+    while (struct dirent * e = readdir(dir))
+    {
+      std::string name = e->d_name;
+      meta_t m;
+
+      if (parse(name, m))
+      {
+        if (best.index < m.index || best.term == 0)
+        {
+          if (best.term != 0)
+            stale.push_back(file(best));
+          best = m;
+        }
+        else
+          stale.push_back(path_ + "/" + name);
+      }
+      else if (parse(name.substr(0, 38), m) && name.size() > 39 && name[ 38 ] == '.')
+        parts.push_back(name);
+      else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+        stale.push_back(path_ + "/" + name);
+    }
+
+    closedir(dir);
+
+    for (auto const & p : parts)
+      if (best.term == 0 || p.compare(0, 38, name(best)) != 0)
+        stale.push_back(path_ + "/" + p);
+
+    for (auto const & p : stale)
+      unlink(p.c_str());
+
+    if (best.term == 0)
+      return status_t::ok;
+
+    return use(best);
+  }
+
+  /**
+   * @brief Get the installed snapshot, with a zero term if there is none
+   */
+  meta_t const &
+  current() const noexcept
+  {
+    return current_;
+  }
+
+  /**
+   * @brief Get path of the installed snapshot, empty if there is none
+   */
+  std::string
+  file() const
+  {
+    return current_.term == 0 ? std::string() : file(current_);
+  }
+
+  /**
+   * @brief Save and install a snapshot of the local state machine
+   *
+   * @tparam F Callback function type (int fd) -> bool
+   * @param f Callback writing the state machine to a file descriptor
+   */
+  template <typename F>
+  status_t
+  save(std::uint64_t index, std::uint64_t term, F && f)
+  {
+    std::string tmp = path_ + "/save.tmp";
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return status_t::fail;
+
+    struct stat st;
+    if (!f(fd) || fstat(fd, &st) < 0)
+    {
+      ::close(fd);
+      unlink(tmp.c_str());
+      return status_t::fail;
+    }
+
+    meta_t meta;
+    meta.index = index;
+    meta.term = term;
+    meta.size = std::uint64_t(st.st_size);
+
+    return install(fd, tmp, meta);
+  }
+
+  /**
+   * @brief Install a snapshot made of existing files, sent as a bundle
+   *
+   * The files are hard linked, not copied: saving costs a small header
+   * whatever their size. They must be on the file system of the directory,
+   * and must not be modified afterwards, only unlinked.
+   */
+  status_t
+  save_parts(std::uint64_t index, std::uint64_t term, std::vector<std::string> const & parts)
+  {
+    meta_t meta;
+    meta.index = index;
+    meta.term = term;
+
+    std::vector<std::uint64_t> sizes;
+
+    for (auto const & p : parts)
+    {
+      struct stat st;
+      if (stat(p.c_str(), &st) < 0)
+        return status_t::fail;
+
+      sizes.push_back(std::uint64_t(st.st_size));
+    }
+
+    std::string target = file(meta);
+    unlink_parts(target);
+
+    for (std::size_t i = 0; i < parts.size(); ++i)
+    {
+      if (link(parts[ i ].c_str(), part(target, i).c_str()) < 0)
+      {
+        unlink_parts(target);
+        return status_t::fail;
+      }
+    }
+
+    auto header = bundle::header(sizes);
+    std::string tmp = path_ + "/save.tmp";
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !write(fd, header.data(), header.size(), 0))
+    {
+      if (0 <= fd)
+        ::close(fd);
+      unlink(tmp.c_str());
+      unlink_parts(target);
+      return status_t::fail;
+    }
+
+    return install(fd, tmp, meta);
+  }
+
+  /**
+   * @brief Read part of the installed snapshot, a bundle of its parts if it
+   * has some
+   *
+   * @return the number of bytes read, short at the end of the snapshot or
+   * on error
+   */
+  std::size_t
+  read(std::uint64_t offset, void * buf, std::size_t len) const
+  {
+    std::size_t done = 0;
+
+    for (auto const & s : segments_)
+    {
+      std::uint64_t at = offset + done;
+
+      if (done == len)
+        break;
+      if (s.offset + s.size <= at)
+        continue;
+
+      auto want = std::size_t(std::min<std::uint64_t>(len - done, s.offset + s.size - at));
+      std::size_t n = read(s.fd, static_cast<std::uint8_t *>(buf) + done, want, at - s.offset);
+
+      done += n;
+      if (n < want)
+        break;
+    }
+
+    return done;
+  }
+
+  /**
+   * @brief Receive a chunk of a snapshot sent by the leader
+   *
+   * The snapshot is installed once its last chunk is received, and
+   * current() then returns meta.
+   *
+   * @param meta Snapshot being transferred
+   * @param offset Chunk offset within the snapshot
+   * @param data Chunk data
+   * @param len Chunk length
+   * @param crc CRC-32C of the chunk
+   * @param done True for the last chunk
+   * @param next Offset of the next chunk expected, meta.size once installed
+   *
+   * @return corrupt if the chunk does not match its checksum or the
+   * snapshot size, fail on I/O error
+   */
+  status_t
+  receive(meta_t const & meta,
+          std::uint64_t offset,
+          void const * data,
+          std::size_t len,
+          std::uint32_t crc,
+          bool done,
+          std::uint64_t & next)
+  {
+    if (meta == current_)
+    {
+      next = meta.size;
+      return status_t::ok;
+    }
+
+    /* a new transfer replaces the one in progress */
+    if (tmp_fd_ < 0 || meta != receiving_)
+    {
+      abort_receive();
+
+      tmp_fd_ = ::open(receive_file().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (tmp_fd_ < 0)
+      {
+        next = 0;
+        return status_t::fail;
+      }
+
+      receiving_ = meta;
+      received_ = 0;
+    }
+
+    next = received_;
+
+    /* duplicate or out of order, tell where to resume */
+    if (offset != received_)
+      return status_t::ok;
+
+    if (utils::crc32(data, len) != crc || meta.size - received_ < len)
+      return status_t::corrupt;
+
+    if (!write(tmp_fd_, data, len, offset))
+    {
+      abort_receive();
+      next = 0;
+      return status_t::fail;
+    }
+
+    received_ += len;
+    next = received_;
+
+    if (!done)
+      return status_t::ok;
+
+    if (received_ != meta.size)
+    {
+      abort_receive();
+      next = 0;
+      return status_t::corrupt;
+    }
+
+    int fd = tmp_fd_;
+    tmp_fd_ = -1;
+    receiving_ = meta_t();
+    received_ = 0;
+
+    status_t ret = install(fd, receive_file(), meta);
+    next = any(ret) ? 0 : meta.size;
+
+    return ret;
+  }
+
+  /**
+   * @brief Get number of bytes received of the snapshot being transferred
+   */
+  std::uint64_t
+  received() const noexcept
+  {
+    return received_;
+  }
+
+private:
+  struct segment_t
+  {
+    int fd;
+    /* within the snapshot */
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  static std::string
+  name(meta_t const & m)
+  {
+    char name[ 64 ];
+
+    std::snprintf(name, sizeof(name), "%016" PRIx64 "-%016" PRIx64 ".snap", m.index, m.term);
+    return name;
+  }
+
+  std::string
+  file(meta_t const & m) const
+  {
+    return path_ + "/" + name(m);
+  }
+
+  static std::string
+  part(std::string const & file, std::size_t i)
+  {
+    return file + "." + std::to_string(i);
+  }
+
+  static void
+  unlink_parts(std::string const & file)
+  {
+    for (std::size_t i = 0; unlink(part(file, i).c_str()) == 0; ++i)
+      ;
+  }
+
+  std::string
+  receive_file() const
+  {
+    return path_ + "/receive.tmp";
+  }
+
+  static bool
+  parse(std::string const & name, meta_t & m)
+  {
+    char tail[ 8 ] = {0};
+
+    return name.size() == 38 &&
+           std::sscanf(name.c_str(), "%16" SCNx64 "-%16" SCNx64 "%5s", &m.index, &m.term, tail) == 3 &&
+           std::string(tail) == ".snap" && m.term != 0;
+  }
+
+  static bool
+  write(int fd, void const * data, std::size_t len, std::uint64_t offset)
+  {
+    std::size_t written = 0;
+
+    while (written < len)
+    {
+      ssize_t n = pwrite(
+        fd, static_cast<std::uint8_t const *>(data) + written, len - written, off_t(offset + written));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+
+      written += std::size_t(n);
+    }
+
+    return true;
+  }
+
+  static std::size_t
+  read(int fd, void * buf, std::size_t len, std::uint64_t offset)
+  {
+    std::size_t done = 0;
+
+    while (done < len)
+    {
+      ssize_t n = pread(fd, static_cast<std::uint8_t *>(buf) + done, len - done, off_t(offset + done));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+
+      done += std::size_t(n);
+    }
+
+    return done;
+  }
+
+  /**
+   * @brief Make a temporary file the installed snapshot
+   *
+   * The file is synced before being renamed, and the directory after.
+   */
+  status_t
+  install(int fd, std::string const & tmp, meta_t const & meta)
+  {
+    int ret = fdatasync(fd);
+    ::close(fd);
+
+    if (ret < 0 || rename(tmp.c_str(), file(meta).c_str()) < 0)
+    {
+      unlink(tmp.c_str());
+      return status_t::fail;
+    }
+
+    int dir = ::open(path_.c_str(), O_RDONLY | O_DIRECTORY);
+    if (0 <= dir)
+    {
+      fsync(dir);
+      ::close(dir);
+    }
+
+    std::string previous = file();
+    if (!previous.empty() && previous != file(meta))
+    {
+      unlink(previous.c_str());
+      unlink_parts(previous);
+    }
+
+    return use(meta);
+  }
+
+  /**
+   * @brief Open the snapshot, and its parts if it has some
+   */
+  status_t
+  use(meta_t meta)
+  {
+    close_segments();
+    current_ = meta_t();
+
+    std::string target = file(meta);
+    std::vector<std::uint64_t> sizes;
+
+    meta.size = 0;
+    for (std::size_t i = 0;; ++i)
+    {
+      int fd = ::open(i == 0 ? target.c_str() : part(target, i - 1).c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        if (i == 0)
+          return status_t::fail;
+        break;
+      }
+
+      struct stat st;
+      if (fstat(fd, &st) < 0)
+      {
+        ::close(fd);
+        return status_t::fail;
+      }
+
+      segments_.push_back({fd, meta.size, std::uint64_t(st.st_size)});
+      meta.size += std::uint64_t(st.st_size);
+
+      if (i)
+        sizes.push_back(std::uint64_t(st.st_size));
+    }
+
+    /* the header must describe the parts found */
+    if (1 < segments_.size())
+    {
+      auto header = bundle::header(sizes);
+      std::vector<std::uint8_t> found(header.size());
+
+      if (segments_[ 0 ].size != header.size() ||
+          read(segments_[ 0 ].fd, found.data(), found.size(), 0) != found.size() || found != header)
+      {
+        close_segments();
+        return status_t::corrupt;
+      }
+    }
+
+    current_ = meta;
+    return status_t::ok;
+  }
+
+  void
+  close_segments()
+  {
+    for (auto const & s : segments_)
+      ::close(s.fd);
+
+    segments_.clear();
+  }
+
+  void
+  abort_receive()
+  {
+    if (tmp_fd_ < 0)
+      return;
+
+    ::close(tmp_fd_);
+    unlink(receive_file().c_str());
+
+    tmp_fd_ = -1;
+    receiving_ = meta_t();
+    received_ = 0;
+  }
+
+private:
+  std::string path_;
+
+  /* installed snapshot, then its parts if any */
+  meta_t current_;
+  std::vector<segment_t> segments_;
+
+  /* snapshot being received */
+  meta_t receiving_;
+  int tmp_fd_;
+  std::uint64_t received_;
+};
+
+/**
+ * @brief Token bucket bounding the bandwidth used by snapshot transfers
+ *
+ * Chunks are let through while tokens are left, the last one possibly
+ * running the bucket into debt, so that chunks larger than the bucket go
+ * through at the set rate as well. Tokens are refilled as time is given to
+ * the server. A zero rate is unlimited.
+ */
+class throttle
+{
+public:
+  throttle() : rate_(0), burst_(0), tokens_(0) {}
+
+  void
+  rate(std::uint64_t bytes_per_second, std::uint64_t burst)
+  {
+    rate_ = bytes_per_second;
+    burst_ = std::int64_t(burst);
+    tokens_ = burst_;
+  }
+
+  std::uint64_t
+  rate() const noexcept
+  {
+    return rate_;
+  }
+
+  void
+  refill(std::chrono::milliseconds elapsed)
+  {
+    if (rate_ == 0 || elapsed.count() <= 0)
+      return;
+
+    auto tokens = std::int64_t(rate_ * std::uint64_t(elapsed.count()) / 1000);
+    tokens_ = std::min(burst_, tokens_ + tokens);
+  }
+
+  bool
+  take(std::size_t n)
+  {
+    if (rate_ == 0)
+      return true;
+
+    if (tokens_ <= 0)
+      return false;
+
+    tokens_ -= std::int64_t(n);
+    return true;
+  }
+
+private:
+  std::uint64_t rate_;
+  std::int64_t burst_;
+  std::int64_t tokens_;
+};
+
+} /** !snapshot  */
+} /** !raft  */
+
+#endif /** !RAFT_SNAPSHOT_HH_  */
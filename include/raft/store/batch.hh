@@ -0,0 +1,97 @@
+#ifndef RAFT_STORE_BATCH_HH_
+#define RAFT_STORE_BATCH_HH_
+
+#include <cstddef>
+#include <vector>
+
+namespace raft
+{
+namespace store
+{
+
+/**
+ * @brief Mutations applied to a store all at once
+ *
+ * A batch collects the mutations of a range of committed log entries. The
+ * store applies them atomically along with the index of the last entry,
+ * so that on restart the log is only replayed past that index.
+ */
+template <typename Key, typename Value>
+class write_batch
+{
+public:
+  enum class op_t
+  {
+    put = 0,
+    del = 1,
+  };
+
+  struct mutation_t
+  {
+    op_t op;
+    Key key;
+    Value value;
+  };
+
+  using const_iterator = typename std::vector<mutation_t>::const_iterator;
+
+public:
+  /**
+   * @brief Create or update a key
+   */
+  void
+  put(Key const & k, Value const & v)
+  {
+    mutations_.push_back({op_t::put, k, v});
+  }
+
+  /**
+   * @brief Delete a key
+   */
+  void
+  del(Key const & k)
+  {
+    mutations_.push_back({op_t::del, k, Value()});
+  }
+
+  std::size_t
+  size() const noexcept
+  {
+    return mutations_.size();
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return mutations_.empty();
+  }
+
+  /**
+   * @brief Forget the mutations, keeping the memory for the next batch
+   */
+  void
+  clear() noexcept
+  {
+    mutations_.clear();
+  }
+
+  const_iterator
+  begin() const noexcept
+  {
+    return mutations_.begin();
+  }
+
+  const_iterator
+  end() const noexcept
+  {
+    return mutations_.end();
+  }
+
+private:
+  std::vector<mutation_t> mutations_;
+};
+
+} /** !store  */
+} /** !raft  */
+
+#endif /** !RAFT_STORE_BATCH_HH_  */
@@ -0,0 +1,388 @@
+#ifndef RAFT_STORE_CHAIN_HH_
+#define RAFT_STORE_CHAIN_HH_
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raft/snapshot.hh>
+#include <raft/store/mapped.hh>
+
+namespace raft
+{
+namespace store
+{
+
+struct chain_options_t
+{
+  /** directory holding the base and delta images */
+  std::string path = "/tmp/raft-chain";
+  /** consolidate into a new base past this many deltas, 0 never */
+  std::size_t max_deltas = 16;
+  /** consolidate once the deltas add up to this fraction of the base, 0 never */
+  double consolidate_ratio = 0.5;
+};
+
+/**
+ * @brief Snapshots of a store::mapped as a base image and a chain of deltas
+ *
+ * The first snapshot is a full image of the store, the base. The next
+ * ones are deltas holding only the keys changed since the previous
+ * snapshot, so that their cost follows the writes rather than the size of
+ * the store. Once the deltas are too many, or too large compared to the
+ * base, the next snapshot consolidates everything into a new base and the
+ * chain starts over. Files are named after the applied index they end at.
+ *
+ * files() lists the base then the deltas, in order: installed with
+ * snapshot::store::save_parts(), they are sent to followers as a bundle
+ * which install() splits back into a chain.
+ */
+template <typename Key, typename Value>
+class chain
+{
+public:
+  using store_t = mapped<Key, Value>;
+
+private:
+  struct file_t
+  {
+    std::uint64_t index;
+    std::uint64_t size;
+  };
+
+public:
+  explicit chain(chain_options_t options) : options_(std::move(options)), base_{0, 0} {}
+
+public:
+  /**
+   * @brief Create the directory if needed and find the latest chain
+   *
+   * Older bases and deltas, and leftovers of interrupted writes, are
+   * removed.
+   *
+   * @return false on error
+   */
+  bool
+  open()
+  {
+    if (mkdir(options_.path.c_str(), 0755) < 0 && errno != EEXIST)
+      return false;
+
+    DIR * dir = opendir(options_.path.c_str());
+    if (dir == nullptr)
+      return false;
+
+    std::vector<file_t> bases;
+    std::vector<file_t> deltas;
+    std::vector<std::string> stale;
+
+    while (struct dirent * e = readdir(dir))
+    {
+      std::string name = e->d_name;
+      file_t f{0, 0};
+      bool delta = false;
+
+      if (parse(name, f, delta))
+        (delta ? deltas : bases).push_back(f);
+      else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+        stale.push_back(options_.path + "/" + name);
+    }
+
+    closedir(dir);
+
+    auto by_index = [](file_t const & a, file_t const & b) { return a.index < b.index; };
+    std::sort(bases.begin(), bases.end(), by_index);
+    std::sort(deltas.begin(), deltas.end(), by_index);
+
+    base_ = {0, 0};
+    deltas_.clear();
+
+    if (!bases.empty())
+    {
+      base_ = bases.back();
+      bases.pop_back();
+    }
+
+    for (auto const & f : bases)
+      stale.push_back(file(f.index, false));
+
+    for (auto const & f : deltas)
+    {
+      if (base_.size && base_.index < f.index)
+        deltas_.push_back(f);
+      else
+        stale.push_back(file(f.index, true));
+    }
+
+    for (auto const & p : stale)
+      unlink(p.c_str());
+
+    return true;
+  }
+
+  /**
+   * @brief Restart a store from the base and its deltas
+   *
+   * @return false if a file cannot be read
+   */
+  bool
+  load(store_t & store) const
+  {
+    if (base_.size == 0)
+    {
+      store = store_t();
+      return true;
+    }
+
+    store = store_t(file(base_.index, false));
+    if (!store.ok())
+      return false;
+
+    for (auto const & f : deltas_)
+      if (!store.load_delta(file(f.index, true)))
+        return false;
+
+    return true;
+  }
+
+  /**
+   * @brief Snapshot the store, as a delta or a new base by policy
+   *
+   * @return false on error
+   */
+  bool
+  snapshot(store_t & store)
+  {
+    std::uint64_t index = store.applied_index();
+
+    if (index == last_index() && base_.size && store.changed() == 0)
+      return true;
+
+    /* a delta is named after its index, it cannot share it */
+    if (should_consolidate() || index == last_index())
+      return consolidate(store);
+
+    std::string path = file(index, true);
+
+    if (!store.save_delta(path))
+      return false;
+
+    deltas_.push_back({index, file_size(path)});
+    return true;
+  }
+
+  /**
+   * @brief Write the store as a new base and drop the previous chain
+   *
+   * @return false on error
+   */
+  bool
+  consolidate(store_t & store)
+  {
+    std::uint64_t index = store.applied_index();
+    std::string path = file(index, false);
+
+    if (!store.rebase(path))
+      return false;
+
+    std::vector<std::string> previous = files();
+    base_ = {index, file_size(path)};
+    deltas_.clear();
+
+    for (auto const & p : previous)
+      if (p != path)
+        unlink(p.c_str());
+
+    return true;
+  }
+
+  /**
+   * @brief Replace the chain by one received as a bundle
+   *
+   * The bundle, as installed in the snapshot store, stays there until the
+   * next snapshot: this can be tried again after a failure.
+   *
+   * @return false if the bundle is not a chain or on error
+   */
+  bool
+  install(std::string const & path)
+  {
+    snapshot::bundle b;
+    if (!b.open(path) || b.size() == 0)
+      return false;
+
+    std::vector<std::string> tmp;
+    std::vector<std::string> target;
+
+    for (std::size_t i = 0; i < b.size(); ++i)
+    {
+      tmp.push_back(options_.path + "/part-" + std::to_string(i) + ".tmp");
+
+      std::uint64_t index = 0;
+      bool ok = b.extract(i, tmp.back());
+
+      if (ok && i == 0)
+      {
+        image<Key, Value> img;
+        ok = img.open(tmp.back());
+        index = img.applied_index();
+      }
+      else if (ok)
+      {
+        typename store_t::delta_t img;
+        ok = img.open(tmp.back());
+        index = img.applied_index();
+      }
+
+      if (!ok)
+      {
+        for (auto const & p : tmp)
+          unlink(p.c_str());
+        return false;
+      }
+
+      target.push_back(file(index, i != 0));
+    }
+
+    for (auto const & p : files())
+      unlink(p.c_str());
+
+    for (std::size_t i = 0; i < tmp.size(); ++i)
+      if (rename(tmp[ i ].c_str(), target[ i ].c_str()) < 0)
+        return false;
+
+    int dir = ::open(options_.path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (0 <= dir)
+    {
+      fsync(dir);
+      ::close(dir);
+    }
+
+    return open();
+  }
+
+  /**
+   * @brief Get the paths of the base then the deltas, empty if there is no
+   * base yet
+   */
+  std::vector<std::string>
+  files() const
+  {
+    std::vector<std::string> paths;
+
+    if (base_.size == 0)
+      return paths;
+
+    paths.push_back(file(base_.index, false));
+    for (auto const & f : deltas_)
+      paths.push_back(file(f.index, true));
+
+    return paths;
+  }
+
+  /**
+   * @brief Get the applied index of the last base or delta
+   */
+  std::uint64_t
+  last_index() const noexcept
+  {
+    return deltas_.empty() ? base_.index : deltas_.back().index;
+  }
+
+  std::size_t
+  deltas() const noexcept
+  {
+    return deltas_.size();
+  }
+
+  /**
+   * @brief Get the size in bytes of the base
+   */
+  std::uint64_t
+  base_size() const noexcept
+  {
+    return base_.size;
+  }
+
+  /**
+   * @brief Get the size in bytes of the deltas
+   */
+  std::uint64_t
+  deltas_size() const noexcept
+  {
+    std::uint64_t size = 0;
+
+    for (auto const & f : deltas_)
+      size += f.size;
+
+    return size;
+  }
+
+private:
+  bool
+  should_consolidate() const noexcept
+  {
+    if (base_.size == 0)
+      return true;
+
+    if (options_.max_deltas && options_.max_deltas <= deltas_.size())
+      return true;
+
+    return options_.consolidate_ratio > 0 && options_.consolidate_ratio * double(base_.size) <= double(deltas_size());
+  }
+
+  std::string
+  file(std::uint64_t index, bool delta) const
+  {
+    char name[ 32 ];
+
+    std::snprintf(name, sizeof(name), "%016" PRIx64 "%s", index, delta ? ".delta" : ".base");
+    return options_.path + "/" + name;
+  }
+
+  bool
+  parse(std::string const & name, file_t & f, bool & delta) const
+  {
+    char tail[ 8 ] = {0};
+
+    if (std::sscanf(name.c_str(), "%16" SCNx64 "%6s", &f.index, tail) != 2 || name.size() != 16 + std::strlen(tail))
+      return false;
+
+    delta = std::string(tail) == ".delta";
+    if (!delta && std::string(tail) != ".base")
+      return false;
+
+    f.size = file_size(options_.path + "/" + name);
+    return f.size != 0;
+  }
+
+  static std::uint64_t
+  file_size(std::string const & path)
+  {
+    struct stat st;
+    return stat(path.c_str(), &st) < 0 ? 0 : std::uint64_t(st.st_size);
+  }
+
+private:
+  chain_options_t options_;
+
+  file_t base_;
+  /* in order, each after the previous one */
+  std::vector<file_t> deltas_;
+};
+
+} /** !store  */
+} /** !raft  */
+
+#endif /** !RAFT_STORE_CHAIN_HH_  */
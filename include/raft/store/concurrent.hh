@@ -0,0 +1,184 @@
+#ifndef RAFT_STORE_CONCURRENT_HH_
+#define RAFT_STORE_CONCURRENT_HH_
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <raft/store/batch.hh>
+#include <utils/pmap.hh>
+#include <utils/rcu.hh>
+
+namespace raft
+{
+namespace store
+{
+
+/**
+ * @brief In memory key value store read by many threads while one applies
+ *
+ * The applying thread modifies its own map, then publishes an immutable
+ * copy of it through utils::rcu. With utils::pmap, the default, a copy is
+ * O(1) and only the path to each modified key is copied afterwards, so
+ * publishing after every mutation is cheap; apply() publishes once per
+ * batch. Readers see the version published last, without locking and
+ * without ever blocking the applying thread.
+ *
+ * c/r/u/d, apply() and applied_index() are for the applying thread. Other
+ * threads read through a reader, one per thread.
+ */
+template <typename Key, typename Value, typename Map = utils::pmap<Key, Value>>
+class concurrent
+{
+public:
+  using map_t = Map;
+  using batch_t = write_batch<Key, Value>;
+
+  /**
+   * @brief A version of the store
+   */
+  struct version_t
+  {
+    Map map;
+    std::uint64_t applied_index;
+  };
+
+  /**
+   * @brief Read access for a thread
+   */
+  class reader
+  {
+  public:
+    /**
+     * @brief Read Key
+     *
+     * @throw std::out_of_range if not found
+     */
+    Value
+    r(Key const & k)
+    {
+      return reader_.read([&k](version_t const & v) { return v.map.at(k); });
+    }
+
+    /**
+     * @brief Call f with a consistent version of the store, valid until f
+     * returns
+     */
+    template <typename F>
+    auto
+    read(F && f) -> decltype(f(std::declval<version_t const &>()))
+    {
+      return reader_.read(std::forward<F>(f));
+    }
+
+  private:
+    friend class concurrent;
+
+    explicit reader(typename utils::rcu<version_t>::reader && r) : reader_(std::move(r)) {}
+
+  private:
+    typename utils::rcu<version_t>::reader reader_;
+  };
+
+public:
+  /**
+   * @param readers Maximum number of reader threads
+   */
+  explicit concurrent(std::size_t readers = 64)
+    : applied_(0), published_(std::unique_ptr<version_t const>(new version_t{Map(), 0}), readers)
+  {
+  }
+
+public:
+  bool
+  c(Key const & k, Value const & v)
+  {
+    _map.insert(std::make_pair(Key(k), Value(v)));
+    publish();
+    return true;
+  }
+
+  Value
+  r(Key const & k) const
+  {
+    return _map.at(k);
+  }
+
+  bool
+  u(Key const & k, Value const & v)
+  {
+    _map[ k ] = Value(v);
+    publish();
+    return true;
+  }
+
+  void
+  d(Key const & k)
+  {
+    if (_map.erase(k))
+      publish();
+  }
+
+  /**
+   * @brief Apply a batch of mutations, the last of them from log entry
+   * index, and publish them at once
+   */
+  bool
+  apply(batch_t const & batch, std::uint64_t index)
+  {
+    for (auto const & m : batch)
+    {
+      if (m.op == batch_t::op_t::put)
+        _map[ m.key ] = m.value;
+      else
+        _map.erase(m.key);
+    }
+
+    applied_ = index;
+    publish();
+    return true;
+  }
+
+  std::uint64_t
+  applied_index() const noexcept
+  {
+    return applied_;
+  }
+
+  /**
+   * @brief Get read access for the calling thread
+   *
+   * @throw std::runtime_error if there are too many readers already
+   */
+  reader
+  make_reader()
+  {
+    return reader(published_.make_reader());
+  }
+
+  /**
+   * @brief Get the number of published versions still held by readers
+   */
+  std::size_t
+  retired() const noexcept
+  {
+    return published_.retired();
+  }
+
+private:
+  void
+  publish()
+  {
+    published_.publish(std::unique_ptr<version_t const>(new version_t{_map, applied_}));
+  }
+
+private:
+  Map _map;
+  std::uint64_t applied_;
+  utils::rcu<version_t> published_;
+};
+
+} /** !store  */
+} /** !raft  */
+
+#endif /** !RAFT_STORE_CONCURRENT_HH_  */
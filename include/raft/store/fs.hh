@@ -1,22 +1,148 @@
 #ifndef FS_HH_
 #define FS_HH_
 
-#include <exception>
-#include <experimental/filesystem>
-#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raft/codec.hh>
+#include <raft/store/batch.hh>
+#include <utils/btree.hh>
+#include <utils/crc32.hh>
 
 namespace raft
 {
 namespace store
 {
 
-namespace fs = std::experimental::filesystem;
+struct options_t
+{
+  /** directory holding the data files */
+  std::string path = "/tmp/raft-store";
+  /** size past which a new data file is started */
+  std::size_t file_size = 64 << 20;
+  /** fdatasync after every mutation */
+  bool sync = true;
+  /** needs_merge() once this fraction of the data files is dead records, 0 never */
+  double merge_ratio = 0.5;
+  /** do not merge data files smaller than this */
+  std::size_t merge_min = 16 << 20;
+};
 
+namespace detail
+{
+
+/**
+ * @brief Tell whether keys can be ordered with operator<
+ */
+template <typename Key, typename = void>
+struct is_ordered : std::false_type
+{
+};
+
+template <typename Key>
+struct is_ordered<Key, decltype(void(std::declval<Key const &>() < std::declval<Key const &>()))>
+  : std::true_type
+{
+};
+
+/**
+ * @brief No ordered index, for keys without operator<
+ */
+struct no_order_t
+{
+};
+
+} /** !detail  */
+
+/**
+ * @brief Log-structured key value store
+ *
+ * Mutations are appended to a data file, and an in memory hash index maps
+ * each key to its latest record. A read is a single pread. Data files are
+ * numbered, a new one is started once the current one is full.
+ *
+ * Overwritten and deleted keys leave dead records behind. Merging copies
+ * the live records into a new data file along with a hint file listing
+ * the key and location of each record, then removes the older files. On
+ * startup, merged files are indexed from their hint file, the others are
+ * scanned and cut at the first torn record. Mutations never merge: the
+ * owner calls merge() when needs_merge() tells, off the write path.
+ *
+ * A write batch is appended as a single write: a batch record holding
+ * the number of mutations and the index of the last log entry they come
+ * from, followed by the mutation records. A batch whose records are not
+ * all found on startup is cut as a whole, so that the applied index
+ * restored along with the index always matches the data.
+ *
+ * Keys ordered with operator< are also held in a utils::btree, along with
+ * the hash index, for range and prefix scans in key order.
+ *
+ * Keys and values are stored through codec::traits.
+ */
 template <typename Key, typename Value>
 class filesystem
 {
 public:
-  filesystem() : _base_path("/tmp") {}
+  /** record header: body length, checksum */
+  static constexpr std::size_t header_size = 8;
+
+  /** bytes of a data file read at once when merging */
+  static constexpr std::size_t merge_chunk = 1 << 20;
+
+  using batch_t = write_batch<Key, Value>;
+
+private:
+  using ordered_t = typename std::conditional<detail::is_ordered<Key>::value,
+                                              utils::btree<Key, std::string>,
+                                              detail::no_order_t>::type;
+
+public:
+  filesystem() : filesystem(options_t()) {}
+
+  explicit filesystem(std::string const & path) : filesystem(make_options(path)) {}
+
+  explicit filesystem(options_t const & options)
+    : options_(options), active_(0), active_fd_(-1), active_size_(0), total_bytes_(0),
+      live_bytes_(0), applied_index_(0), ok_(false)
+  {
+    ok_ = load();
+  }
+
+  filesystem(filesystem && other) noexcept
+    : options_(std::move(other.options_)), index_(std::move(other.index_)),
+      ordered_(std::move(other.ordered_)), files_(std::move(other.files_)), active_(other.active_), active_fd_(other.active_fd_),
+      active_size_(other.active_size_), total_bytes_(other.total_bytes_),
+      live_bytes_(other.live_bytes_), applied_index_(other.applied_index_), ok_(other.ok_)
+  {
+    other.files_.clear();
+    other.active_fd_ = -1;
+    other.ok_ = false;
+  }
+
+  filesystem(filesystem const &) = delete;
+  filesystem & operator=(filesystem const &) = delete;
+
+  ~filesystem()
+  {
+    close_all();
+  }
 
   /**
    * @brief API
@@ -33,14 +159,7 @@ public:
   bool
   c(Key const & k, Value const & v)
   {
-    fs::path k_path = key_path(k);
-    std::ofstream stream(k_path, std::ios::binary);
-
-    // FIXME
-    stream.write(reinterpret_cast<char const *>(&v), sizeof(Value));
-    stream.close();
-
-    return true;
+    return put(k, v);
   }
 
   /**
@@ -53,19 +172,11 @@ public:
   Value
   r(Key const & k) const
   {
-    fs::path k_path = key_path(k);
-    Value value;
-
-    if (!fs::exists(k_path))
+    auto it = index_.find(encode_key(k));
+    if (it == index_.end())
       throw std::out_of_range("key not found");
 
-    std::ifstream stream(k_path, std::ios::binary);
-
-    // FIXME
-    stream.read(reinterpret_cast<char *>(&value), sizeof(Value));
-    stream.close();
-
-    return value;
+    return read_value(it->second);
   }
 
   /**
@@ -79,14 +190,7 @@ public:
   bool
   u(Key const & k, Value const & v)
   {
-    fs::path k_path = key_path(k);
-    std::ofstream stream(k_path, std::ios::binary);
-
-    // FIXME
-    stream.write(reinterpret_cast<char const *>(&v), sizeof(Value));
-    stream.close();
-
-    return true;
+    return put(k, v);
   }
 
   /**
@@ -97,26 +201,951 @@ public:
   void
   d(Key const & k)
   {
-    fs::path k_path = key_path(k);
+    std::string key = encode_key(k);
+    auto it = index_.find(key);
+
+    if (it == index_.end())
+      return;
+
+    buf_.clear();
+    append_record(buf_, op_t::del, key, nullptr);
 
-    fs::remove(k_path);
+    if (write(buf_))
+      update(key, false, location_t());
   }
 
+  /**
+   * @brief Apply a batch of mutations, the last of them from log entry
+   * index
+   *
+   * The batch and the index are written at once, with a single fdatasync.
+   * After a restart, the log only needs replaying past applied_index().
+   *
+   * @return false on error, none of the mutations are applied
+   */
+  bool
+  apply(batch_t const & batch, std::uint64_t index)
+  {
+    std::vector<std::string> keys;
+    std::vector<std::size_t> offsets;
+
+    keys.reserve(batch.size());
+    offsets.reserve(batch.size());
+
+    buf_.clear();
+    append_batch(buf_, batch.size(), index);
+
+    for (auto const & m : batch)
+    {
+      keys.push_back(encode_key(m.key));
+      offsets.push_back(buf_.size());
+
+      if (m.op == batch_t::op_t::put)
+        append_record(buf_, op_t::put, keys.back(), &m.value);
+      else
+        append_record(buf_, op_t::del, keys.back(), nullptr);
+    }
+
+    std::uint64_t offset;
+    if (!write(buf_, &offset))
+      return false;
+
+    std::size_t i = 0;
+    for (auto const & m : batch)
+    {
+      std::size_t end = i + 1 < offsets.size() ? offsets[ i + 1 ] : buf_.size();
+      update(keys[ i ], m.op == batch_t::op_t::put, {active_, offset + offsets[ i ], end - offsets[ i ]});
+      ++i;
+    }
+
+    applied_index_ = index;
+
+    return true;
+  }
+
+  /**
+   * @brief Get the index of the last log entry applied through apply()
+   */
+  std::uint64_t
+  applied_index() const noexcept
+  {
+    return applied_index_;
+  }
+
+  /**
+   * @brief Call f(key, value) for the keys in [from, to), in order
+   *
+   * Needs keys ordered with operator<.
+   *
+   * @param limit Number of keys to visit at most
+   *
+   * @return the number of keys visited
+   */
+  template <typename F>
+  std::size_t
+  scan(Key const & from, Key const & to, F && f, std::size_t limit = std::numeric_limits<std::size_t>::max()) const
+  {
+    static_assert(detail::is_ordered<Key>::value, "scan needs keys ordered with operator<");
+
+    std::size_t n = 0;
+
+    for (auto it = ordered_.lower_bound(from); it != ordered_.end() && n < limit && it->first < to; ++it, ++n)
+      f(it->first, read_value(index_.at(it->second)));
+
+    return n;
+  }
+
+  /**
+   * @brief Call f(key, value) for the keys starting with prefix, in order
+   *
+   * Needs string keys.
+   *
+   * @return the number of keys visited
+   */
+  template <typename F>
+  std::size_t
+  prefix(Key const & prefix, F && f, std::size_t limit = std::numeric_limits<std::size_t>::max()) const
+  {
+    static_assert(detail::is_ordered<Key>::value, "prefix needs keys ordered with operator<");
+
+    std::size_t n = 0;
+
+    for (auto it = ordered_.lower_bound(prefix);
+         it != ordered_.end() && n < limit && it->first.compare(0, prefix.size(), prefix) == 0;
+         ++it, ++n)
+      f(it->first, read_value(index_.at(it->second)));
+
+    return n;
+  }
+
+public:
+  /**
+   * @brief Tell whether the data files could be opened and indexed
+   */
+  bool
+  ok() const noexcept
+  {
+    return ok_;
+  }
+
+  /**
+   * @brief Get number of keys
+   */
+  std::size_t
+  size() const noexcept
+  {
+    return index_.size();
+  }
+
+  /**
+   * @brief Get size of the data files, and of the live records they hold
+   */
+  std::uint64_t
+  total_bytes() const noexcept
+  {
+    return total_bytes_;
+  }
+
+  std::uint64_t
+  live_bytes() const noexcept
+  {
+    return live_bytes_;
+  }
+
+  /**
+   * @brief Tell whether dead records reached merge_ratio of the data files
+   */
+  bool
+  needs_merge() const noexcept
+  {
+    if (options_.merge_ratio <= 0 || total_bytes_ < options_.merge_min)
+      return false;
+
+    return double(total_bytes_ - live_bytes_) >= options_.merge_ratio * double(total_bytes_);
+  }
+
+  /**
+   * @brief Rewrite the live records into a new data file and drop the
+   * older ones
+   *
+   * Source files are read in order, a span of live records at a time.
+   *
+   * @return false on error, the store is left as it was
+   */
+  bool
+  merge()
+  {
+    std::uint64_t out = active_ + 1;
+    int fd = ::open(data_file(out).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+
+    std::unordered_map<std::string, location_t> index;
+    std::vector<std::pair<location_t, std::string const *>> live;
+    std::vector<std::uint8_t> data;
+    std::vector<std::uint8_t> hint;
+    std::vector<std::uint8_t> span;
+    std::uint64_t size = 0;
+    bool ok = true;
+
+    index.reserve(index_.size());
+    live.reserve(index_.size());
+
+    for (auto const & it : index_)
+      live.emplace_back(it.second, &it.first);
+
+    std::sort(live.begin(), live.end(), [](auto const & a, auto const & b) {
+      return a.first.file < b.first.file ||
+             (a.first.file == b.first.file && a.first.offset < b.first.offset);
+    });
+
+    /* the applied index leads the merged file, the hint has it too */
+    if (applied_index_)
+    {
+      append_batch(data, 0, applied_index_);
+      append_hint(hint, std::string(), applied_index_, data.size());
+    }
+
+    for (std::size_t i = 0; i < live.size();)
+    {
+      /* the records of one file read at once, up to a chunk past the first */
+      auto const & first = live[ i ].first;
+      std::size_t end = i + 1;
+
+      while (end < live.size() && live[ end ].first.file == first.file &&
+             live[ end ].first.offset + live[ end ].first.size - first.offset <= merge_chunk)
+        ++end;
+
+      auto const & last = live[ end - 1 ].first;
+
+      span.resize(last.offset + last.size - first.offset);
+      ok = read_at(files_.at(first.file), span.data(), span.size(), first.offset);
+      if (!ok)
+        break;
+
+      for (; i < end; ++i)
+      {
+        auto const & loc = live[ i ].first;
+        auto const & key = *live[ i ].second;
+        auto rec = span.data() + (loc.offset - first.offset);
+
+        index[ key ] = {out, size + data.size(), loc.size};
+        append_hint(hint, key, size + data.size(), loc.size);
+        data.insert(data.end(), rec, rec + loc.size);
+      }
+
+      if (options_.file_size <= data.size())
+      {
+        ok = write_at(fd, data.data(), data.size(), size);
+        size += data.size();
+        data.clear();
+        if (!ok)
+          break;
+      }
+    }
+
+    if (ok && !data.empty())
+    {
+      ok = write_at(fd, data.data(), data.size(), size);
+      size += data.size();
+    }
+
+    /* the hint file is only trusted once the data file is durable */
+    if (!ok || fdatasync(fd) < 0 || !write_file(hint_file(out), hint))
+    {
+      ::close(fd);
+      unlink(data_file(out).c_str());
+      return false;
+    }
+
+    sync_dir();
+
+    for (auto & it : files_)
+    {
+      ::close(it.second);
+      unlink(data_file(it.first).c_str());
+      unlink(hint_file(it.first).c_str());
+    }
+
+    files_.clear();
+    files_[ out ] = fd;
+    index_.swap(index);
+    total_bytes_ = live_bytes_ = size;
+    active_fd_ = -1;
+
+    return start(out + 1);
+  }
+
+private:
+  enum class op_t : std::uint8_t
+  {
+    put = 0,
+    del = 1,
+    batch = 2,
+  };
+
+  struct location_t
+  {
+    std::uint64_t file;
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
 private:
-  fs::path
-  key_path(Key const & k) const
+  static options_t
+  make_options(std::string const & path)
+  {
+    options_t options;
+
+    options.path = path;
+    return options;
+  }
+
+  /**
+   * @brief Read back the value of a record
+   */
+  Value
+  read_value(location_t const & loc) const
+  {
+    std::vector<std::uint8_t> rec(loc.size);
+
+    if (!read_at(files_.at(loc.file), rec.data(), rec.size(), loc.offset) || !check(rec.data(), rec.size()))
+      throw std::runtime_error("corrupt record");
+
+    codec::reader body(rec.data() + header_size, rec.size() - header_size);
+    Value value;
+
+    body.get_byte();
+    body.skip(body.get_varint());
+    codec::traits<Value>::decode(body, value);
+
+    if (!body.ok())
+      throw std::runtime_error("corrupt record");
+
+    return value;
+  }
+
+  static std::string
+  encode_key(Key const & k)
+  {
+    codec::writer counter(nullptr, std::numeric_limits<std::size_t>::max());
+    codec::traits<Key>::encode(counter, k);
+
+    std::string key(counter.size(), '\0');
+    codec::writer w(&key[ 0 ], key.size());
+    codec::traits<Key>::encode(w, k);
+
+    return key;
+  }
+
+  /**
+   * @brief Append a record: header, then operation, key and value
+   */
+  static void
+  append_record(std::vector<std::uint8_t> & buf, op_t op, std::string const & key, Value const * v)
+  {
+    codec::writer counter(nullptr, std::numeric_limits<std::size_t>::max());
+    put_body(counter, op, key, v);
+
+    std::size_t start = buf.size();
+    buf.resize(start + header_size + counter.size());
+
+    auto p = buf.data() + start;
+    codec::writer w(p + header_size, counter.size());
+    put_body(w, op, key, v);
+
+    seal(p, counter.size());
+  }
+
+  /**
+   * @brief Append a batch record: operation, count of the records that
+   * follow and applied index
+   */
+  static void
+  append_batch(std::vector<std::uint8_t> & buf, std::uint64_t count, std::uint64_t applied)
+  {
+    std::uint8_t body[ 1 + 2 * 10 ];
+    codec::writer w(body, sizeof(body));
+
+    w.put_byte(std::uint8_t(op_t::batch));
+    w.put_varint(count);
+    w.put_varint(applied);
+
+    std::size_t start = buf.size();
+    buf.resize(start + header_size + w.size());
+
+    auto p = buf.data() + start;
+    std::memcpy(p + header_size, body, w.size());
+
+    seal(p, w.size());
+  }
+
+  static void
+  put_body(codec::writer & w, op_t op, std::string const & key, Value const * v)
+  {
+    w.put_byte(std::uint8_t(op));
+    w.put_varint(key.size());
+    w.put(key.data(), key.size());
+    if (v)
+      codec::traits<Value>::encode(w, *v);
+  }
+
+  static void
+  append_hint(std::vector<std::uint8_t> & buf, std::string const & key, std::uint64_t offset, std::uint64_t size)
+  {
+    std::uint8_t body[ 3 * 10 ];
+    codec::writer w(body, sizeof(body));
+
+    w.put_varint(key.size());
+    w.put_varint(offset);
+    w.put_varint(size);
+
+    std::size_t start = buf.size();
+    buf.resize(start + header_size + w.size() + key.size());
+
+    auto p = buf.data() + start;
+    std::memcpy(p + header_size, body, w.size());
+    std::memcpy(p + header_size + w.size(), key.data(), key.size());
+
+    seal(p, w.size() + key.size());
+  }
+
+  static void
+  seal(std::uint8_t * p, std::size_t len)
+  {
+    auto len32 = static_cast<std::uint32_t>(len);
+    std::uint32_t crc = utils::crc32(p + header_size, len);
+
+    std::memcpy(p, &len32, sizeof(len32));
+    std::memcpy(p + 4, &crc, sizeof(crc));
+  }
+
+  /**
+   * @brief Check a record read back, header included
+   */
+  static bool
+  check(std::uint8_t const * p, std::size_t len)
+  {
+    std::uint32_t body;
+    std::uint32_t crc;
+
+    if (len < header_size)
+      return false;
+
+    std::memcpy(&body, p, sizeof(body));
+    std::memcpy(&crc, p + 4, sizeof(crc));
+
+    return body == len - header_size && utils::crc32(p + header_size, body) == crc;
+  }
+
+  std::string
+  data_file(std::uint64_t id) const
+  {
+    return file_name(id, "data");
+  }
+
+  std::string
+  hint_file(std::uint64_t id) const
+  {
+    return file_name(id, "hint");
+  }
+
+  std::string
+  file_name(std::uint64_t id, char const * ext) const
+  {
+    char name[ 32 ];
+
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".%s", id, ext);
+    return options_.path + "/" + name;
+  }
+
+  static bool
+  read_at(int fd, void * buf, std::size_t len, std::uint64_t off)
   {
-    std::stringstream ss_k;
+    std::size_t done = 0;
 
-    ss_k << k;
+    while (done < len)
+    {
+      ssize_t n = pread(fd, static_cast<std::uint8_t *>(buf) + done, len - done, off_t(off + done));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+
+      done += std::size_t(n);
+    }
+
+    return true;
+  }
+
+  static bool
+  write_at(int fd, void const * buf, std::size_t len, std::uint64_t off)
+  {
+    std::size_t done = 0;
+
+    while (done < len)
+    {
+      ssize_t n = pwrite(fd, static_cast<std::uint8_t const *>(buf) + done, len - done, off_t(off + done));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+
+      done += std::size_t(n);
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Write a whole file durably, through a temporary file
+   */
+  bool
+  write_file(std::string const & path, std::vector<std::uint8_t> const & content)
+  {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+
+    bool ok = write_at(fd, content.data(), content.size(), 0) && fdatasync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) < 0)
+    {
+      unlink(tmp.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  void
+  sync_dir()
+  {
+    int dir = ::open(options_.path.c_str(), O_RDONLY | O_DIRECTORY);
 
-    return _base_path / ss_k.str();
+    if (0 <= dir)
+    {
+      fsync(dir);
+      ::close(dir);
+    }
+  }
+
+  static bool
+  read_file(std::string const & path, std::vector<std::uint8_t> & content)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+
+    if (ok)
+    {
+      content.resize(std::size_t(st.st_size));
+      ok = read_at(fd, content.data(), content.size(), 0);
+    }
+
+    ::close(fd);
+    return ok;
+  }
+
+  /**
+   * @brief Index the data files found in the directory
+   */
+  bool
+  load()
+  {
+    if (mkdir(options_.path.c_str(), 0755) < 0 && errno != EEXIST)
+      return false;
+
+    DIR * dir = opendir(options_.path.c_str());
+    if (dir == nullptr)
+      return false;
+
+    std::vector<std::uint64_t> ids;
+    std::uint64_t merged = 0;
+
+    while (struct dirent * e = readdir(dir))
+    {
+      std::uint64_t id;
+      char ext[ 8 ] = {0};
+
+      if (std::sscanf(e->d_name, "%16" SCNx64 ".%4s", &id, ext) != 2)
+        continue;
+
+      if (std::strcmp(ext, "data") == 0)
+        ids.push_back(id);
+      else if (std::strcmp(ext, "hint") == 0 && e->d_name[ 21 ] == '\0')
+        merged = std::max(merged, id);
+    }
+
+    closedir(dir);
+    std::sort(ids.begin(), ids.end());
+
+    std::vector<std::uint8_t> content;
+
+    for (auto id : ids)
+    {
+      /* files older than the last merge are leftovers of a crash */
+      if (id < merged)
+      {
+        unlink(data_file(id).c_str());
+        unlink(hint_file(id).c_str());
+        continue;
+      }
+
+      int fd = ::open(data_file(id).c_str(), O_RDWR);
+      if (fd < 0)
+        return false;
+
+      files_[ id ] = fd;
+
+      if (id == merged && read_file(hint_file(id), content) && load_hint(id, content))
+        continue;
+
+      if (!read_file(data_file(id), content))
+        return false;
+
+      std::uint64_t valid = scan(id, content);
+
+      /* cut the torn tail */
+      if (valid != content.size() && ftruncate(fd, off_t(valid)) < 0)
+        return false;
+    }
+
+    /* merged files are never appended to */
+    if (!ids.empty() && ids.back() != merged)
+    {
+      active_ = ids.back();
+      active_fd_ = files_[ active_ ];
+
+      struct stat st;
+      if (fstat(active_fd_, &st) < 0)
+        return false;
+
+      active_size_ = std::uint64_t(st.st_size);
+      return true;
+    }
+
+    return start(ids.empty() ? 1 : ids.back() + 1);
+  }
+
+  bool
+  load_hint(std::uint64_t id, std::vector<std::uint8_t> const & content)
+  {
+    std::unordered_map<std::string, location_t> index;
+    std::uint64_t applied = applied_index_;
+    std::uint64_t size = 0;
+    std::size_t off = 0;
+
+    while (off < content.size())
+    {
+      std::uint32_t len;
+
+      if (content.size() - off < header_size)
+        return false;
+
+      std::memcpy(&len, content.data() + off, sizeof(len));
+      if (content.size() - off - header_size < len || !check(content.data() + off, header_size + len))
+        return false;
+
+      codec::reader r(content.data() + off + header_size, len);
+      std::uint64_t key_len = r.get_varint();
+      location_t loc;
+
+      loc.file = id;
+      loc.offset = r.get_varint();
+      loc.size = r.get_varint();
+
+      auto key = r.skip(key_len);
+      if (!r.ok())
+        return false;
+
+      off += header_size + len;
+
+      /* no key: the applied index, in place of the offset */
+      if (key_len == 0)
+      {
+        applied = loc.offset;
+        size = std::max(size, loc.size);
+        continue;
+      }
+
+      index[ std::string(reinterpret_cast<char const *>(key), key_len) ] = loc;
+      size = std::max(size, loc.offset + loc.size);
+    }
+
+    for (auto & it : index)
+    {
+      auto & loc = index_[ it.first ];
+
+      if (loc.size == 0)
+        order(it.first, true, detail::is_ordered<Key>());
+      loc = it.second;
+    }
+
+    applied_index_ = applied;
+    total_bytes_ += size;
+    live_bytes_ += size;
+
+    return true;
+  }
+
+  struct record_t
+  {
+    op_t op;
+    std::string key;
+    std::uint64_t size;
+    /* batch records only */
+    std::uint64_t count;
+    std::uint64_t applied;
+  };
+
+  /**
+   * @brief Parse the record at off, if whole and valid
+   */
+  static bool
+  parse(std::vector<std::uint8_t> const & content, std::size_t off, record_t & rec)
+  {
+    std::uint32_t len;
+
+    if (content.size() - off < header_size)
+      return false;
+
+    std::memcpy(&len, content.data() + off, sizeof(len));
+    if (content.size() - off - header_size < len || !check(content.data() + off, header_size + len))
+      return false;
+
+    codec::reader r(content.data() + off + header_size, len);
+
+    rec.op = op_t(r.get_byte());
+    rec.size = header_size + len;
+
+    if (rec.op == op_t::batch)
+    {
+      rec.count = r.get_varint();
+      rec.applied = r.get_varint();
+      return r.ok();
+    }
+
+    std::uint64_t key_len = r.get_varint();
+    auto key = r.skip(key_len);
+
+    if (!r.ok())
+      return false;
+
+    rec.key.assign(reinterpret_cast<char const *>(key), key_len);
+    return true;
+  }
+
+  /**
+   * @brief Replay the records of a data file into the index
+   *
+   * @return the length of the valid records
+   */
+  std::uint64_t
+  scan(std::uint64_t id, std::vector<std::uint8_t> const & content)
+  {
+    std::vector<std::pair<record_t, std::size_t>> batch;
+    std::size_t off = 0;
+    record_t rec;
+
+    while (parse(content, off, rec))
+    {
+      if (rec.op != op_t::batch)
+      {
+        update(rec.key, rec.op == op_t::put, {id, off, rec.size});
+        off += rec.size;
+        continue;
+      }
+
+      /* a batch is replayed only once all its records are found */
+      std::size_t end = off + rec.size;
+      std::uint64_t applied = rec.applied;
+
+      batch.clear();
+      for (std::uint64_t i = 0; i < rec.count; ++i)
+      {
+        record_t m;
+        if (!parse(content, end, m) || m.op == op_t::batch)
+          break;
+
+        batch.emplace_back(std::move(m), end);
+        end += batch.back().first.size;
+      }
+
+      if (batch.size() != rec.count)
+        break;
+
+      for (auto const & it : batch)
+        update(it.first.key, it.first.op == op_t::put, {id, it.second, it.first.size});
+
+      applied_index_ = applied;
+      off = end;
+    }
+
+    total_bytes_ += off;
+    return off;
+  }
+
+  /**
+   * @brief Point a key to its latest record, or drop it if deleted
+   */
+  void
+  update(std::string const & key, bool put, location_t const & loc)
+  {
+    auto it = index_.find(key);
+
+    if (it != index_.end())
+    {
+      live_bytes_ -= it->second.size;
+      if (!put)
+      {
+        index_.erase(it);
+        order(key, false, detail::is_ordered<Key>());
+      }
+    }
+    else if (put)
+      order(key, true, detail::is_ordered<Key>());
+
+    if (put)
+    {
+      index_[ key ] = loc;
+      live_bytes_ += loc.size;
+    }
+  }
+
+  /**
+   * @brief Add or remove a key of the ordered index
+   */
+  void
+  order(std::string const & key, bool put, std::true_type)
+  {
+    codec::reader r(key.data(), key.size());
+    Key k;
+
+    codec::traits<Key>::decode(r, k);
+
+    if (put)
+      ordered_[ k ] = key;
+    else
+      ordered_.erase(k);
+  }
+
+  void
+  order(std::string const &, bool, std::false_type)
+  {
+  }
+
+  /**
+   * @brief Start a new data file
+   */
+  bool
+  start(std::uint64_t id)
+  {
+    int fd = ::open(data_file(id).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+
+    files_[ id ] = fd;
+    active_ = id;
+    active_fd_ = fd;
+    active_size_ = 0;
+
+    sync_dir();
+    return true;
+  }
+
+  bool
+  put(Key const & k, Value const & v)
+  {
+    std::string key = encode_key(k);
+
+    buf_.clear();
+    append_record(buf_, op_t::put, key, &v);
+
+    std::uint64_t offset;
+    if (!write(buf_, &offset))
+      return false;
+
+    update(key, true, {active_, offset, buf_.size()});
+
+    return true;
+  }
+
+  /**
+   * @brief Append records to the active data file
+   */
+  bool
+  write(std::vector<std::uint8_t> const & records, std::uint64_t * offset = nullptr)
+  {
+    if (active_fd_ < 0)
+      return false;
+
+    if (0 < active_size_ && options_.file_size < active_size_ + records.size() && !start(active_ + 1))
+      return false;
+
+    if (!write_at(active_fd_, records.data(), records.size(), active_size_))
+      return false;
+
+    if (options_.sync && fdatasync(active_fd_) < 0)
+      return false;
+
+    if (offset)
+      *offset = active_size_;
+
+    active_size_ += records.size();
+    total_bytes_ += records.size();
+
+    return true;
+  }
+
+  void
+  close_all()
+  {
+    for (auto & it : files_)
+      ::close(it.second);
+
+    files_.clear();
+    active_fd_ = -1;
   }
 
 private:
-  fs::path _base_path;
+  options_t options_;
+
+  /* encoded key to latest record */
+  std::unordered_map<std::string, location_t> index_;
+  /* key to encoded key, in key order */
+  ordered_t ordered_;
+
+  /* data files, by id */
+  std::map<std::uint64_t, int> files_;
+
+  std::uint64_t active_;
+  int active_fd_;
+  std::uint64_t active_size_;
+
+  std::uint64_t total_bytes_;
+  std::uint64_t live_bytes_;
+
+  /* last log entry applied through a batch */
+  std::uint64_t applied_index_;
+
+  std::vector<std::uint8_t> buf_;
+  bool ok_;
 };
 
+template <typename Key, typename Value>
+constexpr std::size_t filesystem<Key, Value>::header_size;
+
+template <typename Key, typename Value>
+constexpr std::size_t filesystem<Key, Value>::merge_chunk;
+
 } /** !store  */
 } /** !raft  */
 
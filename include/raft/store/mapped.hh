@@ -0,0 +1,817 @@
+#ifndef RAFT_STORE_MAPPED_HH_
+#define RAFT_STORE_MAPPED_HH_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raft/codec.hh>
+#include <raft/store/batch.hh>
+#include <utils/crc32.hh>
+
+namespace raft
+{
+namespace store
+{
+
+/**
+ * @brief Change of a key recorded in a delta image: its new value, or its
+ * deletion
+ */
+template <typename Value>
+struct change_t
+{
+  bool live;
+  Value value;
+};
+
+} /** !store  */
+
+namespace codec
+{
+
+/* never copied as is: padding is not initialized, and the layout is the host's */
+template <typename Value>
+struct raw_copy<store::change_t<Value>> : std::false_type
+{
+};
+
+template <typename Value>
+struct traits<store::change_t<Value>>
+{
+  static void
+  encode(writer & w, store::change_t<Value> const & c)
+  {
+    w.put_byte(c.live);
+    if (c.live)
+      traits<Value>::encode(w, c.value);
+  }
+
+  static void
+  decode(reader & r, store::change_t<Value> & c)
+  {
+    c.live = r.get_byte() != 0;
+    if (c.live)
+      traits<Value>::decode(r, c.value);
+    else
+      c.value = Value();
+  }
+};
+
+} /** !codec  */
+
+namespace store
+{
+
+/**
+ * @brief Store image: sorted records served from a read-only mapping
+ *
+ * The file holds a header, the records in key order, each the key then
+ * the value encoded through codec::traits, and an array of the offsets of
+ * the records. Opening checks the header only, whatever the size of the
+ * file: a lookup is a binary search over the offsets, decoding the keys
+ * it meets, and the pages are read in by the kernel on first access.
+ *
+ * Images are written whole to a temporary file, synced, then renamed: an
+ * image that opens is complete.
+ */
+template <typename Key, typename Value>
+class image
+{
+public:
+  struct header_t
+  {
+    char magic[ 8 ];
+    std::uint64_t count;
+    std::uint64_t applied_index;
+    /* of the offsets, past the records */
+    std::uint64_t index_offset;
+    /* of the fields above */
+    std::uint32_t crc;
+    std::uint32_t reserved;
+  };
+
+  static constexpr char const * magic = "RAFTIMG1";
+
+public:
+  image() : base_(nullptr), size_(0), count_(0), applied_(0), offsets_(nullptr) {}
+
+  image(image && other) noexcept : image()
+  {
+    swap(other);
+  }
+
+  image &
+  operator=(image other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  ~image()
+  {
+    if (base_)
+      ::munmap(base_, size_);
+  }
+
+  void
+  swap(image & other) noexcept
+  {
+    std::swap(base_, other.base_);
+    std::swap(size_, other.size_);
+    std::swap(count_, other.count_);
+    std::swap(applied_, other.applied_);
+    std::swap(offsets_, other.offsets_);
+  }
+
+  /**
+   * @brief Map an image
+   *
+   * @return false if it cannot be read or is not an image
+   */
+  bool
+  open(std::string const & path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    void * p = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && sizeof(header_t) <= std::size_t(st.st_size))
+      p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+      return false;
+
+    image img;
+    img.base_ = static_cast<std::uint8_t *>(p);
+    img.size_ = std::size_t(st.st_size);
+
+    header_t h;
+    std::memcpy(&h, img.base_, sizeof(h));
+
+    bool valid = std::memcmp(h.magic, magic, sizeof(h.magic)) == 0 &&
+                 utils::crc32(&h, offsetof(header_t, crc)) == h.crc && h.index_offset % 8 == 0 &&
+                 h.index_offset <= img.size_ && h.count <= (img.size_ - h.index_offset) / 8;
+
+    if (!valid)
+      return false;
+
+    img.count_ = h.count;
+    img.applied_ = h.applied_index;
+    img.offsets_ = reinterpret_cast<std::uint64_t const *>(img.base_ + h.index_offset);
+
+    swap(img);
+    return true;
+  }
+
+  std::size_t
+  size() const noexcept
+  {
+    return count_;
+  }
+
+  std::uint64_t
+  applied_index() const noexcept
+  {
+    return applied_;
+  }
+
+  /**
+   * @brief Get the position of the first key not less than k
+   */
+  std::size_t
+  lower_bound(Key const & k) const
+  {
+    std::size_t lo = 0;
+    std::size_t hi = count_;
+
+    while (lo < hi)
+    {
+      std::size_t mid = lo + (hi - lo) / 2;
+
+      if (key(mid) < k)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    return lo;
+  }
+
+  /**
+   * @brief Look a key up
+   *
+   * @return false if not found
+   */
+  bool
+  find(Key const & k, Value & v) const
+  {
+    std::size_t i = lower_bound(k);
+
+    if (i == count_ || k < key(i))
+      return false;
+
+    v = value(i);
+    return true;
+  }
+
+  /**
+   * @brief Decode the key of record i
+   *
+   * @throw std::runtime_error if the record is corrupt
+   */
+  Key
+  key(std::size_t i) const
+  {
+    codec::reader r = record(i);
+    Key k;
+
+    codec::traits<Key>::decode(r, k);
+    if (!r.ok())
+      throw std::runtime_error("corrupt image");
+
+    return k;
+  }
+
+  Value
+  value(std::size_t i) const
+  {
+    codec::reader r = record(i);
+    Key k;
+    Value v;
+
+    codec::traits<Key>::decode(r, k);
+    codec::traits<Value>::decode(r, v);
+    if (!r.ok())
+      throw std::runtime_error("corrupt image");
+
+    return v;
+  }
+
+  /**
+   * @brief Write an image of key value pairs iterated in key order
+   *
+   * @return false on error
+   */
+  template <typename Range>
+  static bool
+  write(std::string const & path, Range const & range, std::uint64_t applied_index)
+  {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint8_t> buf;
+    std::uint64_t off = sizeof(header_t);
+    bool ok = true;
+
+    for (auto const & it : range)
+    {
+      codec::writer counter(nullptr, std::numeric_limits<std::size_t>::max());
+      codec::traits<Key>::encode(counter, it.first);
+      codec::traits<Value>::encode(counter, it.second);
+
+      std::size_t start = buf.size();
+      buf.resize(start + counter.size());
+
+      codec::writer w(buf.data() + start, counter.size());
+      codec::traits<Key>::encode(w, it.first);
+      codec::traits<Value>::encode(w, it.second);
+
+      offsets.push_back(off + start);
+
+      if (flush_size <= buf.size())
+      {
+        ok = write_at(fd, buf.data(), buf.size(), off);
+        off += buf.size();
+        buf.clear();
+        if (!ok)
+          break;
+      }
+    }
+
+    /* the offsets are 8 byte aligned, for the mapping to read them in place */
+    if (ok)
+    {
+      buf.resize(buf.size() + (8 - (off + buf.size()) % 8) % 8);
+      ok = write_at(fd, buf.data(), buf.size(), off);
+      off += buf.size();
+    }
+
+    header_t h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, magic, sizeof(h.magic));
+    h.count = offsets.size();
+    h.applied_index = applied_index;
+    h.index_offset = off;
+    h.crc = utils::crc32(&h, offsetof(header_t, crc));
+
+    ok = ok && write_at(fd, offsets.data(), offsets.size() * 8, off) && write_at(fd, &h, sizeof(h), 0) &&
+         fdatasync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) < 0)
+    {
+      unlink(tmp.c_str());
+      return false;
+    }
+
+    std::string dir = path.substr(0, path.find_last_of('/') + 1);
+    int dfd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (0 <= dfd)
+    {
+      fsync(dfd);
+      ::close(dfd);
+    }
+
+    return true;
+  }
+
+private:
+  static constexpr std::size_t flush_size = 1 << 20;
+
+  codec::reader
+  record(std::size_t i) const
+  {
+    std::uint64_t begin = offsets_[ i ];
+    std::uint64_t end = i + 1 < count_ ? offsets_[ i + 1 ] : index_offset();
+
+    if (end < begin || index_offset() < end || begin < sizeof(header_t))
+      throw std::runtime_error("corrupt image");
+
+    return codec::reader(base_ + begin, std::size_t(end - begin));
+  }
+
+  std::uint64_t
+  index_offset() const noexcept
+  {
+    return std::uint64_t(reinterpret_cast<std::uint8_t const *>(offsets_) - base_);
+  }
+
+  static bool
+  write_at(int fd, void const * buf, std::size_t len, std::uint64_t off)
+  {
+    std::size_t done = 0;
+
+    while (done < len)
+    {
+      ssize_t n = pwrite(fd, static_cast<std::uint8_t const *>(buf) + done, len - done, off_t(off + done));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+
+      done += std::size_t(n);
+    }
+
+    return true;
+  }
+
+private:
+  std::uint8_t * base_;
+  std::size_t size_;
+  std::size_t count_;
+  std::uint64_t applied_;
+  std::uint64_t const * offsets_;
+};
+
+template <typename Key, typename Value>
+constexpr char const * image<Key, Value>::magic;
+
+template <typename Key, typename Value>
+constexpr std::size_t image<Key, Value>::flush_size;
+
+/**
+ * @brief In memory key value store restarted from an image
+ *
+ * Reads are served from the mapped image as soon as it is opened, and
+ * from an overlay of the keys written since: a write promotes its key to
+ * the overlay, a deletion of a key of the image leaves a tombstone there.
+ * save() merges both into a new image, the next restart point.
+ *
+ * The keys written since the last image or delta are tracked as well:
+ * save_delta() writes only those, as an image of changes, so that the
+ * cost of a snapshot follows the writes rather than the size of the
+ * store. A restart opens the last full image and replays its deltas with
+ * load_delta(); rebase() folds everything into a new full image. See
+ * store::chain.
+ *
+ * Keys are ordered with operator<, in the image as in the overlay.
+ */
+template <typename Key, typename Value>
+class mapped
+{
+public:
+  using batch_t = write_batch<Key, Value>;
+  using delta_t = image<Key, change_t<Value>>;
+
+private:
+  using entry_t = change_t<Value>;
+
+public:
+  /**
+   * @brief Start empty
+   */
+  mapped() : applied_(0), ok_(true) {}
+
+  /**
+   * @brief Start from an image, ok() telling whether it could be opened
+   */
+  explicit mapped(std::string const & path) : applied_(0), ok_(false)
+  {
+    ok_ = image_.open(path);
+    applied_ = image_.applied_index();
+  }
+
+public:
+  bool
+  c(Key const & k, Value const & v)
+  {
+    if (!contains(k))
+    {
+      overlay_[ k ] = {true, v};
+      dirty_.insert(k);
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Read Key
+   *
+   * @throw std::out_of_range if not found
+   */
+  Value
+  r(Key const & k) const
+  {
+    auto it = overlay_.find(k);
+    Value v;
+
+    if (it != overlay_.end())
+    {
+      if (!it->second.live)
+        throw std::out_of_range("key not found");
+
+      return it->second.value;
+    }
+
+    if (!image_.find(k, v))
+      throw std::out_of_range("key not found");
+
+    return v;
+  }
+
+  bool
+  u(Key const & k, Value const & v)
+  {
+    overlay_[ k ] = {true, v};
+    dirty_.insert(k);
+    return true;
+  }
+
+  void
+  d(Key const & k)
+  {
+    if (in_image(k))
+      overlay_[ k ] = {false, Value()};
+    else if (!overlay_.erase(k))
+      return;
+
+    dirty_.insert(k);
+  }
+
+  /**
+   * @brief Apply a batch of mutations, the last of them from log entry
+   * index
+   */
+  bool
+  apply(batch_t const & batch, std::uint64_t index)
+  {
+    for (auto const & m : batch)
+    {
+      if (m.op == batch_t::op_t::put)
+        u(m.key, m.value);
+      else
+        d(m.key);
+    }
+
+    applied_ = index;
+    return true;
+  }
+
+  /**
+   * @brief Get the applied index of the image, or of the last batch
+   */
+  std::uint64_t
+  applied_index() const noexcept
+  {
+    return applied_;
+  }
+
+  bool
+  ok() const noexcept
+  {
+    return ok_;
+  }
+
+  /**
+   * @brief Get the number of keys written since the image, deletions
+   * included
+   */
+  std::size_t
+  promoted() const noexcept
+  {
+    return overlay_.size();
+  }
+
+  /**
+   * @brief Get the number of keys written since the last image or delta
+   */
+  std::size_t
+  changed() const noexcept
+  {
+    return dirty_.size();
+  }
+
+  /**
+   * @brief Write the image and the overlay merged as a new image
+   */
+  bool
+  save(std::string const & path) const
+  {
+    return image<Key, Value>::write(path, merged_t{this}, applied_);
+  }
+
+  /**
+   * @brief Write the keys changed since the last image or delta as a delta
+   * image, and start tracking changes from there
+   */
+  bool
+  save_delta(std::string const & path)
+  {
+    if (!delta_t::write(path, changes_t{this}, applied_))
+      return false;
+
+    dirty_.clear();
+    return true;
+  }
+
+  /**
+   * @brief Replay a delta image written after the current state
+   *
+   * @return false if it cannot be opened or read
+   */
+  bool
+  load_delta(std::string const & path)
+  {
+    delta_t delta;
+    if (!delta.open(path))
+      return false;
+
+    try
+    {
+      for (std::size_t i = 0; i < delta.size(); ++i)
+      {
+        Key k = delta.key(i);
+        change_t<Value> c = delta.value(i);
+
+        if (c.live || in_image(k))
+          overlay_[ k ] = std::move(c);
+        else
+          overlay_.erase(k);
+      }
+    }
+    catch (std::runtime_error const &)
+    {
+      return false;
+    }
+
+    applied_ = delta.applied_index();
+    return true;
+  }
+
+  /**
+   * @brief Write the image and the overlay merged as a new image, and
+   * serve reads from it
+   */
+  bool
+  rebase(std::string const & path)
+  {
+    image<Key, Value> img;
+
+    if (!save(path) || !img.open(path))
+      return false;
+
+    image_ = std::move(img);
+    overlay_.clear();
+    dirty_.clear();
+    return true;
+  }
+
+private:
+  /**
+   * @brief Range over the image and the overlay merged, in key order
+   */
+  struct merged_t
+  {
+    class iterator
+    {
+    public:
+      iterator(mapped const * m, bool end)
+        : m_(m), i_(end ? m->image_.size() : 0), it_(end ? m->overlay_.end() : m->overlay_.begin())
+      {
+        settle();
+      }
+
+      std::pair<Key, Value> const & operator*() const
+      {
+        return current_;
+      }
+
+      iterator &
+      operator++()
+      {
+        if (from_image_)
+          ++i_;
+        else
+          ++it_;
+
+        settle();
+        return *this;
+      }
+
+      bool
+      operator!=(iterator const & other) const
+      {
+        return i_ != other.i_ || it_ != other.it_;
+      }
+
+    private:
+      /* move to the next live key, from the image or the overlay */
+      void
+      settle()
+      {
+        auto const & img = m_->image_;
+        auto const & overlay = m_->overlay_;
+
+        for (;;)
+        {
+          bool image_left = i_ < img.size();
+          bool overlay_left = it_ != overlay.end();
+
+          if (!image_left && !overlay_left)
+            return;
+
+          if (image_left)
+            current_.first = img.key(i_);
+
+          from_image_ = !overlay_left || (image_left && current_.first < it_->first);
+
+          if (from_image_)
+          {
+            current_.second = img.value(i_);
+            return;
+          }
+
+          /* the overlay hides the image */
+          if (image_left && !(it_->first < current_.first))
+            ++i_;
+
+          if (it_->second.live)
+          {
+            current_ = std::make_pair(it_->first, it_->second.value);
+            return;
+          }
+
+          ++it_;
+        }
+      }
+
+    private:
+      mapped const * m_;
+      std::size_t i_;
+      typename std::map<Key, entry_t>::const_iterator it_;
+      bool from_image_;
+      std::pair<Key, Value> current_;
+    };
+
+    iterator
+    begin() const
+    {
+      return iterator(m, false);
+    }
+
+    iterator
+    end() const
+    {
+      return iterator(m, true);
+    }
+
+    mapped const * m;
+  };
+
+  /**
+   * @brief Range over the changed keys in order, with their change
+   */
+  struct changes_t
+  {
+    class iterator
+    {
+    public:
+      iterator(mapped const * m, typename std::set<Key>::const_iterator it) : m_(m), it_(it) {}
+
+      std::pair<Key, change_t<Value>> operator*() const
+      {
+        auto e = m_->overlay_.find(*it_);
+
+        if (e == m_->overlay_.end())
+          return std::make_pair(*it_, change_t<Value>{false, Value()});
+
+        return std::make_pair(*it_, e->second);
+      }
+
+      iterator &
+      operator++()
+      {
+        ++it_;
+        return *this;
+      }
+
+      bool
+      operator!=(iterator const & other) const
+      {
+        return it_ != other.it_;
+      }
+
+    private:
+      mapped const * m_;
+      typename std::set<Key>::const_iterator it_;
+    };
+
+    iterator
+    begin() const
+    {
+      return iterator(m, m->dirty_.begin());
+    }
+
+    iterator
+    end() const
+    {
+      return iterator(m, m->dirty_.end());
+    }
+
+    mapped const * m;
+  };
+
+  bool
+  contains(Key const & k) const
+  {
+    auto it = overlay_.find(k);
+    return it != overlay_.end() ? it->second.live : in_image(k);
+  }
+
+  bool
+  in_image(Key const & k) const
+  {
+    std::size_t i = image_.lower_bound(k);
+    return i < image_.size() && !(k < image_.key(i));
+  }
+
+private:
+  image<Key, Value> image_;
+  /* keys written since the image, false for deleted ones */
+  std::map<Key, entry_t> overlay_;
+  /* keys written since the last image or delta */
+  std::set<Key> dirty_;
+  std::uint64_t applied_;
+  bool ok_;
+};
+
+} /** !store  */
+} /** !raft  */
+
+#endif /** !RAFT_STORE_MAPPED_HH_  */
@@ -1,16 +1,34 @@
 #ifndef STORE_HH_
 #define STORE_HH_
 
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <map>
 
+#include <raft/store/batch.hh>
+
 namespace raft
 {
 namespace store
 {
 
-template <typename Key, typename Value>
+/**
+ * @brief In memory key value store
+ *
+ * @tparam Map Map holding the values, such as std::map, utils::pmap or,
+ * for stores read mostly by key, the utils::flat_map hash table
+ */
+template <typename Key, typename Value, typename Map = std::map<Key, Value>>
 class memory
 {
+public:
+  using map_t = Map;
+  using batch_t = write_batch<Key, Value>;
+
+public:
+  memory() : _applied(0) {}
+
 public:
   bool
   c(Key const & k, Value const & v)
@@ -35,14 +53,99 @@ public:
   void
   d(Key const & k)
   {
-    auto to_del = _map.find(k);
+    _map.erase(k);
+  }
+
+  /**
+   * @brief Apply a batch of mutations, the last of them from log entry
+   * index
+   *
+   * Puts overwrite as u() does.
+   */
+  bool
+  apply(batch_t const & batch, std::uint64_t index)
+  {
+    for (auto const & m : batch)
+    {
+      if (m.op == batch_t::op_t::put)
+        _map[ m.key ] = m.value;
+      else
+        _map.erase(m.key);
+    }
+
+    _applied = index;
+    return true;
+  }
+
+  /**
+   * @brief Get the index of the last log entry applied through apply()
+   */
+  std::uint64_t
+  applied_index() const noexcept
+  {
+    return _applied;
+  }
+
+  /**
+   * @brief Call f(key, value) for the keys in [from, to), in order
+   *
+   * Needs an ordered Map with lower_bound, such as std::map or, for
+   * faster iteration, utils::btree.
+   *
+   * @param limit Number of keys to visit at most
+   *
+   * @return the number of keys visited
+   */
+  template <typename F>
+  std::size_t
+  scan(Key const & from, Key const & to, F && f, std::size_t limit = std::numeric_limits<std::size_t>::max()) const
+  {
+    auto cmp = _map.key_comp();
+    std::size_t n = 0;
+
+    for (auto it = _map.lower_bound(from); it != _map.end() && n < limit && cmp(it->first, to); ++it, ++n)
+      f(it->first, it->second);
+
+    return n;
+  }
 
-    if (to_del != _map.end())
-      _map.erase(to_del);
+  /**
+   * @brief Call f(key, value) for the keys starting with prefix, in order
+   *
+   * Needs string keys and an ordered Map, as scan() does.
+   *
+   * @return the number of keys visited
+   */
+  template <typename F>
+  std::size_t
+  prefix(Key const & prefix, F && f, std::size_t limit = std::numeric_limits<std::size_t>::max()) const
+  {
+    std::size_t n = 0;
+
+    for (auto it = _map.lower_bound(prefix);
+         it != _map.end() && n < limit && it->first.compare(0, prefix.size(), prefix) == 0;
+         ++it, ++n)
+      f(it->first, it->second);
+
+    return n;
+  }
+
+  /**
+   * @brief Get a consistent view of the store
+   *
+   * A utils::pmap view is taken in O(1) and shares its structure with the
+   * store: another thread may serialize it while updates go on. Other maps
+   * are copied.
+   */
+  Map
+  snapshot() const
+  {
+    return _map;
   }
 
 private:
-  std::map<Key, Value> _map;
+  Map _map;
+  std::uint64_t _applied;
 };
 
 } /** !store  */
@@ -0,0 +1,357 @@
+#ifndef RAFT_STORE_MVCC_HH_
+#define RAFT_STORE_MVCC_HH_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <raft/store/batch.hh>
+
+namespace raft
+{
+namespace store
+{
+
+/**
+ * @brief In memory multi-version key value store
+ *
+ * Each mutation is tagged with the index of the log entry it comes from
+ * and keeps the versions it replaces, so that the store can be read as of
+ * any applied index not collected yet: a follower or ReadIndex read at
+ * index N sees exactly the entries up to N, whatever was applied since.
+ *
+ * A reader pins its index until destroyed. gc() drops the versions no
+ * reader can see anymore, those replaced at or before the oldest pinned
+ * index, or the applied index if there are no readers. A scan walks the
+ * keys in order through a cursor, in as many steps as needed: mutations
+ * and collections in between never invalidate it.
+ *
+ * Not thread safe: readers are meant to be served from the applying
+ * thread, between entries.
+ */
+template <typename Key, typename Value>
+class mvcc
+{
+public:
+  using batch_t = write_batch<Key, Value>;
+
+private:
+  struct version_t
+  {
+    std::uint64_t index;
+    bool live;
+    Value value;
+  };
+
+  /* oldest first */
+  using chain_t = std::vector<version_t>;
+  using map_t = std::map<Key, chain_t>;
+
+public:
+  /**
+   * @brief Reads as of a log index
+   */
+  class reader
+  {
+  public:
+    reader(reader && other) noexcept
+      : store_(other.store_), pin_(other.pin_), cursor_(std::move(other.cursor_)), done_(other.done_)
+    {
+      other.store_ = nullptr;
+    }
+
+    reader(reader const &) = delete;
+    reader & operator=(reader const &) = delete;
+
+    ~reader()
+    {
+      if (store_)
+        store_->pins_.erase(pin_);
+    }
+
+    std::uint64_t
+    index() const noexcept
+    {
+      return *pin_;
+    }
+
+    /**
+     * @brief Read Key as of the reader's index
+     *
+     * @throw std::out_of_range if not found
+     */
+    Value
+    r(Key const & k) const
+    {
+      auto it = store_->map_.find(k);
+      version_t const * v = it == store_->map_.end() ? nullptr : visible(it->second);
+
+      if (v == nullptr)
+        throw std::out_of_range("key not found");
+
+      return v->value;
+    }
+
+    /**
+     * @brief Call f(key, value) for the next keys in order, as of the
+     * reader's index
+     *
+     * @param limit Number of keys to visit in this step
+     *
+     * @return false once all the keys have been visited
+     */
+    template <typename F>
+    bool
+    scan(F && f, std::size_t limit = std::numeric_limits<std::size_t>::max())
+    {
+      if (done_)
+        return false;
+
+      auto const & map = store_->map_;
+      auto it = cursor_ ? map.upper_bound(*cursor_) : map.begin();
+      auto last = map.end();
+
+      for (; it != map.end() && limit; ++it)
+      {
+        version_t const * v = visible(it->second);
+        if (v == nullptr)
+          continue;
+
+        f(it->first, v->value);
+        --limit;
+        last = it;
+      }
+
+      /* the cursor key is allocated once, then assigned to */
+      if (last != map.end())
+      {
+        if (cursor_)
+          *cursor_ = last->first;
+        else
+          cursor_.reset(new Key(last->first));
+      }
+
+      done_ = it == map.end();
+      return !done_;
+    }
+
+    /**
+     * @brief Start scanning again from the first key
+     */
+    void
+    rewind()
+    {
+      cursor_.reset();
+      done_ = false;
+    }
+
+  private:
+    friend class mvcc;
+
+    reader(mvcc * store, std::multiset<std::uint64_t>::iterator pin) : store_(store), pin_(pin), done_(false)
+    {
+    }
+
+    version_t const *
+    visible(chain_t const & chain) const
+    {
+      for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        if (it->index <= *pin_)
+          return it->live ? &*it : nullptr;
+
+      return nullptr;
+    }
+
+  private:
+    mvcc * store_;
+    std::multiset<std::uint64_t>::iterator pin_;
+    /* last key scanned */
+    std::unique_ptr<Key> cursor_;
+    bool done_;
+  };
+
+public:
+  mvcc() : applied_(0), horizon_(0), versions_(0) {}
+
+  mvcc(mvcc const &) = delete;
+  mvcc & operator=(mvcc const &) = delete;
+
+public:
+  /**
+   * @brief Create or update a key from log entry index
+   */
+  bool
+  put(Key const & k, Value const & v, std::uint64_t index)
+  {
+    add(k, {index, true, v});
+    applied_ = std::max(applied_, index);
+    return true;
+  }
+
+  /**
+   * @brief Delete a key from log entry index
+   */
+  void
+  del(Key const & k, std::uint64_t index)
+  {
+    auto it = map_.find(k);
+
+    if (it != map_.end() && it->second.back().live)
+      add(k, {index, false, Value()});
+
+    applied_ = std::max(applied_, index);
+  }
+
+  /**
+   * @brief Apply a batch of mutations, all tagged with index
+   */
+  bool
+  apply(batch_t const & batch, std::uint64_t index)
+  {
+    for (auto const & m : batch)
+    {
+      if (m.op == batch_t::op_t::put)
+        put(m.key, m.value, index);
+      else
+        del(m.key, index);
+    }
+
+    applied_ = std::max(applied_, index);
+    return true;
+  }
+
+  /**
+   * @brief Read the latest version of a key
+   *
+   * @throw std::out_of_range if not found
+   */
+  Value
+  r(Key const & k) const
+  {
+    auto it = map_.find(k);
+
+    if (it == map_.end() || !it->second.back().live)
+      throw std::out_of_range("key not found");
+
+    return it->second.back().value;
+  }
+
+  std::uint64_t
+  applied_index() const noexcept
+  {
+    return applied_;
+  }
+
+  /**
+   * @brief Read as of a log index, pinning its versions until the reader
+   * is destroyed
+   *
+   * @throw std::out_of_range if the index is past the applied index, or
+   * if its versions may have been collected
+   */
+  reader
+  read_at(std::uint64_t index)
+  {
+    if (applied_ < index || index < horizon_)
+      throw std::out_of_range("index not readable");
+
+    return reader(this, pins_.insert(index));
+  }
+
+  /**
+   * @brief Drop the versions no reader can see anymore
+   *
+   * @return the number of versions dropped
+   */
+  std::size_t
+  gc()
+  {
+    std::uint64_t horizon = pins_.empty() ? applied_ : *pins_.begin();
+    std::size_t dropped = 0;
+
+    for (auto k = stale_.begin(); k != stale_.end();)
+    {
+      auto it = map_.find(*k);
+      chain_t & chain = it->second;
+
+      /* the newest version at or before the horizon is still visible */
+      std::size_t keep = 0;
+      while (keep + 1 < chain.size() && chain[ keep + 1 ].index <= horizon)
+        ++keep;
+
+      chain.erase(chain.begin(), chain.begin() + std::ptrdiff_t(keep));
+      dropped += keep;
+
+      bool settled = chain.size() == 1 && chain.front().live;
+
+      if (chain.size() == 1 && !chain.front().live && chain.front().index <= horizon)
+      {
+        map_.erase(it);
+        ++dropped;
+        settled = true;
+      }
+
+      if (settled)
+        k = stale_.erase(k);
+      else
+        ++k;
+    }
+
+    versions_ -= dropped;
+    horizon_ = std::max(horizon_, horizon);
+
+    return dropped;
+  }
+
+  /**
+   * @brief Get the number of versions held, deletions included
+   */
+  std::size_t
+  versions() const noexcept
+  {
+    return versions_;
+  }
+
+private:
+  void
+  add(Key const & k, version_t && v)
+  {
+    chain_t & chain = map_[ k ];
+
+    /* several mutations of an entry: the last one wins */
+    if (!chain.empty() && chain.back().index == v.index)
+      chain.back() = std::move(v);
+    else
+    {
+      chain.push_back(std::move(v));
+      ++versions_;
+    }
+
+    if (1 < chain.size() || !chain.back().live)
+      stale_.insert(k);
+  }
+
+private:
+  map_t map_;
+
+  /* keys holding more than one version, or a deletion */
+  std::set<Key> stale_;
+  /* indexes of the readers */
+  std::multiset<std::uint64_t> pins_;
+
+  std::uint64_t applied_;
+  /* index of the last collection, no version before it is kept */
+  std::uint64_t horizon_;
+  std::size_t versions_;
+};
+
+} /** !store  */
+} /** !raft  */
+
+#endif /** !RAFT_STORE_MVCC_HH_  */
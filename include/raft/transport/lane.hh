@@ -0,0 +1,51 @@
+#ifndef RAFT_TRANSPORT_LANE_HH_
+#define RAFT_TRANSPORT_LANE_HH_
+
+#include <cstddef>
+
+#include <raft/codec.hh>
+
+namespace raft
+{
+namespace transport
+{
+
+/**
+ * @brief Priority of a frame in an outbox
+ *
+ * Control frames (votes, heartbeats, responses) are small and time
+ * critical: they are written before bulk frames (entries, snapshots)
+ * queued ahead of them, so that replication traffic cannot delay an
+ * election or a heartbeat.
+ */
+enum class lane_t
+{
+  control = 0,
+  bulk = 1,
+};
+
+/** number of lanes */
+constexpr std::size_t lanes = 2;
+
+/**
+ * @brief Lane of an encoded rpc message
+ *
+ * @return bulk for appendentries and installsnapshot requests and frames
+ * that are not rpc messages, control otherwise
+ */
+inline lane_t
+lane_of(void const * frame, std::size_t len)
+{
+  codec::type_t type = codec::type_t::appendentries_request;
+
+  if (any(codec::peek(frame, len, type)) || type == codec::type_t::appendentries_request ||
+      type == codec::type_t::installsnapshot_request)
+    return lane_t::bulk;
+
+  return lane_t::control;
+}
+
+} /** !transport  */
+} /** !raft  */
+
+#endif /** !RAFT_TRANSPORT_LANE_HH_  */
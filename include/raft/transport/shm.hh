@@ -0,0 +1,490 @@
+#ifndef RAFT_TRANSPORT_SHM_HH_
+#define RAFT_TRANSPORT_SHM_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <raft/transport/status.hh>
+
+namespace raft
+{
+namespace transport
+{
+
+/**
+ * @brief Single producer, single consumer ring of frames
+ *
+ * The ring is laid out in place, its buffer following it in memory, so that
+ * it can live in memory shared between processes. Frames are stored as a
+ * 4 bytes length followed by the payload, padded to 8 bytes, and never
+ * wrap: a padding record fills the end of the buffer when needed.
+ */
+class spsc_ring
+{
+public:
+  static constexpr std::size_t cacheline = 64;
+
+  /**
+   * @brief Get bytes needed by a ring holding capacity bytes of frames
+   */
+  static constexpr std::size_t
+  footprint(std::size_t capacity)
+  {
+    return sizeof(spsc_ring) + capacity;
+  }
+
+  /**
+   * @brief Build a ring in place
+   *
+   * @param capacity Buffer size, a power of two
+   */
+  explicit spsc_ring(std::size_t capacity) : capacity_(capacity), cached_head_(0), cached_tail_(0)
+  {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+  spsc_ring(spsc_ring const &) = delete;
+  spsc_ring &
+  operator=(spsc_ring const &) = delete;
+
+public:
+  /**
+   * @brief Push a frame, producer side
+   *
+   * @return false if there is not enough room
+   */
+  bool
+  push(struct iovec const * iov, int iovcnt)
+  {
+    std::size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+      len += iov[ i ].iov_len;
+
+    std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+    std::size_t at = tail & (capacity_ - 1);
+    std::size_t record = align(header_size + len);
+    std::size_t pad = capacity_ - at < record ? capacity_ - at : 0;
+
+    if (capacity_ < record || len == skip)
+      return false;
+
+    /* look at the consumer position only when the cached one says full */
+    if (capacity_ - (tail - cached_head_) < pad + record)
+    {
+      cached_head_ = head_.load(std::memory_order_acquire);
+
+      if (capacity_ - (tail - cached_head_) < pad + record)
+        return false;
+    }
+
+    if (pad)
+    {
+      put_header(at, skip);
+      tail += pad;
+      at = 0;
+    }
+
+    put_header(at, std::uint32_t(len));
+
+    std::size_t pos = at + header_size;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+      std::memcpy(data() + pos, iov[ i ].iov_base, iov[ i ].iov_len);
+      pos += iov[ i ].iov_len;
+    }
+
+    tail_.store(tail + record, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Consume frames, consumer side
+   *
+   * Frames are valid for the duration of the callback only.
+   *
+   * @tparam F Callback function type (std::uint8_t const *, std::size_t) -> void
+   * @param f Callback function
+   * @param max Maximum number of frames consumed
+   *
+   * @return the number of frames consumed
+   */
+  template <typename F>
+  std::size_t
+  poll(F && f, std::size_t max = std::numeric_limits<std::size_t>::max())
+  {
+    std::uint64_t head = head_.load(std::memory_order_relaxed);
+    std::size_t n = 0;
+
+    if (head == cached_tail_)
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+
+    while (head != cached_tail_ && n < max)
+    {
+      std::size_t at = head & (capacity_ - 1);
+      std::uint32_t len = get_header(at);
+
+      if (len == skip)
+      {
+        head += capacity_ - at;
+        continue;
+      }
+
+      f(static_cast<std::uint8_t const *>(data() + at + header_size), std::size_t(len));
+
+      head += align(header_size + len);
+      ++n;
+    }
+
+    head_.store(head, std::memory_order_release);
+    return n;
+  }
+
+  /**
+   * @brief Check whether frames are waiting
+   */
+  bool
+  empty() const noexcept
+  {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+  std::size_t
+  capacity() const noexcept
+  {
+    return capacity_;
+  }
+
+private:
+  static constexpr std::size_t header_size = 4;
+  static constexpr std::uint32_t skip = std::numeric_limits<std::uint32_t>::max();
+
+  static constexpr std::size_t
+  align(std::size_t n)
+  {
+    return (n + 7) & ~std::size_t(7);
+  }
+
+  std::uint8_t *
+  data() noexcept
+  {
+    return reinterpret_cast<std::uint8_t *>(this + 1);
+  }
+
+  void
+  put_header(std::size_t at, std::uint32_t len)
+  {
+    std::memcpy(data() + at, &len, header_size);
+  }
+
+  std::uint32_t
+  get_header(std::size_t at)
+  {
+    std::uint32_t len;
+
+    std::memcpy(&len, data() + at, header_size);
+    return len;
+  }
+
+private:
+  std::size_t const capacity_;
+
+  /** consumer position, and producer copy of it */
+  alignas(cacheline) std::atomic<std::uint64_t> head_;
+  alignas(cacheline) std::uint64_t cached_head_;
+
+  /** producer position, and consumer copy of it */
+  alignas(cacheline) std::atomic<std::uint64_t> tail_;
+  alignas(cacheline) std::uint64_t cached_tail_;
+};
+
+/**
+ * @brief Memory region holding one ring per ordered pair of nodes
+ *
+ * The region is either anonymous, shared by threads and forked processes,
+ * or a named POSIX shared memory object that unrelated processes open.
+ */
+class shm_region
+{
+private:
+  static constexpr std::uint64_t magic = 0x72616674726e6773; /* "raftrngs" */
+
+  struct header_t
+  {
+    std::uint64_t magic;
+    std::uint64_t nodes;
+    std::uint64_t capacity;
+  };
+
+public:
+  /**
+   * @brief Create an anonymous region
+   *
+   * @param nodes Number of nodes
+   * @param capacity Buffer size of each ring, a power of two of at least 64
+   */
+  static std::unique_ptr<shm_region>
+  create(std::size_t nodes, std::size_t capacity)
+  {
+    if (!valid(capacity))
+      return nullptr;
+
+    std::size_t size = footprint(nodes, capacity);
+
+    void * p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      return nullptr;
+
+    return std::unique_ptr<shm_region>(new shm_region(p, size, nodes, capacity, ""));
+  }
+
+  /**
+   * @brief Create a named region, removed when the creator destroys it
+   *
+   * @param name POSIX shared memory object name, starting with a slash
+   */
+  static std::unique_ptr<shm_region>
+  create(std::string const & name, std::size_t nodes, std::size_t capacity)
+  {
+    if (!valid(capacity))
+      return nullptr;
+
+    std::size_t size = footprint(nodes, capacity);
+
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+      return nullptr;
+
+    void * p = MAP_FAILED;
+    if (::ftruncate(fd, off_t(size)) == 0)
+      p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+    {
+      ::shm_unlink(name.c_str());
+      return nullptr;
+    }
+
+    return std::unique_ptr<shm_region>(new shm_region(p, size, nodes, capacity, name));
+  }
+
+  /**
+   * @brief Open a named region created by another process
+   */
+  static std::unique_ptr<shm_region>
+  open(std::string const & name)
+  {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd == -1)
+      return nullptr;
+
+    struct stat st;
+    void * p = MAP_FAILED;
+
+    if (::fstat(fd, &st) == 0 && sizeof(header_t) <= std::size_t(st.st_size))
+      p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+      return nullptr;
+
+    auto h = static_cast<header_t *>(p);
+
+    if (h->magic != magic ||
+        footprint(std::size_t(h->nodes), std::size_t(h->capacity)) != std::size_t(st.st_size))
+    {
+      ::munmap(p, std::size_t(st.st_size));
+      return nullptr;
+    }
+
+    return std::unique_ptr<shm_region>(new shm_region(p, std::size_t(st.st_size)));
+  }
+
+  shm_region(shm_region const &) = delete;
+  shm_region &
+  operator=(shm_region const &) = delete;
+
+  ~shm_region()
+  {
+    ::munmap(base_, size_);
+
+    if (!name_.empty())
+      ::shm_unlink(name_.c_str());
+  }
+
+public:
+  std::size_t
+  nodes() const noexcept
+  {
+    return std::size_t(header()->nodes);
+  }
+
+  /**
+   * @brief Get ring carrying frames from a node to another
+   */
+  spsc_ring &
+  ring(std::size_t from, std::size_t to) noexcept
+  {
+    std::size_t stride = spsc_ring::footprint(std::size_t(header()->capacity));
+    auto p = static_cast<std::uint8_t *>(base_) + rings_offset + (from * nodes() + to) * stride;
+
+    return *reinterpret_cast<spsc_ring *>(p);
+  }
+
+private:
+  static constexpr std::size_t rings_offset = spsc_ring::cacheline;
+
+  static bool
+  valid(std::size_t capacity)
+  {
+    /* rings stay aligned on cache lines */
+    return spsc_ring::cacheline <= capacity && (capacity & (capacity - 1)) == 0;
+  }
+
+  static std::size_t
+  footprint(std::size_t nodes, std::size_t capacity)
+  {
+    return rings_offset + nodes * nodes * spsc_ring::footprint(capacity);
+  }
+
+  /* creator: lay the rings out */
+  shm_region(void * base, std::size_t size, std::size_t nodes, std::size_t capacity, std::string name)
+    : base_(base), size_(size), name_(std::move(name))
+  {
+    header()->nodes = nodes;
+    header()->capacity = capacity;
+
+    for (std::size_t i = 0; i < nodes; ++i)
+      for (std::size_t j = 0; j < nodes; ++j)
+        new (&ring(i, j)) spsc_ring(capacity);
+
+    std::atomic_thread_fence(std::memory_order_release);
+    header()->magic = magic;
+  }
+
+  /* opener */
+  shm_region(void * base, std::size_t size) : base_(base), size_(size) {}
+
+  header_t *
+  header() const noexcept
+  {
+    return static_cast<header_t *>(base_);
+  }
+
+private:
+  void * base_;
+  std::size_t size_;
+
+  /** set by the creator of a named region only */
+  std::string name_;
+};
+
+/**
+ * @brief Shared memory transport endpoint
+ *
+ * Frames are moved through the rings of a region, without system calls.
+ * Nodes are numbered from 0 to the number of nodes of the region. Nothing
+ * runs in the background: receivers poll their inbound rings.
+ *
+ * Only one thread may send from, and one thread may poll for, a given
+ * endpoint.
+ */
+class shm
+{
+public:
+  using node_id_t = std::size_t;
+
+public:
+  /**
+   * @brief Attach to a region as a node
+   */
+  shm(shm_region & region, node_id_t self) : region_(region), self_(self), next_(0) {}
+
+public:
+  node_id_t
+  id() const noexcept
+  {
+    return self_;
+  }
+
+  /**
+   * @brief Push a frame to a peer
+   *
+   * @return ok if success, unknown_peer, or full if the ring has no room
+   */
+  status_t
+  send(node_id_t const & to, struct iovec const * iov, int iovcnt)
+  {
+    if (region_.nodes() <= to || to == self_)
+      return status_t::unknown_peer;
+
+    return region_.ring(self_, to).push(iov, iovcnt) ? status_t::ok : status_t::full;
+  }
+
+  status_t
+  send(node_id_t const & to, void const * data, std::size_t len)
+  {
+    struct iovec iov;
+
+    iov.iov_base = const_cast<void *>(data);
+    iov.iov_len = len;
+
+    return send(to, &iov, 1);
+  }
+
+  /**
+   * @brief Consume frames sent to this node
+   *
+   * Inbound rings are visited round robin, so that a busy peer does not
+   * starve the others.
+   *
+   * @tparam F Callback function type (node_id_t, std::uint8_t const *, std::size_t) -> void
+   * @param f Callback function
+   * @param max Maximum number of frames consumed per peer
+   *
+   * @return the number of frames consumed
+   */
+  template <typename F>
+  std::size_t
+  poll(F && f, std::size_t max = 64)
+  {
+    std::size_t n = 0;
+    std::size_t nodes = region_.nodes();
+
+    for (std::size_t i = 0; i < nodes; ++i)
+    {
+      node_id_t from = (next_ + i) % nodes;
+      if (from == self_)
+        continue;
+
+      n += region_.ring(from, self_).poll(
+        [&](std::uint8_t const * data, std::size_t len) { f(from, data, len); }, max);
+    }
+
+    next_ = (next_ + 1) % nodes;
+    return n;
+  }
+
+private:
+  shm_region & region_;
+  node_id_t self_;
+  std::size_t next_;
+};
+
+} /** !transport  */
+} /** !raft  */
+
+#endif /** !RAFT_TRANSPORT_SHM_HH_  */
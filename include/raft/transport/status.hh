@@ -0,0 +1,30 @@
+#ifndef RAFT_TRANSPORT_STATUS_HH_
+#define RAFT_TRANSPORT_STATUS_HH_
+
+#include <raft/traits.hh>
+
+namespace raft
+{
+namespace transport
+{
+
+enum class status_t
+{
+  ok = 0,
+  fail = 1,
+  unknown_peer = 2,
+  full = 3,
+  too_large = 4,
+};
+
+} /** !transport  */
+
+template <>
+struct enum_traits<transport::status_t>
+{
+  static constexpr bool has_any = true;
+};
+
+} /** !raft  */
+
+#endif /** !RAFT_TRANSPORT_STATUS_HH_  */
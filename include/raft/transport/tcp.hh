@@ -0,0 +1,1007 @@
+#ifndef RAFT_TRANSPORT_TCP_HH_
+#define RAFT_TRANSPORT_TCP_HH_
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <raft/codec.hh>
+#include <raft/transport/lane.hh>
+#include <raft/transport/status.hh>
+
+namespace raft
+{
+namespace transport
+{
+
+/**
+ * @brief Non-blocking TCP transport
+ *
+ * Messages are opaque frames, prefixed with their length on the wire. Each
+ * node opens one connection to each of its peers and sends its own id
+ * first, so that messages read on accepted connections can be attributed.
+ *
+ * Frames sent to a peer are queued in its outbox and written by the I/O
+ * thread owning the peer, as many at a time as possible with writev.
+ * Peers and accepted connections are spread over the I/O threads, each
+ * running its own epoll loop. Frames still queued when a connection drops
+ * are sent once it is re-established; a frame partially written is lost.
+ * A lane of an outbox holds at most max_outbox bytes not yet accepted by
+ * the socket, so that sends to a slow peer end up refused.
+ *
+ * An outbox has one queue per lane. Control frames are written ahead of
+ * the bulk frames queued before them, at frame boundaries: a control frame
+ * waits at most for the bulk frame being written, and for the bytes the
+ * sockets hold already, bounded by send_buffer and receive_buffer. Bulk
+ * frames are handed to writev max_write bytes at a time, so that control
+ * frames sent meanwhile are picked up between writes. Bulk frames still
+ * get one slot after every control_burst control frames.
+ *
+ * @tparam node_id_t Node id type, encoded with codec::traits
+ */
+template <typename node_id_t = unsigned long int>
+class tcp
+{
+public:
+  using clock_t = std::chrono::steady_clock;
+
+  /**
+   * @brief Callback receiving frames, run on an I/O thread
+   */
+  using handler_t = std::function<void(node_id_t const &, std::uint8_t const *, std::size_t)>;
+
+  struct options_t
+  {
+    /** number of I/O threads */
+    unsigned int io_threads = 1;
+
+    /** bytes of a lane not yet written to a peer before sends are refused */
+    std::size_t max_outbox = std::size_t(64) << 20;
+
+    /** control frames written in a row while bulk frames wait */
+    unsigned int control_burst = 16;
+
+    /** send buffer of connections to peers, 0 for the system default */
+    std::size_t send_buffer = std::size_t(256) << 10;
+
+    /** receive buffer of connections from peers, 0 for the system default */
+    std::size_t receive_buffer = std::size_t(256) << 10;
+
+    /** bulk bytes handed to one writev */
+    std::size_t max_write = std::size_t(256) << 10;
+
+    /** largest frame sent or accepted, at most 4 GiB - 1 */
+    std::size_t max_frame = std::size_t(64) << 20;
+
+    /** delay between connection attempts */
+    std::chrono::milliseconds reconnect = std::chrono::milliseconds(100);
+  };
+
+private:
+  static constexpr std::size_t header_size = 4;
+  static constexpr std::size_t max_header = 0xffffffff;
+
+  struct worker_t;
+  struct peer_t;
+
+  struct conn_t
+  {
+    enum class kind_t
+    {
+      event,
+      listener,
+      outbound,
+      inbound,
+    };
+
+    kind_t kind;
+    int fd = -1;
+    worker_t * worker = nullptr;
+
+    /** outbound: destination peer, connected once the handshake is done */
+    peer_t * peer = nullptr;
+    bool connected = false;
+    bool writing = false;
+
+    /** inbound: sender, known once its id is read */
+    node_id_t from{};
+    bool identified = false;
+
+    std::vector<std::uint8_t> in;
+    std::size_t in_len = 0;
+  };
+
+  struct peer_t
+  {
+    node_id_t id;
+    sockaddr_in addr;
+    worker_t * worker;
+
+    /** frames queued by senders, and bytes not written yet, per lane */
+    std::mutex lock;
+    std::deque<std::vector<std::uint8_t>> queue[ lanes ];
+    std::vector<std::vector<std::uint8_t>> spare;
+    std::size_t queued[ lanes ] = {};
+    std::atomic<bool> dirty{false};
+
+    /** frames being written, per lane, owned by the I/O thread */
+    std::deque<std::vector<std::uint8_t>> sending[ lanes ];
+    /** lane whose first frame is partially written, and how much of it */
+    int partial = -1;
+    std::size_t offset = 0;
+    /** control frames written since the last bulk frame */
+    unsigned int burst = 0;
+    conn_t conn;
+    clock_t::time_point last_attempt;
+  };
+
+  struct worker_t
+  {
+    int epfd = -1;
+    conn_t event;
+    std::thread thread;
+
+    std::mutex lock;
+    std::vector<peer_t *> dirty;
+    std::vector<std::unique_ptr<conn_t>> inbound;
+    std::vector<peer_t *> peers;
+  };
+
+public:
+  /**
+   * @brief Build a transport
+   *
+   * @param self Id sent to peers when connecting
+   * @param options Transport options
+   */
+  explicit tcp(node_id_t const & self, options_t const & options = options_t())
+    : self_(self), options_(options), running_(false), next_worker_(0)
+  {
+    if (options_.io_threads == 0)
+      options_.io_threads = 1;
+
+    listener_.kind = conn_t::kind_t::listener;
+
+    for (unsigned int i = 0; i < options_.io_threads; ++i)
+    {
+      auto w = std::make_unique<worker_t>();
+
+      w->epfd = ::epoll_create1(EPOLL_CLOEXEC);
+      w->event.kind = conn_t::kind_t::event;
+      w->event.fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      w->event.worker = w.get();
+      watch(&w->event, EPOLLIN);
+
+      workers_.push_back(std::move(w));
+    }
+  }
+
+  tcp(tcp const &) = delete;
+  tcp &
+  operator=(tcp const &) = delete;
+
+  ~tcp()
+  {
+    stop();
+
+    for (auto & it : peers_)
+      close(&it.second->conn);
+
+    for (auto & w : workers_)
+    {
+      for (auto & c : w->inbound)
+        ::close(c->fd);
+
+      ::close(w->event.fd);
+      ::close(w->epfd);
+    }
+
+    if (listener_.fd != -1)
+      ::close(listener_.fd);
+  }
+
+public:
+  /**
+   * @brief Accept connections on an IPv4 address
+   *
+   * @param host Address to bind
+   * @param port Port to bind, 0 to pick one
+   */
+  status_t
+  listen(std::string const & host, std::uint16_t port)
+  {
+    sockaddr_in addr;
+    if (!resolve(host, port, addr))
+      return status_t::fail;
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+      return status_t::fail;
+
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    /* inherited by accepted connections, the window is sized on accept */
+    if (options_.receive_buffer)
+    {
+      int size = int(options_.receive_buffer);
+      ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 ||
+        ::listen(fd, SOMAXCONN) == -1)
+    {
+      ::close(fd);
+      return status_t::fail;
+    }
+
+    listener_.fd = fd;
+    listener_.worker = workers_[ 0 ].get();
+    watch(&listener_, EPOLLIN);
+
+    return status_t::ok;
+  }
+
+  /**
+   * @brief Get port connections are accepted on, 0 if not listening
+   */
+  std::uint16_t
+  port() const
+  {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (listener_.fd == -1 ||
+        ::getsockname(listener_.fd, reinterpret_cast<sockaddr *>(&addr), &len) == -1)
+      return 0;
+
+    return ntohs(addr.sin_port);
+  }
+
+  /**
+   * @brief Declare a peer
+   *
+   * The connection is opened on the first frame sent. Peers must be
+   * declared before start().
+   */
+  status_t
+  peer_add(node_id_t const & id, std::string const & host, std::uint16_t port)
+  {
+    if (running_ || peers_.count(id))
+      return status_t::fail;
+
+    auto p = std::make_unique<peer_t>();
+
+    if (!resolve(host, port, p->addr))
+      return status_t::fail;
+
+    p->id = id;
+    p->worker = workers_[ peers_.size() % workers_.size() ].get();
+    p->conn.kind = conn_t::kind_t::outbound;
+    p->conn.worker = p->worker;
+    p->conn.peer = p.get();
+    p->worker->peers.push_back(p.get());
+
+    peers_.emplace(id, std::move(p));
+    return status_t::ok;
+  }
+
+  void
+  on_message(handler_t const & handler)
+  {
+    handler_ = handler;
+  }
+
+public:
+  /**
+   * @brief Start the I/O threads
+   */
+  status_t
+  start()
+  {
+    if (running_.exchange(true))
+      return status_t::fail;
+
+    for (auto & w : workers_)
+    {
+      auto ptr = w.get();
+      w->thread = std::thread([this, ptr]() { run(*ptr); });
+    }
+
+    return status_t::ok;
+  }
+
+  /**
+   * @brief Stop and join the I/O threads
+   */
+  void
+  stop()
+  {
+    if (!running_.exchange(false))
+      return;
+
+    for (auto & w : workers_)
+      wake(*w);
+
+    for (auto & w : workers_)
+      w->thread.join();
+  }
+
+public:
+  /**
+   * @brief Queue a frame for a peer
+   *
+   * The frame is copied, buffers can be reused as soon as send returns.
+   * Safe to call from any thread, including I/O threads.
+   *
+   * @param id Peer
+   * @param iov Frame, gathered
+   * @param iovcnt Number of frame pieces
+   * @param lane Lane of the frame
+   *
+   * @return ok if queued, unknown_peer, too_large if the frame is larger than
+   * max_frame, or full if the lane is full
+   */
+  status_t
+  send(node_id_t const & id, struct iovec const * iov, int iovcnt, lane_t lane = lane_t::bulk)
+  {
+    auto it = peers_.find(id);
+    if (it == peers_.end())
+      return status_t::unknown_peer;
+
+    peer_t & p = *it->second;
+
+    std::size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+      len += iov[ i ].iov_len;
+
+    /* the peer would drop the connection, and the header holds 32 bits */
+    if (options_.max_frame < len || max_header < len)
+      return status_t::too_large;
+
+    {
+      std::lock_guard<std::mutex> guard(p.lock);
+
+      std::size_t l = std::size_t(lane);
+
+      if (options_.max_outbox < p.queued[ l ] + header_size + len)
+        return status_t::full;
+
+      std::vector<std::uint8_t> frame;
+      if (!p.spare.empty())
+      {
+        frame = std::move(p.spare.back());
+        p.spare.pop_back();
+      }
+
+      frame.resize(header_size + len);
+      put_header(frame.data(), len);
+
+      std::size_t pos = header_size;
+      for (int i = 0; i < iovcnt; ++i)
+      {
+        std::memcpy(frame.data() + pos, iov[ i ].iov_base, iov[ i ].iov_len);
+        pos += iov[ i ].iov_len;
+      }
+
+      p.queued[ l ] += frame.size();
+      p.queue[ l ].push_back(std::move(frame));
+    }
+
+    /* wake the I/O thread once per batch of frames */
+    if (!p.dirty.exchange(true))
+    {
+      {
+        std::lock_guard<std::mutex> guard(p.worker->lock);
+        p.worker->dirty.push_back(&p);
+      }
+      wake(*p.worker);
+    }
+
+    return status_t::ok;
+  }
+
+  status_t
+  send(node_id_t const & id, void const * data, std::size_t len, lane_t lane = lane_t::bulk)
+  {
+    struct iovec iov;
+
+    iov.iov_base = const_cast<void *>(data);
+    iov.iov_len = len;
+
+    return send(id, &iov, 1, lane);
+  }
+
+private:
+  static bool
+  resolve(std::string const & host, std::uint16_t port, sockaddr_in & addr)
+  {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    return ::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1;
+  }
+
+  static void
+  put_header(std::uint8_t * p, std::size_t len)
+  {
+    for (std::size_t i = 0; i < header_size; ++i)
+      p[ i ] = std::uint8_t(len >> (8 * i));
+  }
+
+  static std::size_t
+  get_header(std::uint8_t const * p)
+  {
+    std::size_t len = 0;
+
+    for (std::size_t i = 0; i < header_size; ++i)
+      len |= std::size_t(p[ i ]) << (8 * i);
+
+    return len;
+  }
+
+  void
+  watch(conn_t * c, std::uint32_t events, int op = EPOLL_CTL_ADD)
+  {
+    epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = c;
+    ::epoll_ctl(c->worker->epfd, op, c->fd, &ev);
+  }
+
+  static void
+  wake(worker_t & w)
+  {
+    std::uint64_t one = 1;
+
+    /* the counter saturating means the thread is awake already */
+    (void)!::write(w.event.fd, &one, sizeof(one));
+  }
+
+  void
+  close(conn_t * c)
+  {
+    if (c->fd == -1)
+      return;
+
+    ::epoll_ctl(c->worker->epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+
+    c->fd = -1;
+    c->connected = false;
+    c->writing = false;
+    c->in_len = 0;
+  }
+
+private:
+  void
+  run(worker_t & w)
+  {
+    epoll_event events[ 64 ];
+
+    while (running_)
+    {
+      int n = ::epoll_wait(w.epfd, events, 64, int(options_.reconnect.count()));
+
+      for (int i = 0; i < n; ++i)
+      {
+        auto c = static_cast<conn_t *>(events[ i ].data.ptr);
+
+        switch (c->kind)
+        {
+          case conn_t::kind_t::event:
+            on_event(w);
+            break;
+
+          case conn_t::kind_t::listener:
+            on_accept();
+            break;
+
+          case conn_t::kind_t::outbound:
+            on_outbound(*c->peer, events[ i ].events);
+            break;
+
+          case conn_t::kind_t::inbound:
+            on_inbound(w, c, events[ i ].events);
+            break;
+        }
+      }
+
+      /* retry peers whose connection dropped */
+      for (auto p : w.peers)
+      {
+        if (p->conn.fd == -1 && pending(*p))
+          flush(*p);
+      }
+    }
+  }
+
+  void
+  on_event(worker_t & w)
+  {
+    std::uint64_t v;
+    (void)!::read(w.event.fd, &v, sizeof(v));
+
+    std::vector<peer_t *> dirty;
+    {
+      std::lock_guard<std::mutex> guard(w.lock);
+      dirty.swap(w.dirty);
+    }
+
+    for (auto p : dirty)
+    {
+      p->dirty = false;
+      flush(*p);
+    }
+  }
+
+  void
+  on_accept()
+  {
+    for (;;)
+    {
+      int fd = ::accept4(listener_.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1)
+        return;
+
+      int one = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+      auto & w = *workers_[ next_worker_++ % workers_.size() ];
+      auto c = std::make_unique<conn_t>();
+
+      c->kind = conn_t::kind_t::inbound;
+      c->fd = fd;
+      c->worker = &w;
+
+      conn_t * ptr = c.get();
+      {
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.inbound.push_back(std::move(c));
+      }
+      watch(ptr, EPOLLIN | EPOLLRDHUP);
+    }
+  }
+
+  void
+  on_outbound(peer_t & p, std::uint32_t events)
+  {
+    conn_t & c = p.conn;
+
+    if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+    {
+      disconnect(p);
+      return;
+    }
+
+    if (!c.connected && (events & EPOLLOUT))
+    {
+      int err = 0;
+      socklen_t len = sizeof(err);
+
+      if (::getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0)
+      {
+        disconnect(p);
+        return;
+      }
+
+      handshake(p);
+    }
+
+    if (events & EPOLLIN)
+    {
+      /* peers never write on our connections, this is a close */
+      std::uint8_t buf[ 64 ];
+      ssize_t r = ::read(c.fd, buf, sizeof(buf));
+
+      if (r == 0 || (r == -1 && errno != EAGAIN && errno != EINTR))
+      {
+        disconnect(p);
+        return;
+      }
+    }
+
+    if (c.connected && (events & EPOLLOUT))
+      flush(p);
+  }
+
+  void
+  on_inbound(worker_t & w, conn_t * c, std::uint32_t events)
+  {
+    bool closed = (events & (EPOLLERR | EPOLLHUP)) != 0;
+
+    if (!closed && (events & (EPOLLIN | EPOLLRDHUP)))
+      closed = !receive(*c);
+
+    if (!closed)
+      return;
+
+    close(c);
+
+    std::lock_guard<std::mutex> guard(w.lock);
+    for (auto it = w.inbound.begin(); it != w.inbound.end(); ++it)
+    {
+      if (it->get() == c)
+      {
+        w.inbound.erase(it);
+        break;
+      }
+    }
+  }
+
+  /**
+   * @brief Read and dispatch frames
+   *
+   * @return false if the connection must be closed
+   */
+  bool
+  receive(conn_t & c)
+  {
+    for (;;)
+    {
+      if (c.in.size() - c.in_len < 4096)
+        c.in.resize(std::max<std::size_t>(c.in.size() * 2, 16384));
+
+      ssize_t r = ::read(c.fd, c.in.data() + c.in_len, c.in.size() - c.in_len);
+
+      if (r == 0)
+        return false;
+
+      if (r == -1)
+      {
+        if (errno == EINTR)
+          continue;
+
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+
+      c.in_len += std::size_t(r);
+
+      std::size_t pos = 0;
+      while (header_size <= c.in_len - pos)
+      {
+        std::size_t len = get_header(c.in.data() + pos);
+
+        if (options_.max_frame < len)
+          return false;
+
+        if (c.in_len - pos < header_size + len)
+        {
+          /* make room for the whole frame */
+          if (c.in.size() < header_size + len)
+            c.in.resize(header_size + len);
+          break;
+        }
+
+        std::uint8_t const * data = c.in.data() + pos + header_size;
+
+        if (!c.identified)
+        {
+          codec::reader rd(data, len);
+
+          codec::traits<node_id_t>::decode(rd, c.from);
+          if (!rd.ok())
+            return false;
+
+          c.identified = true;
+        }
+        else if (handler_)
+          handler_(c.from, data, len);
+
+        pos += header_size + len;
+      }
+
+      /* keep the incomplete frame at the front */
+      if (pos)
+      {
+        std::memmove(c.in.data(), c.in.data() + pos, c.in_len - pos);
+        c.in_len -= pos;
+      }
+    }
+  }
+
+  void
+  connect(peer_t & p)
+  {
+    conn_t & c = p.conn;
+
+    p.last_attempt = clock_t::now();
+
+    c.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd == -1)
+      return;
+
+    int one = 1;
+    ::setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    /* bulk bytes buffered by the kernel are ahead of any control frame */
+    if (options_.send_buffer)
+    {
+      int size = int(options_.send_buffer);
+      ::setsockopt(c.fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+
+    int r = ::connect(c.fd, reinterpret_cast<sockaddr const *>(&p.addr), sizeof(p.addr));
+
+    if (r == -1 && errno != EINPROGRESS)
+    {
+      ::close(c.fd);
+      c.fd = -1;
+      return;
+    }
+
+    c.writing = true;
+    watch(&c, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+
+    if (r == 0)
+      handshake(p);
+  }
+
+  void
+  handshake(peer_t & p)
+  {
+    std::uint8_t buf[ header_size + 16 ];
+    codec::writer w(buf + header_size, sizeof(buf) - header_size);
+
+    codec::traits<node_id_t>::encode(w, self_);
+    put_header(buf, w.size());
+
+    /* first on the wire: nothing is partially written on a new connection */
+    p.sending[ std::size_t(lane_t::control) ].emplace_front(buf, buf + header_size + w.size());
+    {
+      std::lock_guard<std::mutex> guard(p.lock);
+      p.queued[ std::size_t(lane_t::control) ] += header_size + w.size();
+    }
+    p.burst = 0;
+    p.conn.connected = true;
+  }
+
+  void
+  disconnect(peer_t & p)
+  {
+    close(&p.conn);
+
+    /* the peer drops the partial frame along with the connection */
+    if (p.partial != -1)
+    {
+      recycle(p, p.partial, std::move(p.sending[ p.partial ].front()));
+      p.sending[ p.partial ].pop_front();
+      p.partial = -1;
+      p.offset = 0;
+    }
+  }
+
+  /**
+   * @brief Write as many queued frames as the socket accepts
+   */
+  void
+  flush(peer_t & p)
+  {
+    conn_t & c = p.conn;
+
+    if (c.fd == -1)
+    {
+      if (clock_t::now() - p.last_attempt < options_.reconnect)
+        return;
+
+      connect(p);
+      if (c.fd == -1)
+        return;
+    }
+
+    if (!c.connected)
+      return;
+
+    for (;;)
+    {
+      {
+        std::lock_guard<std::mutex> guard(p.lock);
+
+        for (std::size_t l = 0; l < lanes; ++l)
+        {
+          for (auto & f : p.queue[ l ])
+            p.sending[ l ].push_back(std::move(f));
+
+          p.queue[ l ].clear();
+        }
+      }
+
+      struct iovec iov[ 64 ];
+      int lane[ 64 ];
+      int iovcnt = schedule(p, iov, lane);
+
+      if (iovcnt == 0)
+        break;
+
+      ssize_t r = ::writev(c.fd, iov, iovcnt);
+
+      if (r == -1)
+      {
+        if (errno == EINTR)
+          continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+          /* resume when the socket drains */
+          if (!c.writing)
+          {
+            c.writing = true;
+            watch(&c, EPOLLIN | EPOLLOUT | EPOLLRDHUP, EPOLL_CTL_MOD);
+          }
+          return;
+        }
+
+        disconnect(p);
+        return;
+      }
+
+      std::size_t written = std::size_t(r);
+
+      /* frames of a lane were picked from its front, in iov order */
+      for (int i = 0; i < iovcnt && written; ++i)
+      {
+        if (written < iov[ i ].iov_len)
+        {
+          p.offset = p.partial == lane[ i ] ? p.offset + written : written;
+          p.partial = lane[ i ];
+          break;
+        }
+
+        written -= iov[ i ].iov_len;
+        p.partial = -1;
+        p.offset = 0;
+
+        auto & q = p.sending[ lane[ i ] ];
+        recycle(p, lane[ i ], std::move(q.front()));
+        q.pop_front();
+      }
+    }
+
+    if (c.writing)
+    {
+      c.writing = false;
+      watch(&c, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_MOD);
+    }
+  }
+
+  /**
+   * @brief Pick the frames of the next writev
+   *
+   * The frame partially written goes first, then control frames, letting
+   * one bulk frame through after control_burst of them, until max_write
+   * bulk bytes are picked.
+   *
+   * @return the number of frames picked
+   */
+  int
+  schedule(peer_t & p, struct iovec * iov, int * lane)
+  {
+    auto & control = p.sending[ std::size_t(lane_t::control) ];
+    auto & bulk = p.sending[ std::size_t(lane_t::bulk) ];
+
+    std::size_t next[ lanes ] = {};
+    std::size_t bulk_bytes = 0;
+    int iovcnt = 0;
+
+    if (p.partial != -1)
+    {
+      auto & f = p.sending[ p.partial ].front();
+
+      iov[ 0 ].iov_base = f.data() + p.offset;
+      iov[ 0 ].iov_len = f.size() - p.offset;
+      lane[ 0 ] = p.partial;
+      next[ p.partial ] = 1;
+      iovcnt = 1;
+
+      if (p.partial == int(lane_t::bulk))
+        bulk_bytes = iov[ 0 ].iov_len;
+    }
+
+    while (iovcnt < 64)
+    {
+      bool has_control = next[ 0 ] < control.size();
+      bool has_bulk =
+        next[ 1 ] < bulk.size() && (bulk_bytes == 0 || bulk_bytes < options_.max_write);
+      int l;
+
+      if (has_control && (!has_bulk || p.burst < options_.control_burst))
+      {
+        l = int(lane_t::control);
+        ++p.burst;
+      }
+      else if (has_bulk)
+      {
+        l = int(lane_t::bulk);
+        p.burst = 0;
+      }
+      else
+        break;
+
+      auto & f = p.sending[ l ][ next[ l ]++ ];
+
+      if (l == int(lane_t::bulk))
+        bulk_bytes += f.size();
+
+      iov[ iovcnt ].iov_base = f.data();
+      iov[ iovcnt ].iov_len = f.size();
+      lane[ iovcnt ] = l;
+      ++iovcnt;
+    }
+
+    return iovcnt;
+  }
+
+  bool
+  pending(peer_t & p)
+  {
+    std::lock_guard<std::mutex> guard(p.lock);
+
+    for (std::size_t l = 0; l < lanes; ++l)
+    {
+      if (!p.sending[ l ].empty() || !p.queue[ l ].empty())
+        return true;
+    }
+
+    return false;
+  }
+
+  /**
+   * @brief Release a frame written, or dropped, from the outbox
+   */
+  void
+  recycle(peer_t & p, int lane, std::vector<std::uint8_t> && frame)
+  {
+    std::lock_guard<std::mutex> guard(p.lock);
+
+    p.queued[ lane ] -= frame.size();
+
+    if (p.spare.size() < 64)
+      p.spare.push_back(std::move(frame));
+  }
+
+private:
+  node_id_t self_;
+  options_t options_;
+
+  std::atomic<bool> running_;
+
+  conn_t listener_;
+  std::vector<std::unique_ptr<worker_t>> workers_;
+  std::atomic<unsigned int> next_worker_;
+
+  std::unordered_map<node_id_t, std::unique_ptr<peer_t>> peers_;
+  handler_t handler_;
+};
+
+template <typename node_id_t>
+constexpr std::size_t tcp<node_id_t>::header_size;
+
+template <typename node_id_t>
+constexpr std::size_t tcp<node_id_t>::max_header;
+
+} /** !transport  */
+} /** !raft  */
+
+#endif /** !RAFT_TRANSPORT_TCP_HH_  */
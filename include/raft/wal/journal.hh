@@ -0,0 +1,790 @@
+#ifndef RAFT_WAL_JOURNAL_HH_
+#define RAFT_WAL_JOURNAL_HH_
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <raft/traits.hh>
+#include <raft/wal/posix.hh>
+#include <raft/wal/uring.hh>
+#include <utils/crc32.hh>
+#include <utils/ring.hh>
+
+namespace raft
+{
+namespace wal
+{
+
+enum class status_t
+{
+  ok = 0,
+  fail = 1,
+  /** no buffer or queue slot left, poll then retry */
+  full = 2,
+};
+
+} /** !wal  */
+
+template <>
+struct enum_traits<wal::status_t>
+{
+  static constexpr bool has_any = true;
+};
+
+namespace wal
+{
+
+struct options_t
+{
+  /** directory holding the segments */
+  std::string path;
+  /** size past which a new segment is started */
+  std::size_t segment_size = 64 << 20;
+  /** size of a write buffer, bounds the size of a record */
+  std::size_t buffer_size = 1 << 20;
+  /** number of write buffers, one is filled while the others are written */
+  unsigned int buffers = 4;
+  /** allocate segments up front, so that fdatasync has no metadata to flush */
+  bool preallocate = false;
+  /** bypass the page cache */
+  bool direct = false;
+};
+
+/**
+ * @brief Write-ahead log made of segment files
+ *
+ * Records are appended to a buffer, written and made durable by the
+ * backend when the buffer is flushed, while the next buffer is filled: all
+ * the records of a buffer share one write and one fdatasync. The caller
+ * never waits for the device; durability is reported by poll.
+ *
+ * A record holds an index and opaque data. Replaying a record whose index
+ * is not past the previous one truncates the log before that index, as a
+ * follower does when its log conflicts with the leader's.
+ *
+ * Starting a segment opens (and preallocates) a file synchronously, once
+ * per segment_size bytes.
+ *
+ * With direct I/O, writes cover whole blocks: the block holding the end of
+ * the log is written again along with the next records, so only one buffer
+ * may be in flight at a time.
+ *
+ * @tparam backend_t Disk backend, uring or posix
+ * @tparam index_t Log index type
+ */
+template <typename backend_t = uring, typename index_t = unsigned long int>
+class journal
+{
+public:
+  /** record header: payload length, checksum, index */
+  static constexpr std::size_t header_size = 16;
+  /** alignment of direct I/O */
+  static constexpr std::size_t block_size = 4096;
+
+public:
+  explicit journal(options_t const & options)
+    : options_(options)
+    , backend_(2 * options.buffers)
+    , fd_(-1)
+    , seq_(0)
+    , end_(0)
+    , cur_(0)
+    , file_off_(0)
+    , used_(0)
+    , last_(0)
+    , durable_(0)
+    , empty_(true)
+    , tag_(0)
+    , flush_(false)
+    , failed_(false)
+  {
+    options_.buffers = std::max(options_.buffers, 2u);
+
+    for (unsigned int i = 0; i < options_.buffers; ++i)
+    {
+      void * p = nullptr;
+      if (posix_memalign(&p, block_size, options_.buffer_size) != 0)
+        throw std::bad_alloc();
+
+      buffers_.push_back({static_cast<std::uint8_t *>(p), false});
+    }
+
+    batches_.reserve(options_.buffers);
+  }
+
+  journal(journal const &) = delete;
+  journal & operator=(journal const &) = delete;
+
+  ~journal()
+  {
+    /* the kernel may still be reading buffers */
+    while (!batches_.empty() && !failed_)
+    {
+      if (poll([](index_t) {}) == 0)
+        usleep(100);
+    }
+
+    for (int fd : retired_)
+      ::close(fd);
+    if (0 <= fd_)
+      ::close(fd_);
+
+    for (auto & b : buffers_)
+      std::free(b.data);
+  }
+
+public:
+  /**
+   * @brief Tell whether the backend is usable
+   */
+  bool
+  ok() const noexcept
+  {
+    return backend_.ok();
+  }
+
+  /**
+   * @brief Replay the segments, then get ready to append
+   *
+   * Replay stops at the first torn or corrupted record: the log is cut
+   * there and later segments are removed.
+   *
+   * @tparam F Callback function type (index_t, std::uint8_t const *, std::size_t) -> void
+   * @param f Callback function, called for each record in order
+   *
+   * @return ok if success
+   */
+  template <typename F>
+  status_t
+  open(F && f)
+  {
+    if (!ok())
+      return status_t::fail;
+
+    if (mkdir(options_.path.c_str(), 0755) < 0 && errno != EEXIST)
+      return status_t::fail;
+
+    std::vector<std::uint64_t> seqs;
+    if (!list(seqs))
+      return status_t::fail;
+
+    std::vector<std::uint8_t> content;
+    std::size_t valid = 0;
+    std::size_t i = 0;
+
+    for (; i < seqs.size(); ++i)
+    {
+      if (!read(seqs[ i ], content))
+        return status_t::fail;
+
+      bool clean = replay(content, valid, f);
+      if (!clean && i + 1 < seqs.size())
+      {
+        /* a hole: whatever follows was never reported durable */
+        for (std::size_t j = i + 1; j < seqs.size(); ++j)
+          unlink(segment_path(seqs[ j ]).c_str());
+        break;
+      }
+
+      if (i + 1 < seqs.size())
+        closed_.push_back({seqs[ i ], last_});
+    }
+
+    durable_ = last_;
+
+    if (seqs.empty())
+      return start(0, 0, content);
+
+    return start(seqs[ std::min(i, seqs.size() - 1) ], valid, content);
+  }
+
+  /**
+   * @brief Append a record
+   *
+   * @param idx Index
+   * @param iov Data, gathered
+   * @param iovcnt Number of data pieces
+   *
+   * @return ok, full if all buffers are in flight, fail on error or if
+   * the record exceeds buffer_size
+   */
+  status_t
+  append(index_t const & idx, struct iovec const * iov, int iovcnt)
+  {
+    if (failed_ || fd_ < 0)
+      return status_t::fail;
+
+    if (!empty_ && last_ + 1 < idx)
+      return status_t::fail;
+
+    std::size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+      len += iov[ i ].iov_len;
+
+    std::size_t rec = record_size(len);
+    if (options_.buffer_size - block_size < rec)
+      return status_t::fail;
+
+    if (0 < end_ && options_.segment_size < end_ + rec)
+    {
+      status_t ret = roll();
+      if (any(ret))
+        return ret;
+    }
+
+    if (options_.buffer_size < used_ + rec)
+    {
+      status_t ret = write();
+      if (any(ret))
+        return ret;
+    }
+
+    std::uint8_t * p = buffers_[ cur_ ].data + used_;
+    std::uint32_t len32 = static_cast<std::uint32_t>(len);
+    std::uint64_t idx64 = idx;
+
+    std::memcpy(p + 8, &idx64, sizeof(idx64));
+
+    std::size_t off = header_size;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+      std::memcpy(p + off, iov[ i ].iov_base, iov[ i ].iov_len);
+      off += iov[ i ].iov_len;
+    }
+
+    std::memset(p + off, 0, rec - off);
+
+    std::uint32_t crc = utils::crc32(p + 8, 8 + len);
+    std::memcpy(p, &len32, sizeof(len32));
+    std::memcpy(p + 4, &crc, sizeof(crc));
+
+    used_ += rec;
+    end_ += rec;
+
+    /* an overwritten suffix is no longer durable, even once written */
+    if (!empty_ && idx <= last_)
+    {
+      durable_ = std::min(durable_, index_t(idx - 1));
+      for (std::size_t i = 0; i < batches_.size(); ++i)
+        batches_[ i ].last = std::min(batches_[ i ].last, index_t(idx - 1));
+    }
+
+    last_ = idx;
+    empty_ = false;
+
+    return status_t::ok;
+  }
+
+  status_t
+  append(index_t const & idx, void const * data, std::size_t len)
+  {
+    struct iovec iov;
+
+    iov.iov_base = const_cast<void *>(data);
+    iov.iov_len = len;
+
+    return append(idx, &iov, 1);
+  }
+
+  /**
+   * @brief Start writing the records appended so far
+   *
+   * With direct I/O, the write may be deferred until the buffer in flight
+   * completes; poll issues it.
+   *
+   * @return ok, or fail on error
+   */
+  status_t
+  flush()
+  {
+    if (failed_)
+      return status_t::fail;
+
+    flush_ = true;
+
+    status_t ret = submit();
+    if (any(ret))
+      return ret;
+
+    ret = write();
+    if (ret == status_t::full)
+      return status_t::ok;
+
+    return ret;
+  }
+
+  /**
+   * @brief Reap completed writes
+   *
+   * @tparam F Callback function type (index_t) -> void
+   * @param f Callback function, given the new durable index when it moves
+   *
+   * @return the number of buffers completed
+   */
+  template <typename F>
+  std::size_t
+  poll(F && f)
+  {
+    std::size_t n = backend_.poll([this](std::uint64_t tag, int res) {
+      auto & b = batches_[ tag - batches_.front().tag ];
+
+      b.done = true;
+      b.res = res;
+    });
+
+    /* with completions reaped, the kernel has room for what it refused */
+    if (!failed_)
+      submit();
+
+    if (n == 0)
+      return 0;
+
+    index_t durable = durable_;
+
+    while (!batches_.empty() && batches_.front().done)
+    {
+      auto const & b = batches_.front();
+
+      if (b.res < 0)
+        failed_ = true;
+      else if (!failed_)
+        durable_ = std::max(durable_, b.last);
+
+      buffers_[ b.buffer ].busy = false;
+      batches_.pop_front();
+    }
+
+    retire();
+
+    if (durable != durable_)
+      f(durable_);
+
+    if (flush_ && !failed_)
+      flush();
+
+    return n;
+  }
+
+  /**
+   * @brief Remove the segments holding only records up to an index
+   *
+   * Called once a snapshot covers these records. The segment being
+   * written is kept.
+   *
+   * @return the number of segments removed
+   */
+  std::size_t
+  release(index_t const & idx)
+  {
+    std::size_t n = 0;
+
+    for (std::size_t i = 0; i < closed_.size();)
+    {
+      if (idx < closed_[ i ].last)
+      {
+        ++i;
+        continue;
+      }
+
+      unlink(segment_path(closed_[ i ].seq).c_str());
+      closed_.erase(closed_.begin() + std::ptrdiff_t(i));
+      ++n;
+    }
+
+    return n;
+  }
+
+  /**
+   * @brief Index of the last record appended
+   */
+  index_t
+  last_index() const noexcept
+  {
+    return last_;
+  }
+
+  /**
+   * @brief Index up to which records are known to be on disk
+   */
+  index_t
+  durable_index() const noexcept
+  {
+    return durable_;
+  }
+
+  /**
+   * @brief Tell whether a write failed, in which case the journal must be
+   * reopened
+   */
+  bool
+  failed() const noexcept
+  {
+    return failed_;
+  }
+
+private:
+  struct buffer_t
+  {
+    std::uint8_t * data;
+    bool busy;
+  };
+
+  struct segment_t
+  {
+    std::uint64_t seq;
+    index_t last;
+  };
+
+  struct batch_t
+  {
+    std::uint64_t tag;
+    unsigned int buffer;
+    int fd;
+    index_t last;
+    bool done;
+    int res;
+  };
+
+private:
+  static std::size_t
+  record_size(std::size_t len)
+  {
+    return (header_size + len + 7) & ~std::size_t(7);
+  }
+
+  std::string
+  segment_path(std::uint64_t seq) const
+  {
+    char name[ 32 ];
+
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".wal", seq);
+    return options_.path + "/" + name;
+  }
+
+  bool
+  list(std::vector<std::uint64_t> & seqs) const
+  {
+    DIR * dir = opendir(options_.path.c_str());
+    if (dir == nullptr)
+      return false;
+
+    while (struct dirent * e = readdir(dir))
+    {
+      char const * name = e->d_name;
+      std::size_t len = std::strlen(name);
+
+      if (len != 20 || std::strcmp(name + 16, ".wal") != 0)
+        continue;
+
+      seqs.push_back(std::strtoull(name, nullptr, 16));
+    }
+
+    closedir(dir);
+    std::sort(seqs.begin(), seqs.end());
+
+    return true;
+  }
+
+  bool
+  read(std::uint64_t seq, std::vector<std::uint8_t> & content) const
+  {
+    int fd = ::open(segment_path(seq).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    content.resize(std::size_t(st.st_size));
+
+    std::size_t done = 0;
+    while (done < content.size())
+    {
+      ssize_t n = ::read(fd, content.data() + done, content.size() - done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+
+      done += std::size_t(n);
+    }
+
+    ::close(fd);
+    content.resize(done);
+
+    return true;
+  }
+
+  /**
+   * @brief Replay the records of a segment
+   *
+   * @param content Segment content
+   * @param valid Length of the valid prefix
+   * @param f Callback function
+   *
+   * @return true if the segment ends cleanly, false if a record is torn,
+   * corrupted or out of sequence
+   */
+  template <typename F>
+  bool
+  replay(std::vector<std::uint8_t> const & content, std::size_t & valid, F & f)
+  {
+    std::size_t off = 0;
+
+    valid = 0;
+
+    while (off + header_size <= content.size())
+    {
+      std::uint8_t const * p = content.data() + off;
+      std::uint32_t len, crc;
+      std::uint64_t idx;
+
+      std::memcpy(&len, p, sizeof(len));
+      std::memcpy(&crc, p + 4, sizeof(crc));
+      std::memcpy(&idx, p + 8, sizeof(idx));
+
+      /* zeroes past the end, preallocated or padding a direct write */
+      if (len == 0 && crc == 0 && idx == 0)
+        return true;
+
+      std::size_t rec = record_size(len);
+      if (content.size() - off < rec || crc != utils::crc32(p + 8, 8 + len))
+        return false;
+
+      if (!empty_ && last_ + 1 < idx)
+        return false;
+
+      f(index_t(idx), p + header_size, std::size_t(len));
+
+      last_ = index_t(idx);
+      empty_ = false;
+      off += rec;
+      valid = off;
+    }
+
+    return off == content.size();
+  }
+
+  /**
+   * @brief Open a segment for writing, cut at its valid length
+   */
+  status_t
+  start(std::uint64_t seq, std::size_t valid, std::vector<std::uint8_t> const & content)
+  {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    if (options_.direct)
+      flags |= O_DIRECT;
+
+    int fd = ::open(segment_path(seq).c_str(), flags, 0644);
+    if (fd < 0)
+      return status_t::fail;
+
+    if (ftruncate(fd, off_t(valid)) < 0 ||
+        (options_.preallocate && fallocate(fd, 0, 0, off_t(options_.segment_size)) < 0))
+    {
+      ::close(fd);
+      return status_t::fail;
+    }
+
+    if (0 <= fd_)
+      retired_.push_back(fd_);
+
+    fd_ = fd;
+    seq_ = seq;
+    end_ = valid;
+    used_ = 0;
+    file_off_ = valid;
+
+    if (options_.direct)
+    {
+      /* the block holding the end of the log is written again */
+      used_ = valid % block_size;
+      file_off_ = valid - used_;
+      std::memcpy(buffers_[ cur_ ].data, content.data() + file_off_, used_);
+    }
+
+    flushed_ = used_;
+
+    return status_t::ok;
+  }
+
+  /**
+   * @brief Write the current buffer out and continue in a new segment
+   */
+  status_t
+  roll()
+  {
+    status_t ret = write();
+    if (any(ret))
+      return ret;
+
+    /* the buffer may still hold the partial block of the old segment */
+    if (options_.direct && !batches_.empty())
+      return status_t::full;
+
+    std::uint64_t seq = seq_;
+    index_t last = last_;
+
+    ret = start(seq_ + 1, 0, {});
+    if (!any(ret))
+      closed_.push_back({seq, last});
+
+    return ret;
+  }
+
+  /**
+   * @brief Submit the current buffer and switch to a free one
+   */
+  status_t
+  write()
+  {
+    if (used_ == flushed_)
+      return status_t::ok;
+
+    if (options_.direct && !batches_.empty())
+      return status_t::full;
+
+    unsigned int next = options_.buffers;
+    for (unsigned int i = 0; i < options_.buffers; ++i)
+    {
+      if (i != cur_ && !buffers_[ i ].busy)
+      {
+        next = i;
+        break;
+      }
+    }
+
+    if (next == options_.buffers)
+      return status_t::full;
+
+    auto & b = buffers_[ cur_ ];
+    std::size_t len = used_;
+
+    if (options_.direct)
+    {
+      len = (used_ + block_size - 1) & ~(block_size - 1);
+      std::memset(b.data + used_, 0, len - used_);
+    }
+
+    if (!backend_.write_sync(fd_, b.data, len, file_off_, tag_))
+      return status_t::full;
+
+    if (any(submit()))
+      return status_t::fail;
+
+    batches_.push_back({tag_, cur_, fd_, last_, false, 0});
+    b.busy = true;
+    ++tag_;
+
+    std::size_t tail = options_.direct ? used_ % block_size : 0;
+    std::memcpy(buffers_[ next ].data, b.data + used_ - tail, tail);
+
+    file_off_ += used_ - tail;
+    used_ = tail;
+    flushed_ = tail;
+    cur_ = next;
+
+    if (used_ == flushed_)
+      flush_ = false;
+
+    return status_t::ok;
+  }
+
+  /**
+   * @brief Submit the writes the backend still holds
+   */
+  status_t
+  submit()
+  {
+    if (backend_.pending() && !backend_.submit())
+    {
+      failed_ = true;
+      return status_t::fail;
+    }
+
+    return status_t::ok;
+  }
+
+  /**
+   * @brief Close the segments no write refers to anymore
+   */
+  void
+  retire()
+  {
+    for (std::size_t i = 0; i < retired_.size();)
+    {
+      int fd = retired_[ i ];
+      bool used = false;
+
+      for (std::size_t j = 0; j < batches_.size() && !used; ++j)
+        used = batches_[ j ].fd == fd;
+
+      if (used)
+      {
+        ++i;
+        continue;
+      }
+
+      ::close(fd);
+      retired_[ i ] = retired_.back();
+      retired_.pop_back();
+    }
+  }
+
+private:
+  options_t options_;
+  backend_t backend_;
+
+  std::vector<buffer_t> buffers_;
+  utils::ring<batch_t> batches_;
+  std::vector<int> retired_;
+  std::vector<segment_t> closed_;
+
+  /* current segment */
+  int fd_;
+  std::uint64_t seq_;
+  std::size_t end_;
+
+  /* current buffer, written at file_off_ */
+  unsigned int cur_;
+  std::size_t file_off_;
+  std::size_t used_;
+  std::size_t flushed_ = 0;
+
+  index_t last_;
+  index_t durable_;
+  bool empty_;
+
+  std::uint64_t tag_;
+  bool flush_;
+  bool failed_;
+};
+
+template <typename backend_t, typename index_t>
+constexpr std::size_t journal<backend_t, index_t>::header_size;
+
+template <typename backend_t, typename index_t>
+constexpr std::size_t journal<backend_t, index_t>::block_size;
+
+} /** !wal  */
+} /** !raft  */
+
+#endif /** !RAFT_WAL_JOURNAL_HH_  */
@@ -0,0 +1,236 @@
+#ifndef RAFT_WAL_POSIX_HH_
+#define RAFT_WAL_POSIX_HH_
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace raft
+{
+namespace wal
+{
+
+/**
+ * @brief Portable disk backend
+ *
+ * Writes and fdatasync are run by a worker thread, so that the caller never
+ * waits for the device. Operations queued between two submits are written
+ * in order and made durable by a single fdatasync per file.
+ */
+class posix
+{
+public:
+  /** default number of operations in flight */
+  static constexpr unsigned int default_depth = 64;
+
+public:
+  explicit posix(unsigned int depth = default_depth) : depth_(depth), inflight_(0), stop_(false)
+  {
+    queued_.reserve(depth);
+    todo_.reserve(depth);
+    done_.reserve(depth);
+    reaped_.reserve(depth);
+
+    worker_ = std::thread([this]() { run(); });
+  }
+
+  posix(posix const &) = delete;
+  posix & operator=(posix const &) = delete;
+
+  ~posix()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+
+    cond_.notify_one();
+    worker_.join();
+  }
+
+public:
+  bool
+  ok() const noexcept
+  {
+    return true;
+  }
+
+  /**
+   * @brief Queue a write followed by an fdatasync of the file
+   *
+   * @return false if the queue has no room left, poll then retry
+   */
+  bool
+  write_sync(int fd, void const * buf, std::size_t len, std::uint64_t off, std::uint64_t tag)
+  {
+    if (depth_ <= inflight_)
+      return false;
+
+    queued_.push_back({fd, static_cast<std::uint8_t const *>(buf), len, off, tag, 0});
+    ++inflight_;
+
+    return true;
+  }
+
+  /**
+   * @brief Hand queued operations to the worker
+   */
+  bool
+  submit()
+  {
+    if (queued_.empty())
+      return true;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      todo_.insert(todo_.end(), queued_.begin(), queued_.end());
+    }
+
+    queued_.clear();
+    cond_.notify_one();
+
+    return true;
+  }
+
+  /**
+   * @brief Reap completions
+   *
+   * @tparam F Callback function type (std::uint64_t tag, int res) -> void
+   * @param f Callback function, res is negative on error
+   *
+   * @return the number of operations completed
+   */
+  template <typename F>
+  std::size_t
+  poll(F && f)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      reaped_.swap(done_);
+    }
+
+    for (auto const & op : reaped_)
+      f(op.tag, op.res);
+
+    std::size_t n = reaped_.size();
+
+    inflight_ -= n;
+    reaped_.clear();
+
+    return n;
+  }
+
+  std::size_t
+  pending() const noexcept
+  {
+    return queued_.size();
+  }
+
+  std::size_t
+  inflight() const noexcept
+  {
+    return inflight_;
+  }
+
+private:
+  struct op_t
+  {
+    int fd;
+    std::uint8_t const * buf;
+    std::size_t len;
+    std::uint64_t off;
+    std::uint64_t tag;
+    int res;
+  };
+
+private:
+  void
+  run()
+  {
+    std::vector<op_t> batch;
+    batch.reserve(depth_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;)
+    {
+      cond_.wait(lock, [this]() { return stop_ || !todo_.empty(); });
+      if (todo_.empty())
+        return;
+
+      batch.swap(todo_);
+      lock.unlock();
+
+      for (auto & op : batch)
+        op.res = write(op);
+
+      /* one fdatasync per file covers the whole batch */
+      for (std::size_t i = 0; i < batch.size(); ++i)
+      {
+        bool seen = false;
+        for (std::size_t j = i + 1; j < batch.size() && !seen; ++j)
+          seen = batch[ j ].fd == batch[ i ].fd;
+
+        if (seen)
+          continue;
+
+        int res = fdatasync(batch[ i ].fd) < 0 ? -errno : 0;
+        for (std::size_t j = 0; j <= i; ++j)
+        {
+          if (batch[ j ].fd == batch[ i ].fd && 0 <= batch[ j ].res)
+            batch[ j ].res = res;
+        }
+      }
+
+      lock.lock();
+      done_.insert(done_.end(), batch.begin(), batch.end());
+      batch.clear();
+    }
+  }
+
+  static int
+  write(op_t const & op)
+  {
+    std::size_t written = 0;
+
+    while (written < op.len)
+    {
+      ssize_t n = pwrite(op.fd, op.buf + written, op.len - written, off_t(op.off + written));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return -errno;
+      }
+
+      written += std::size_t(n);
+    }
+
+    return 0;
+  }
+
+private:
+  std::size_t depth_;
+  std::size_t inflight_;
+
+  std::vector<op_t> queued_;
+  std::vector<op_t> reaped_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<op_t> todo_;
+  std::vector<op_t> done_;
+  bool stop_;
+
+  std::thread worker_;
+};
+
+} /** !wal  */
+} /** !raft  */
+
+#endif /** !RAFT_WAL_POSIX_HH_  */
@@ -0,0 +1,335 @@
+#ifndef RAFT_WAL_URING_HH_
+#define RAFT_WAL_URING_HH_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace raft
+{
+namespace wal
+{
+
+/**
+ * @brief io_uring disk backend
+ *
+ * Each write is submitted along with a linked fdatasync, so that a single
+ * completion tells that the data is durable. Submitting and reaping
+ * completions never wait for the device: the kernel runs the operations
+ * asynchronously.
+ *
+ * The ring is driven with raw system calls, no liburing required.
+ */
+class uring
+{
+public:
+  /** default number of submission queue entries */
+  static constexpr unsigned int default_depth = 64;
+
+public:
+  explicit uring(unsigned int depth = default_depth)
+    : fd_(-1), sq_ptr_(nullptr), sq_size_(0), cq_ptr_(nullptr), cq_size_(0), sqes_(nullptr),
+      queued_(0), inflight_(0)
+  {
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, depth, &p));
+    if (fd_ < 0)
+      return;
+
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(std::uint32_t);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                   IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+    {
+      sq_ptr_ = nullptr;
+      close();
+      return;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ptr_ = sq_ptr_;
+    else
+    {
+      cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                     IORING_OFF_CQ_RING);
+      if (cq_ptr_ == MAP_FAILED)
+      {
+        cq_ptr_ = nullptr;
+        close();
+        return;
+      }
+    }
+
+    void * sqes = mmap(nullptr, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+      close();
+      return;
+    }
+
+    sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+    sqes_count_ = p.sq_entries;
+    cq_count_ = p.cq_entries;
+
+    slots_.resize(sqes_count_ / 2);
+    for (unsigned int i = 0; i < slots_.size(); ++i)
+      free_.push_back(i);
+
+    auto sq = static_cast<std::uint8_t *>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+
+    auto cq = static_cast<std::uint8_t *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+  }
+
+  uring(uring const &) = delete;
+  uring & operator=(uring const &) = delete;
+
+  ~uring()
+  {
+    close();
+  }
+
+public:
+  /**
+   * @brief Tell whether the kernel let the ring be set up
+   */
+  bool
+  ok() const noexcept
+  {
+    return sqes_ != nullptr;
+  }
+
+  /**
+   * @brief Queue a write followed by an fdatasync of the file
+   *
+   * @param fd File descriptor
+   * @param buf Data, left untouched until completion
+   * @param len Data length
+   * @param off File offset
+   * @param tag Reported on completion
+   *
+   * @return false if the queue has no room left, poll then retry
+   */
+  bool
+  write_sync(int fd, void const * buf, std::size_t len, std::uint64_t off, std::uint64_t tag)
+  {
+    /* both entries of the pair complete, keep room for them in the cq */
+    if (!ok() || free_.empty() || sqes_count_ < queued_ + 2 || cq_count_ < inflight_ + 2)
+      return false;
+
+    unsigned int slot = free_.back();
+    free_.pop_back();
+    slots_[ slot ] = {tag, len, 0};
+
+    auto w = sqe();
+    w->opcode = IORING_OP_WRITE;
+    w->flags = IOSQE_IO_LINK;
+    w->fd = fd;
+    w->addr = reinterpret_cast<std::uint64_t>(buf);
+    w->len = static_cast<std::uint32_t>(len);
+    w->off = off;
+    w->user_data = std::uint64_t(slot) << 1;
+
+    auto s = sqe();
+    s->opcode = IORING_OP_FSYNC;
+    s->fd = fd;
+    s->fsync_flags = IORING_FSYNC_DATASYNC;
+    s->user_data = (std::uint64_t(slot) << 1) | 1;
+
+    queued_ += 2;
+    inflight_ += 2;
+
+    return true;
+  }
+
+  /**
+   * @brief Hand queued operations to the kernel, without waiting for them
+   *
+   * The kernel may take them only in part: when interrupted, short of
+   * memory, or while completions overflow the cq (EBUSY). The others stay
+   * pending, submit again once poll reaped completions.
+   *
+   * @return false on error
+   */
+  bool
+  submit()
+  {
+    while (queued_)
+    {
+      int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, queued_, 0, 0, nullptr, 0));
+      if (ret < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return errno == EAGAIN || errno == EBUSY;
+      }
+
+      if (ret == 0)
+        return true;
+
+      queued_ -= static_cast<unsigned int>(ret);
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Number of operations queued but not submitted yet
+   */
+  std::size_t
+  pending() const noexcept
+  {
+    return queued_;
+  }
+
+  /**
+   * @brief Reap completions
+   *
+   * A pair is reported once: with the error of its write if it failed or
+   * was short, with the result of its fdatasync otherwise.
+   *
+   * @tparam F Callback function type (std::uint64_t tag, int res) -> void
+   * @param f Callback function, res is negative on error
+   *
+   * @return the number of pairs completed
+   */
+  template <typename F>
+  std::size_t
+  poll(F && f)
+  {
+    std::size_t n = 0;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head)
+    {
+      auto const & cqe = cqes_[ head & cq_mask_ ];
+      auto slot = static_cast<unsigned int>(cqe.user_data >> 1);
+      auto & op = slots_[ slot ];
+
+      --inflight_;
+
+      if ((cqe.user_data & 1) == 0)
+      {
+        /* the write, keep its error for the linked fdatasync */
+        if (cqe.res < 0)
+          op.res = cqe.res;
+        else if (std::size_t(cqe.res) != op.len)
+          op.res = -EIO;
+        continue;
+      }
+
+      f(op.tag, op.res < 0 ? op.res : cqe.res);
+      free_.push_back(slot);
+      ++n;
+    }
+
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return n;
+  }
+
+  /**
+   * @brief Number of operations not completed yet
+   */
+  std::size_t
+  inflight() const noexcept
+  {
+    return inflight_;
+  }
+
+private:
+  struct slot_t
+  {
+    std::uint64_t tag;
+    std::size_t len;
+    int res;
+  };
+
+private:
+  struct io_uring_sqe *
+  sqe()
+  {
+    unsigned tail = *sq_tail_;
+    unsigned idx = tail & sq_mask_;
+    auto e = &sqes_[ idx ];
+
+    std::memset(e, 0, sizeof(*e));
+    sq_array_[ idx ] = idx;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    return e;
+  }
+
+  void
+  close()
+  {
+    if (sqes_)
+      munmap(sqes_, sqes_count_ * sizeof(struct io_uring_sqe));
+    if (cq_ptr_ && cq_ptr_ != sq_ptr_)
+      munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_)
+      munmap(sq_ptr_, sq_size_);
+    if (0 <= fd_)
+      ::close(fd_);
+
+    sqes_ = nullptr;
+    cq_ptr_ = sq_ptr_ = nullptr;
+    fd_ = -1;
+  }
+
+private:
+  int fd_;
+
+  void * sq_ptr_;
+  std::size_t sq_size_;
+  void * cq_ptr_;
+  std::size_t cq_size_;
+
+  struct io_uring_sqe * sqes_;
+  unsigned sqes_count_ = 0;
+  unsigned cq_count_ = 0;
+
+  unsigned * sq_head_ = nullptr;
+  unsigned * sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned * sq_array_ = nullptr;
+
+  unsigned * cq_head_ = nullptr;
+  unsigned * cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  struct io_uring_cqe * cqes_ = nullptr;
+
+  unsigned int queued_;
+  std::size_t inflight_;
+
+  /* write and fdatasync pairs in flight, and their free slots */
+  std::vector<slot_t> slots_;
+  std::vector<unsigned int> free_;
+};
+
+} /** !wal  */
+} /** !raft  */
+
+#endif /** !RAFT_WAL_URING_HH_  */
@@ -0,0 +1,763 @@
+#ifndef UTILS_BTREE_HH_
+#define UTILS_BTREE_HH_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace utils
+{
+
+/**
+ * @brief Ordered map as a B+tree with wide nodes
+ *
+ * Values are stored in leaves of a few hundred bytes each, linked in key
+ * order: iterating reads them sequentially, a cache miss per leaf instead
+ * of one per value as with a binary tree, and a range scan is a descent
+ * followed by such an iteration. Inner nodes only hold keys and children.
+ *
+ * Keys and values are moved around within and between nodes, so value_type
+ * is a pair whose key is not const, and both must be default
+ * constructible. Iterators and references are invalidated by insertions
+ * and erasures.
+ *
+ * @tparam Key Key type
+ * @tparam T Mapped type
+ * @tparam Compare Key ordering
+ */
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class btree
+{
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+
+private:
+  static constexpr int node_bytes = 512;
+
+  static constexpr int
+  slots(std::size_t size)
+  {
+    return node_bytes / size < 8 ? 8 : int(node_bytes / size);
+  }
+
+public:
+  /** values per leaf */
+  static constexpr int leaf_slots = slots(sizeof(value_type));
+  /** keys per inner node */
+  static constexpr int inner_slots = slots(sizeof(Key) + sizeof(void *));
+
+private:
+  struct node_t
+  {
+    explicit node_t(bool l) : leaf(l), n(0) {}
+
+    bool leaf;
+    int n;
+  };
+
+  struct leaf_t : node_t
+  {
+    leaf_t() : node_t(true), next(nullptr) {}
+
+    value_type values[ leaf_slots ];
+    leaf_t * next;
+  };
+
+  /* n keys and n + 1 children, keys[ i ] separating children i and i + 1 */
+  struct inner_t : node_t
+  {
+    inner_t() : node_t(false) {}
+
+    Key keys[ inner_slots ];
+    node_t * children[ inner_slots + 1 ];
+  };
+
+  struct split_t
+  {
+    Key key;
+    node_t * right;
+  };
+
+public:
+  /**
+   * @brief In order iterator
+   */
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename btree::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+  public:
+    const_iterator() : leaf_(nullptr), pos_(0) {}
+
+    reference operator*() const
+    {
+      return leaf_->values[ pos_ ];
+    }
+
+    pointer operator->() const
+    {
+      return &leaf_->values[ pos_ ];
+    }
+
+    const_iterator &
+    operator++()
+    {
+      if (++pos_ == leaf_->n)
+      {
+        leaf_ = leaf_->next;
+        pos_ = 0;
+      }
+
+      return *this;
+    }
+
+    const_iterator
+    operator++(int)
+    {
+      const_iterator it = *this;
+
+      ++*this;
+      return it;
+    }
+
+    bool
+    operator==(const_iterator const & other) const
+    {
+      return leaf_ == other.leaf_ && pos_ == other.pos_;
+    }
+
+    bool
+    operator!=(const_iterator const & other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    friend class btree;
+
+    const_iterator(leaf_t const * leaf, int pos) : leaf_(leaf), pos_(pos)
+    {
+      if (leaf_ && pos_ == leaf_->n)
+      {
+        leaf_ = leaf_->next;
+        pos_ = 0;
+      }
+    }
+
+  private:
+    leaf_t const * leaf_;
+    int pos_;
+  };
+
+public:
+  btree() : root_(nullptr), size_(0) {}
+
+  explicit btree(Compare const & cmp) : root_(nullptr), size_(0), cmp_(cmp) {}
+
+  btree(btree const & other) : root_(nullptr), size_(0), cmp_(other.cmp_)
+  {
+    leaf_t * last = nullptr;
+
+    root_ = copy(other.root_, last);
+    size_ = other.size_;
+  }
+
+  btree(btree && other) noexcept : btree()
+  {
+    swap(other);
+  }
+
+  btree &
+  operator=(btree other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  ~btree()
+  {
+    dispose(root_);
+  }
+
+public:
+  size_type
+  size() const noexcept
+  {
+    return size_;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  Compare
+  key_comp() const
+  {
+    return cmp_;
+  }
+
+  const_iterator
+  begin() const
+  {
+    node_t const * n = root_;
+
+    while (n && !n->leaf)
+      n = static_cast<inner_t const *>(n)->children[ 0 ];
+
+    return const_iterator(static_cast<leaf_t const *>(n), 0);
+  }
+
+  const_iterator
+  end() const
+  {
+    return const_iterator();
+  }
+
+  /**
+   * @brief Get an iterator to the first key not less than k
+   */
+  const_iterator
+  lower_bound(Key const & k) const
+  {
+    leaf_t const * l = find_leaf(k);
+    return l ? const_iterator(l, lower(l, k)) : end();
+  }
+
+  /**
+   * @brief Get an iterator to the first key greater than k
+   */
+  const_iterator
+  upper_bound(Key const & k) const
+  {
+    leaf_t const * l = find_leaf(k);
+    return l ? const_iterator(l, upper(l, k)) : end();
+  }
+
+  /**
+   * @brief Get the value mapped to a key
+   *
+   * @return a pointer to the value, valid until the map is modified, or
+   * nullptr
+   */
+  T const *
+  find(Key const & k) const
+  {
+    leaf_t const * l = find_leaf(k);
+    if (l == nullptr)
+      return nullptr;
+
+    int pos = lower(l, k);
+    if (pos == l->n || cmp_(k, l->values[ pos ].first))
+      return nullptr;
+
+    return &l->values[ pos ].second;
+  }
+
+  size_type
+  count(Key const & k) const
+  {
+    return find(k) ? 1 : 0;
+  }
+
+  T const &
+  at(Key const & k) const
+  {
+    T const * v = find(k);
+
+    if (v == nullptr)
+      throw std::out_of_range("btree::at");
+
+    return *v;
+  }
+
+  /**
+   * @brief Insert a value if its key is not in the map yet
+   *
+   * @return true if inserted
+   */
+  bool
+  insert(value_type const & v)
+  {
+    bool added = false;
+    T & value = emplace(v.first, added);
+
+    if (added)
+      value = v.second;
+
+    return added;
+  }
+
+  /**
+   * @brief Get the value mapped to a key, inserting a default one if needed
+   *
+   * @return a reference valid until the map is modified
+   */
+  T &
+  operator[](Key const & k)
+  {
+    bool added = false;
+    return emplace(k, added);
+  }
+
+  /**
+   * @brief Remove a key
+   *
+   * @return the number of values removed
+   */
+  size_type
+  erase(Key const & k)
+  {
+    if (root_ == nullptr || !remove(root_, k))
+      return 0;
+
+    --size_;
+
+    /* the root shrinks when it has a single child left */
+    if (root_->n == 0)
+    {
+      node_t * old = root_;
+
+      root_ = root_->leaf ? nullptr : static_cast<inner_t *>(root_)->children[ 0 ];
+      destroy(old);
+    }
+
+    return 1;
+  }
+
+  void
+  clear() noexcept
+  {
+    dispose(root_);
+    root_ = nullptr;
+    size_ = 0;
+  }
+
+  void
+  swap(btree & other) noexcept
+  {
+    using std::swap;
+
+    swap(root_, other.root_);
+    swap(size_, other.size_);
+    swap(cmp_, other.cmp_);
+  }
+
+private:
+  /**
+   * @brief Position of the first value not less than k in a leaf
+   */
+  int
+  lower(leaf_t const * l, Key const & k) const
+  {
+    auto v = std::lower_bound(
+      l->values, l->values + l->n, k, [this](value_type const & v, Key const & k) { return cmp_(v.first, k); });
+
+    return int(v - l->values);
+  }
+
+  /**
+   * @brief Position of the first value greater than k in a leaf
+   */
+  int
+  upper(leaf_t const * l, Key const & k) const
+  {
+    auto v = std::upper_bound(
+      l->values, l->values + l->n, k, [this](Key const & k, value_type const & v) { return cmp_(k, v.first); });
+
+    return int(v - l->values);
+  }
+
+  /**
+   * @brief Get the child of an inner node that may hold k
+   */
+  int
+  child(inner_t const * n, Key const & k) const
+  {
+    return int(std::upper_bound(n->keys, n->keys + n->n, k, cmp_) - n->keys);
+  }
+
+  leaf_t const *
+  find_leaf(Key const & k) const
+  {
+    node_t const * n = root_;
+
+    while (n && !n->leaf)
+    {
+      auto in = static_cast<inner_t const *>(n);
+      n = in->children[ child(in, k) ];
+    }
+
+    return static_cast<leaf_t const *>(n);
+  }
+
+  T &
+  emplace(Key const & k, bool & added)
+  {
+    if (root_ == nullptr)
+      root_ = new leaf_t;
+
+    T * v = nullptr;
+    split_t split;
+
+    added = false;
+    if (insert(root_, k, v, added, split))
+    {
+      /* the root split: the tree grows by one level */
+      auto root = new inner_t;
+
+      root->n = 1;
+      root->keys[ 0 ] = std::move(split.key);
+      root->children[ 0 ] = root_;
+      root->children[ 1 ] = split.right;
+      root_ = root;
+    }
+
+    if (added)
+      ++size_;
+
+    return *v;
+  }
+
+  /**
+   * @brief Insert k with a default value below node, unless found
+   *
+   * @param v set to the value of k
+   * @param added set to true if k was not there yet
+   *
+   * @return true if node split, split then holding the new right node
+   */
+  bool
+  insert(node_t * node, Key const & k, T *& v, bool & added, split_t & split)
+  {
+    if (node->leaf)
+      return insert_leaf(static_cast<leaf_t *>(node), k, v, added, split);
+
+    auto n = static_cast<inner_t *>(node);
+    int i = child(n, k);
+    split_t below;
+
+    if (!insert(n->children[ i ], k, v, added, below))
+      return false;
+
+    if (n->n < inner_slots)
+    {
+      std::move_backward(n->keys + i, n->keys + n->n, n->keys + n->n + 1);
+      std::move_backward(n->children + i + 1, n->children + n->n + 1, n->children + n->n + 2);
+      n->keys[ i ] = std::move(below.key);
+      n->children[ i + 1 ] = below.right;
+      ++n->n;
+
+      return false;
+    }
+
+    /* full: the middle key moves up, the keys after it go right */
+    Key keys[ inner_slots + 1 ];
+    node_t * children[ inner_slots + 2 ];
+
+    std::move(n->keys, n->keys + i, keys);
+    keys[ i ] = std::move(below.key);
+    std::move(n->keys + i, n->keys + n->n, keys + i + 1);
+
+    std::copy(n->children, n->children + i + 1, children);
+    children[ i + 1 ] = below.right;
+    std::copy(n->children + i + 1, n->children + n->n + 1, children + i + 2);
+
+    int mid = (inner_slots + 1) / 2;
+    auto right = new inner_t;
+
+    n->n = mid;
+    std::move(keys, keys + mid, n->keys);
+    std::copy(children, children + mid + 1, n->children);
+
+    right->n = inner_slots - mid;
+    std::move(keys + mid + 1, keys + inner_slots + 1, right->keys);
+    std::copy(children + mid + 1, children + inner_slots + 2, right->children);
+
+    split.key = std::move(keys[ mid ]);
+    split.right = right;
+
+    return true;
+  }
+
+  bool
+  insert_leaf(leaf_t * l, Key const & k, T *& v, bool & added, split_t & split)
+  {
+    int pos = lower(l, k);
+
+    if (pos < l->n && !cmp_(k, l->values[ pos ].first))
+    {
+      v = &l->values[ pos ].second;
+      return false;
+    }
+
+    added = true;
+
+    if (l->n < leaf_slots)
+    {
+      v = place(l, pos, k);
+      return false;
+    }
+
+    /* full: the upper half goes to a new leaf */
+    int mid = leaf_slots / 2;
+    auto right = new leaf_t;
+
+    std::move(l->values + mid, l->values + leaf_slots, right->values);
+    right->n = leaf_slots - mid;
+    l->n = mid;
+
+    right->next = l->next;
+    l->next = right;
+
+    v = pos <= mid ? place(l, pos, k) : place(right, pos - mid, k);
+
+    split.key = right->values[ 0 ].first;
+    split.right = right;
+
+    return true;
+  }
+
+  static T *
+  place(leaf_t * l, int pos, Key const & k)
+  {
+    std::move_backward(l->values + pos, l->values + l->n, l->values + l->n + 1);
+    l->values[ pos ] = value_type(k, T());
+    ++l->n;
+
+    return &l->values[ pos ].second;
+  }
+
+  /**
+   * @brief Remove k below node, merging or refilling the nodes left less
+   * than half full
+   *
+   * @return true if removed
+   */
+  bool
+  remove(node_t * node, Key const & k)
+  {
+    if (node->leaf)
+    {
+      auto l = static_cast<leaf_t *>(node);
+      int pos = lower(l, k);
+
+      if (pos == l->n || cmp_(k, l->values[ pos ].first))
+        return false;
+
+      std::move(l->values + pos + 1, l->values + l->n, l->values + pos);
+      --l->n;
+
+      return true;
+    }
+
+    auto n = static_cast<inner_t *>(node);
+    int i = child(n, k);
+
+    if (!remove(n->children[ i ], k))
+      return false;
+
+    node_t * c = n->children[ i ];
+    if (c->n < (c->leaf ? leaf_slots : inner_slots) / 2)
+      refill(n, i);
+
+    return true;
+  }
+
+  /**
+   * @brief Refill child i of n from a sibling, or merge it with one
+   */
+  void
+  refill(inner_t * n, int i)
+  {
+    /* with the left sibling if any: merge or borrow between i - 1 and i */
+    int l = 0 < i ? i - 1 : i;
+    node_t * left = n->children[ l ];
+    node_t * right = n->children[ l + 1 ];
+    int min = (left->leaf ? leaf_slots : inner_slots) / 2;
+
+    if (left->leaf)
+    {
+      auto a = static_cast<leaf_t *>(left);
+      auto b = static_cast<leaf_t *>(right);
+
+      if (a->n + b->n <= leaf_slots)
+      {
+        std::move(b->values, b->values + b->n, a->values + a->n);
+        a->n += b->n;
+        a->next = b->next;
+
+        drop(n, l);
+        delete b;
+      }
+      else if (b->n < min)
+      {
+        /* take the last values of the left leaf */
+        int k = min - b->n;
+
+        std::move_backward(b->values, b->values + b->n, b->values + b->n + k);
+        std::move(a->values + a->n - k, a->values + a->n, b->values);
+        a->n -= k;
+        b->n += k;
+        n->keys[ l ] = b->values[ 0 ].first;
+      }
+      else
+      {
+        /* take the first values of the right leaf */
+        int k = min - a->n;
+
+        std::move(b->values, b->values + k, a->values + a->n);
+        std::move(b->values + k, b->values + b->n, b->values);
+        a->n += k;
+        b->n -= k;
+        n->keys[ l ] = b->values[ 0 ].first;
+      }
+
+      return;
+    }
+
+    auto a = static_cast<inner_t *>(left);
+    auto b = static_cast<inner_t *>(right);
+
+    if (a->n + 1 + b->n <= inner_slots)
+    {
+      /* the separator comes down between the two */
+      a->keys[ a->n ] = std::move(n->keys[ l ]);
+      std::move(b->keys, b->keys + b->n, a->keys + a->n + 1);
+      std::copy(b->children, b->children + b->n + 1, a->children + a->n + 1);
+      a->n += 1 + b->n;
+
+      drop(n, l);
+      delete b;
+    }
+    else if (b->n < min)
+    {
+      /* rotate right through the separator */
+      std::move_backward(b->keys, b->keys + b->n, b->keys + b->n + 1);
+      std::move_backward(b->children, b->children + b->n + 1, b->children + b->n + 2);
+      b->keys[ 0 ] = std::move(n->keys[ l ]);
+      b->children[ 0 ] = a->children[ a->n ];
+      n->keys[ l ] = std::move(a->keys[ a->n - 1 ]);
+      --a->n;
+      ++b->n;
+    }
+    else
+    {
+      /* rotate left through the separator */
+      a->keys[ a->n ] = std::move(n->keys[ l ]);
+      a->children[ a->n + 1 ] = b->children[ 0 ];
+      n->keys[ l ] = std::move(b->keys[ 0 ]);
+      std::move(b->keys + 1, b->keys + b->n, b->keys);
+      std::copy(b->children + 1, b->children + b->n + 1, b->children);
+      ++a->n;
+      --b->n;
+    }
+  }
+
+  /**
+   * @brief Remove key l and child l + 1 of n, once merged into child l
+   */
+  static void
+  drop(inner_t * n, int l)
+  {
+    std::move(n->keys + l + 1, n->keys + n->n, n->keys + l);
+    std::copy(n->children + l + 2, n->children + n->n + 1, n->children + l + 1);
+    --n->n;
+  }
+
+  /**
+   * @brief Copy a subtree, linking its leaves after last
+   */
+  static node_t *
+  copy(node_t const * node, leaf_t *& last)
+  {
+    if (node == nullptr)
+      return nullptr;
+
+    if (node->leaf)
+    {
+      auto l = new leaf_t(*static_cast<leaf_t const *>(node));
+
+      l->next = nullptr;
+      if (last)
+        last->next = l;
+      last = l;
+
+      return l;
+    }
+
+    auto src = static_cast<inner_t const *>(node);
+    auto n = new inner_t;
+
+    n->children[ 0 ] = nullptr;
+
+    try
+    {
+      for (int i = 0; i <= src->n; ++i)
+      {
+        n->children[ i ] = copy(src->children[ i ], last);
+        n->n = i;
+      }
+    }
+    catch (...)
+    {
+      dispose(n);
+      throw;
+    }
+
+    std::copy(src->keys, src->keys + src->n, n->keys);
+    return n;
+  }
+
+  static void
+  destroy(node_t * node) noexcept
+  {
+    if (node->leaf)
+      delete static_cast<leaf_t *>(node);
+    else
+      delete static_cast<inner_t *>(node);
+  }
+
+  static void
+  dispose(node_t * node) noexcept
+  {
+    if (node == nullptr)
+      return;
+
+    if (!node->leaf)
+    {
+      auto n = static_cast<inner_t *>(node);
+      for (int i = 0; i <= n->n; ++i)
+        dispose(n->children[ i ]);
+    }
+
+    destroy(node);
+  }
+
+private:
+  node_t * root_;
+  size_type size_;
+  Compare cmp_;
+};
+
+template <typename Key, typename T, typename Compare>
+constexpr int btree<Key, T, Compare>::leaf_slots;
+
+template <typename Key, typename T, typename Compare>
+constexpr int btree<Key, T, Compare>::inner_slots;
+
+} /** !utils  */
+
+#endif /** !UTILS_BTREE_HH_  */
@@ -0,0 +1,62 @@
+#ifndef UTILS_CRC32_HH_
+#define UTILS_CRC32_HH_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+
+namespace detail
+{
+
+inline std::array<std::uint32_t, 256> const &
+crc32_table()
+{
+  static std::array<std::uint32_t, 256> const table = []() {
+    std::array<std::uint32_t, 256> t;
+
+    for (std::uint32_t i = 0; i < 256; ++i)
+    {
+      std::uint32_t c = i;
+
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0x82f63b78 ^ (c >> 1) : c >> 1;
+
+      t[ i ] = c;
+    }
+
+    return t;
+  }();
+
+  return table;
+}
+
+} /** !detail  */
+
+/**
+ * @brief CRC-32C (Castagnoli) checksum
+ *
+ * @param data Input buffer
+ * @param len Input buffer length
+ * @param crc Checksum of the preceding data, to checksum a buffer in pieces
+ *
+ * @return the checksum
+ */
+inline std::uint32_t
+crc32(void const * data, std::size_t len, std::uint32_t crc = 0)
+{
+  auto const & table = detail::crc32_table();
+  auto p = static_cast<std::uint8_t const *>(data);
+
+  crc = ~crc;
+  for (std::size_t i = 0; i < len; ++i)
+    crc = table[ (crc ^ p[ i ]) & 0xff ] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+} /** !utils  */
+
+#endif /** !UTILS_CRC32_HH_  */
@@ -0,0 +1,523 @@
+#ifndef UTILS_FLAT_MAP_HH_
+#define UTILS_FLAT_MAP_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace utils
+{
+
+/**
+ * @brief Open addressing hash map
+ *
+ * Values are stored inline in a single array probed linearly with Robin
+ * Hood hashing: an insertion takes the slot of any value closer to its
+ * home slot, which keeps probe sequences short and lets a lookup stop as
+ * soon as it meets such a value. Erasing shifts the following values back
+ * instead of leaving tombstones. A point lookup is a hash and, most of the
+ * time, a single cache line.
+ *
+ * Keys are copied or moved around as the table changes, so value_type is
+ * a pair whose key is not const. Iterators and references are invalidated
+ * by insertions and erasures.
+ *
+ * @tparam Key Key type
+ * @tparam T Mapped type
+ * @tparam Hash Key hash, mixed again so that an identity hash is fine
+ * @tparam KeyEqual Key equality
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class flat_map
+{
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+
+  /** smallest number of slots */
+  static constexpr size_type min_capacity = 16;
+
+private:
+  /* probe distance, plus one, of the value in a slot: 0 for empty slots.
+   * Probes are short with a decent hash, but a bad one must not make the
+   * table grow without end */
+  using dist_t = std::uint16_t;
+
+  static constexpr dist_t max_dist = 0xffff;
+
+public:
+  /**
+   * @brief Iterator over the slots, in no particular order
+   */
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename flat_map::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+  public:
+    const_iterator() : map_(nullptr), i_(0) {}
+
+    reference operator*() const
+    {
+      return map_->slots_[ i_ ];
+    }
+
+    pointer operator->() const
+    {
+      return &map_->slots_[ i_ ];
+    }
+
+    const_iterator &
+    operator++()
+    {
+      ++i_;
+      skip();
+      return *this;
+    }
+
+    const_iterator
+    operator++(int)
+    {
+      const_iterator it = *this;
+
+      ++*this;
+      return it;
+    }
+
+    bool
+    operator==(const_iterator const & other) const
+    {
+      return i_ == other.i_;
+    }
+
+    bool
+    operator!=(const_iterator const & other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    friend class flat_map;
+
+    const_iterator(flat_map const * map, size_type i) : map_(map), i_(i)
+    {
+      skip();
+    }
+
+    void
+    skip()
+    {
+      while (i_ < map_->capacity_ && map_->dist_[ i_ ] == 0)
+        ++i_;
+    }
+
+  private:
+    flat_map const * map_;
+    size_type i_;
+  };
+
+public:
+  flat_map() : slots_(nullptr), capacity_(0), shift_(64), size_(0) {}
+
+  explicit flat_map(size_type n) : flat_map()
+  {
+    reserve(n);
+  }
+
+  flat_map(flat_map const & other)
+    : slots_(nullptr), capacity_(0), shift_(64), size_(0), hash_(other.hash_), eq_(other.eq_)
+  {
+    if (other.capacity_ == 0)
+      return;
+
+    allocate(other.capacity_);
+
+    try
+    {
+      for (size_type i = 0; i < capacity_; ++i)
+      {
+        if (other.dist_[ i ])
+        {
+          ::new (static_cast<void *>(slots_ + i)) value_type(other.slots_[ i ]);
+          dist_[ i ] = other.dist_[ i ];
+          ++size_;
+        }
+      }
+    }
+    catch (...)
+    {
+      destroy();
+      throw;
+    }
+  }
+
+  flat_map(flat_map && other) noexcept : flat_map()
+  {
+    swap(other);
+  }
+
+  flat_map &
+  operator=(flat_map other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  ~flat_map()
+  {
+    destroy();
+  }
+
+public:
+  size_type
+  size() const noexcept
+  {
+    return size_;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  size_type
+  capacity() const noexcept
+  {
+    return capacity_;
+  }
+
+  const_iterator
+  begin() const
+  {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator
+  end() const
+  {
+    return const_iterator(this, capacity_);
+  }
+
+  /**
+   * @brief Get the value mapped to a key
+   *
+   * @return a pointer to the value, valid until the map is modified, or
+   * nullptr
+   */
+  T const *
+  find(Key const & k) const
+  {
+    size_type i = lookup(k);
+    return i == capacity_ ? nullptr : &slots_[ i ].second;
+  }
+
+  size_type
+  count(Key const & k) const
+  {
+    return lookup(k) == capacity_ ? 0 : 1;
+  }
+
+  T const &
+  at(Key const & k) const
+  {
+    T const * v = find(k);
+
+    if (v == nullptr)
+      throw std::out_of_range("flat_map::at");
+
+    return *v;
+  }
+
+  /**
+   * @brief Insert a value if its key is not in the map yet
+   *
+   * @return true if inserted
+   */
+  bool
+  insert(value_type const & v)
+  {
+    if (lookup(v.first) != capacity_)
+      return false;
+
+    place(value_type(v));
+    return true;
+  }
+
+  /**
+   * @brief Get the value mapped to a key, inserting a default one if needed
+   *
+   * @return a reference valid until the map is modified
+   */
+  T &
+  operator[](Key const & k)
+  {
+    size_type i = lookup(k);
+
+    if (i == capacity_)
+      i = place(value_type(k, T()));
+
+    return slots_[ i ].second;
+  }
+
+  /**
+   * @brief Remove a key
+   *
+   * @return the number of values removed
+   */
+  size_type
+  erase(Key const & k)
+  {
+    size_type i = lookup(k);
+    if (i == capacity_)
+      return 0;
+
+    slots_[ i ].~value_type();
+
+    /* shift the following values back toward their home slot */
+    for (size_type j = next(i); 1 < dist_[ j ]; i = j, j = next(j))
+    {
+      ::new (static_cast<void *>(slots_ + i)) value_type(std::move(slots_[ j ]));
+      slots_[ j ].~value_type();
+      dist_[ i ] = dist_t(dist_[ j ] - 1);
+    }
+
+    dist_[ i ] = 0;
+    --size_;
+
+    return 1;
+  }
+
+  void
+  clear() noexcept
+  {
+    for (size_type i = 0; i < capacity_; ++i)
+    {
+      if (dist_[ i ])
+      {
+        slots_[ i ].~value_type();
+        dist_[ i ] = 0;
+      }
+    }
+
+    size_ = 0;
+  }
+
+  /**
+   * @brief Make room for n values without rehashing
+   */
+  void
+  reserve(size_type n)
+  {
+    size_type capacity = min_capacity;
+
+    while (capacity - capacity / 8 < n)
+      capacity *= 2;
+
+    if (capacity_ < capacity)
+      rehash(capacity);
+  }
+
+  void
+  swap(flat_map & other) noexcept
+  {
+    using std::swap;
+
+    swap(dist_, other.dist_);
+    swap(slots_, other.slots_);
+    swap(capacity_, other.capacity_);
+    swap(shift_, other.shift_);
+    swap(size_, other.size_);
+    swap(hash_, other.hash_);
+    swap(eq_, other.eq_);
+  }
+
+private:
+  /**
+   * @brief Spread the hash over the upper bits, which pick the home slot
+   */
+  size_type
+  home(Key const & k) const
+  {
+    std::uint64_t h = static_cast<std::uint64_t>(hash_(k));
+    return size_type((h * 0x9e3779b97f4a7c15ull) >> shift_);
+  }
+
+  size_type
+  next(size_type i) const noexcept
+  {
+    return (i + 1) & (capacity_ - 1);
+  }
+
+  /**
+   * @brief Find the slot of a key
+   *
+   * @return the slot, or capacity_ if not found
+   */
+  size_type
+  lookup(Key const & k) const
+  {
+    if (size_ == 0)
+      return capacity_;
+
+    size_type i = home(k);
+
+    /* a value closer to its home than we are to ours ends the probe */
+    for (int d = 1; d <= dist_[ i ]; ++d, i = next(i))
+    {
+      if (dist_[ i ] == d && eq_(slots_[ i ].first, k))
+        return i;
+    }
+
+    return capacity_;
+  }
+
+  /**
+   * @brief Insert a value whose key is not in the map
+   *
+   * @return the slot where it ends up
+   */
+  size_type
+  place(value_type && v)
+  {
+    if (capacity_ - capacity_ / 8 <= size_)
+      rehash(capacity_ ? 2 * capacity_ : min_capacity);
+
+    std::unique_ptr<Key> moved;
+    size_type pos = capacity_;
+
+    while (!displace(std::move(v), pos))
+    {
+      /* probes grew too long: v holds the value displaced last, and the
+       * one inserted will move with the rehash */
+      if (!moved)
+        moved.reset(new Key(pos == capacity_ ? v.first : slots_[ pos ].first));
+
+      rehash(2 * capacity_);
+      pos = capacity_;
+    }
+
+    ++size_;
+    return moved ? lookup(*moved) : pos;
+  }
+
+  /**
+   * @brief Robin Hood insertion of a value not in the table
+   *
+   * @param pos set to the slot where the value first lands, if it was
+   * capacity_
+   *
+   * @return false if a probe went past max_dist, v holding the value left
+   * out
+   */
+  bool
+  displace(value_type && v, size_type & pos)
+  {
+    size_type i = home(v.first);
+    dist_t d = 1;
+
+    for (;; i = next(i), ++d)
+    {
+      if (dist_[ i ] == 0)
+      {
+        ::new (static_cast<void *>(slots_ + i)) value_type(std::move(v));
+        dist_[ i ] = d;
+        if (pos == capacity_)
+          pos = i;
+        return true;
+      }
+
+      if (dist_[ i ] < d)
+      {
+        using std::swap;
+
+        swap(v, slots_[ i ]);
+        swap(d, dist_[ i ]);
+        if (pos == capacity_)
+          pos = i;
+      }
+
+      if (d == max_dist)
+        return false;
+    }
+  }
+
+  void
+  rehash(size_type capacity)
+  {
+    std::unique_ptr<dist_t[]> dist = std::move(dist_);
+    value_type * slots = slots_;
+    size_type old = capacity_;
+
+    allocate(capacity);
+
+    for (size_type i = 0; i < old; ++i)
+    {
+      if (dist[ i ])
+      {
+        size_type pos = capacity_;
+        value_type v(std::move(slots[ i ]));
+
+        slots[ i ].~value_type();
+        while (!displace(std::move(v), pos))
+          rehash(2 * capacity_);
+      }
+    }
+
+    std::allocator<value_type>().deallocate(slots, old);
+  }
+
+  void
+  allocate(size_type capacity)
+  {
+    dist_.reset(new dist_t[ capacity ]());
+    slots_ = std::allocator<value_type>().allocate(capacity);
+    capacity_ = capacity;
+
+    shift_ = 64;
+    for (size_type c = capacity; 1 < c; c /= 2)
+      --shift_;
+  }
+
+  void
+  destroy() noexcept
+  {
+    if (slots_ == nullptr)
+      return;
+
+    clear();
+    std::allocator<value_type>().deallocate(slots_, capacity_);
+
+    dist_.reset();
+    slots_ = nullptr;
+    capacity_ = 0;
+    shift_ = 64;
+  }
+
+private:
+  std::unique_ptr<dist_t[]> dist_;
+  value_type * slots_;
+  size_type capacity_;
+  int shift_;
+  size_type size_;
+  Hash hash_;
+  KeyEqual eq_;
+};
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+constexpr typename flat_map<Key, T, Hash, KeyEqual>::size_type flat_map<Key, T, Hash, KeyEqual>::min_capacity;
+
+} /** !utils  */
+
+#endif /** !UTILS_FLAT_MAP_HH_  */
@@ -0,0 +1,450 @@
+#ifndef UTILS_PMAP_HH_
+#define UTILS_PMAP_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * @brief Persistent ordered map
+ *
+ * An AVL tree whose nodes are shared between copies: copying a map is
+ * O(1), and modifying it copies the O(log n) nodes on the path to the
+ * modified key while the copies keep seeing their own version. Nodes owned
+ * by a single version are modified in place, so a map that is never copied
+ * costs no more than a plain balanced tree.
+ *
+ * A copy may be read from another thread while the original is being
+ * modified, which is how a consistent view of a state machine is
+ * serialized without pausing it. A single map is not thread safe.
+ *
+ * @tparam Key Key type
+ * @tparam T Mapped type
+ * @tparam Compare Key ordering
+ */
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class pmap
+{
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key const, T>;
+  using size_type = std::size_t;
+
+private:
+  struct node_t;
+  using ptr_t = std::shared_ptr<node_t>;
+
+  struct node_t
+  {
+    explicit node_t(value_type const & v) : value(v), height(1) {}
+
+    value_type value;
+    int height;
+    ptr_t left;
+    ptr_t right;
+  };
+
+public:
+  /**
+   * @brief In order iterator
+   */
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename pmap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+  public:
+    const_iterator() = default;
+
+    reference operator*() const
+    {
+      return stack_.back()->value;
+    }
+
+    pointer operator->() const
+    {
+      return &stack_.back()->value;
+    }
+
+    const_iterator &
+    operator++()
+    {
+      node_t const * n = stack_.back();
+
+      stack_.pop_back();
+      descend(n->right.get());
+
+      return *this;
+    }
+
+    const_iterator
+    operator++(int)
+    {
+      const_iterator it = *this;
+
+      ++*this;
+      return it;
+    }
+
+    bool
+    operator==(const_iterator const & other) const
+    {
+      return stack_.empty() ? other.stack_.empty()
+                            : !other.stack_.empty() && stack_.back() == other.stack_.back();
+    }
+
+    bool
+    operator!=(const_iterator const & other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    friend class pmap;
+
+    explicit const_iterator(node_t const * root)
+    {
+      descend(root);
+    }
+
+    void
+    descend(node_t const * n)
+    {
+      for (; n; n = n->left.get())
+        stack_.push_back(n);
+    }
+
+  private:
+    /* nodes whose left subtree has been visited, the current one last */
+    std::vector<node_t const *> stack_;
+  };
+
+public:
+  pmap() : size_(0) {}
+
+  explicit pmap(Compare const & cmp) : size_(0), cmp_(cmp) {}
+
+public:
+  size_type
+  size() const noexcept
+  {
+    return size_;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  const_iterator
+  begin() const
+  {
+    return const_iterator(root_.get());
+  }
+
+  const_iterator
+  end() const
+  {
+    return const_iterator();
+  }
+
+  /**
+   * @brief Get the value mapped to a key
+   *
+   * @return a pointer to the value, valid until the map is modified, or
+   * nullptr
+   */
+  T const *
+  find(Key const & k) const
+  {
+    node_t const * n = root_.get();
+
+    while (n)
+    {
+      if (cmp_(k, n->value.first))
+        n = n->left.get();
+      else if (cmp_(n->value.first, k))
+        n = n->right.get();
+      else
+        return &n->value.second;
+    }
+
+    return nullptr;
+  }
+
+  size_type
+  count(Key const & k) const
+  {
+    return find(k) ? 1 : 0;
+  }
+
+  T const &
+  at(Key const & k) const
+  {
+    T const * v = find(k);
+
+    if (v == nullptr)
+      throw std::out_of_range("pmap::at");
+
+    return *v;
+  }
+
+  /**
+   * @brief Insert a value if its key is not in the map yet
+   *
+   * @return true if inserted
+   */
+  bool
+  insert(value_type const & v)
+  {
+    if (find(v.first))
+      return false;
+
+    bool added = false;
+    emplace(root_, v.first, [&v]() { return v; }, added);
+    ++size_;
+
+    return true;
+  }
+
+  /**
+   * @brief Get the value mapped to a key, inserting a default one if needed
+   *
+   * @return a reference valid until the map is modified
+   */
+  T &
+  operator[](Key const & k)
+  {
+    bool added = false;
+    T & v = emplace(root_, k, [&k]() { return value_type(k, T()); }, added);
+
+    if (added)
+      ++size_;
+
+    return v;
+  }
+
+  /**
+   * @brief Remove a key
+   *
+   * @return the number of values removed
+   */
+  size_type
+  erase(Key const & k)
+  {
+    if (!find(k))
+      return 0;
+
+    remove(root_, k);
+    --size_;
+
+    return 1;
+  }
+
+  void
+  clear() noexcept
+  {
+    root_.reset();
+    size_ = 0;
+  }
+
+  void
+  swap(pmap & other) noexcept
+  {
+    using std::swap;
+
+    swap(root_, other.root_);
+    swap(size_, other.size_);
+    swap(cmp_, other.cmp_);
+  }
+
+private:
+  /**
+   * @brief Make a node owned by this version only, copying it if shared
+   */
+  static node_t &
+  own(ptr_t & p)
+  {
+    if (p.use_count() == 1)
+    {
+      /* order writes to the node after reads by versions since dropped */
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return *p;
+    }
+
+    p = std::make_shared<node_t>(*p);
+    return *p;
+  }
+
+  static int
+  height(ptr_t const & p) noexcept
+  {
+    return p ? p->height : 0;
+  }
+
+  static void
+  update(node_t & n) noexcept
+  {
+    n.height = 1 + std::max(height(n.left), height(n.right));
+  }
+
+  static void
+  rotate_right(ptr_t & p)
+  {
+    own(p->left);
+
+    ptr_t l = std::move(p->left);
+    p->left = std::move(l->right);
+    update(*p);
+
+    l->right = std::move(p);
+    p = std::move(l);
+    update(*p);
+  }
+
+  static void
+  rotate_left(ptr_t & p)
+  {
+    own(p->right);
+
+    ptr_t r = std::move(p->right);
+    p->right = std::move(r->left);
+    update(*p);
+
+    r->left = std::move(p);
+    p = std::move(r);
+    update(*p);
+  }
+
+  /**
+   * @brief Restore the balance of an owned node whose subtrees changed
+   */
+  static void
+  balance(ptr_t & p)
+  {
+    node_t & n = *p;
+    int factor = height(n.left) - height(n.right);
+
+    if (1 < factor)
+    {
+      if (height(n.left->left) < height(n.left->right))
+      {
+        own(n.left);
+        rotate_left(n.left);
+      }
+      rotate_right(p);
+    }
+    else if (factor < -1)
+    {
+      if (height(n.right->right) < height(n.right->left))
+      {
+        own(n.right);
+        rotate_right(n.right);
+      }
+      rotate_left(p);
+    }
+    else
+      update(n);
+  }
+
+  template <typename F>
+  T &
+  emplace(ptr_t & p, Key const & k, F && make, bool & added)
+  {
+    if (!p)
+    {
+      p = std::make_shared<node_t>(make());
+      added = true;
+      return p->value.second;
+    }
+
+    node_t & n = own(p);
+    T * v;
+
+    if (cmp_(k, n.value.first))
+      v = &emplace(n.left, k, make, added);
+    else if (cmp_(n.value.first, k))
+      v = &emplace(n.right, k, make, added);
+    else
+      return n.value.second;
+
+    /* rotations move nodes around but never copy the owned ones */
+    balance(p);
+    return *v;
+  }
+
+  /**
+   * @brief Detach the smallest node of a subtree
+   */
+  static ptr_t
+  remove_min(ptr_t & p)
+  {
+    node_t & n = own(p);
+
+    if (!n.left)
+    {
+      ptr_t m = std::move(p);
+      p = std::move(m->right);
+      return m;
+    }
+
+    ptr_t m = remove_min(n.left);
+    balance(p);
+
+    return m;
+  }
+
+  void
+  remove(ptr_t & p, Key const & k)
+  {
+    node_t & n = own(p);
+
+    if (cmp_(k, n.value.first))
+      remove(n.left, k);
+    else if (cmp_(n.value.first, k))
+      remove(n.right, k);
+    else
+    {
+      ptr_t l = std::move(n.left);
+      ptr_t r = std::move(n.right);
+
+      if (!r)
+      {
+        p = std::move(l);
+        return;
+      }
+
+      /* the successor takes the place of the removed node */
+      ptr_t m = remove_min(r);
+      m->left = std::move(l);
+      m->right = std::move(r);
+      p = std::move(m);
+    }
+
+    balance(p);
+  }
+
+private:
+  ptr_t root_;
+  size_type size_;
+  Compare cmp_;
+};
+
+} /** !utils  */
+
+#endif /** !UTILS_PMAP_HH_  */
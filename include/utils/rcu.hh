@@ -0,0 +1,228 @@
+#ifndef UTILS_RCU_HH_
+#define UTILS_RCU_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * @brief Read-copy-update cell
+ *
+ * A single writer publishes immutable versions of a T; any number of
+ * readers access the current version without locks. Replaced versions are
+ * retired and freed by the writer once no reader can still be using them,
+ * which is tracked with epochs: a reader announces the epoch it started
+ * in, a version retired in epoch e is freed once every active reader
+ * started after e. Reading is two stores and a load, readers never wait
+ * for the writer nor for each other, and the writer never waits for
+ * readers.
+ *
+ * Each reader thread holds a reader, which owns one of a fixed number of
+ * slots. Readers must be gone before the cell is destroyed.
+ */
+template <typename T>
+class rcu
+{
+private:
+  static constexpr std::size_t cacheline = 64;
+
+  struct slot_t
+  {
+    /* epoch the current read started in, 0 when idle */
+    std::atomic<std::uint64_t> epoch;
+    std::atomic<bool> used;
+    /* one slot per cache line, not to bounce readers' lines around */
+    char pad[ cacheline - sizeof(std::atomic<std::uint64_t>) - sizeof(std::atomic<bool>) ];
+  };
+
+  struct retired_t
+  {
+    T const * version;
+    std::uint64_t epoch;
+  };
+
+public:
+  /**
+   * @brief Read access for a thread
+   */
+  class reader
+  {
+  public:
+    reader(reader && other) noexcept : cell_(other.cell_), slot_(other.slot_)
+    {
+      other.slot_ = nullptr;
+    }
+
+    reader(reader const &) = delete;
+    reader & operator=(reader const &) = delete;
+
+    ~reader()
+    {
+      if (slot_)
+        slot_->used.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief Call f with the current version
+     *
+     * The version stays valid until f returns. Not reentrant.
+     *
+     * @return what f returns
+     */
+    template <typename F>
+    auto
+    read(F && f) -> decltype(f(std::declval<T const &>()))
+    {
+      struct guard_t
+      {
+        ~guard_t()
+        {
+          slot->epoch.store(0, std::memory_order_release);
+        }
+
+        slot_t * slot;
+      } guard{slot_};
+
+      /* announced before the version is loaded: a writer that retires it
+       * after this point sees the announcement, one that retired it
+       * before has already published the next version */
+      slot_->epoch.store(cell_->epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+
+      return f(*cell_->current_.load(std::memory_order_seq_cst));
+    }
+
+  private:
+    friend class rcu;
+
+    reader(rcu * cell, slot_t * slot) : cell_(cell), slot_(slot) {}
+
+  private:
+    rcu * cell_;
+    slot_t * slot_;
+  };
+
+public:
+  /**
+   * @param readers Maximum number of readers at once
+   */
+  explicit rcu(std::unique_ptr<T const> initial, std::size_t readers = 64)
+    : current_(initial.release()), epoch_(1), slots_(new slot_t[ readers ]), nslots_(readers)
+  {
+    for (std::size_t i = 0; i < nslots_; ++i)
+    {
+      slots_[ i ].epoch.store(0, std::memory_order_relaxed);
+      slots_[ i ].used.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  rcu(rcu const &) = delete;
+  rcu & operator=(rcu const &) = delete;
+
+  ~rcu()
+  {
+    for (auto & it : retired_)
+      delete it.version;
+
+    delete current_.load(std::memory_order_relaxed);
+  }
+
+public:
+  /**
+   * @brief Get read access for the calling thread
+   *
+   * @throw std::runtime_error if all the slots are taken
+   */
+  reader
+  make_reader()
+  {
+    for (std::size_t i = 0; i < nslots_; ++i)
+    {
+      bool used = false;
+
+      if (slots_[ i ].used.compare_exchange_strong(used, true, std::memory_order_acquire))
+        return reader(this, &slots_[ i ]);
+    }
+
+    throw std::runtime_error("rcu: no reader slot left");
+  }
+
+  /**
+   * @brief Get the current version, from the writer thread
+   */
+  T const &
+  get() const noexcept
+  {
+    return *current_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Replace the current version, from the writer thread
+   *
+   * The replaced version is freed once no reader uses it, by this or a
+   * later call.
+   */
+  void
+  publish(std::unique_ptr<T const> version)
+  {
+    T const * old = current_.exchange(version.release(), std::memory_order_seq_cst);
+
+    retired_.push_back({old, epoch_.fetch_add(1, std::memory_order_seq_cst)});
+    reclaim();
+  }
+
+  /**
+   * @brief Get the number of replaced versions not freed yet
+   */
+  std::size_t
+  retired() const noexcept
+  {
+    return retired_.size();
+  }
+
+  /**
+   * @brief Free the retired versions no reader can be using
+   */
+  void
+  reclaim()
+  {
+    std::uint64_t oldest = epoch_.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < nslots_; ++i)
+    {
+      std::uint64_t e = slots_[ i ].epoch.load(std::memory_order_seq_cst);
+      if (e && e < oldest)
+        oldest = e;
+    }
+
+    /* retired in epoch order: readers that started after e cannot see it */
+    std::size_t n = 0;
+    while (n < retired_.size() && retired_[ n ].epoch < oldest)
+      delete retired_[ n++ ].version;
+
+    retired_.erase(retired_.begin(), retired_.begin() + std::ptrdiff_t(n));
+  }
+
+private:
+  std::atomic<T const *> current_;
+  std::atomic<std::uint64_t> epoch_;
+
+  std::unique_ptr<slot_t[]> slots_;
+  std::size_t nslots_;
+
+  /* writer only */
+  std::vector<retired_t> retired_;
+};
+
+template <typename T>
+constexpr std::size_t rcu<T>::cacheline;
+
+} /** !utils  */
+
+#endif /** !UTILS_RCU_HH_  */
@@ -0,0 +1,245 @@
+#ifndef UTILS_RING_HH_
+#define UTILS_RING_HH_
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace utils
+{
+
+/**
+ * @brief Growable circular buffer
+ *
+ * Elements are stored contiguously in a power of two sized buffer, which
+ * only grows when full. Once large enough, pushing at the back and popping
+ * at the front never allocates.
+ *
+ * Pointers to elements stay valid until the buffer grows or the element
+ * is removed.
+ */
+template <typename T>
+class ring
+{
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+
+public:
+  ring() : buf_(nullptr), capacity_(0), head_(0), size_(0) {}
+
+  ring(ring const & other) : ring()
+  {
+    reserve(other.size_);
+
+    for (size_type i = 0; i < other.size_; ++i)
+      push_back(other[ i ]);
+  }
+
+  ring(ring && other) noexcept : ring()
+  {
+    swap(other);
+  }
+
+  ring &
+  operator=(ring other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  ~ring()
+  {
+    clear();
+    ::operator delete(buf_);
+  }
+
+  void
+  swap(ring & other) noexcept
+  {
+    std::swap(buf_, other.buf_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(head_, other.head_);
+    std::swap(size_, other.size_);
+  }
+
+public:
+  size_type
+  size() const noexcept
+  {
+    return size_;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  size_type
+  capacity() const noexcept
+  {
+    return capacity_;
+  }
+
+  /**
+   * @brief Make room for at least n elements
+   */
+  void
+  reserve(size_type n)
+  {
+    if (n <= capacity_)
+      return;
+
+    size_type capacity = grown(n);
+    relocate(static_cast<T *>(::operator new(capacity * sizeof(T))), capacity);
+  }
+
+public:
+  T &
+  operator[](size_type i) noexcept
+  {
+    assert(i < size_);
+    return buf_[ (head_ + i) & (capacity_ - 1) ];
+  }
+
+  T const &
+  operator[](size_type i) const noexcept
+  {
+    assert(i < size_);
+    return buf_[ (head_ + i) & (capacity_ - 1) ];
+  }
+
+  T &
+  front() noexcept
+  {
+    return (*this)[ 0 ];
+  }
+
+  T const &
+  front() const noexcept
+  {
+    return (*this)[ 0 ];
+  }
+
+  T &
+  back() noexcept
+  {
+    return (*this)[ size_ - 1 ];
+  }
+
+  T const &
+  back() const noexcept
+  {
+    return (*this)[ size_ - 1 ];
+  }
+
+public:
+  template <typename... Args>
+  T &
+  emplace_back(Args &&... args)
+  {
+    if (size_ == capacity_)
+    {
+      /* built before the elements move, as args may refer to one of them */
+      size_type capacity = grown(size_ + 1);
+      T * buf = static_cast<T *>(::operator new(capacity * sizeof(T)));
+
+      try
+      {
+        new (buf + size_) T(std::forward<Args>(args)...);
+      }
+      catch (...)
+      {
+        ::operator delete(buf);
+        throw;
+      }
+
+      relocate(buf, capacity);
+      return buf_[ size_++ ];
+    }
+
+    T * e = buf_ + ((head_ + size_) & (capacity_ - 1));
+    new (e) T(std::forward<Args>(args)...);
+    ++size_;
+
+    return *e;
+  }
+
+  void
+  push_back(T const & e)
+  {
+    emplace_back(e);
+  }
+
+  void
+  pop_front() noexcept
+  {
+    assert(size_);
+
+    front().~T();
+    head_ = (head_ + 1) & (capacity_ - 1);
+    --size_;
+  }
+
+  void
+  pop_back() noexcept
+  {
+    assert(size_);
+
+    back().~T();
+    --size_;
+  }
+
+  void
+  clear() noexcept
+  {
+    while (size_)
+      pop_back();
+
+    head_ = 0;
+  }
+
+private:
+  size_type
+  grown(size_type n) const noexcept
+  {
+    size_type capacity = capacity_ ? capacity_ : 16;
+    while (capacity < n)
+      capacity *= 2;
+
+    return capacity;
+  }
+
+  /**
+   * @brief Move the elements to the front of a larger buffer, and adopt it
+   */
+  void
+  relocate(T * buf, size_type capacity)
+  {
+    for (size_type i = 0; i < size_; ++i)
+    {
+      T & e = (*this)[ i ];
+
+      new (buf + i) T(std::move(e));
+      e.~T();
+    }
+
+    ::operator delete(buf_);
+
+    buf_ = buf;
+    capacity_ = capacity;
+    head_ = 0;
+  }
+
+private:
+  T * buf_;
+  size_type capacity_;
+  size_type head_;
+  size_type size_;
+};
+
+} /** !utils  */
+
+#endif /** !UTILS_RING_HH_  */
@@ -0,0 +1,325 @@
+#ifndef UTILS_TIMER_WHEEL_HH_
+#define UTILS_TIMER_WHEEL_HH_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace utils
+{
+
+/**
+ * @brief Hierarchical timer wheel
+ *
+ * Each level holds 2^bits slots, a slot of level l spanning 2^(bits * l)
+ * ticks. Timers are inserted in the coarsest level able to hold them and
+ * cascade down as time goes by, so advancing the wheel only touches the
+ * timers that are about to expire.
+ *
+ * Slots are intrusive lists threaded through a pool holding one timer per
+ * key. Keys stay known to the wheel until cancelled, so that re-arming a
+ * timer is O(1) and does not allocate.
+ *
+ * @tparam Key Timer identifier
+ * @tparam bits log2 of the number of slots per level
+ * @tparam levels Number of levels
+ */
+template <typename Key, unsigned int bits = 6, unsigned int levels = 4>
+class timer_wheel
+{
+public:
+  using tick_t = std::uint64_t;
+
+  static constexpr tick_t never = std::numeric_limits<tick_t>::max();
+
+private:
+  static constexpr tick_t slots = tick_t(1) << bits;
+  static constexpr tick_t mask = slots - 1;
+  static constexpr std::size_t nil = std::numeric_limits<std::size_t>::max();
+
+  struct timer_t
+  {
+    Key key;
+    tick_t deadline;
+
+    /** slot holding the timer, or nil if not armed */
+    std::size_t slot;
+    std::size_t prev;
+    std::size_t next;
+  };
+
+public:
+  explicit timer_wheel(tick_t now = 0) : now_(now), free_(nil), count_(0)
+  {
+    heads_.fill(nil);
+  }
+
+public:
+  /**
+   * @brief Arm a timer, replacing any previous deadline of the key
+   *
+   * @param k Timer key
+   * @param deadline Absolute tick at which the timer expires
+   */
+  void
+  schedule(Key const & k, tick_t deadline)
+  {
+    if (deadline <= now_)
+      deadline = now_ + 1;
+
+    std::size_t t;
+    auto it = index_.find(k);
+
+    if (it == index_.end())
+    {
+      t = acquire(k);
+      index_.emplace(k, t);
+    }
+    else
+    {
+      t = it->second;
+      unlink(t);
+    }
+
+    timers_[ t ].deadline = deadline;
+    link(t);
+  }
+
+  /**
+   * @brief Disarm a timer and forget its key
+   */
+  void
+  cancel(Key const & k)
+  {
+    auto it = index_.find(k);
+    if (it == index_.end())
+      return;
+
+    unlink(it->second);
+    release(it->second);
+    index_.erase(it);
+  }
+
+  /**
+   * @brief Get deadline of a timer, or never if not armed
+   */
+  tick_t
+  deadline(Key const & k) const
+  {
+    auto it = index_.find(k);
+
+    return it == index_.cend() ? never : timers_[ it->second ].deadline;
+  }
+
+  /**
+   * @brief Get number of armed timers
+   */
+  std::size_t
+  size() const noexcept
+  {
+    return count_;
+  }
+
+  tick_t
+  now() const noexcept
+  {
+    return now_;
+  }
+
+public:
+  /**
+   * @brief Move time forwards, firing expired timers
+   *
+   * @tparam F Callback function type (Key) -> void
+   * @param now New current tick
+   * @param f Callback function, may re-arm or cancel timers
+   */
+  template <typename F>
+  void
+  advance(tick_t now, F && f)
+  {
+    while (now_ < now)
+    {
+      if (count_ == 0)
+      {
+        now_ = now;
+        break;
+      }
+
+      ++now_;
+      cascade(1);
+
+      /* callbacks may alter the slot, pop timers one at a time */
+      std::size_t & head = heads_[ now_ & mask ];
+
+      while (head != nil)
+      {
+        std::size_t t = head;
+
+        unlink(t);
+        timers_[ t ].deadline = never;
+
+        Key k = timers_[ t ].key;
+        f(k);
+      }
+    }
+  }
+
+  /**
+   * @brief Get a lower bound of the next expiry
+   *
+   * @return the tick before which no timer expires, or never
+   */
+  tick_t
+  next_expiry() const
+  {
+    tick_t next = never;
+
+    if (count_ == 0)
+      return next;
+
+    for (unsigned int l = 0; l < levels; ++l)
+    {
+      unsigned int shift = bits * l;
+
+      /* a slot is visited when its span starts */
+      for (tick_t i = 1; i <= slots; ++i)
+      {
+        tick_t t = ((now_ >> shift) + i) << shift;
+
+        if (heads_[ l * slots + ((t >> shift) & mask) ] != nil)
+        {
+          next = std::min(next, t);
+          break;
+        }
+      }
+    }
+
+    return next;
+  }
+
+private:
+  std::size_t
+  acquire(Key const & k)
+  {
+    timer_t timer{k, never, nil, nil, nil};
+
+    if (free_ == nil)
+    {
+      timers_.push_back(timer);
+      return timers_.size() - 1;
+    }
+
+    std::size_t t = free_;
+    free_ = timers_[ t ].next;
+    timers_[ t ] = timer;
+
+    return t;
+  }
+
+  void
+  release(std::size_t t)
+  {
+    timers_[ t ].next = free_;
+    free_ = t;
+  }
+
+  void
+  link(std::size_t t)
+  {
+    timer_t & timer = timers_[ t ];
+    tick_t delta = timer.deadline - now_;
+
+    for (unsigned int l = 0; l < levels; ++l)
+    {
+      if (delta < (tick_t(1) << (bits * (l + 1))) || l == levels - 1)
+      {
+        unsigned int shift = bits * l;
+        tick_t at = timer.deadline;
+
+        /* too far away for the wheel: park it in the last slot reachable */
+        if (l == levels - 1 && (tick_t(1) << (bits * levels)) <= delta)
+          at = now_ + (mask << shift);
+
+        timer.slot = l * slots + ((at >> shift) & mask);
+        timer.prev = nil;
+        timer.next = heads_[ timer.slot ];
+
+        if (timer.next != nil)
+          timers_[ timer.next ].prev = t;
+        heads_[ timer.slot ] = t;
+
+        ++count_;
+        return;
+      }
+    }
+  }
+
+  void
+  unlink(std::size_t t)
+  {
+    timer_t & timer = timers_[ t ];
+
+    if (timer.slot == nil)
+      return;
+
+    if (timer.prev != nil)
+      timers_[ timer.prev ].next = timer.next;
+    else
+      heads_[ timer.slot ] = timer.next;
+
+    if (timer.next != nil)
+      timers_[ timer.next ].prev = timer.prev;
+
+    timer.slot = nil;
+    --count_;
+  }
+
+  void
+  cascade(unsigned int l)
+  {
+    if (levels <= l)
+      return;
+
+    unsigned int shift = bits * l;
+
+    /* lower level wrapped: redistribute the current slot of this level */
+    if ((now_ & ((tick_t(1) << shift) - 1)) != 0)
+      return;
+
+    cascade(l + 1);
+
+    std::size_t & head = heads_[ l * slots + ((now_ >> shift) & mask) ];
+
+    /* timers always land in a lower level or another slot */
+    while (head != nil)
+    {
+      std::size_t t = head;
+
+      unlink(t);
+      link(t);
+    }
+  }
+
+private:
+  tick_t now_;
+
+  /** list head of every slot, level after level */
+  std::array<std::size_t, levels * slots> heads_;
+
+  std::vector<timer_t> timers_;
+  std::unordered_map<Key, std::size_t> index_;
+  std::size_t free_;
+  std::size_t count_;
+};
+
+template <typename Key, unsigned int bits, unsigned int levels>
+constexpr typename timer_wheel<Key, bits, levels>::tick_t timer_wheel<Key, bits, levels>::never;
+
+} /** !utils  */
+
+#endif /** !UTILS_TIMER_WHEEL_HH_  */
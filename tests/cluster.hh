@@ -0,0 +1,67 @@
+#ifndef RAFT_TESTS_CLUSTER_HH_
+#define RAFT_TESTS_CLUSTER_HH_
+
+#include <cstddef>
+#include <functional>
+
+#include <raft/server.hh>
+
+/**
+ * @brief Servers of one cluster, in process
+ *
+ * Server i has node id i. Vote requests, appendentries and heartbeats are
+ * delivered by direct calls, and entries applied by a server are handed to
+ * apply along with its id.
+ */
+template <typename T, std::size_t N>
+struct cluster
+{
+  using server_t = raft::server<T>;
+  using entry_t = typename server_t::entry_t;
+  using index_t = typename server_t::index_t;
+
+  cluster()
+  {
+    for (unsigned long int i = 0; i < N; ++i)
+    {
+      for (unsigned long int j = 0; j < N; ++j)
+        servers[ i ].node_add(j, i == j);
+
+      typename server_t::callbacks_t cbs;
+      cbs.send_request_vote = [this, i](auto const & node, auto const & req) {
+        auto & peer = servers[ node->id() ];
+        typename server_t::vote_response_t resp;
+
+        peer.recv_vote_request(peer.node_get(i), req, resp);
+        return servers[ i ].recv_vote_response(node, resp);
+      };
+      cbs.send_appendentries = [this, i](auto const & node, auto const & req) {
+        auto & peer = servers[ node->id() ];
+        typename server_t::appendentries_response_t resp;
+
+        peer.recv_appendentries(peer.node_get(i), req, resp);
+        return servers[ i ].recv_appendentries_response(node, resp);
+      };
+      cbs.send_heartbeat = [this, i](auto const & node, auto const & req) {
+        auto & peer = servers[ node->id() ];
+        typename server_t::heartbeat_response_t resp;
+
+        peer.recv_heartbeat(peer.node_get(i), req, resp);
+        return servers[ i ].recv_heartbeat_response(node, resp);
+      };
+      cbs.apply_log = [this, i](auto const & e, auto idx) {
+        return apply ? apply(i, e, idx) : raft::status_t::ok;
+      };
+      servers[ i ].callbacks(cbs);
+    }
+  }
+
+  cluster(cluster const &) = delete;
+  cluster &
+  operator=(cluster const &) = delete;
+
+  server_t servers[ N ];
+  std::function<raft::status_t(std::size_t, entry_t const &, index_t)> apply;
+};
+
+#endif /** !RAFT_TESTS_CLUSTER_HH_  */
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <new>
+
+#include <raft/multi.hh>
+#include <raft/server.hh>
+
+#include "cluster.hh"
+
+/*
+ * Heap allocations are counted by replacing the global allocation
+ * functions, which is why these tests are built as their own program.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && 11 <= __GNUC__
+/* allocation functions below are paired with each other, not with malloc */
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static bool counting = false;
+static unsigned long int allocations = 0;
+
+void *
+operator new(std::size_t size)
+{
+  if (counting)
+    ++allocations;
+
+  if (void * p = std::malloc(size ? size : 1))
+    return p;
+
+  throw std::bad_alloc();
+}
+
+void *
+operator new[](std::size_t size)
+{
+  if (counting)
+    ++allocations;
+
+  if (void * p = std::malloc(size ? size : 1))
+    return p;
+
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+void
+operator delete[](void * p) noexcept
+{
+  std::free(p);
+}
+
+void
+operator delete(void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void
+operator delete[](void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+template <typename F>
+unsigned long int
+count_allocations(F && f)
+{
+  allocations = 0;
+  counting = true;
+  f();
+  counting = false;
+
+  return allocations;
+}
+
+using server_t = raft::server<int>;
+
+/* a leader replicating to two followers, logs sized upfront */
+struct replication : cluster<int, 3>
+{
+  replication()
+  {
+    for (auto & s : servers)
+      s.reserve(1 << 16);
+
+    apply = [this](auto i, auto const & e, auto) {
+      sums[ i ] += e.elt;
+      return raft::status_t::ok;
+    };
+  }
+
+  void
+  replicate(int n)
+  {
+    server_t::index_t idx;
+
+    for (int v = 0; v < n; ++v)
+    {
+      servers[ 0 ].recv_entry({raft::entry_type_t::regular, 0, 0, v}, idx);
+
+      if (v % 100 == 0)
+        servers[ 0 ].periodic(200ms);
+    }
+  }
+
+  long int sums[ 3 ] = {0, 0, 0};
+};
+
+TEST(TestAlloc, SteadyStateReplicateCommitApplyDoesNotAllocate)
+{
+  replication c;
+
+  c.servers[ 0 ].election_start();
+  ASSERT_TRUE(c.servers[ 0 ].is_leader());
+
+  /* warm up */
+  c.replicate(1000);
+
+  auto n = count_allocations([&]() { c.replicate(10000); });
+
+  /* past the noop of the election */
+  EXPECT_EQ(n, 0);
+  EXPECT_EQ(c.servers[ 0 ].commit_index(), 11001);
+  EXPECT_EQ(c.servers[ 1 ].current_index(), 11001);
+  EXPECT_EQ(c.sums[ 0 ], 999 * 1000 / 2 + 9999 * 10000 / 2);
+}
+
+TEST(TestAlloc, SteadyStateCoalescedHeartbeatsDoNotAllocate)
+{
+  using multi_t = raft::multi<int>;
+
+  multi_t h1(1);
+  multi_t h2(2);
+  multi_t::heartbeats_response_t resp;
+
+  for (unsigned long int gid = 0; gid < 100; ++gid)
+  {
+    auto s = h1.group_add(gid);
+    s->node_add(2);
+    s->node_add(3);
+    s->current_term(1);
+    s->become_leader();
+
+    /* followers already hold the noop of the election */
+    for (unsigned long int id : {2, 3})
+    {
+      s->node_get(id)->match_index(s->current_index());
+      s->node_get(id)->next_index(s->current_index() + 1);
+    }
+
+    h2.group_add(gid)->node_add(1);
+  }
+
+  unsigned long int messages = 0;
+  multi_t::callbacks_t cbs;
+  cbs.send_heartbeats = [&](auto peer, auto const & req) {
+    ++messages;
+    if (peer != h2.id())
+      return raft::status_t::ok;
+
+    h2.recv_heartbeats(h1.id(), req, resp);
+    return h1.recv_heartbeats_response(peer, resp);
+  };
+  h1.callbacks(cbs);
+
+  /* warm up, until every timer wheel slot has been used */
+  for (unsigned int i = 0; i < 1000; ++i)
+  {
+    h1.periodic(10ms);
+    h2.periodic(10ms);
+  }
+
+  messages = 0;
+  auto n = count_allocations([&]() {
+    for (unsigned int i = 0; i < 1000; ++i)
+    {
+      h1.periodic(10ms);
+      h2.periodic(10ms);
+    }
+  });
+
+  EXPECT_EQ(n, 0);
+  EXPECT_EQ(messages, 2 * 1000 * 10 / 200);
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <raft/batch.hh>
+
+using cache_t = raft::batch::cache<unsigned long int, unsigned long int>;
+
+static bool
+fill(std::vector<std::uint8_t> & buf)
+{
+  buf.assign({1, 2, 3});
+  return true;
+}
+
+TEST(TestBatch, EncodesOnce)
+{
+  cache_t c;
+  unsigned int calls = 0;
+  auto f = [&](auto & buf) { return ++calls, fill(buf); };
+
+  auto a = c.get(1, 10, 2, f);
+  auto b = c.get(1, 10, 2, f);
+
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(1u, calls);
+  EXPECT_EQ(1u, c.misses());
+  EXPECT_EQ(1u, c.hits());
+
+  EXPECT_EQ(1u, a->first());
+  EXPECT_EQ(10u, a->last());
+  EXPECT_EQ(2u, a->term());
+  EXPECT_EQ(10u, a->count());
+  EXPECT_EQ(3u, a->bytes());
+  EXPECT_EQ(2, a->data()[ 1 ]);
+}
+
+TEST(TestBatch, KeyedByRangeAndTerm)
+{
+  cache_t c;
+
+  auto a = c.get(1, 10, 2, fill);
+  EXPECT_NE(a, c.get(1, 9, 2, fill));
+  EXPECT_NE(a, c.get(2, 10, 2, fill));
+  EXPECT_NE(a, c.get(1, 10, 3, fill));
+  EXPECT_EQ(4u, c.misses());
+}
+
+TEST(TestBatch, FailedEncodingIsNotCached)
+{
+  cache_t c;
+
+  EXPECT_EQ(nullptr, c.get(1, 10, 2, [](auto &) { return false; }));
+  EXPECT_NE(nullptr, c.get(1, 10, 2, fill));
+  EXPECT_EQ(2u, c.misses());
+}
+
+TEST(TestBatch, RecyclesRunsNoLongerReferenced)
+{
+  cache_t c(1);
+
+  auto const * a = c.get(1, 10, 2, fill).get();
+  auto const * b = c.get(11, 20, 2, fill).get();
+
+  /* nothing held the first run, its storage is reused */
+  EXPECT_EQ(a, b);
+
+  auto held = c.get(21, 30, 2, fill);
+  auto d = c.get(31, 40, 2, fill);
+
+  /* a message in flight keeps its run intact */
+  EXPECT_NE(held, d);
+  EXPECT_EQ(21u, held->first());
+  EXPECT_EQ(31u, d->first());
+}
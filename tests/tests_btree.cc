@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <raft/store/memory.hh>
+#include <utils/btree.hh>
+
+namespace
+{
+
+template <typename Map>
+std::vector<std::pair<int, int>>
+items(Map const & m)
+{
+  std::vector<std::pair<int, int>> v;
+
+  for (auto const & it : m)
+    v.emplace_back(it.first, it.second);
+
+  return v;
+}
+
+template <typename It>
+std::vector<std::pair<int, int>>
+range(It first, It last)
+{
+  std::vector<std::pair<int, int>> v;
+
+  for (; first != last; ++first)
+    v.emplace_back(first->first, first->second);
+
+  return v;
+}
+
+} // namespace
+
+TEST(TestBtree, BehavesLikeStdMap)
+{
+  utils::btree<int, int> b;
+  std::map<int, int> m;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> key(0, 9999);
+
+  for (int i = 0; i < 200000; ++i)
+  {
+    int k = key(gen);
+
+    /* grow for the first half, then shrink */
+    switch (gen() % 4 + (i < 100000 ? 0 : 1))
+    {
+      case 0:
+        EXPECT_EQ(m.insert({k, i}).second, b.insert({k, i}));
+        break;
+      case 1:
+      case 2:
+        m[ k ] = i;
+        b[ k ] = i;
+        break;
+      default:
+        EXPECT_EQ(m.erase(k), b.erase(k));
+        break;
+    }
+
+    ASSERT_EQ(m.size(), b.size());
+
+    if (i % 20000 == 0)
+    {
+      ASSERT_EQ(items(m), items(b));
+    }
+  }
+
+  EXPECT_EQ(items(m), items(b));
+
+  for (int k = -1; k < 10001; ++k)
+  {
+    ASSERT_EQ(m.count(k), b.count(k));
+    ASSERT_EQ(range(m.lower_bound(k), m.end()).size(), range(b.lower_bound(k), b.end()).size());
+    ASSERT_EQ(range(m.upper_bound(k), m.end()).size(), range(b.upper_bound(k), b.end()).size());
+  }
+
+  EXPECT_EQ(range(m.lower_bound(100), m.lower_bound(200)), range(b.lower_bound(100), b.lower_bound(200)));
+  EXPECT_THROW(b.at(10000), std::out_of_range);
+
+  /* down to nothing */
+  for (int k = 0; k < 10000; ++k)
+    b.erase(k);
+  EXPECT_TRUE(b.empty());
+  EXPECT_TRUE(b.begin() == b.end());
+}
+
+TEST(TestBtree, CopiesAreDeep)
+{
+  utils::btree<std::string, int> b;
+
+  for (int k = 0; k < 1000; ++k)
+    b[ std::to_string(k) ] = k;
+
+  auto copy = b;
+  for (int k = 0; k < 1000; k += 2)
+    b.erase(std::to_string(k));
+  b[ "1" ] = -1;
+
+  EXPECT_EQ(1000u, copy.size());
+  EXPECT_EQ(500u, b.size());
+  EXPECT_EQ(1, copy.at("1"));
+  EXPECT_EQ(0, copy.at("0"));
+  EXPECT_EQ(-1, b.at("1"));
+
+  std::size_t n = 0;
+  for (auto const & it : copy)
+  {
+    EXPECT_EQ(std::to_string(it.second), it.first);
+    ++n;
+  }
+  EXPECT_EQ(1000u, n);
+}
+
+TEST(TestBtree, StoreScans)
+{
+  raft::store::memory<std::string, int, utils::btree<std::string, int>> store;
+  std::vector<std::string> keys;
+
+  for (auto const & k : {"user/1", "user/2", "user/3", "users", "group/1", "v"})
+    store.c(k, 0);
+
+  auto collect = [&keys](std::string const & k, int) { keys.push_back(k); };
+
+  EXPECT_EQ(3u, store.prefix("user/", collect));
+  EXPECT_EQ(std::vector<std::string>({"user/1", "user/2", "user/3"}), keys);
+
+  keys.clear();
+  EXPECT_EQ(2u, store.scan("user/2", "v", collect, 2));
+  EXPECT_EQ(std::vector<std::string>({"user/2", "user/3"}), keys);
+
+  keys.clear();
+  EXPECT_EQ(5u, store.scan("", "v", collect));
+  EXPECT_EQ("group/1", keys.front());
+}
@@ -0,0 +1,463 @@
+#include <gtest/gtest.h>
+
+#include <raft/codec.hh>
+
+namespace codec = raft::codec;
+
+using status_t = codec::status_t;
+
+template <typename msg_t>
+msg_t
+roundtrip(msg_t const & msg)
+{
+  std::vector<std::uint8_t> buf(codec::size(msg));
+  std::size_t written = 0;
+
+  EXPECT_EQ(status_t::ok, codec::encode(msg, buf.data(), buf.size(), written));
+  EXPECT_EQ(buf.size(), written);
+
+  msg_t out{};
+  std::size_t read = 0;
+
+  EXPECT_EQ(status_t::ok, codec::decode(buf.data(), buf.size(), out, read));
+  EXPECT_EQ(written, read);
+
+  return out;
+}
+
+TEST(TestCodec, VarintLengths)
+{
+  std::uint8_t buf[ 16 ];
+
+  for (auto & it : std::vector<std::pair<std::uint64_t, std::size_t>>{
+         {0, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3}, {~std::uint64_t(0), 10}})
+  {
+    codec::writer w(buf, sizeof(buf));
+    w.put_varint(it.first);
+    ASSERT_TRUE(w.ok());
+    EXPECT_EQ(it.second, w.size());
+
+    codec::reader r(buf, w.size());
+    EXPECT_EQ(it.first, r.get_varint());
+    EXPECT_TRUE(r.ok());
+  }
+}
+
+TEST(TestCodec, SignedIntegersAreZigzagged)
+{
+  std::uint8_t buf[ 16 ];
+
+  for (long int v : {0L, -1L, 1L, -64L, 64L, std::numeric_limits<long int>::min()})
+  {
+    codec::writer w(buf, sizeof(buf));
+    codec::put_int(w, v);
+
+    if (-64 <= v && v < 64)
+    {
+      EXPECT_EQ(1u, w.size());
+    }
+
+    codec::reader r(buf, w.size());
+    long int out;
+    codec::get_int(r, out);
+    EXPECT_TRUE(r.ok());
+    EXPECT_EQ(v, out);
+  }
+}
+
+TEST(TestCodec, NarrowingIsMalformed)
+{
+  std::uint8_t buf[ 16 ];
+  codec::writer w(buf, sizeof(buf));
+  w.put_varint(300);
+
+  codec::reader r(buf, w.size());
+  std::uint8_t out;
+  codec::get_int(r, out);
+  EXPECT_FALSE(r.ok());
+}
+
+TEST(TestCodec, VoteRequest)
+{
+  raft::rpc::vote_request_t<unsigned long int, unsigned long int, unsigned long int> msg{
+    7, 3, 1000, 6};
+
+  auto out = roundtrip(msg);
+  EXPECT_EQ(7u, out.term);
+  EXPECT_EQ(3u, out.candidate_id);
+  EXPECT_EQ(1000u, out.last_log_idx);
+  EXPECT_EQ(6u, out.last_log_term);
+
+  /* header and one byte per field but the 2 bytes index */
+  EXPECT_EQ(7u, codec::size(msg));
+}
+
+TEST(TestCodec, VoteResponse)
+{
+  raft::rpc::vote_response_t<int> msg{4, raft::rpc::vote_t::node_not_found};
+
+  auto out = roundtrip(msg);
+  EXPECT_EQ(4, out.term);
+  EXPECT_EQ(raft::rpc::vote_t::node_not_found, out.vote);
+}
+
+TEST(TestCodec, AppendEntriesRequest)
+{
+  raft::rpc::appendentries_request_t<std::string, int, int, int> msg{
+    3,
+    42,
+    2,
+    40,
+    {
+      {raft::entry_type_t::regular, 2, 43, "hello"},
+      {raft::entry_type_t::user, 3, 44, "world"},
+    }};
+
+  auto out = roundtrip(msg);
+  EXPECT_EQ(3, out.term);
+  EXPECT_EQ(42, out.prev_log_idx);
+  EXPECT_EQ(2, out.prev_log_term);
+  EXPECT_EQ(40, out.leader_commit);
+  ASSERT_EQ(2u, out.entries.size());
+  EXPECT_EQ(raft::entry_type_t::regular, out.entries[ 0 ].type);
+  EXPECT_EQ(43, out.entries[ 0 ].id);
+  EXPECT_EQ("hello", out.entries[ 0 ].elt);
+  EXPECT_EQ(raft::entry_type_t::user, out.entries[ 1 ].type);
+  EXPECT_EQ(3, out.entries[ 1 ].term);
+  EXPECT_EQ("world", out.entries[ 1 ].elt);
+}
+
+TEST(TestCodec, TriviallyCopyablePayload)
+{
+  struct point
+  {
+    double x;
+    double y;
+  };
+
+  raft::rpc::appendentries_request_t<point, int, int, int> msg{
+    1, 0, 0, 0, {{raft::entry_type_t::regular, 1, 1, {1.5, -2.5}}}};
+
+  auto out = roundtrip(msg);
+  ASSERT_EQ(1u, out.entries.size());
+  EXPECT_EQ(1.5, out.entries[ 0 ].elt.x);
+  EXPECT_EQ(-2.5, out.entries[ 0 ].elt.y);
+}
+
+TEST(TestCodec, AppendEntriesResponse)
+{
+  raft::rpc::appendentries_response_t<int, int> msg{3, true, 2, 1};
+
+  auto out = roundtrip(msg);
+  EXPECT_EQ(3, out.term);
+  EXPECT_TRUE(out.success);
+  EXPECT_EQ(2, out.current_idx);
+  EXPECT_EQ(1, out.first_idx);
+}
+
+TEST(TestCodec, Heartbeats)
+{
+  raft::rpc::heartbeat_request_t<int, int> req{5, 12, 100};
+  auto out = roundtrip(req);
+  EXPECT_EQ(5, out.term);
+  EXPECT_EQ(12, out.leader_commit);
+  EXPECT_EQ(100u, out.interval);
+
+  raft::rpc::heartbeat_response_t<int> resp{5, true};
+  auto out2 = roundtrip(resp);
+  EXPECT_EQ(5, out2.term);
+  EXPECT_TRUE(out2.success);
+}
+
+TEST(TestCodec, CoalescedHeartbeats)
+{
+  raft::rpc::coalesced_t<unsigned long int, raft::rpc::heartbeat_request_t<int, int>> req{
+    {{7, {5, 12, 100}}, {1ul << 40, {6, 3, 50}}}};
+  auto out = roundtrip(req);
+  ASSERT_EQ(2u, out.msgs.size());
+  EXPECT_EQ(7u, out.msgs[ 0 ].first);
+  EXPECT_EQ(5, out.msgs[ 0 ].second.term);
+  EXPECT_EQ(12, out.msgs[ 0 ].second.leader_commit);
+  EXPECT_EQ(100u, out.msgs[ 0 ].second.interval);
+  EXPECT_EQ(1ul << 40, out.msgs[ 1 ].first);
+  EXPECT_EQ(6, out.msgs[ 1 ].second.term);
+
+  raft::rpc::coalesced_t<unsigned long int, raft::rpc::heartbeat_response_t<int>> resp{
+    {{7, {5, true}}, {8, {6, false}}}};
+  auto out2 = roundtrip(resp);
+  ASSERT_EQ(2u, out2.msgs.size());
+  EXPECT_EQ(8u, out2.msgs[ 1 ].first);
+  EXPECT_EQ(6, out2.msgs[ 1 ].second.term);
+  EXPECT_TRUE(out2.msgs[ 0 ].second.success);
+  EXPECT_FALSE(out2.msgs[ 1 ].second.success);
+
+  /* control frames on the transports */
+  std::uint8_t buf[ 64 ];
+  std::size_t written = 0;
+  codec::type_t type;
+  ASSERT_EQ(status_t::ok, codec::encode(req, buf, sizeof(buf), written));
+  EXPECT_EQ(status_t::ok, codec::peek(buf, written, type));
+  EXPECT_EQ(codec::type_t::heartbeats_request, type);
+}
+
+TEST(TestCodec, CoalescedCountIsNotTrusted)
+{
+  std::uint8_t buf[ 16 ];
+  codec::writer w(buf, sizeof(buf));
+
+  w.put_byte(codec::version);
+  w.put_byte(std::uint8_t(codec::type_t::heartbeats_request));
+  w.put_varint(std::uint64_t(1) << 40);
+
+  raft::rpc::coalesced_t<int, raft::rpc::heartbeat_request_t<int, int>> out;
+  std::size_t read;
+  EXPECT_EQ(status_t::malformed, codec::decode(buf, w.size(), out, read));
+}
+
+TEST(TestCodec, InstallSnapshot)
+{
+  raft::rpc::installsnapshot_request_t<int, int> req{3, 100, 2, 1 << 30, 4096, 0xdeadbeef, false, {1, 2, 3}};
+  auto out = roundtrip(req);
+  EXPECT_EQ(3, out.term);
+  EXPECT_EQ(100, out.last_idx);
+  EXPECT_EQ(2, out.last_term);
+  EXPECT_EQ(1u << 30, out.size);
+  EXPECT_EQ(4096u, out.offset);
+  EXPECT_EQ(0xdeadbeef, out.crc);
+  EXPECT_FALSE(out.done);
+  EXPECT_EQ(req.data, out.data);
+
+  raft::rpc::installsnapshot_response_t<int, int> resp{3, 100, 8192, true};
+  auto out2 = roundtrip(resp);
+  EXPECT_EQ(3, out2.term);
+  EXPECT_EQ(100, out2.last_idx);
+  EXPECT_EQ(8192u, out2.offset);
+  EXPECT_TRUE(out2.success);
+}
+
+TEST(TestCodec, ShortBuffer)
+{
+  raft::rpc::vote_request_t<int, int, int> msg{7, 3, 1000, 6};
+  std::uint8_t buf[ 4 ];
+  std::size_t written = 0;
+
+  EXPECT_EQ(status_t::short_buffer, codec::encode(msg, buf, sizeof(buf), written));
+  EXPECT_EQ(0u, written);
+}
+
+TEST(TestCodec, DecodeErrors)
+{
+  raft::rpc::vote_request_t<int, int, int> msg{7, 3, 1000, 6};
+  std::uint8_t buf[ 16 ];
+  std::size_t written = 0, read;
+
+  ASSERT_EQ(status_t::ok, codec::encode(msg, buf, sizeof(buf), written));
+
+  decltype(msg) out;
+  EXPECT_EQ(status_t::short_buffer, codec::decode(buf, 1, out, read));
+  EXPECT_EQ(status_t::malformed, codec::decode(buf, written - 1, out, read));
+
+  raft::rpc::vote_response_t<int> other;
+  EXPECT_EQ(status_t::bad_type, codec::decode(buf, written, other, read));
+
+  codec::type_t type;
+  EXPECT_EQ(status_t::ok, codec::peek(buf, written, type));
+  EXPECT_EQ(codec::type_t::vote_request, type);
+
+  buf[ 0 ] = codec::version + 1;
+  EXPECT_EQ(status_t::bad_version, codec::decode(buf, written, out, read));
+}
+
+TEST(TestCodec, EntryCountIsNotTrusted)
+{
+  std::uint8_t buf[ 16 ];
+  codec::writer w(buf, sizeof(buf));
+
+  w.put_byte(codec::version);
+  w.put_byte(std::uint8_t(codec::type_t::appendentries_request));
+  for (int i = 0; i < 4; ++i)
+    w.put_varint(0);
+  w.put_varint(std::uint64_t(1) << 40);
+
+  raft::rpc::appendentries_request_t<int, int, int, int> out;
+  std::size_t read;
+  EXPECT_EQ(status_t::malformed, codec::decode(buf, w.size(), out, read));
+}
+
+TEST(TestCodec, EncodeEntriesFillsBuffer)
+{
+  using entry_t = raft::entry<std::uint32_t, int, int>;
+
+  std::vector<entry_t> entries;
+  for (int i = 1; i <= 10; ++i)
+    entries.push_back({raft::entry_type_t::regular, 1, i, std::uint32_t(i)});
+
+  /* each entry takes 5 varint bytes, payload length included */
+  std::uint8_t buf[ 5 * 4 + 3 ];
+  std::size_t written;
+
+  EXPECT_EQ(4u, codec::encode_entries(entries.begin(), entries.end(), buf, sizeof(buf), written));
+  EXPECT_EQ(20u, written);
+
+  codec::reader r(buf, written);
+  for (int i = 1; i <= 4; ++i)
+  {
+    entry_t e;
+    codec::get(r, e);
+    ASSERT_TRUE(r.ok());
+    EXPECT_EQ(i, e.id);
+    EXPECT_EQ(std::uint32_t(i), e.elt);
+  }
+  EXPECT_EQ(0u, r.remaining());
+}
+
+TEST(TestCodec, AppendEntriesView)
+{
+  raft::rpc::appendentries_request_t<std::string, int, int, int> msg{
+    3,
+    42,
+    2,
+    40,
+    {
+      {raft::entry_type_t::regular, 2, 43, "hello"},
+      {raft::entry_type_t::user, 3, 44, "world!"},
+    }};
+
+  std::vector<std::uint8_t> buf(codec::size(msg));
+  std::size_t written = 0, read;
+  ASSERT_EQ(status_t::ok, codec::encode(msg, buf.data(), buf.size(), written));
+
+  codec::appendentries_view_t<int, int, int> view;
+  ASSERT_EQ(status_t::ok, codec::decode(buf.data(), written, view, read));
+  EXPECT_EQ(written, read);
+  EXPECT_EQ(3, view.term);
+  EXPECT_EQ(42, view.prev_log_idx);
+  EXPECT_EQ(2, view.prev_log_term);
+  EXPECT_EQ(40, view.leader_commit);
+  ASSERT_EQ(2u, view.entries.size());
+
+  /* entries are laid out back to back at the end of the message */
+  EXPECT_EQ(buf.data() + written, view.entries.data() + view.entries.bytes());
+
+  std::size_t i = 0;
+  for (auto & e : view.entries)
+  {
+    EXPECT_EQ(msg.entries[ i ].type, e.type);
+    EXPECT_EQ(msg.entries[ i ].term, e.term);
+    EXPECT_EQ(msg.entries[ i ].id, e.id);
+
+    /* payloads point into the receive buffer */
+    EXPECT_LE(buf.data(), e.raw);
+    EXPECT_LT(e.raw, buf.data() + written);
+
+    std::string elt;
+    EXPECT_EQ(status_t::ok, codec::decode(e, elt));
+    EXPECT_EQ(msg.entries[ i ].elt, elt);
+
+    /* raw bytes decode as a regular entry */
+    codec::reader r(e.raw, e.raw_size);
+    raft::entry<std::string, int, int> copy;
+    codec::get(r, copy);
+    EXPECT_TRUE(r.ok());
+    EXPECT_EQ(msg.entries[ i ].elt, copy.elt);
+
+    ++i;
+  }
+  EXPECT_EQ(2u, i);
+}
+
+TEST(TestCodec, AppendEntriesViewRejectsTruncatedEntries)
+{
+  raft::rpc::appendentries_request_t<std::string, int, int, int> msg{
+    3, 42, 2, 40, {{raft::entry_type_t::regular, 2, 43, "hello"}}};
+
+  std::vector<std::uint8_t> buf(codec::size(msg));
+  std::size_t written = 0, read;
+  ASSERT_EQ(status_t::ok, codec::encode(msg, buf.data(), buf.size(), written));
+
+  codec::appendentries_view_t<int, int, int> view;
+  EXPECT_EQ(status_t::malformed, codec::decode(buf.data(), written - 1, view, read));
+  EXPECT_TRUE(view.entries.empty());
+}
+
+TEST(TestCodec, EntryViewPayloadMismatch)
+{
+  raft::rpc::appendentries_request_t<std::uint64_t, int, int, int> msg{
+    1, 0, 0, 0, {{raft::entry_type_t::regular, 1, 1, 1000}}};
+
+  std::vector<std::uint8_t> buf(codec::size(msg));
+  std::size_t written = 0, read;
+  ASSERT_EQ(status_t::ok, codec::encode(msg, buf.data(), buf.size(), written));
+
+  codec::appendentries_view_t<int, int, int> view;
+  ASSERT_EQ(status_t::ok, codec::decode(buf.data(), written, view, read));
+
+  /* a 2 bytes varint does not fit in a byte */
+  std::uint8_t small;
+  EXPECT_EQ(status_t::malformed, codec::decode(*view.entries.begin(), small));
+}
+
+namespace
+{
+
+/* payload without a size in its traits, counting its encodings */
+struct opaque
+{
+  std::string s;
+};
+
+unsigned int opaque_encodes = 0;
+
+} // namespace
+
+namespace raft
+{
+namespace codec
+{
+
+template <>
+struct traits<opaque>
+{
+  static void
+  encode(writer & w, opaque const & v)
+  {
+    ++opaque_encodes;
+    traits<std::string>::encode(w, v.s);
+  }
+
+  static void
+  decode(reader & r, opaque & v)
+  {
+    traits<std::string>::decode(r, v.s);
+  }
+};
+
+} // namespace codec
+} // namespace raft
+
+TEST(TestCodec, PayloadsAreEncodedOnce)
+{
+  using entry_t = raft::entry<opaque, int, int>;
+
+  entry_t e{raft::entry_type_t::regular, 1, 1, {std::string(300, 'x')}};
+  std::uint8_t buf[ 512 ];
+  codec::writer w(buf, sizeof(buf));
+
+  /* the length is patched in after the payload */
+  codec::put(w, e);
+  ASSERT_TRUE(w.ok());
+  EXPECT_EQ(1u, opaque_encodes);
+
+  entry_t out;
+  codec::reader r(buf, w.size());
+  codec::get(r, out);
+  ASSERT_TRUE(r.ok());
+  EXPECT_EQ(0u, r.remaining());
+  EXPECT_EQ(e.elt.s, out.elt.s);
+
+  /* sized payloads keep the shortest length */
+  EXPECT_TRUE(codec::is_sized<std::string>::value);
+  EXPECT_FALSE(codec::is_sized<opaque>::value);
+  EXPECT_EQ(3u + 2u + 302u, codec::size(raft::entry<std::string, int, int>{
+                              raft::entry_type_t::regular, 1, 1, std::string(300, 'x')}));
+}
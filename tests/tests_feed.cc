@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <raft/feed.hh>
+#include <raft/server.hh>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+using server_t = raft::server<int>;
+using feed_t = raft::feed<server_t>;
+
+/**
+ * @brief Single voter applying entries as they are received, after the
+ * noop of its election
+ */
+struct fixture_t
+{
+  fixture_t() : feed(server)
+  {
+    server.node_add(1, true);
+    server.periodic(1ms);
+
+    server_t::callbacks_t cbs;
+    cbs.applied = [this](auto) { feed.pump(); };
+    cbs.retain = [this]() { return feed.horizon(); };
+    cbs.snapshot = [](auto, auto) { return raft::status_t::ok; };
+    server.callbacks(cbs);
+  }
+
+  void
+  propose(int from, int to)
+  {
+    server_t::index_t idx;
+
+    for (int v = from; v < to; ++v)
+      server.recv_entry({raft::entry_type_t::regular, 0, 0, v}, idx);
+  }
+
+  server_t server;
+  feed_t feed;
+};
+
+} // namespace
+
+TEST(TestFeed, DeliversBatchesInPlace)
+{
+  fixture_t f;
+  std::vector<std::pair<server_t::index_t, int>> seen;
+  std::vector<std::size_t> batches;
+
+  f.propose(0, 10);
+
+  /* a subscriber starts after the entries it knows of */
+  f.feed.subscribe(
+    2,
+    [&](feed_t::range_t const & range) {
+      batches.push_back(range.size());
+      for (auto it = range.begin(); it != range.end(); ++it)
+      {
+        EXPECT_EQ(f.server.get(it.index()), &*it);
+        seen.emplace_back(it.index(), it->elt);
+      }
+      return range.size();
+    },
+    nullptr,
+    feed_t::default_capacity,
+    4);
+
+  f.feed.pump();
+  EXPECT_EQ((std::vector<std::size_t>{4, 4, 1}), batches);
+
+  /* then every entry as it is applied */
+  f.propose(10, 13);
+
+  std::vector<std::pair<server_t::index_t, int>> expected;
+  for (int v = 1; v < 13; ++v)
+    expected.emplace_back(server_t::index_t(v + 2), v);
+
+  EXPECT_EQ(expected, seen);
+  EXPECT_EQ((std::vector<std::size_t>{4, 4, 1, 1, 1, 1}), batches);
+  EXPECT_EQ(0u, f.feed.lag(0));
+}
+
+TEST(TestFeed, SlowSubscriberCatchesUpFromTheLog)
+{
+  fixture_t f;
+  std::vector<int> fast;
+  std::vector<int> slow;
+  std::size_t budget = 5;
+
+  server_t::snapshot_policy_t policy;
+  policy.max_entries = 10;
+  f.server.snapshot_policy(policy);
+
+  auto start = f.server.current_index();
+
+  f.feed.subscribe(start, [&](feed_t::range_t const & range) {
+    for (auto const & e : range)
+      fast.push_back(e.elt);
+    return range.size();
+  });
+
+  auto id = f.feed.subscribe(
+    start,
+    [&](feed_t::range_t const & range) {
+      std::size_t n = std::min(budget, range.size());
+      for (std::size_t i = 0; i < n; ++i)
+        slow.push_back(range[ range.first() + i ].elt);
+      budget -= n;
+      return n;
+    },
+    nullptr,
+    100);
+
+  f.propose(0, 50);
+
+  /* paused once out of budget, with its entries kept in the log */
+  EXPECT_EQ(50u, fast.size());
+  EXPECT_EQ(5u, slow.size());
+  EXPECT_TRUE(f.feed.paused(id));
+  EXPECT_EQ(45u, f.feed.lag(id));
+  EXPECT_FALSE(f.feed.pressure());
+  EXPECT_LE(f.server.log_base(), start + 5);
+
+  budget = 1000;
+  f.feed.resume(id);
+
+  EXPECT_EQ(fast, slow);
+  EXPECT_EQ(0u, f.feed.lag(id));
+
+  /* caught up, the log is compacted again */
+  f.propose(50, 70);
+  EXPECT_LT(50u, f.server.log_base());
+}
+
+TEST(TestFeed, SubscriberPastItsCapacityLosesEntries)
+{
+  fixture_t f;
+  std::vector<std::pair<server_t::index_t, server_t::index_t>> lost;
+  std::vector<int> seen;
+  bool stalled = true;
+
+  server_t::snapshot_policy_t policy;
+  policy.max_entries = 10;
+  f.server.snapshot_policy(policy);
+
+  auto start = f.server.current_index();
+
+  auto id = f.feed.subscribe(
+    start,
+    [&](feed_t::range_t const & range) {
+      if (stalled)
+        return std::size_t(0);
+      for (auto const & e : range)
+        seen.push_back(e.elt);
+      return range.size();
+    },
+    [&](auto cursor, auto base) { lost.emplace_back(cursor, base); },
+    20);
+
+  f.propose(0, 30);
+  EXPECT_TRUE(f.feed.pressure());
+  EXPECT_EQ(start + 10, f.feed.horizon());
+
+  f.propose(30, 60);
+  EXPECT_LT(0u, f.server.log_base());
+
+  stalled = false;
+  f.feed.resume(id);
+  ASSERT_EQ(1u, lost.size());
+  EXPECT_EQ(start, lost[ 0 ].first);
+  EXPECT_EQ(f.server.log_base(), lost[ 0 ].second);
+  EXPECT_TRUE(f.feed.lost(id));
+  EXPECT_FALSE(f.feed.pressure());
+
+  /* resynced from a snapshot, it follows the log again */
+  f.feed.seek(id, f.server.log_base());
+  EXPECT_FALSE(f.feed.lost(id));
+  EXPECT_EQ(start + 60 - f.server.log_base(), seen.size());
+  EXPECT_EQ(59, seen.back());
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <raft/store/memory.hh>
+#include <utils/flat_map.hh>
+
+namespace
+{
+
+template <typename Map>
+std::vector<std::pair<int, int>>
+items(Map const & m)
+{
+  std::vector<std::pair<int, int>> v;
+
+  for (auto const & it : m)
+    v.emplace_back(it.first, it.second);
+
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+/* every key has the same home slot */
+struct collide
+{
+  std::size_t
+  operator()(int) const
+  {
+    return 0;
+  }
+};
+
+} // namespace
+
+TEST(TestFlatMap, BehavesLikeUnorderedMap)
+{
+  utils::flat_map<int, int> f;
+  std::unordered_map<int, int> m;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> key(0, 4999);
+
+  for (int i = 0; i < 100000; ++i)
+  {
+    int k = key(gen);
+
+    switch (gen() % 3)
+    {
+      case 0:
+        EXPECT_EQ(m.insert({k, i}).second, f.insert({k, i}));
+        break;
+      case 1:
+        m[ k ] = i;
+        f[ k ] = i;
+        break;
+      case 2:
+        EXPECT_EQ(m.erase(k), f.erase(k));
+        break;
+    }
+
+    ASSERT_EQ(m.size(), f.size());
+  }
+
+  EXPECT_EQ(items(m), items(f));
+
+  for (int k = 0; k < 5000; ++k)
+  {
+    EXPECT_EQ(m.count(k), f.count(k));
+    if (m.count(k))
+    {
+      EXPECT_EQ(m.at(k), f.at(k));
+    }
+  }
+
+  EXPECT_THROW(f.at(5000), std::out_of_range);
+}
+
+TEST(TestFlatMap, ErasingShiftsCollisionsBack)
+{
+  utils::flat_map<int, int, collide> f;
+
+  for (int k = 0; k < 10; ++k)
+    f[ k ] = k;
+
+  EXPECT_EQ(1u, f.erase(0));
+  EXPECT_EQ(1u, f.erase(5));
+  EXPECT_EQ(0u, f.erase(5));
+
+  for (int k = 0; k < 10; ++k)
+    EXPECT_EQ(k != 0 && k != 5, f.count(k) == 1) << k;
+
+  EXPECT_EQ(9, f.at(9));
+}
+
+TEST(TestFlatMap, SurvivesABadHash)
+{
+  utils::flat_map<int, std::string, collide> f;
+
+  for (int k = 0; k < 300; ++k)
+    f[ k ] = std::to_string(k);
+
+  EXPECT_EQ(300u, f.size());
+  for (int k = 0; k < 300; ++k)
+    EXPECT_EQ(std::to_string(k), f.at(k));
+}
+
+TEST(TestFlatMap, CopiesAreIsolated)
+{
+  utils::flat_map<std::string, int> f;
+
+  for (int k = 0; k < 100; ++k)
+    f[ std::to_string(k) ] = k;
+
+  auto copy = f;
+  f.erase("1");
+  f[ "2" ] = -2;
+
+  EXPECT_EQ(100u, copy.size());
+  EXPECT_EQ(1, copy.at("1"));
+  EXPECT_EQ(2, copy.at("2"));
+  EXPECT_EQ(-2, f.at("2"));
+  EXPECT_EQ(0u, f.count("1"));
+
+  utils::flat_map<std::string, int> moved(std::move(copy));
+  EXPECT_EQ(100u, moved.size());
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(0u, copy.count("1"));
+}
+
+TEST(TestFlatMap, Store)
+{
+  raft::store::memory<std::string, int, utils::flat_map<std::string, int>> store;
+
+  EXPECT_TRUE(store.c("k", 42));
+  EXPECT_EQ(42, store.r("k"));
+
+  EXPECT_TRUE(store.u("k", 21));
+  EXPECT_EQ(21, store.r("k"));
+
+  store.d("k");
+  EXPECT_THROW(store.r("k"), std::out_of_range);
+}
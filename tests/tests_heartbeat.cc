@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <raft/heartbeat.hh>
+
+enum class status_t
+{
+  ok = 0,
+  fail = 1,
+};
+
+namespace raft
+{
+template <>
+struct enum_traits<::status_t>
+{
+  static constexpr bool has_any = true;
+};
+}
+
+using coalescer_t = raft::heartbeat::coalescer<int, int, int, int>;
+
+TEST(TestHeartbeat, OneMessagePerPeer)
+{
+  coalescer_t c;
+
+  c.add(2, 10, {1, 5, 0});
+  c.add(3, 10, {1, 5, 0});
+  c.add(2, 11, {4, 7, 0});
+  c.add(2, 12, {2, 0, 0});
+  EXPECT_EQ(c.count(), 4);
+
+  std::map<int, coalescer_t::message_t> sent;
+  auto ret = c.flush([&](int peer, coalescer_t::message_t const & msg) {
+    EXPECT_EQ(sent.count(peer), 0);
+    sent[ peer ] = msg;
+    return status_t::ok;
+  });
+
+  EXPECT_TRUE(ret == status_t::ok);
+  EXPECT_EQ(sent.size(), 2);
+  EXPECT_EQ(sent[ 2 ].msgs.size(), 3);
+  EXPECT_EQ(sent[ 3 ].msgs.size(), 1);
+
+  EXPECT_EQ(sent[ 2 ].msgs[ 1 ].first, 11);
+  EXPECT_EQ(sent[ 2 ].msgs[ 1 ].second.term, 4);
+  EXPECT_EQ(sent[ 2 ].msgs[ 1 ].second.leader_commit, 7);
+}
+
+TEST(TestHeartbeat, FlushEmptiesQueues)
+{
+  coalescer_t c;
+
+  c.add(2, 10, {1, 5, 0});
+  c.flush([](int, coalescer_t::message_t const &) { return status_t::ok; });
+
+  EXPECT_EQ(c.count(), 0);
+
+  unsigned int calls = 0;
+  c.flush([&](int, coalescer_t::message_t const &) { return ++calls, status_t::ok; });
+  EXPECT_EQ(calls, 0);
+}
+
+TEST(TestHeartbeat, FlushReportsErrors)
+{
+  coalescer_t c;
+
+  c.add(2, 10, {1, 5, 0});
+  c.add(3, 10, {1, 5, 0});
+
+  auto ret = c.flush([](int peer, coalescer_t::message_t const &) {
+    return peer == 3 ? status_t::fail : status_t::ok;
+  });
+
+  EXPECT_TRUE(ret == status_t::fail);
+  EXPECT_EQ(c.count(), 0);
+}
+
+TEST(TestHeartbeat, Print)
+{
+  coalescer_t::message_t msg{{{10, {1, 5, 0}}, {11, {2, 6, 0}}}};
+
+  std::cout << msg << std::endl;
+}
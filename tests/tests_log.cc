@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <string>
+
 #include <raft/log.hh>
+#include <utils/ring.hh>
 
 #define entry(id)                                                                                  \
   {                                                                                                \
@@ -254,3 +257,45 @@ TEST(TestLog, DeleteAfterPolling)
   EXPECT_EQ(l.remove(1), raft::log_status_t::ok);
   EXPECT_EQ(l.count(), 0);
 }
+
+TEST(TestLog, CompactKeepsLastDroppedTerm)
+{
+  raft::log<int> l;
+
+  for (int i = 1; i <= 5; ++i)
+    l.append({raft::entry_type_t::regular, (unsigned long int)(i + 10), (unsigned long int)i, 0});
+
+  EXPECT_EQ(l.compact(3), raft::log_status_t::ok);
+  EXPECT_EQ(l.base(), 3);
+  EXPECT_EQ(l.base_term(), 13);
+  EXPECT_EQ(l.count(), 2);
+  EXPECT_EQ(l.current(), 5);
+  EXPECT_EQ(l.at(3), nullptr);
+  EXPECT_EQ(l.at(4)->id, 4);
+
+  /* past the end: everything goes */
+  EXPECT_EQ(l.compact(10), raft::log_status_t::ok);
+  EXPECT_EQ(l.base(), 5);
+  EXPECT_EQ(l.base_term(), 15);
+  EXPECT_EQ(l.count(), 0);
+
+  l.load(20, 7);
+  EXPECT_EQ(l.base(), 20);
+  EXPECT_EQ(l.base_term(), 7);
+}
+
+TEST(TestRing, EmplaceOwnElementWhileGrowing)
+{
+  utils::ring<std::string> r;
+
+  for (int i = 0; i < 16; ++i)
+    r.emplace_back(std::string(32, char('a' + i)));
+  ASSERT_EQ(r.size(), r.capacity());
+
+  /* the argument is read before the elements move to the larger buffer */
+  r.emplace_back(r.front());
+  EXPECT_EQ(std::string(32, 'a'), r.back());
+  EXPECT_EQ(std::string(32, 'a'), r.front());
+  EXPECT_EQ(std::string(32, 'p'), r[ 15 ]);
+  EXPECT_EQ(17u, r.size());
+}
@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+
+#include <raft/multi.hh>
+
+TEST(TestMulti, GroupAddHostsSelf)
+{
+  raft::multi<int> h(1);
+
+  auto s = h.group_add(7);
+  EXPECT_NE(s, nullptr);
+  EXPECT_EQ(s->my_node()->id(), 1);
+  EXPECT_EQ(h.group_get(7), s);
+  EXPECT_EQ(h.group_count(), 1);
+}
+
+TEST(TestMulti, GroupAddTwiceIsNotAllowed)
+{
+  raft::multi<int> h(1);
+
+  h.group_add(7);
+  EXPECT_EQ(h.group_add(7), nullptr);
+}
+
+TEST(TestMulti, GroupRemove)
+{
+  raft::multi<int> h(1);
+
+  h.group_add(7);
+  h.group_add(8);
+  h.group_remove(7);
+
+  EXPECT_EQ(h.group_get(7), nullptr);
+  EXPECT_NE(h.group_get(8), nullptr);
+}
+
+TEST(TestMulti, ServerDoesNotEmbedRandomEngine)
+{
+  using server_t = raft::multi<int>::server_t;
+
+  EXPECT_LT(sizeof(server_t), sizeof(server_t::generator_t));
+}
+
+TEST(TestMulti, RecvOnUnknownGroupFails)
+{
+  raft::multi<int> h(1);
+
+  raft::multi<int>::vote_response_t resp;
+
+  EXPECT_TRUE(h.recv_vote_request(7, 2, {1, 2, 0, 0}, resp) == raft::status_t::fail);
+  EXPECT_TRUE(h.recv_vote_response(7, 2, {1, raft::rpc::vote_t::granted}) == raft::status_t::fail);
+}
+
+TEST(TestMulti, SharedTickRoutesElectionByGroup)
+{
+  raft::multi<int> h1(1);
+  raft::multi<int> h2(2);
+
+  for (auto gid : {7, 8})
+  {
+    h1.group_add(gid)->node_add(2);
+    h2.group_add(gid)->node_add(1);
+  }
+
+  raft::multi<int>::callbacks_t cbs;
+  cbs.send_request_vote = [&](auto gid, auto to, auto const & req) {
+    EXPECT_EQ(gid, 7);
+    EXPECT_EQ(to, 2);
+    EXPECT_EQ(req.candidate_id, 1);
+
+    raft::multi<int>::vote_response_t resp;
+    h2.recv_vote_request(gid, h1.id(), req, resp);
+    return h1.recv_vote_response(gid, to, resp);
+  };
+  h1.callbacks(cbs);
+
+  /* only group 7 reaches its election timeout */
+  h1.group_get(8)->election_timeout(10000ms);
+  h1.periodic(2000ms);
+
+  EXPECT_TRUE(h1.group_get(7)->is_leader());
+  EXPECT_TRUE(h1.group_get(8)->is_follower());
+  EXPECT_EQ(h2.group_get(7)->voted_for()->id(), 1);
+  EXPECT_EQ(h2.group_get(8)->voted_for(), nullptr);
+}
+
+TEST(TestMulti, HeartbeatsAreCoalescedPerPeer)
+{
+  raft::multi<int> h1(1);
+  raft::multi<int> h2(2);
+
+  for (auto gid : {7, 8, 9})
+  {
+    auto s = h1.group_add(gid);
+    s->node_add(2);
+    s->node_add(3);
+    s->current_term(gid);
+    s->become_leader();
+
+    /* followers already hold the noop of the election */
+    for (auto id : {2, 3})
+    {
+      s->node_get(id)->match_index(s->current_index());
+      s->node_get(id)->next_index(s->current_index() + 1);
+    }
+
+    h2.group_add(gid)->node_add(1);
+  }
+
+  /* drop the heartbeats sent on election */
+  h1.flush_heartbeats();
+
+  std::map<unsigned long int, unsigned int> messages;
+  raft::multi<int>::callbacks_t cbs;
+  cbs.send_heartbeats = [&](auto peer, auto const & req) {
+    ++messages[ peer ];
+    EXPECT_EQ(req.msgs.size(), 3);
+
+    if (peer != h2.id())
+      return raft::status_t::ok;
+
+    raft::multi<int>::heartbeats_response_t resp;
+    h2.recv_heartbeats(h1.id(), req, resp);
+    EXPECT_EQ(resp.msgs.size(), 3);
+    return h1.recv_heartbeats_response(peer, resp);
+  };
+  h1.callbacks(cbs);
+
+  h1.periodic(200ms);
+
+  EXPECT_EQ(messages.size(), 2);
+  EXPECT_EQ(messages[ 2 ], 1);
+  EXPECT_EQ(messages[ 3 ], 1);
+
+  for (auto gid : {7, 8, 9})
+  {
+    EXPECT_TRUE(h1.group_get(gid)->is_leader());
+    EXPECT_EQ(h2.group_get(gid)->leader()->id(), 1);
+    EXPECT_EQ(h2.group_get(gid)->current_term(), gid);
+  }
+}
+
+TEST(TestMulti, NextDeadlineIsTheEarliestGroupDeadline)
+{
+  raft::multi<int> h(1);
+
+  EXPECT_EQ(h.next_deadline(), std::chrono::milliseconds::max());
+
+  for (auto gid : {7, 8})
+  {
+    auto s = h.group_add(gid);
+    s->node_add(2);
+    s->node_add(3);
+  }
+
+  h.periodic(1ms);
+  EXPECT_GE(h.next_deadline(), 900ms);
+  EXPECT_LE(h.next_deadline(), 2000ms);
+
+  auto s = h.group_get(8);
+  s->current_term(1);
+  s->become_leader();
+  h.touch(8);
+  EXPECT_LE(h.next_deadline(), 200ms);
+}
+
+TEST(TestMulti, RecvResetsGroupTimer)
+{
+  raft::multi<int> h(1);
+
+  auto s = h.group_add(7);
+  s->node_add(2);
+  s->election_timeout(1000ms);
+  h.periodic(1ms);
+
+  /* keep receiving heartbeats before the election timeout */
+  for (unsigned int i = 0; i < 20; ++i)
+  {
+    h.periodic(900ms);
+
+    raft::multi<int>::heartbeats_response_t resp;
+    h.recv_heartbeats(2, {{{7, {1, 0, 100}}}}, resp);
+    EXPECT_TRUE(resp.msgs[ 0 ].second.success);
+  }
+
+  EXPECT_TRUE(s->is_follower());
+  EXPECT_EQ(s->leader()->id(), 2);
+}
+
+TEST(TestMulti, GroupsReplicateAndApplyThroughTheHost)
+{
+  raft::multi<int> h1(1);
+  raft::multi<int> h2(2);
+  std::vector<int> applied;
+
+  raft::multi<int>::server_t::callbacks_t group;
+  group.apply_log = [&](auto const & e, auto) {
+    applied.push_back(e.elt);
+    return raft::status_t::ok;
+  };
+
+  h1.group_add(7)->node_add(2);
+  h2.group_add(7, group)->node_add(1);
+
+  raft::multi<int>::callbacks_t cbs;
+  cbs.send_request_vote = [&](auto gid, auto to, auto const & req) {
+    raft::multi<int>::vote_response_t resp;
+    h2.recv_vote_request(gid, h1.id(), req, resp);
+    return h1.recv_vote_response(gid, to, resp);
+  };
+  cbs.send_appendentries = [&](auto gid, auto to, auto const & req) {
+    EXPECT_EQ(gid, 7);
+    EXPECT_EQ(to, 2);
+
+    raft::multi<int>::appendentries_response_t resp;
+    h2.recv_appendentries(gid, h1.id(), req, resp);
+    return h1.recv_appendentries_response(gid, to, resp);
+  };
+  cbs.send_heartbeats = [&](auto peer, auto const & req) {
+    raft::multi<int>::heartbeats_response_t resp;
+    h2.recv_heartbeats(h1.id(), req, resp);
+    return h1.recv_heartbeats_response(peer, resp);
+  };
+  h1.callbacks(cbs);
+
+  /* the group hooks leave the host routing in place */
+  h2.group_get(7)->election_timeout(10000ms);
+  h1.periodic(2000ms);
+  ASSERT_TRUE(h1.group_get(7)->is_leader());
+
+  unsigned long int idx;
+  EXPECT_TRUE(h1.group_get(7)->recv_entry({raft::entry_type_t::regular, 0, 0, 42}, idx) ==
+              raft::status_t::ok);
+  EXPECT_EQ(h1.group_get(7)->commit_index(), idx);
+  EXPECT_EQ(h2.group_get(7)->current_index(), idx);
+
+  /* the follower learns the commit index with the next heartbeat */
+  h1.periodic(200ms);
+  EXPECT_EQ(h2.group_get(7)->last_applied_index(), idx);
+  ASSERT_FALSE(applied.empty());
+  EXPECT_EQ(applied.back(), 42);
+}
+
+TEST(TestMulti, GroupTimerSurvivesFailedSend)
+{
+  raft::multi<int> h(1);
+
+  auto s = h.group_add(7);
+  s->node_add(2);
+  s->node_add(3);
+
+  unsigned int votes = 0;
+  raft::multi<int>::callbacks_t cbs;
+  cbs.send_request_vote = [&](auto, auto, auto const &) {
+    /* the first election cannot reach anyone */
+    return ++votes <= 2 ? raft::status_t::fail : raft::status_t::ok;
+  };
+  h.callbacks(cbs);
+
+  EXPECT_TRUE(h.periodic(2000ms) == raft::status_t::fail);
+  EXPECT_EQ(votes, 2);
+
+  /* the group still runs its next election */
+  EXPECT_NE(h.next_deadline(), std::chrono::milliseconds::max());
+  for (int i = 0; i < 50 && votes == 2; ++i)
+    EXPECT_TRUE(h.periodic(100ms) == raft::status_t::ok);
+  EXPECT_EQ(votes, 4);
+  EXPECT_TRUE(s->is_candidate());
+}
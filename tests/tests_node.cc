@@ -56,3 +56,48 @@ TEST(TestNode, Print)
 
   std::cout << n << std::endl;
 }
+
+TEST(TestNode, RttSmoothing)
+{
+  raft::node<int> n(1);
+
+  EXPECT_EQ(n.rtt_samples(), 0);
+
+  n.rtt_sample(std::chrono::microseconds(800));
+  EXPECT_EQ(n.rtt(), std::chrono::microseconds(800));
+  EXPECT_EQ(n.rtt_var(), std::chrono::microseconds(400));
+  EXPECT_EQ(n.rto(), std::chrono::microseconds(2400));
+
+  n.rtt_sample(std::chrono::microseconds(1600));
+  EXPECT_EQ(n.rtt(), std::chrono::microseconds(900));
+  EXPECT_EQ(n.rtt_var(), std::chrono::microseconds(500));
+  EXPECT_EQ(n.rtt_samples(), 2);
+}
+
+TEST(TestNode, ProbeSupersededIsNotMeasured)
+{
+  raft::node<int> n(1);
+  auto t0 = raft::node<int>::clock_t::now();
+
+  n.probe_received(t0);
+  EXPECT_EQ(n.rtt_samples(), 0);
+
+  n.probe_sent(t0);
+  n.probe_received(t0 + std::chrono::milliseconds(2));
+  EXPECT_EQ(n.rtt_samples(), 1);
+  EXPECT_EQ(n.rtt(), std::chrono::milliseconds(2));
+
+  /* the first request is lost, the response cannot be told apart */
+  n.probe_sent(t0 + std::chrono::milliseconds(100));
+  n.probe_sent(t0 + std::chrono::milliseconds(200));
+  n.probe_received(t0 + std::chrono::milliseconds(202));
+  EXPECT_EQ(n.rtt_samples(), 1);
+
+  n.probe_sent(t0 + std::chrono::milliseconds(300));
+  n.probe_received(t0 + std::chrono::milliseconds(302));
+  EXPECT_EQ(n.rtt_samples(), 2);
+  EXPECT_EQ(n.rtt(), std::chrono::milliseconds(2));
+
+  n.probe_received(t0 + std::chrono::milliseconds(400));
+  EXPECT_EQ(n.rtt_samples(), 2);
+}
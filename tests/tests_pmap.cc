@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <raft/store/memory.hh>
+#include <utils/pmap.hh>
+
+namespace
+{
+
+template <typename Map>
+std::vector<std::pair<int, int>>
+items(Map const & m)
+{
+  std::vector<std::pair<int, int>> v;
+
+  for (auto const & it : m)
+    v.emplace_back(it.first, it.second);
+
+  return v;
+}
+
+} // namespace
+
+TEST(TestPmap, BehavesLikeStdMap)
+{
+  utils::pmap<int, int> p;
+  std::map<int, int> m;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> key(0, 999);
+
+  for (int i = 0; i < 20000; ++i)
+  {
+    int k = key(gen);
+
+    switch (gen() % 3)
+    {
+      case 0:
+        EXPECT_EQ(m.insert({k, i}).second, p.insert({k, i}));
+        break;
+      case 1:
+        m[ k ] = i;
+        p[ k ] = i;
+        break;
+      case 2:
+        EXPECT_EQ(m.erase(k), p.erase(k));
+        break;
+    }
+
+    ASSERT_EQ(m.size(), p.size());
+  }
+
+  EXPECT_EQ(items(m), items(p));
+
+  for (int k = 0; k < 1000; ++k)
+  {
+    EXPECT_EQ(m.count(k), p.count(k));
+    if (m.count(k))
+    {
+      EXPECT_EQ(m.at(k), p.at(k));
+    }
+  }
+
+  EXPECT_THROW(p.at(1000), std::out_of_range);
+}
+
+TEST(TestPmap, CopiesAreIsolated)
+{
+  utils::pmap<int, int> p;
+
+  for (int k = 0; k < 100; ++k)
+    p[ k ] = k;
+
+  auto frozen = p;
+  auto expected = items(frozen);
+
+  for (int k = 0; k < 100; k += 2)
+    p.erase(k);
+  for (int k = 1; k < 100; k += 2)
+    p[ k ] = -k;
+  for (int k = 100; k < 200; ++k)
+    p.insert({k, k});
+
+  EXPECT_EQ(expected, items(frozen));
+  EXPECT_EQ(100u, frozen.size());
+  EXPECT_EQ(150u, p.size());
+  EXPECT_EQ(-1, p.at(1));
+  EXPECT_EQ(1, frozen.at(1));
+
+  /* and the other way round */
+  frozen[ 1 ] = 7;
+  EXPECT_EQ(-1, p.at(1));
+}
+
+TEST(TestPmap, CopyIsSerializedWhileUpdatesGoOn)
+{
+  utils::pmap<int, int> p;
+
+  for (int k = 0; k < 10000; ++k)
+    p[ k ] = k;
+
+  for (int round = 0; round < 10; ++round)
+  {
+    auto frozen = p;
+    long long sum = 0;
+
+    std::thread reader([&frozen, &sum]() {
+      for (auto const & it : frozen)
+        sum += it.second;
+    });
+
+    for (int k = 0; k < 10000; k += 3)
+    {
+      p[ k ] += 1;
+      p.erase(k + 1);
+      p.insert({k + 1, k + 1});
+    }
+
+    reader.join();
+
+    long long expected = 0;
+    for (auto const & it : frozen)
+      expected += it.second;
+    EXPECT_EQ(expected, sum);
+  }
+}
+
+TEST(TestPmap, StoreSnapshot)
+{
+  raft::store::memory<std::string, int, utils::pmap<std::string, int>> store;
+
+  store.c("a", 1);
+  store.c("b", 2);
+
+  auto view = store.snapshot();
+
+  store.u("a", 10);
+  store.d("b");
+
+  EXPECT_EQ(1, view.at("a"));
+  EXPECT_EQ(2, view.at("b"));
+  EXPECT_EQ(10, store.r("a"));
+  EXPECT_THROW(store.r("b"), std::out_of_range);
+}
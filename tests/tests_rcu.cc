@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <raft/store/concurrent.hh>
+#include <utils/rcu.hh>
+
+TEST(TestRcu, ReclaimsOnceReadersMoveOn)
+{
+  utils::rcu<int> cell(std::unique_ptr<int const>(new int(1)));
+  auto reader = cell.make_reader();
+
+  reader.read([&cell](int const & v) {
+    EXPECT_EQ(1, v);
+
+    /* the reader keeps seeing its version */
+    cell.publish(std::unique_ptr<int const>(new int(2)));
+    EXPECT_EQ(1, v);
+    EXPECT_EQ(1u, cell.retired());
+  });
+
+  EXPECT_EQ(2, reader.read([](int const & v) { return v; }));
+
+  cell.reclaim();
+  EXPECT_EQ(0u, cell.retired());
+
+  cell.publish(std::unique_ptr<int const>(new int(3)));
+  EXPECT_EQ(0u, cell.retired());
+  EXPECT_EQ(3, cell.get());
+}
+
+TEST(TestRcu, ReadersAreBounded)
+{
+  utils::rcu<int> cell(std::unique_ptr<int const>(new int(0)), 2);
+
+  {
+    auto r1 = cell.make_reader();
+    auto r2 = cell.make_reader();
+    EXPECT_THROW(cell.make_reader(), std::runtime_error);
+  }
+
+  auto r3 = cell.make_reader();
+  EXPECT_EQ(0, r3.read([](int const & v) { return v; }));
+}
+
+TEST(TestRcu, StoreReadersSeeWholeBatches)
+{
+  raft::store::concurrent<int, int> store;
+  raft::store::write_batch<int, int> batch;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+
+  batch.put(0, 0);
+  batch.put(1, 0);
+  store.apply(batch, 1);
+
+  for (int i = 0; i < 4; ++i)
+  {
+    readers.emplace_back([&store, &done]() {
+      auto reader = store.make_reader();
+      std::uint64_t last = 0;
+
+      while (!done.load())
+      {
+        reader.read([&last](raft::store::concurrent<int, int>::version_t const & v) {
+          /* both keys come from the same batch */
+          EXPECT_EQ(0, v.map.at(0) + v.map.at(1));
+          EXPECT_LE(last, v.applied_index);
+          last = v.applied_index;
+        });
+      }
+    });
+  }
+
+  for (int i = 2; i < 20000; ++i)
+  {
+    batch.clear();
+    batch.put(0, i);
+    batch.put(1, -i);
+    batch.put(i, i);
+    store.apply(batch, std::uint64_t(i));
+  }
+
+  done = true;
+  for (auto & t : readers)
+    t.join();
+
+  store.d(2);
+  EXPECT_EQ(19999u, store.applied_index());
+  EXPECT_EQ(19999, store.make_reader().r(0));
+  EXPECT_THROW(store.make_reader().r(2), std::out_of_range);
+  EXPECT_EQ(0u, store.retired());
+}
@@ -2,6 +2,8 @@
 
 #include <raft/server.hh>
 
+#include "cluster.hh"
+
 TEST(TestServer, ServerVotedForRecordsWhoWeVotedFor)
 {
   raft::server<int> s;
@@ -394,3 +396,788 @@ TEST(TestServer, RecvRequestVoteDependsOnCandidateId)
   EXPECT_EQ(s.current_term(), 2);
   EXPECT_EQ(s.voted_for()->id(), 3);
 }
+
+TEST(TestServer, LeaderSendsHeartbeatsOnRequestTimeout)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.node_add(2);
+  s.node_add(3);
+
+  unsigned int sent = 0;
+  unsigned int appended = 0;
+  decltype(s)::callbacks_t cbs;
+  cbs.send_heartbeat = [&](auto const & node, auto const & msg) {
+    EXPECT_NE(node->id(), 1);
+    EXPECT_EQ(msg.term, 1);
+    return ++sent, raft::status_t::ok;
+  };
+  /* followers take the noop of the election */
+  cbs.send_appendentries = [&](auto const & node, auto const & req) {
+    ++appended;
+    return s.recv_appendentries_response(
+      node, {1, true, req.prev_log_idx + req.entries.size(), req.prev_log_idx + 1});
+  };
+  s.callbacks(cbs);
+
+  s.current_term(1);
+  s.become_leader();
+  EXPECT_EQ(sent, 2);
+  EXPECT_EQ(appended, 2);
+  EXPECT_EQ(s.commit_index(), 1);
+  sent = 0;
+
+  s.periodic(100ms);
+  EXPECT_EQ(sent, 0);
+
+  s.periodic(100ms);
+  EXPECT_EQ(sent, 2);
+  EXPECT_EQ(s.elapsed_timeout(), 0ms);
+}
+
+TEST(TestServer, HeartbeatCommitIsBoundedByMatchIndex)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+
+  s.append({raft::entry_type_t::regular, 1, 1, 0});
+  s.append({raft::entry_type_t::regular, 1, 2, 0});
+  s.commit_index(2);
+  n2->match_index(1);
+
+  s.send_heartbeat(n2, [](auto, auto const & msg) {
+    EXPECT_EQ(msg.leader_commit, 1);
+    return raft::status_t::ok;
+  });
+}
+
+TEST(TestServer, RecvHeartbeatRejectsStaleTerm)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.current_term(2);
+
+  decltype(s)::heartbeat_response_t resp;
+  s.recv_heartbeat(n2, {1, 0, 200}, resp);
+
+  EXPECT_FALSE(resp.success);
+  EXPECT_EQ(resp.term, 2);
+  EXPECT_EQ(s.leader(), nullptr);
+}
+
+TEST(TestServer, RecvHeartbeatSetsLeaderAndCommit)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.append({raft::entry_type_t::regular, 1, 1, 0});
+  s.append({raft::entry_type_t::regular, 1, 2, 0});
+
+  s.periodic(500ms);
+
+  decltype(s)::heartbeat_response_t resp;
+  s.recv_heartbeat(n2, {1, 5, 200}, resp);
+
+  EXPECT_TRUE(resp.success);
+  EXPECT_EQ(s.current_term(), 1);
+  EXPECT_EQ(s.leader(), n2);
+  EXPECT_EQ(s.commit_index(), 2);
+  EXPECT_EQ(s.elapsed_timeout(), 0ms);
+}
+
+TEST(TestServer, CandidateStepsDownOnHeartbeat)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.become_candidate();
+
+  decltype(s)::heartbeat_response_t resp;
+  s.recv_heartbeat(n2, {s.current_term(), 0, 200}, resp);
+
+  EXPECT_TRUE(resp.success);
+  EXPECT_TRUE(s.is_follower());
+}
+
+TEST(TestServer, LeaderStepsDownOnHeartbeatResponseWithHigherTerm)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.current_term(1);
+  s.become_leader();
+
+  s.recv_heartbeat_response(n2, {3, false});
+
+  EXPECT_TRUE(s.is_follower());
+  EXPECT_EQ(s.current_term(), 3);
+}
+
+TEST(TestServer, NextDeadlineFollowsRandomizedElectionTimeout)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.node_add(2);
+  s.election_timeout(1000ms);
+
+  auto d = s.next_deadline();
+  EXPECT_GT(d, 1000ms);
+  EXPECT_LE(d, 2000ms);
+
+  s.periodic(d - 1ms);
+  EXPECT_TRUE(s.is_follower());
+  EXPECT_EQ(s.next_deadline(), 1ms);
+
+  s.periodic(1ms);
+  EXPECT_TRUE(s.is_candidate());
+  EXPECT_GT(s.next_deadline(), 1000ms);
+}
+
+TEST(TestServer, NextDeadlineOfLeaderIsRequestTimeout)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.node_add(2);
+  s.current_term(1);
+  s.become_leader();
+
+  EXPECT_EQ(s.next_deadline(), 200ms);
+  s.periodic(50ms);
+  EXPECT_EQ(s.next_deadline(), 150ms);
+}
+
+TEST(TestServer, NextDeadlineOfNonVotingServerNeverExpires)
+{
+  raft::server<int> s;
+
+  EXPECT_EQ(s.next_deadline(), std::chrono::milliseconds::max());
+
+  s.node_non_voting_add(1, true);
+  s.node_add(2);
+  EXPECT_EQ(s.next_deadline(), std::chrono::milliseconds::max());
+}
+
+TEST(TestServer, StaticTimeoutsUntilRttIsMeasured)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.node_add(2);
+  s.adaptive_timeouts(20ms, 5000ms, 5ms, 1000ms);
+
+  EXPECT_TRUE(s.is_adaptive());
+  EXPECT_EQ(s.election_timeout(), 1000ms);
+  EXPECT_EQ(s.request_timeout(), 200ms);
+}
+
+TEST(TestServer, AdaptiveTimeoutsFollowWorstRtt)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.node_add(2)->rtt_sample(std::chrono::microseconds(400));
+  s.node_add(3)->rtt_sample(std::chrono::microseconds(30000));
+  s.adaptive_timeouts(20ms, 5000ms, 5ms, 1000ms);
+
+  /* rto = 30ms + 4 * 15ms */
+  EXPECT_EQ(s.election_timeout(), 900ms);
+  EXPECT_EQ(s.request_timeout(), 180ms);
+
+  auto d = s.next_deadline();
+  EXPECT_GT(d, 900ms);
+  EXPECT_LE(d, 1800ms);
+}
+
+TEST(TestServer, AdaptiveTimeoutsAreBounded)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  n2->rtt_sample(std::chrono::microseconds(100));
+
+  s.adaptive_timeouts(20ms, 5000ms, 5ms, 1000ms);
+  EXPECT_EQ(s.election_timeout(), 20ms);
+  EXPECT_EQ(s.request_timeout(), 5ms);
+
+  for (unsigned int i = 0; i < 100; ++i)
+    n2->rtt_sample(std::chrono::seconds(2));
+
+  s.become_follower();
+  EXPECT_EQ(s.election_timeout(), 5000ms);
+  EXPECT_EQ(s.request_timeout(), 1000ms);
+}
+
+TEST(TestServer, HeartbeatResponseMeasuresRtt)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.current_term(1);
+  s.become_leader();
+
+  /* answer what was sent on election first, or the probes overlap */
+  s.recv_heartbeat_response(n2, {1, true});
+  auto samples = n2->rtt_samples();
+
+  s.send_heartbeat(n2);
+  s.recv_heartbeat_response(n2, {1, true});
+
+  EXPECT_EQ(n2->rtt_samples(), samples + 1);
+}
+
+TEST(TestServer, FollowerElectionTimeoutOutlastsLeaderHeartbeats)
+{
+  raft::server<int> l;
+  raft::server<int> f;
+
+  l.node_add(1, true);
+  f.node_add(2, true);
+
+  /* the follower measured a fast round trip while a candidate, the leader
+   * a slow one */
+  auto n2 = l.node_add(2);
+  auto n1 = f.node_add(1);
+  n2->rtt_sample(std::chrono::microseconds(30000));
+  n1->rtt_sample(std::chrono::microseconds(400));
+
+  l.adaptive_timeouts(20ms, 5000ms, 5ms, 1000ms);
+  f.adaptive_timeouts(20ms, 5000ms, 5ms, 1000ms);
+  EXPECT_EQ(l.request_timeout(), 180ms);
+  EXPECT_EQ(f.election_timeout(), 20ms);
+
+  decltype(l)::callbacks_t cbs;
+  cbs.send_heartbeat = [&](auto const &, auto const & req) {
+    decltype(f)::heartbeat_response_t resp;
+    return f.recv_heartbeat(n1, req, resp);
+  };
+  cbs.send_appendentries = [&](auto const &, auto const & req) {
+    decltype(f)::appendentries_response_t resp;
+    f.recv_appendentries(n1, req, resp);
+    return l.recv_appendentries_response(n2, resp);
+  };
+  l.callbacks(cbs);
+
+  l.current_term(1);
+  l.become_leader();
+
+  for (unsigned int i = 0; i < 500; ++i)
+  {
+    l.periodic(10ms);
+    f.periodic(10ms);
+
+    ASSERT_TRUE(f.is_follower());
+  }
+
+  EXPECT_EQ(f.current_term(), 1);
+  EXPECT_GE(f.election_timeout(), 5 * l.request_timeout());
+}
+
+TEST(TestServer, RecvEntryFailsIfNotLeader)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.node_add(2);
+
+  decltype(s)::index_t idx;
+  EXPECT_TRUE(s.recv_entry({raft::entry_type_t::regular, 0, 1, 42}, idx) == raft::status_t::fail);
+  EXPECT_EQ(s.current_index(), 0);
+}
+
+TEST(TestServer, SingleVoterCommitsAndAppliesOnRecvEntry)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.periodic(1ms);
+  EXPECT_TRUE(s.is_leader());
+
+  std::vector<int> applied;
+  decltype(s)::callbacks_t cbs;
+  cbs.apply_log = [&](auto const & e, auto) { return applied.push_back(e.elt), raft::status_t::ok; };
+  s.callbacks(cbs);
+
+  /* the noop of the election is committed, and not applied to the user */
+  EXPECT_EQ(s.commit_index(), 1);
+  EXPECT_EQ(s.last_applied_index(), 1);
+
+  s.current_term(3);
+  decltype(s)::index_t idx;
+  s.recv_entry({raft::entry_type_t::regular, 0, 1, 42}, idx);
+
+  EXPECT_EQ(idx, 2);
+  EXPECT_EQ(s.get(2)->term, 3);
+  EXPECT_EQ(s.commit_index(), 2);
+  EXPECT_EQ(s.last_applied_index(), 2);
+  EXPECT_EQ(applied, std::vector<int>{42});
+}
+
+TEST(TestServer, RecvAppendentriesRejectsStaleTerm)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.current_term(5);
+
+  decltype(s)::appendentries_response_t resp;
+  s.recv_appendentries(n2, {4, 0, 0, 0, {{raft::entry_type_t::regular, 4, 1, 42}}}, resp);
+
+  EXPECT_FALSE(resp.success);
+  EXPECT_EQ(resp.term, 5);
+  EXPECT_EQ(s.current_index(), 0);
+}
+
+TEST(TestServer, RecvAppendentriesFailsWithoutPreviousEntry)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+
+  decltype(s)::appendentries_response_t resp;
+  s.recv_appendentries(n2, {1, 3, 1, 0, {{raft::entry_type_t::regular, 1, 1, 42}}}, resp);
+
+  EXPECT_FALSE(resp.success);
+  EXPECT_EQ(resp.current_idx, 0);
+  EXPECT_EQ(s.leader(), n2);
+  EXPECT_EQ(s.current_index(), 0);
+}
+
+TEST(TestServer, RecvAppendentriesDeletesConflictingEntries)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.append({raft::entry_type_t::regular, 1, 1, 1});
+  s.append({raft::entry_type_t::regular, 1, 2, 2});
+  s.append({raft::entry_type_t::regular, 1, 3, 3});
+
+  decltype(s)::appendentries_response_t resp;
+  s.recv_appendentries(n2, {2, 1, 1, 0, {{raft::entry_type_t::regular, 2, 4, 4}}}, resp);
+
+  EXPECT_TRUE(resp.success);
+  EXPECT_EQ(resp.current_idx, 2);
+  EXPECT_EQ(resp.first_idx, 2);
+  EXPECT_EQ(s.current_index(), 2);
+  EXPECT_EQ(s.get(2)->elt, 4);
+}
+
+TEST(TestServer, RecvAppendentriesSkipsEntriesAlreadyHeld)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.append({raft::entry_type_t::regular, 1, 1, 1});
+  s.append({raft::entry_type_t::regular, 1, 2, 2});
+  s.append({raft::entry_type_t::regular, 1, 3, 3});
+
+  decltype(s)::appendentries_response_t resp;
+  s.recv_appendentries(n2, {1, 0, 0, 3, {{raft::entry_type_t::regular, 1, 1, 1}}}, resp);
+
+  EXPECT_TRUE(resp.success);
+  EXPECT_EQ(resp.current_idx, 1);
+  EXPECT_EQ(s.current_index(), 3);
+
+  /* entries past the last new entry may not be the leader's */
+  EXPECT_EQ(s.commit_index(), 1);
+}
+
+TEST(TestServer, RecvAppendentriesFromView)
+{
+  raft::server<std::string> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.append({raft::entry_type_t::regular, 1, 1, "a"});
+
+  decltype(s)::appendentries_request_t req{
+    2,
+    0,
+    0,
+    2,
+    {{raft::entry_type_t::regular, 1, 1, "a"},
+     {raft::entry_type_t::regular, 2, 2, "b"},
+     {raft::entry_type_t::user, 2, 3, "c"}}};
+
+  std::vector<std::uint8_t> buf(raft::codec::size(req));
+  std::size_t written = 0, read;
+  ASSERT_EQ(raft::codec::status_t::ok, raft::codec::encode(req, buf.data(), buf.size(), written));
+
+  decltype(s)::appendentries_view_t view;
+  ASSERT_EQ(raft::codec::status_t::ok, raft::codec::decode(buf.data(), written, view, read));
+
+  decltype(s)::appendentries_response_t resp;
+  s.recv_appendentries(n2, view, resp);
+
+  EXPECT_TRUE(resp.success);
+  EXPECT_EQ(resp.current_idx, 3);
+  EXPECT_EQ(resp.first_idx, 1);
+  EXPECT_EQ(s.current_index(), 3);
+  EXPECT_EQ(s.commit_index(), 2);
+  EXPECT_EQ(s.get(2)->elt, "b");
+  EXPECT_EQ(s.get(3)->type, raft::entry_type_t::user);
+  EXPECT_EQ(s.get(3)->elt, "c");
+}
+
+TEST(TestServer, RecvAppendentriesResponseWalksNextIndexBack)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.current_term(1);
+  for (int i = 1; i <= 5; ++i)
+    s.append({raft::entry_type_t::regular, 1, (unsigned long int) i, i});
+  s.become_leader();
+  EXPECT_EQ(n2->next_index(), 6);
+
+  std::vector<decltype(s)::index_t> prevs;
+  decltype(s)::callbacks_t cbs;
+  cbs.send_appendentries = [&](auto, auto const & msg) {
+    return prevs.push_back(msg.prev_log_idx), raft::status_t::ok;
+  };
+  s.callbacks(cbs);
+
+  s.recv_appendentries_response(n2, {1, false, 5, 0});
+  s.recv_appendentries_response(n2, {1, false, 2, 0});
+
+  EXPECT_EQ(n2->next_index(), 3);
+  EXPECT_EQ(prevs, (std::vector<decltype(s)::index_t>{4, 2}));
+}
+
+TEST(TestServer, RecvAppendentriesResponseCommitsOnMajority)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  auto n3 = s.node_add(3);
+  s.current_term(1);
+  s.become_leader();
+
+  decltype(s)::index_t idx;
+  s.recv_entry({raft::entry_type_t::regular, 0, 1, 42}, idx);
+  s.recv_entry({raft::entry_type_t::regular, 0, 2, 43}, idx);
+  EXPECT_EQ(s.commit_index(), 0);
+
+  s.recv_appendentries_response(n2, {1, true, 1, 1});
+  EXPECT_EQ(n2->match_index(), 1);
+  EXPECT_EQ(s.commit_index(), 1);
+  EXPECT_EQ(s.last_applied_index(), 1);
+
+  /* stale response */
+  s.recv_appendentries_response(n2, {1, true, 1, 1});
+  EXPECT_EQ(n2->match_index(), 1);
+
+  s.recv_appendentries_response(n3, {1, true, 2, 1});
+  EXPECT_EQ(s.commit_index(), 2);
+}
+
+TEST(TestServer, LeaderDoesNotCommitEntriesOfPreviousTerms)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.node_add(3);
+  s.append({raft::entry_type_t::regular, 1, 1, 42});
+  s.current_term(2);
+  s.become_leader();
+
+  s.recv_appendentries_response(n2, {2, true, 1, 1});
+  EXPECT_EQ(n2->match_index(), 1);
+  EXPECT_EQ(s.commit_index(), 0);
+}
+
+TEST(TestServer, ThreeServersReplicate)
+{
+  cluster<int, 3> c;
+  auto & servers = c.servers;
+  std::vector<int> applied[ 3 ];
+
+  c.apply = [&](auto i, auto const & e, auto) { return applied[ i ].push_back(e.elt), raft::status_t::ok; };
+
+  servers[ 0 ].election_start();
+  ASSERT_TRUE(servers[ 0 ].is_leader());
+
+  /* past the noop of the election */
+  raft::server<int>::index_t idx;
+  for (int v = 0; v < 200; ++v)
+    servers[ 0 ].recv_entry({raft::entry_type_t::regular, 0, 0, v}, idx);
+
+  EXPECT_EQ(servers[ 0 ].commit_index(), 201);
+  EXPECT_EQ(applied[ 0 ].size(), 200);
+
+  /* followers learn the commit index on the next round */
+  servers[ 0 ].periodic(200ms);
+  for (unsigned int i = 1; i < 3; ++i)
+  {
+    EXPECT_EQ(servers[ i ].current_index(), 201);
+    EXPECT_EQ(servers[ i ].commit_index(), 201);
+    EXPECT_EQ(applied[ i ].size(), 200);
+    EXPECT_EQ(applied[ i ], applied[ 0 ]);
+  }
+}
+
+TEST(TestServer, NewLeaderRepairsFollowersWithoutClientEntries)
+{
+  cluster<int, 3> c;
+  auto & servers = c.servers;
+  std::vector<int> applied[ 3 ];
+
+  c.apply = [&](auto i, auto const & e, auto) { return applied[ i ].push_back(e.elt), raft::status_t::ok; };
+
+  for (auto & server : servers)
+    server.current_term(1);
+
+  /* entries of the previous term, the second server missing most of them */
+  for (int v = 1; v <= 5; ++v)
+  {
+    servers[ 0 ].append({raft::entry_type_t::regular, 1, 0, v});
+    servers[ 2 ].append({raft::entry_type_t::regular, 1, 0, v});
+    if (v <= 2)
+      servers[ 1 ].append({raft::entry_type_t::regular, 1, 0, v});
+  }
+
+  servers[ 0 ].election_start();
+  ASSERT_TRUE(servers[ 0 ].is_leader());
+
+  /* no client entry: the noop commits the entries of the previous term */
+  EXPECT_EQ(servers[ 0 ].current_index(), 6);
+  EXPECT_EQ(servers[ 0 ].commit_index(), 6);
+  EXPECT_EQ(servers[ 0 ].node_get(1)->match_index(), 6);
+  EXPECT_EQ(applied[ 0 ], (std::vector<int>{1, 2, 3, 4, 5}));
+
+  /* followers learn the commit index on the next round */
+  servers[ 0 ].periodic(200ms);
+  for (unsigned int i = 1; i < 3; ++i)
+  {
+    EXPECT_EQ(servers[ i ].current_index(), 6);
+    EXPECT_EQ(servers[ i ].commit_index(), 6);
+    EXPECT_EQ(applied[ i ], applied[ 0 ]);
+  }
+}
+
+TEST(TestServer, LaggingFollowerCatchesUpInBatches)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.current_term(1);
+  s.become_leader();
+  s.max_entries(4);
+
+  /* past the noop of the election */
+  decltype(s)::index_t idx;
+  for (int v = 0; v < 9; ++v)
+    s.recv_entry({raft::entry_type_t::regular, 0, 0, v}, idx);
+
+  std::vector<std::size_t> sizes;
+  decltype(s)::callbacks_t cbs;
+  cbs.send_appendentries = [&](auto const & node, auto const & req) {
+    sizes.push_back(req.entries.size());
+    return s.recv_appendentries_response(
+      node, {1, true, req.prev_log_idx + req.entries.size(), req.prev_log_idx + 1});
+  };
+  s.callbacks(cbs);
+
+  n2->next_index(1);
+  s.periodic(200ms);
+
+  EXPECT_EQ(sizes, (std::vector<std::size_t>{4, 4, 2}));
+  EXPECT_EQ(n2->match_index(), 10);
+  EXPECT_EQ(s.commit_index(), 10);
+}
+
+TEST(TestServer, EntriesAreEncodedOnceForAllFollowers)
+{
+  using server_t = raft::server<std::string>;
+
+  cluster<std::string, 5> c;
+  auto & servers = c.servers;
+
+  /* appendentries go encoded */
+  for (unsigned long int i = 0; i < 5; ++i)
+  {
+    auto cbs = servers[ i ].callbacks();
+    cbs.send_appendentries_encoded = [&, i](auto const & node, auto iov, int iovcnt) {
+      std::vector<std::uint8_t> buf;
+      for (int k = 0; k < iovcnt; ++k)
+      {
+        auto p = static_cast<std::uint8_t const *>(iov[ k ].iov_base);
+        buf.insert(buf.end(), p, p + iov[ k ].iov_len);
+      }
+
+      server_t::appendentries_view_t req;
+      std::size_t read;
+      EXPECT_EQ(raft::codec::status_t::ok, raft::codec::decode(buf.data(), buf.size(), req, read));
+
+      auto & peer = servers[ node->id() ];
+      server_t::appendentries_response_t resp;
+
+      peer.recv_appendentries(peer.node_get(i), req, resp);
+      return servers[ i ].recv_appendentries_response(node, resp);
+    };
+    servers[ i ].callbacks(cbs);
+  }
+
+  servers[ 0 ].election_start();
+  ASSERT_TRUE(servers[ 0 ].is_leader());
+
+  auto misses = servers[ 0 ].batches().misses();
+  auto hits = servers[ 0 ].batches().hits();
+
+  server_t::index_t idx;
+  for (int v = 0; v < 10; ++v)
+    servers[ 0 ].recv_entry({raft::entry_type_t::regular, 0, 0, std::to_string(v)}, idx);
+
+  /* one encoding per entry, shared by the 4 followers */
+  EXPECT_EQ(10u, servers[ 0 ].batches().misses() - misses);
+  EXPECT_EQ(30u, servers[ 0 ].batches().hits() - hits);
+
+  /* past the noop of the election */
+  EXPECT_EQ(servers[ 0 ].commit_index(), 11);
+  for (unsigned int i = 1; i < 5; ++i)
+  {
+    EXPECT_EQ(servers[ i ].current_index(), 11);
+    EXPECT_EQ(servers[ i ].get(11)->elt, "9");
+  }
+}
+
+TEST(TestServer, SnapshotPolicyCompactsKeepingTrailingEntries)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.periodic(1ms);
+  s.current_term(3);
+
+  std::vector<std::pair<unsigned long int, unsigned long int>> snapshots;
+  decltype(s)::callbacks_t cbs;
+  cbs.snapshot = [&](auto idx, auto term) { return snapshots.emplace_back(idx, term), raft::status_t::ok; };
+  s.callbacks(cbs);
+
+  decltype(s)::snapshot_policy_t policy;
+  policy.max_entries = 10;
+  policy.trailing = 3;
+  s.snapshot_policy(policy);
+
+  /* past the noop of the election */
+  decltype(s)::index_t idx;
+  for (int v = 0; v < 24; ++v)
+    s.recv_entry({raft::entry_type_t::regular, 0, 0, v}, idx);
+
+  /* growth is counted from the trailing entries left by compaction */
+  std::vector<std::pair<unsigned long int, unsigned long int>> expected{{11, 3}, {22, 3}};
+  EXPECT_EQ(snapshots, expected);
+  EXPECT_EQ(s.snapshot_last_index(), 22);
+  EXPECT_EQ(s.snapshot_last_term(), 3);
+  EXPECT_EQ(s.log_base(), 19);
+  EXPECT_EQ(s.log_count(), 6);
+  EXPECT_EQ(s.get(19), nullptr);
+  EXPECT_EQ(s.get(20)->elt, 18);
+  EXPECT_EQ(s.current_index(), 25);
+}
+
+TEST(TestServer, SnapshotPolicyCountsBytes)
+{
+  raft::server<std::string> s;
+
+  s.node_add(1, true);
+  s.periodic(1ms);
+
+  unsigned int taken = 0;
+  decltype(s)::callbacks_t cbs;
+  cbs.snapshot = [&](auto, auto) { return ++taken, raft::status_t::ok; };
+  s.callbacks(cbs);
+
+  decltype(s)::snapshot_policy_t policy;
+  policy.max_bytes = 4096;
+  s.snapshot_policy(policy);
+
+  decltype(s)::index_t idx;
+  for (int v = 0; v < 9; ++v)
+    s.recv_entry({raft::entry_type_t::regular, 0, 0, std::string(500, 'x')}, idx);
+
+  EXPECT_EQ(taken, 1u);
+  EXPECT_EQ(s.log_count(), 0);
+  EXPECT_EQ(s.log_bytes(), 0u);
+  EXPECT_EQ(s.last_log_term(), s.current_term());
+}
+
+TEST(TestServer, SnapshotFailsWithoutCallback)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  s.periodic(1ms);
+
+  decltype(s)::index_t idx;
+  s.recv_entry({raft::entry_type_t::regular, 0, 0, 1}, idx);
+
+  /* the noop of the election and the entry */
+  EXPECT_EQ(s.snapshot(), raft::status_t::fail);
+  EXPECT_EQ(s.log_count(), 2);
+}
+
+TEST(TestServer, VoteComparesWithSnapshotTermOnceCompacted)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.load_snapshot(10, 4);
+  s.current_term(5);
+
+  EXPECT_EQ(s.current_index(), 10);
+  EXPECT_EQ(s.commit_index(), 10);
+  EXPECT_EQ(s.last_applied_index(), 10);
+  EXPECT_EQ(s.last_log_term(), 4);
+
+  EXPECT_FALSE(s.should_grant_vote(n2, {6, 2, 20, 3}));
+  EXPECT_FALSE(s.should_grant_vote(n2, {6, 2, 9, 4}));
+  EXPECT_TRUE(s.should_grant_vote(n2, {6, 2, 10, 4}));
+}
+
+TEST(TestServer, RecvAppendentriesOverlappingSnapshot)
+{
+  raft::server<int> s;
+
+  s.node_add(1, true);
+  auto n2 = s.node_add(2);
+  s.load_snapshot(5, 1);
+
+  decltype(s)::appendentries_response_t resp;
+  s.recv_appendentries(n2,
+                       {1,
+                        3,
+                        1,
+                        5,
+                        {{raft::entry_type_t::regular, 1, 4, 4},
+                         {raft::entry_type_t::regular, 1, 5, 5},
+                         {raft::entry_type_t::regular, 1, 6, 6},
+                         {raft::entry_type_t::regular, 1, 7, 7}}},
+                       resp);
+
+  EXPECT_TRUE(resp.success);
+  EXPECT_EQ(resp.current_idx, 7);
+  EXPECT_EQ(s.current_index(), 7);
+  EXPECT_EQ(s.get(6)->elt, 6);
+  EXPECT_EQ(s.commit_index(), 5);
+}
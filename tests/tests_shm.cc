@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <raft/transport/shm.hh>
+
+using raft::transport::shm;
+using raft::transport::shm_region;
+using raft::transport::spsc_ring;
+using status_t = raft::transport::status_t;
+
+TEST(TestShm, RingWrapsAround)
+{
+  std::vector<std::uint64_t> mem(spsc_ring::footprint(256) / 8);
+  auto ring = new (mem.data()) spsc_ring(256);
+
+  std::string got;
+  auto collect = [&](std::uint8_t const * data, std::size_t len) {
+    got.assign(reinterpret_cast<char const *>(data), len);
+  };
+
+  /* frames of 100 bytes take 104 bytes: the third one wraps */
+  for (int i = 0; i < 20; ++i)
+  {
+    std::string frame(100, char('a' + i));
+    struct iovec iov = {&frame[ 0 ], frame.size()};
+
+    ASSERT_TRUE(ring->push(&iov, 1));
+    EXPECT_EQ(1u, ring->poll(collect));
+    EXPECT_EQ(frame, got);
+  }
+  EXPECT_TRUE(ring->empty());
+}
+
+TEST(TestShm, RingRefusesWhenFull)
+{
+  std::vector<std::uint64_t> mem(spsc_ring::footprint(64) / 8);
+  auto ring = new (mem.data()) spsc_ring(64);
+
+  std::string frame(20, 'x');
+  struct iovec iov = {&frame[ 0 ], frame.size()};
+
+  EXPECT_TRUE(ring->push(&iov, 1));
+  EXPECT_TRUE(ring->push(&iov, 1));
+  EXPECT_FALSE(ring->push(&iov, 1));
+
+  std::string big(100, 'x');
+  struct iovec large = {&big[ 0 ], big.size()};
+  ring->poll([](auto, auto) {});
+  EXPECT_FALSE(ring->push(&large, 1));
+}
+
+TEST(TestShm, GathersFrames)
+{
+  auto region = shm_region::create(2, 4096);
+  ASSERT_NE(nullptr, region);
+
+  shm a(*region, 0), b(*region, 1);
+
+  std::string head("head:"), body("body");
+  struct iovec iov[ 2 ] = {{&head[ 0 ], head.size()}, {&body[ 0 ], body.size()}};
+
+  EXPECT_EQ(status_t::ok, a.send(1, iov, 2));
+  EXPECT_EQ(status_t::unknown_peer, a.send(0, iov, 2));
+  EXPECT_EQ(status_t::unknown_peer, a.send(2, iov, 2));
+
+  std::size_t from = 42;
+  std::string got;
+  EXPECT_EQ(1u, b.poll([&](std::size_t f, std::uint8_t const * data, std::size_t len) {
+    from = f;
+    got.assign(reinterpret_cast<char const *>(data), len);
+  }));
+  EXPECT_EQ(0u, from);
+  EXPECT_EQ("head:body", got);
+}
+
+TEST(TestShm, ThreadsPingPong)
+{
+  auto region = shm_region::create(2, 1 << 12);
+  ASSERT_NE(nullptr, region);
+
+  unsigned int const n = 20000;
+
+  std::thread echo([&]() {
+    shm b(*region, 1);
+    unsigned int seen = 0;
+
+    while (seen < n)
+    {
+      b.poll([&](std::size_t from, std::uint8_t const * data, std::size_t len) {
+        while (b.send(from, data, len) == status_t::full)
+          ;
+        ++seen;
+      });
+    }
+  });
+
+  shm a(*region, 0);
+  unsigned int sent = 0, received = 0;
+  bool ordered = true;
+
+  while (received < n)
+  {
+    if (sent < n && a.send(1, &sent, sizeof(sent)) == status_t::ok)
+      ++sent;
+
+    a.poll([&](std::size_t, std::uint8_t const * data, std::size_t len) {
+      unsigned int v;
+      std::memcpy(&v, data, len);
+      ordered = ordered && v == received;
+      ++received;
+    });
+  }
+
+  echo.join();
+  EXPECT_TRUE(ordered);
+}
+
+TEST(TestShm, NamedRegionIsSharedAcrossMappings)
+{
+  std::string name = "/raft-tests-" + std::to_string(::getpid());
+
+  auto owner = shm_region::create(name, 3, 1024);
+  ASSERT_NE(nullptr, owner);
+  EXPECT_EQ(nullptr, shm_region::create(name, 3, 1024));
+
+  auto other = shm_region::open(name);
+  ASSERT_NE(nullptr, other);
+  EXPECT_EQ(3u, other->nodes());
+
+  shm a(*owner, 2), b(*other, 0);
+  EXPECT_EQ(status_t::ok, a.send(0, "ping", 4));
+
+  std::string got;
+  b.poll([&](std::size_t from, std::uint8_t const * data, std::size_t len) {
+    EXPECT_EQ(2u, from);
+    got.assign(reinterpret_cast<char const *>(data), len);
+  });
+  EXPECT_EQ("ping", got);
+
+  other.reset();
+  owner.reset();
+  EXPECT_EQ(nullptr, shm_region::open(name));
+}
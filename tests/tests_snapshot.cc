@@ -0,0 +1,460 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <raft/server.hh>
+#include <raft/snapshot.hh>
+
+namespace snapshot = raft::snapshot;
+
+namespace
+{
+
+std::string
+make_dir()
+{
+  char path[] = "/tmp/raft-snapshot-XXXXXX";
+  return mkdtemp(path);
+}
+
+void
+remove_dir(std::string const & path)
+{
+  DIR * dir = opendir(path.c_str());
+  if (dir == nullptr)
+    return;
+
+  while (struct dirent * e = readdir(dir))
+  {
+    std::string name = e->d_name;
+    if (name != "." && name != "..")
+      unlink((path + "/" + name).c_str());
+  }
+
+  closedir(dir);
+  rmdir(path.c_str());
+}
+
+std::vector<std::string>
+list_dir(std::string const & path)
+{
+  std::vector<std::string> names;
+  DIR * dir = opendir(path.c_str());
+
+  while (struct dirent * e = readdir(dir))
+  {
+    std::string name = e->d_name;
+    if (name != "." && name != "..")
+      names.push_back(name);
+  }
+
+  closedir(dir);
+  return names;
+}
+
+std::string
+content(std::size_t n)
+{
+  std::string s;
+
+  for (std::size_t i = 0; i < n; ++i)
+    s.push_back(char('a' + i % 26));
+
+  return s;
+}
+
+snapshot::status_t
+save(snapshot::store & store, std::uint64_t index, std::uint64_t term, std::string const & data)
+{
+  return store.save(index, term, [&](int fd) {
+    return ::write(fd, data.data(), data.size()) == ssize_t(data.size());
+  });
+}
+
+std::string
+load(snapshot::store const & store)
+{
+  std::string data(store.current().size, '\0');
+
+  data.resize(store.read(0, &data[ 0 ], data.size()));
+  return data;
+}
+
+} // namespace
+
+class TestSnapshot : public ::testing::Test
+{
+protected:
+  void
+  SetUp() override
+  {
+    path = make_dir();
+  }
+
+  void
+  TearDown() override
+  {
+    remove_dir(path);
+  }
+
+  std::string path;
+};
+
+TEST_F(TestSnapshot, StoreKeepsLatestSnapshot)
+{
+  {
+    snapshot::store store(path);
+    ASSERT_EQ(snapshot::status_t::ok, store.open());
+    EXPECT_EQ(0u, store.current().term);
+    EXPECT_TRUE(store.file().empty());
+
+    ASSERT_EQ(snapshot::status_t::ok, save(store, 10, 2, content(1000)));
+    ASSERT_EQ(snapshot::status_t::ok, save(store, 20, 3, content(3000)));
+    EXPECT_EQ(20u, store.current().index);
+    EXPECT_EQ(3000u, store.current().size);
+    EXPECT_EQ(1u, list_dir(path).size());
+  }
+
+  /* an interrupted save is forgotten */
+  {
+    std::ofstream f(path + "/save.tmp");
+    f << "partial";
+  }
+
+  snapshot::store store(path);
+  ASSERT_EQ(snapshot::status_t::ok, store.open());
+  EXPECT_EQ(20u, store.current().index);
+  EXPECT_EQ(3u, store.current().term);
+  EXPECT_EQ(content(3000), load(store));
+  EXPECT_EQ(1u, list_dir(path).size());
+}
+
+TEST_F(TestSnapshot, ChunksAreInstalledOnceComplete)
+{
+  snapshot::store store(path);
+  ASSERT_EQ(snapshot::status_t::ok, store.open());
+
+  std::string data = content(10000);
+  snapshot::meta_t meta;
+  meta.index = 42;
+  meta.term = 5;
+  meta.size = data.size();
+
+  std::uint64_t next = 0;
+
+  for (std::size_t off = 0; off < data.size(); off += 4096)
+  {
+    std::size_t len = std::min<std::size_t>(4096, data.size() - off);
+    bool done = off + len == data.size();
+
+    /* nothing is installed until the last chunk is in */
+    EXPECT_EQ(0u, store.current().term);
+
+    ASSERT_EQ(snapshot::status_t::ok,
+              store.receive(meta, off, &data[ off ], len, utils::crc32(&data[ off ], len), done, next));
+    EXPECT_EQ(done ? data.size() : off + len, next);
+  }
+
+  EXPECT_EQ(meta, store.current());
+  EXPECT_EQ(data, load(store));
+  EXPECT_EQ(1u, list_dir(path).size());
+
+  /* a retransmitted chunk of an installed snapshot is acknowledged */
+  ASSERT_EQ(snapshot::status_t::ok,
+            store.receive(meta, 0, &data[ 0 ], 4096, utils::crc32(&data[ 0 ], 4096), false, next));
+  EXPECT_EQ(data.size(), next);
+}
+
+TEST_F(TestSnapshot, ChunksAreChecked)
+{
+  snapshot::store store(path);
+  ASSERT_EQ(snapshot::status_t::ok, store.open());
+
+  std::string data = content(8192);
+  snapshot::meta_t meta;
+  meta.index = 7;
+  meta.term = 1;
+  meta.size = data.size();
+
+  std::uint64_t next = 0;
+  auto crc = utils::crc32(&data[ 0 ], 4096);
+
+  ASSERT_EQ(snapshot::status_t::ok, store.receive(meta, 0, &data[ 0 ], 4096, crc, false, next));
+  EXPECT_EQ(4096u, next);
+
+  /* a chunk out of order tells where to resume */
+  EXPECT_EQ(snapshot::status_t::ok, store.receive(meta, 0, &data[ 0 ], 4096, crc, false, next));
+  EXPECT_EQ(4096u, next);
+
+  /* a damaged chunk is refused */
+  std::string damaged = data.substr(4096);
+  auto good = utils::crc32(damaged.data(), damaged.size());
+  damaged[ 100 ] ^= 1;
+
+  EXPECT_EQ(snapshot::status_t::corrupt,
+            store.receive(meta, 4096, damaged.data(), damaged.size(), good, true, next));
+  EXPECT_EQ(4096u, next);
+  EXPECT_EQ(0u, store.current().term);
+
+  ASSERT_EQ(snapshot::status_t::ok,
+            store.receive(meta, 4096, &data[ 4096 ], 4096, good, true, next));
+  EXPECT_EQ(meta, store.current());
+
+  /* a newer snapshot restarts from the beginning */
+  meta.index = 9;
+  EXPECT_EQ(snapshot::status_t::ok, store.receive(meta, 4096, &data[ 4096 ], 4096, good, false, next));
+  EXPECT_EQ(0u, next);
+}
+
+TEST_F(TestSnapshot, PartsAreSentAsABundle)
+{
+  std::vector<std::string> parts = {path + "-base", path + "-delta"};
+  std::vector<std::string> data = {content(5000), content(300)};
+
+  for (std::size_t i = 0; i < parts.size(); ++i)
+    std::ofstream(parts[ i ]) << data[ i ];
+
+  {
+    snapshot::store store(path);
+    ASSERT_EQ(snapshot::status_t::ok, store.open());
+    ASSERT_EQ(snapshot::status_t::ok, store.save_parts(10, 2, parts));
+  }
+
+  /* the parts are linked next to the header and outlive their files */
+  for (auto const & p : parts)
+    unlink(p.c_str());
+
+  snapshot::store store(path);
+  ASSERT_EQ(snapshot::status_t::ok, store.open());
+  EXPECT_EQ(3u, list_dir(path).size());
+
+  auto header = snapshot::bundle::header({5000, 300});
+  std::string bundled(header.begin(), header.end());
+  bundled += data[ 0 ] + data[ 1 ];
+
+  EXPECT_EQ(10u, store.current().index);
+  EXPECT_EQ(bundled.size(), store.current().size);
+  EXPECT_EQ(bundled, load(store));
+
+  {
+    std::ofstream(path + "/received") << bundled;
+
+    snapshot::bundle b;
+    ASSERT_TRUE(b.open(path + "/received"));
+    ASSERT_EQ(2u, b.size());
+    ASSERT_TRUE(b.extract(1, path + "/extracted"));
+
+    std::ifstream f(path + "/extracted");
+    EXPECT_EQ(data[ 1 ], std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()));
+
+    std::ofstream(path + "/received") << bundled.substr(0, 100);
+    EXPECT_FALSE(b.open(path + "/received"));
+
+    unlink((path + "/received").c_str());
+    unlink((path + "/extracted").c_str());
+  }
+
+  /* the next snapshot replaces the parts as well */
+  ASSERT_EQ(snapshot::status_t::ok, save(store, 20, 2, content(100)));
+  EXPECT_EQ(1u, list_dir(path).size());
+}
+
+TEST(TestThrottle, HoldsBackOnceEmpty)
+{
+  snapshot::throttle t;
+
+  /* unlimited */
+  EXPECT_TRUE(t.take(1 << 30));
+
+  t.rate(1000, 100);
+  EXPECT_TRUE(t.take(300));
+  EXPECT_FALSE(t.take(1));
+
+  /* the debt is paid first */
+  t.refill(std::chrono::milliseconds(150));
+  EXPECT_FALSE(t.take(1));
+  t.refill(std::chrono::milliseconds(100));
+  EXPECT_TRUE(t.take(1));
+
+  /* refills are bounded */
+  t.refill(std::chrono::milliseconds(10000));
+  EXPECT_TRUE(t.take(100));
+  EXPECT_FALSE(t.take(1));
+}
+
+class TestSnapshotTransfer : public ::testing::Test
+{
+protected:
+  using server_t = raft::server<int>;
+
+  void
+  SetUp() override
+  {
+    leader_path = make_dir();
+    follower_path = make_dir();
+
+    leader_store.reset(new snapshot::store(leader_path));
+    follower_store.reset(new snapshot::store(follower_path));
+    ASSERT_EQ(snapshot::status_t::ok, leader_store->open());
+    ASSERT_EQ(snapshot::status_t::ok, follower_store->open());
+
+    /* the leader log starts after a snapshot of 50 entries */
+    data = content(10000);
+    ASSERT_EQ(snapshot::status_t::ok, save(*leader_store, 50, 1, data));
+
+    leader.node_add(1, true);
+    leader.node_add(2);
+    leader.current_term(1);
+    leader.load_snapshot(50, 1);
+    for (int v = 51; v <= 60; ++v)
+      leader.append({raft::entry_type_t::regular, 1, 0, v});
+    leader.become_leader();
+    leader.node_get(2)->next_index(1);
+    leader.snapshot_store(leader_store.get());
+    leader.snapshot_chunk(1024);
+
+    follower.node_add(2, true);
+    follower.node_add(1);
+    follower.snapshot_store(follower_store.get());
+
+    server_t::callbacks_t cbs;
+    cbs.send_installsnapshot = [this](auto const & node, auto const & req) {
+      sent.push_back(req.offset);
+      if (drop && drop(req))
+        return raft::status_t::ok;
+
+      server_t::installsnapshot_response_t resp;
+      follower.recv_installsnapshot(follower.node_get(1), req, resp);
+      return leader.recv_installsnapshot_response(node, resp);
+    };
+    cbs.send_appendentries = [this](auto const & node, auto const & req) {
+      server_t::appendentries_response_t resp;
+      follower.recv_appendentries(follower.node_get(1), req, resp);
+      return leader.recv_appendentries_response(node, resp);
+    };
+    cbs.send_heartbeat = [this](auto const & node, auto const & req) {
+      server_t::heartbeat_response_t resp;
+      follower.recv_heartbeat(follower.node_get(1), req, resp);
+      return leader.recv_heartbeat_response(node, resp);
+    };
+    leader.callbacks(cbs);
+
+    server_t::callbacks_t fcbs;
+    fcbs.install_snapshot = [this](auto idx, auto term) {
+      installed.emplace_back(idx, term);
+      EXPECT_EQ(data, load(*follower_store));
+      return raft::status_t::ok;
+    };
+    follower.callbacks(fcbs);
+  }
+
+  void
+  TearDown() override
+  {
+    leader_store.reset();
+    follower_store.reset();
+    remove_dir(leader_path);
+    remove_dir(follower_path);
+  }
+
+  std::string leader_path;
+  std::string follower_path;
+  std::unique_ptr<snapshot::store> leader_store;
+  std::unique_ptr<snapshot::store> follower_store;
+  std::string data;
+
+  server_t leader;
+  server_t follower;
+
+  std::vector<std::uint64_t> sent;
+  std::function<bool(server_t::installsnapshot_request_t const &)> drop;
+  std::vector<std::pair<unsigned long int, unsigned long int>> installed;
+};
+
+TEST_F(TestSnapshotTransfer, LaggingFollowerReceivesSnapshotInChunks)
+{
+  leader.periodic(200ms);
+
+  EXPECT_EQ(10u, sent.size());
+  EXPECT_EQ(installed, (std::vector<std::pair<unsigned long int, unsigned long int>>{{50, 1}}));
+
+  /* the log follows the snapshot, up to the noop of the election */
+  EXPECT_EQ(50u, follower.log_base());
+  EXPECT_EQ(61u, follower.current_index());
+  EXPECT_EQ(61u, leader.node_get(2)->match_index());
+  EXPECT_EQ(0u, leader.node_get(2)->snapshot_offset());
+  EXPECT_EQ(61u, leader.commit_index());
+}
+
+TEST_F(TestSnapshotTransfer, TransferResumesAfterLostChunks)
+{
+  /* the link goes down in the middle of the transfer */
+  drop = [](auto const & req) { return 4096 <= req.offset; };
+  leader.periodic(200ms);
+  EXPECT_TRUE(installed.empty());
+  EXPECT_EQ(4096u, follower_store->received());
+
+  /* and is back, the lost chunk is sent again */
+  drop = nullptr;
+  sent.clear();
+  leader.periodic(200ms);
+
+  EXPECT_EQ(sent.front(), 4096u);
+  EXPECT_EQ(6u, sent.size());
+  EXPECT_EQ(1u, installed.size());
+}
+
+TEST_F(TestSnapshotTransfer, FollowerTellsWhereToResume)
+{
+  drop = [](auto const & req) { return 4096 <= req.offset; };
+  leader.periodic(200ms);
+
+  /* the leader forgot how far the transfer went */
+  drop = nullptr;
+  sent.clear();
+  leader.node_get(2)->snapshot_offset(0);
+  leader.periodic(200ms);
+
+  EXPECT_EQ(sent.front(), 0u);
+  EXPECT_EQ(sent[ 1 ], 4096u);
+  EXPECT_EQ(7u, sent.size());
+  EXPECT_EQ(1u, installed.size());
+  EXPECT_EQ(61u, follower.current_index());
+}
+
+TEST_F(TestSnapshotTransfer, RateLimitHoldsChunksBack)
+{
+  /* two chunks a second */
+  leader.snapshot_rate(2048);
+
+  for (int i = 0; i < 10; ++i)
+    leader.periodic(200ms);
+
+  /* one chunk of burst, then 4096 bytes in two seconds */
+  EXPECT_LE(4u, sent.size());
+  EXPECT_GE(5u, sent.size());
+  EXPECT_TRUE(installed.empty());
+
+  leader.snapshot_rate(0);
+  leader.periodic(200ms);
+  EXPECT_EQ(1u, installed.size());
+}
+
+TEST_F(TestSnapshotTransfer, StaleLeaderIsRefused)
+{
+  follower.current_term(3);
+  leader.periodic(200ms);
+
+  EXPECT_EQ(1u, sent.size());
+  EXPECT_TRUE(installed.empty());
+  EXPECT_FALSE(leader.is_leader());
+}
@@ -1,63 +1,779 @@
-#include <cassert>
-#include <iostream>
+#include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <raft/snapshot.hh>
+#include <raft/store/chain.hh>
 #include <raft/store/fs.hh>
+#include <raft/store/mapped.hh>
 #include <raft/store/memory.hh>
+#include <raft/store/mvcc.hh>
+
+namespace
+{
 
 template <typename T, typename Key, typename Value>
 void
-utest(T store, Key const & k, Value const & v1, Value const & v2)
+utest(T & store, Key const & k, Value const & v1, Value const & v2)
 {
-  store.c(k, v1);
-  assert(store.r(k) == v1);
+  EXPECT_TRUE(store.c(k, v1));
+  EXPECT_EQ(store.r(k), v1);
 
-  store.u(k, v2);
-  assert(store.r(k) == v2);
+  EXPECT_TRUE(store.u(k, v2));
+  EXPECT_EQ(store.r(k), v2);
 
   store.d(k);
+  EXPECT_THROW(store.r(k), std::out_of_range);
+}
+
+struct MyKey
+{
+  int k;
+};
+
+struct MyValue
+{
+  int v;
 
-  try
+  bool
+  operator==(MyValue const & v) const
   {
-    store.r(k);
-    assert(false);
+    return this->v == v.v;
   }
-  catch (std::out_of_range & e)
+};
+
+std::ostream &
+operator<<(std::ostream & os, MyValue const & v)
+{
+  return os << v.v;
+}
+
+std::string
+make_dir()
+{
+  char path[] = "/tmp/raft-store-XXXXXX";
+  return mkdtemp(path);
+}
+
+void
+remove_dir(std::string const & path)
+{
+  DIR * dir = opendir(path.c_str());
+  if (dir == nullptr)
+    return;
+
+  while (struct dirent * e = readdir(dir))
   {
-    assert(true);
+    std::string name = e->d_name;
+    if (name != "." && name != "..")
+      unlink((path + "/" + name).c_str());
   }
+
+  closedir(dir);
+  rmdir(path.c_str());
 }
 
-struct MyKey
+std::size_t
+count_files(std::string const & path, std::string const & ext)
 {
-  int k;
-};
+  std::size_t n = 0;
+  DIR * dir = opendir(path.c_str());
+
+  while (struct dirent * e = readdir(dir))
+  {
+    std::string name = e->d_name;
+    n += ext.size() < name.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+  closedir(dir);
+  return n;
+}
 
-template <typename ostream>
-inline ostream &
-operator<<(ostream & os, MyKey const & k)
+} // namespace
+
+TEST(TestStore, Memory)
 {
-  os << k.k;
-  return os;
+  raft::store::memory<std::string, int> store;
+  utest(store, std::string("k"), 42, 21);
 }
 
-struct MyValue
+TEST(TestStore, MemoryBatch)
 {
-  int v;
+  raft::store::memory<std::string, int> store;
+  raft::store::write_batch<std::string, int> batch;
+
+  store.c("a", 1);
+
+  batch.put("a", 10);
+  batch.put("b", 2);
+  batch.del("b");
+  batch.put("c", 3);
+
+  EXPECT_TRUE(store.apply(batch, 7));
+  EXPECT_EQ(7u, store.applied_index());
+  EXPECT_EQ(10, store.r("a"));
+  EXPECT_THROW(store.r("b"), std::out_of_range);
+  EXPECT_EQ(3, store.r("c"));
+}
+
+TEST(TestStoreMvcc, ReadsAsOfAnIndex)
+{
+  raft::store::mvcc<std::string, int> store;
+
+  store.put("a", 1, 1);
+  store.put("b", 1, 2);
+  store.put("a", 2, 3);
+  store.del("b", 4);
+
+  EXPECT_EQ(2, store.r("a"));
+  EXPECT_THROW(store.r("b"), std::out_of_range);
+
+  auto at2 = store.read_at(2);
+  EXPECT_EQ(1, at2.r("a"));
+  EXPECT_EQ(1, at2.r("b"));
+
+  auto at3 = store.read_at(3);
+  EXPECT_EQ(2, at3.r("a"));
+  EXPECT_EQ(1, at3.r("b"));
+
+  /* readers are not affected by later entries */
+  raft::store::write_batch<std::string, int> batch;
+  batch.put("a", 5);
+  batch.put("c", 5);
+  store.apply(batch, 5);
+
+  EXPECT_EQ(1, at2.r("a"));
+  EXPECT_THROW(at2.r("c"), std::out_of_range);
+  EXPECT_EQ(5, store.read_at(5).r("c"));
+
+  EXPECT_THROW(store.read_at(6), std::out_of_range);
+}
+
+TEST(TestStoreMvcc, CollectsBelowTheOldestReader)
+{
+  raft::store::mvcc<int, int> store;
+
+  for (std::uint64_t i = 1; i <= 10; ++i)
+    store.put(0, int(i), i);
+  store.put(1, 1, 10);
+  store.del(1, 11);
+  EXPECT_EQ(12u, store.versions());
 
-  bool
-  operator==(MyValue const & v)
   {
-    return this->v == v.v;
+    auto reader = store.read_at(5);
+
+    /* versions 1 to 4 of key 0 are hidden by version 5 */
+    EXPECT_EQ(4u, store.gc());
+    EXPECT_EQ(5, reader.r(0));
+    EXPECT_THROW(store.read_at(4), std::out_of_range);
+  }
+
+  /* nothing pinned: only the latest versions are kept, deletions go */
+  EXPECT_EQ(7u, store.gc());
+  EXPECT_EQ(1u, store.versions());
+  EXPECT_EQ(10, store.r(0));
+  EXPECT_THROW(store.read_at(10), std::out_of_range);
+  EXPECT_EQ(0u, store.gc());
+}
+
+TEST(TestStoreMvcc, ScansSurviveApplyAndGc)
+{
+  raft::store::mvcc<int, int> store;
+
+  for (int k = 0; k < 100; ++k)
+    store.put(k, k, 1);
+
+  auto reader = store.read_at(1);
+  std::vector<std::pair<int, int>> seen;
+  int steps = 0;
+
+  while (reader.scan([&seen](int k, int v) { seen.emplace_back(k, v); }, 10))
+  {
+    /* entries applied and collected between steps */
+    std::uint64_t index = std::uint64_t(++steps) + 1;
+    for (int k = 0; k < 100; k += 2)
+      store.del(k, index);
+    for (int k = 1000; k < 1010; ++k)
+      store.put(k, k, index);
+    store.gc();
+  }
+
+  ASSERT_EQ(100u, seen.size());
+  for (int k = 0; k < 100; ++k)
+    EXPECT_EQ(std::make_pair(k, k), seen[ std::size_t(k) ]);
+
+  EXPECT_EQ(10, steps);
+  EXPECT_FALSE(reader.scan([](int, int) {}));
+}
+
+class TestStoreFilesystem : public ::testing::Test
+{
+protected:
+  void
+  SetUp() override
+  {
+    options.path = make_dir();
+  }
+
+  void
+  TearDown() override
+  {
+    remove_dir(options.path);
   }
+
+  raft::store::options_t options;
 };
 
-int
-main(void)
+TEST_F(TestStoreFilesystem, Crud)
+{
+  {
+    raft::store::filesystem<std::string, int> store(options.path);
+    ASSERT_TRUE(store.ok());
+    utest(store, std::string("k"), 42, 21);
+  }
+
+  {
+    raft::store::filesystem<int, std::string> store(options.path);
+    utest(store, 101, std::string("forty two"), std::string("twenty one"));
+  }
+
+  raft::store::filesystem<MyKey, MyValue> store(options.path);
+  utest(store, MyKey({101}), MyValue({42}), MyValue({21}));
+}
+
+TEST_F(TestStoreFilesystem, PersistsAcrossReopen)
+{
+  {
+    raft::store::filesystem<int, std::string> store(options);
+    ASSERT_TRUE(store.ok());
+
+    for (int k = 0; k < 100; ++k)
+      store.c(k, "v" + std::to_string(k));
+    for (int k = 0; k < 100; k += 2)
+      store.d(k);
+    store.u(1, "updated");
+  }
+
+  raft::store::filesystem<int, std::string> store(options);
+  ASSERT_TRUE(store.ok());
+
+  EXPECT_EQ(50u, store.size());
+  EXPECT_EQ("updated", store.r(1));
+  EXPECT_EQ("v99", store.r(99));
+  EXPECT_THROW(store.r(98), std::out_of_range);
+}
+
+TEST_F(TestStoreFilesystem, RollsDataFiles)
+{
+  options.file_size = 4096;
+  options.sync = false;
+
+  {
+    raft::store::filesystem<int, std::string> store(options);
+    for (int k = 0; k < 1000; ++k)
+      store.c(k, std::string(32, 'x'));
+  }
+
+  EXPECT_LT(1u, count_files(options.path, ".data"));
+
+  raft::store::filesystem<int, std::string> store(options);
+  EXPECT_EQ(1000u, store.size());
+  EXPECT_EQ(std::string(32, 'x'), store.r(999));
+}
+
+TEST_F(TestStoreFilesystem, MergeKeepsLiveRecords)
+{
+  options.file_size = 4096;
+  options.sync = false;
+  options.merge_ratio = 0;
+
+  {
+    raft::store::filesystem<int, int> store(options);
+
+    for (int round = 0; round < 10; ++round)
+      for (int k = 0; k < 200; ++k)
+        store.u(k, round);
+    for (int k = 100; k < 200; ++k)
+      store.d(k);
+
+    auto before = store.total_bytes();
+    ASSERT_TRUE(store.merge());
+
+    EXPECT_GT(before / 10, store.total_bytes());
+    EXPECT_EQ(store.live_bytes(), store.total_bytes());
+    EXPECT_EQ(1u, count_files(options.path, ".hint"));
+    EXPECT_EQ(2u, count_files(options.path, ".data"));
+
+    store.u(0, 100);
+  }
+
+  /* indexed from the hint file, then from the file written after */
+  raft::store::filesystem<int, int> store(options);
+
+  EXPECT_EQ(100u, store.size());
+  EXPECT_EQ(100, store.r(0));
+  EXPECT_EQ(9, store.r(99));
+  EXPECT_THROW(store.r(100), std::out_of_range);
+}
+
+TEST_F(TestStoreFilesystem, MergesByPolicy)
+{
+  options.sync = false;
+  options.merge_ratio = 0.5;
+  options.merge_min = 16 << 10;
+
+  raft::store::filesystem<int, int> store(options);
+
+  /* writes leave the merge to the owner */
+  for (int i = 0; i < 10000; ++i)
+    store.u(i % 10, i);
+
+  EXPECT_TRUE(store.needs_merge());
+  EXPECT_LT(64u << 10, store.total_bytes());
+
+  ASSERT_TRUE(store.merge());
+  EXPECT_FALSE(store.needs_merge());
+
+  for (int i = 0; i < 10000; ++i)
+  {
+    store.u(i % 10, i);
+    if (store.needs_merge())
+    {
+      ASSERT_TRUE(store.merge());
+    }
+  }
+
+  EXPECT_GT(32u << 10, store.total_bytes());
+  EXPECT_EQ(9999, store.r(9));
+}
+
+TEST_F(TestStoreFilesystem, TornTailIsCut)
+{
+  {
+    raft::store::filesystem<int, int> store(options);
+    for (int k = 0; k < 10; ++k)
+      store.c(k, k);
+  }
+
+  /* half a record */
+  {
+    std::ofstream f(options.path + "/0000000000000001.data", std::ios::app | std::ios::binary);
+    f.write("\x20\x00\x00\x00\x12\x34", 6);
+  }
+
+  {
+    raft::store::filesystem<int, int> store(options);
+    ASSERT_TRUE(store.ok());
+    EXPECT_EQ(10u, store.size());
+    store.c(10, 10);
+  }
+
+  raft::store::filesystem<int, int> store(options);
+  EXPECT_EQ(11u, store.size());
+  EXPECT_EQ(10, store.r(10));
+}
+
+TEST_F(TestStoreFilesystem, BatchPersistsAppliedIndex)
+{
+  options.merge_ratio = 0;
+
+  {
+    raft::store::filesystem<int, std::string> store(options);
+    raft::store::write_batch<int, std::string> batch;
+
+    EXPECT_EQ(0u, store.applied_index());
+
+    for (int k = 0; k < 10; ++k)
+      batch.put(k, "v" + std::to_string(k));
+    batch.del(0);
+    batch.put(1, "updated");
+
+    ASSERT_TRUE(store.apply(batch, 12));
+    EXPECT_EQ(12u, store.applied_index());
+    EXPECT_EQ(9u, store.size());
+    EXPECT_EQ("updated", store.r(1));
+
+    batch.clear();
+    batch.del(9);
+    ASSERT_TRUE(store.apply(batch, 13));
+  }
+
+  {
+    raft::store::filesystem<int, std::string> store(options);
+    ASSERT_TRUE(store.ok());
+
+    EXPECT_EQ(13u, store.applied_index());
+    EXPECT_EQ(8u, store.size());
+    EXPECT_EQ("updated", store.r(1));
+    EXPECT_EQ("v8", store.r(8));
+    EXPECT_THROW(store.r(0), std::out_of_range);
+
+    ASSERT_TRUE(store.merge());
+    EXPECT_EQ(store.live_bytes(), store.total_bytes());
+  }
+
+  /* from the hint file */
+  {
+    raft::store::filesystem<int, std::string> store(options);
+    EXPECT_EQ(13u, store.applied_index());
+    EXPECT_EQ(8u, store.size());
+  }
+
+  /* and from the merged data file alone */
+  ASSERT_EQ(1u, count_files(options.path, ".hint"));
+  unlink((options.path + "/0000000000000002.hint").c_str());
+
+  raft::store::filesystem<int, std::string> store(options);
+  EXPECT_EQ(13u, store.applied_index());
+  EXPECT_EQ(8u, store.size());
+  EXPECT_EQ("updated", store.r(1));
+}
+
+TEST_F(TestStoreFilesystem, TornBatchIsCutAsAWhole)
+{
+  std::string file = options.path + "/0000000000000001.data";
+  long before;
+
+  {
+    raft::store::filesystem<int, int> store(options);
+    raft::store::write_batch<int, int> batch;
+
+    batch.put(1, 1);
+    ASSERT_TRUE(store.apply(batch, 1));
+    before = long(store.total_bytes());
+
+    batch.clear();
+    for (int k = 2; k < 10; ++k)
+      batch.put(k, k);
+    batch.del(1);
+    ASSERT_TRUE(store.apply(batch, 2));
+  }
+
+  /* lose the last record of the second batch */
+  {
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    long size = long(in.tellg());
+    ASSERT_EQ(0, truncate(file.c_str(), size - 3));
+  }
+
+  {
+    raft::store::filesystem<int, int> store(options);
+    ASSERT_TRUE(store.ok());
+
+    EXPECT_EQ(1u, store.applied_index());
+    EXPECT_EQ(1u, store.size());
+    EXPECT_EQ(1, store.r(1));
+    EXPECT_EQ(before, long(store.total_bytes()));
+  }
+
+  std::ifstream in(file, std::ios::binary | std::ios::ate);
+  EXPECT_EQ(before, long(in.tellg()));
+}
+
+TEST_F(TestStoreFilesystem, ScansInKeyOrder)
+{
+  options.merge_ratio = 0;
+
+  {
+    raft::store::filesystem<int, int> store(options);
+    for (int k = 99; 0 <= k; --k)
+      store.c(k, k * 10);
+    store.d(50);
+  }
+
+  std::vector<int> keys;
+  auto collect = [&keys](int k, int v) {
+    EXPECT_EQ(k * 10, v);
+    keys.push_back(k);
+  };
+
+  {
+    /* ordered index rebuilt from the data file */
+    raft::store::filesystem<int, int> store(options);
+
+    EXPECT_EQ(4u, store.scan(48, 53, collect));
+    EXPECT_EQ(std::vector<int>({48, 49, 51, 52}), keys);
+
+    ASSERT_TRUE(store.merge());
+    store.d(49);
+  }
+
+  /* and from the hint file */
+  raft::store::filesystem<int, int> store(options);
+
+  keys.clear();
+  EXPECT_EQ(3u, store.scan(48, 100, collect, 3));
+  EXPECT_EQ(std::vector<int>({48, 51, 52}), keys);
+}
+
+TEST_F(TestStoreFilesystem, ScansPrefix)
+{
+  raft::store::filesystem<std::string, int> store(options);
+  std::vector<std::string> keys;
+
+  for (auto const & k : {"b/2", "a/1", "b/1", "bb", "b/3"})
+    store.c(k, 1);
+  store.d("b/3");
+
+  EXPECT_EQ(2u, store.prefix("b/", [&keys](std::string const & k, int) { keys.push_back(k); }));
+  EXPECT_EQ(std::vector<std::string>({"b/1", "b/2"}), keys);
+}
+
+TEST_F(TestStoreFilesystem, MappedImage)
+{
+  std::string path = options.path + "/image";
+
+  {
+    std::map<std::string, int> state;
+    for (int k = 0; k < 1000; ++k)
+      state[ "key" + std::to_string(k) ] = k;
+
+    ASSERT_TRUE((raft::store::image<std::string, int>::write(path, state, 42)));
+  }
+
+  {
+    raft::store::mapped<std::string, int> store(path);
+    ASSERT_TRUE(store.ok());
+
+    EXPECT_EQ(42u, store.applied_index());
+    EXPECT_EQ(0, store.r("key0"));
+    EXPECT_EQ(999, store.r("key999"));
+    EXPECT_THROW(store.r("key1000"), std::out_of_range);
+    EXPECT_EQ(0u, store.promoted());
+
+    /* writes go to the overlay */
+    EXPECT_TRUE(store.c("key1", -1));
+    EXPECT_EQ(1, store.r("key1"));
+    store.u("key1", -1);
+    store.d("key2");
+    store.d("nothing");
+    store.c("new", 7);
+
+    raft::store::write_batch<std::string, int> batch;
+    batch.put("key3", -3);
+    batch.del("new");
+    batch.put("newer", 8);
+    store.apply(batch, 50);
+
+    EXPECT_EQ(-1, store.r("key1"));
+    EXPECT_THROW(store.r("key2"), std::out_of_range);
+    EXPECT_THROW(store.r("new"), std::out_of_range);
+    EXPECT_EQ(-3, store.r("key3"));
+    EXPECT_EQ(4u, store.promoted());
+
+    ASSERT_TRUE(store.save(path));
+  }
+
+  raft::store::mapped<std::string, int> store(path);
+  ASSERT_TRUE(store.ok());
+
+  EXPECT_EQ(50u, store.applied_index());
+  EXPECT_EQ(-1, store.r("key1"));
+  EXPECT_THROW(store.r("key2"), std::out_of_range);
+  EXPECT_EQ(-3, store.r("key3"));
+  EXPECT_EQ(8, store.r("newer"));
+  EXPECT_EQ(998, store.r("key998"));
+}
+
+TEST_F(TestStoreFilesystem, MappedImageIsChecked)
+{
+  std::string path = options.path + "/image";
+  raft::store::image<int, int> img;
+
+  EXPECT_FALSE(img.open(path));
+
+  ASSERT_TRUE((raft::store::image<int, int>::write(path, std::map<int, int>{{1, 1}, {2, 2}}, 2)));
+  ASSERT_TRUE(img.open(path));
+  EXPECT_EQ(2u, img.size());
+
+  {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(8);
+    f.put('\x7f');
+  }
+
+  raft::store::mapped<int, int> store(path);
+  EXPECT_FALSE(store.ok());
+}
+
+TEST(TestStore, DeltaChangesAreEncodedByField)
+{
+  using change_t = raft::store::change_t<std::uint64_t>;
+  using traits_t = raft::codec::traits<change_t>;
+
+  /* whatever the padding and the value of a deletion hold */
+  change_t del;
+  std::memset(&del, 0xff, sizeof(del));
+  del.live = false;
+
+  std::uint8_t buf[ 16 ];
+  raft::codec::writer w(buf, sizeof(buf));
+  traits_t::encode(w, del);
+  traits_t::encode(w, change_t{true, 300});
+  ASSERT_TRUE(w.ok());
+  EXPECT_EQ(4u, w.size());
+  EXPECT_EQ(0, buf[ 0 ]);
+
+  change_t out;
+  raft::codec::reader r(buf, w.size());
+  traits_t::decode(r, out);
+  EXPECT_FALSE(out.live);
+  traits_t::decode(r, out);
+  ASSERT_TRUE(r.ok());
+  EXPECT_TRUE(out.live);
+  EXPECT_EQ(300u, out.value);
+}
+
+TEST_F(TestStoreFilesystem, DeltaSnapshots)
+{
+  raft::store::chain_options_t chain_options;
+  chain_options.path = options.path;
+  chain_options.max_deltas = 3;
+  chain_options.consolidate_ratio = 0;
+
+  raft::store::mapped<int, std::string> store;
+  std::map<int, std::string> state;
+  std::uint64_t index = 0;
+
+  auto write = [&](int from, int to, char tag) {
+    raft::store::write_batch<int, std::string> batch;
+    for (int k = from; k < to; ++k)
+    {
+      batch.put(k, std::string(100, tag));
+      state[ k ] = std::string(100, tag);
+    }
+    store.apply(batch, ++index);
+  };
+
+  auto check = [&](raft::store::mapped<int, std::string> const & s) {
+    EXPECT_EQ(index, s.applied_index());
+    for (int k = 0; k < 1100; ++k)
+    {
+      if (state.count(k))
+        EXPECT_EQ(state[ k ], s.r(k));
+      else
+        EXPECT_THROW(s.r(k), std::out_of_range);
+    }
+  };
+
+  {
+    raft::store::chain<int, std::string> chain(chain_options);
+    ASSERT_TRUE(chain.open());
+
+    write(0, 1000, 'a');
+    ASSERT_TRUE(chain.snapshot(store));
+    EXPECT_EQ(0u, chain.deltas());
+
+    /* a delta holds the changed keys only, deletions included */
+    write(10, 20, 'b');
+    write(1000, 1010, 'c');
+    store.d(30);
+    store.d(1005);
+    state.erase(30);
+    state.erase(1005);
+    ASSERT_TRUE(chain.snapshot(store));
+    EXPECT_EQ(1u, chain.deltas());
+    EXPECT_LT(chain.deltas_size() * 20, chain.base_size());
+
+    write(1005, 1006, 'd');
+    store.d(1000);
+    state.erase(1000);
+    ASSERT_TRUE(chain.snapshot(store));
+    EXPECT_EQ(2u, chain.deltas());
+    EXPECT_EQ(1u, count_files(options.path, ".base"));
+    EXPECT_EQ(2u, count_files(options.path, ".delta"));
+  }
+
+  {
+    raft::store::chain<int, std::string> chain(chain_options);
+    ASSERT_TRUE(chain.open());
+    EXPECT_EQ(2u, chain.deltas());
+
+    raft::store::mapped<int, std::string> restarted;
+    ASSERT_TRUE(chain.load(restarted));
+    check(restarted);
+
+    /* past max_deltas, the chain is consolidated into a new base */
+    write(0, 5, 'e');
+    ASSERT_TRUE(chain.snapshot(store));
+    write(5, 10, 'f');
+    ASSERT_TRUE(chain.snapshot(store));
+    EXPECT_EQ(0u, chain.deltas());
+    EXPECT_EQ(1u, count_files(options.path, ".base"));
+    EXPECT_EQ(0u, count_files(options.path, ".delta"));
+
+    write(1050, 1060, 'g');
+    ASSERT_TRUE(chain.snapshot(store));
+    ASSERT_TRUE(chain.load(restarted));
+    check(restarted);
+  }
+}
+
+TEST_F(TestStoreFilesystem, DeltaSnapshotsAreSentAsABundle)
 {
-  utest(raft::store::memory<std::string, int>(), "k", 42, 21);
-  utest(raft::store::filesystem<std::string, int>(), "k", 42, 21);
-  utest(raft::store::filesystem<int, int>(), 101, 42, 21);
-  utest(raft::store::filesystem<MyKey, MyValue>(), MyKey({101}), MyValue({42}), MyValue({21}));
+  std::string leader = options.path + "/leader";
+  std::string follower = options.path + "/follower";
+
+  raft::store::chain_options_t chain_options;
+  chain_options.path = leader + "-chain";
+
+  raft::store::mapped<int, int> store;
+  raft::store::chain<int, int> chain(chain_options);
+  raft::snapshot::store snapshots(leader);
+  ASSERT_TRUE(chain.open());
+  ASSERT_EQ(raft::snapshot::status_t::ok, snapshots.open());
+
+  for (int k = 0; k < 1000; ++k)
+    store.u(k, k);
+  store.apply({}, 10);
+  ASSERT_TRUE(chain.snapshot(store));
+
+  store.u(1, -1);
+  store.d(2);
+  store.apply({}, 20);
+  ASSERT_TRUE(chain.snapshot(store));
+  ASSERT_EQ(1u, chain.deltas());
+  ASSERT_EQ(raft::snapshot::status_t::ok, snapshots.save_parts(20, 3, chain.files()));
+
+  /* the follower receives the bundle in chunks, then splits it */
+  raft::snapshot::store received(follower);
+  ASSERT_EQ(raft::snapshot::status_t::ok, received.open());
+
+  std::vector<char> buf(1000);
+  std::uint64_t next = 0;
+
+  while (received.current().term == 0)
+  {
+    std::size_t len = snapshots.read(next, buf.data(), buf.size());
+    bool done = next + len == snapshots.current().size;
+
+    ASSERT_EQ(raft::snapshot::status_t::ok,
+              received.receive(snapshots.current(), next, buf.data(), len, utils::crc32(buf.data(), len), done, next));
+  }
+
+  chain_options.path = follower + "-chain";
+  raft::store::chain<int, int> installed(chain_options);
+  ASSERT_TRUE(installed.open());
+  ASSERT_TRUE(installed.install(received.file()));
+  EXPECT_EQ(1u, installed.deltas());
+  EXPECT_EQ(20u, installed.last_index());
+
+  raft::store::mapped<int, int> replica;
+  ASSERT_TRUE(installed.load(replica));
+  EXPECT_EQ(20u, replica.applied_index());
+  EXPECT_EQ(-1, replica.r(1));
+  EXPECT_THROW(replica.r(2), std::out_of_range);
+  EXPECT_EQ(999, replica.r(999));
 
-  return 0;
+  for (auto const & dir : {leader, leader + "-chain", follower, follower + "-chain"})
+    remove_dir(dir);
 }
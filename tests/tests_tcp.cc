@@ -0,0 +1,351 @@
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+
+#include <raft/codec.hh>
+#include <raft/transport/tcp.hh>
+
+using tcp_t = raft::transport::tcp<unsigned long int>;
+using status_t = raft::transport::status_t;
+
+namespace
+{
+
+/* frames received by a node, in order */
+struct inbox
+{
+  std::mutex lock;
+  std::condition_variable cv;
+  std::vector<std::pair<unsigned long int, std::string>> msgs;
+
+  tcp_t::handler_t
+  handler()
+  {
+    return [this](unsigned long int from, std::uint8_t const * data, std::size_t len) {
+      std::lock_guard<std::mutex> guard(lock);
+      msgs.emplace_back(from, std::string(reinterpret_cast<char const *>(data), len));
+      cv.notify_all();
+    };
+  }
+
+  bool
+  wait(std::size_t n)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    return cv.wait_for(guard, std::chrono::seconds(10), [&]() { return n <= msgs.size(); });
+  }
+};
+
+} // namespace
+
+TEST(TestTcp, LoopbackExchange)
+{
+  tcp_t a(1), b(2);
+  inbox ia, ib;
+
+  ASSERT_EQ(status_t::ok, a.listen("127.0.0.1", 0));
+  ASSERT_EQ(status_t::ok, b.listen("127.0.0.1", 0));
+  ASSERT_NE(0, a.port());
+
+  ASSERT_EQ(status_t::ok, a.peer_add(2, "127.0.0.1", b.port()));
+  ASSERT_EQ(status_t::ok, b.peer_add(1, "127.0.0.1", a.port()));
+  a.on_message(ia.handler());
+  b.on_message(ib.handler());
+
+  ASSERT_EQ(status_t::ok, a.start());
+  ASSERT_EQ(status_t::ok, b.start());
+
+  EXPECT_EQ(status_t::ok, a.send(2, "hello", 5));
+  EXPECT_EQ(status_t::ok, b.send(1, "world", 5));
+  EXPECT_EQ(status_t::unknown_peer, a.send(3, "lost", 4));
+
+  ASSERT_TRUE(ib.wait(1));
+  ASSERT_TRUE(ia.wait(1));
+
+  EXPECT_EQ(2u, ia.msgs[ 0 ].first);
+  EXPECT_EQ("world", ia.msgs[ 0 ].second);
+  EXPECT_EQ(1u, ib.msgs[ 0 ].first);
+  EXPECT_EQ("hello", ib.msgs[ 0 ].second);
+}
+
+TEST(TestTcp, ManyFramesKeepTheirOrder)
+{
+  tcp_t::options_t options;
+  options.io_threads = 2;
+
+  tcp_t a(1, options), b(2, options), c(3, options);
+  inbox ic;
+
+  ASSERT_EQ(status_t::ok, c.listen("127.0.0.1", 0));
+  a.peer_add(3, "127.0.0.1", c.port());
+  b.peer_add(3, "127.0.0.1", c.port());
+  c.on_message(ic.handler());
+
+  a.start();
+  b.start();
+  c.start();
+
+  unsigned int const n = 10000;
+  std::thread ta([&]() {
+    for (unsigned int i = 0; i < n; ++i)
+      ASSERT_EQ(status_t::ok, a.send(3, std::to_string(i).data(), std::to_string(i).size()));
+  });
+  for (unsigned int i = 0; i < n; ++i)
+    ASSERT_EQ(status_t::ok, b.send(3, std::to_string(i).data(), std::to_string(i).size()));
+  ta.join();
+
+  ASSERT_TRUE(ic.wait(2 * n));
+
+  unsigned int next[ 4 ] = {0, 0, 0, 0};
+  for (auto & m : ic.msgs)
+  {
+    ASSERT_TRUE(m.first == 1 || m.first == 2);
+    EXPECT_EQ(std::to_string(next[ m.first ]++), m.second);
+  }
+  EXPECT_EQ(n, next[ 1 ]);
+  EXPECT_EQ(n, next[ 2 ]);
+}
+
+TEST(TestTcp, LargeFramesAreGathered)
+{
+  tcp_t a(1), b(2);
+  inbox ib;
+
+  ASSERT_EQ(status_t::ok, b.listen("127.0.0.1", 0));
+  a.peer_add(2, "127.0.0.1", b.port());
+  b.on_message(ib.handler());
+  a.start();
+  b.start();
+
+  std::string head(10, 'h'), body(4 << 20, 'b');
+  struct iovec iov[ 2 ] = {{&head[ 0 ], head.size()}, {&body[ 0 ], body.size()}};
+
+  for (unsigned int i = 0; i < 4; ++i)
+    ASSERT_EQ(status_t::ok, a.send(2, iov, 2));
+
+  ASSERT_TRUE(ib.wait(4));
+  for (auto & m : ib.msgs)
+    EXPECT_EQ(head + body, m.second);
+}
+
+TEST(TestTcp, FullOutboxRefusesFrames)
+{
+  tcp_t::options_t options;
+  options.max_outbox = 64;
+
+  /* nobody listens, frames pile up */
+  tcp_t a(1, options);
+  a.peer_add(2, "127.0.0.1", 1);
+
+  std::string frame(40, 'x');
+  EXPECT_EQ(status_t::ok, a.send(2, frame.data(), frame.size()));
+  EXPECT_EQ(status_t::full, a.send(2, frame.data(), frame.size()));
+}
+
+TEST(TestTcp, OversizedFramesAreRefused)
+{
+  tcp_t::options_t options;
+  options.max_frame = 32;
+
+  tcp_t a(1, options);
+  a.peer_add(2, "127.0.0.1", 1);
+
+  std::string frame(40, 'x');
+  EXPECT_EQ(status_t::too_large, a.send(2, frame.data(), frame.size()));
+  EXPECT_EQ(status_t::ok, a.send(2, frame.data(), 32));
+
+  /* past what the header holds, refused before any byte is read */
+  options.max_frame = std::size_t(-1);
+  tcp_t b(1, options);
+  b.peer_add(2, "127.0.0.1", 1);
+
+  std::size_t half = std::size_t(1) << 31;
+  struct iovec iov[ 2 ] = {{&frame[ 0 ], half}, {&frame[ 0 ], half}};
+  EXPECT_EQ(status_t::too_large, b.send(2, iov, 2));
+}
+
+TEST(TestTcp, SlowReaderFillsTheOutbox)
+{
+  tcp_t::options_t options;
+  options.max_outbox = 1 << 20;
+
+  /* connections are accepted by the kernel, never read */
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(0, ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+  ASSERT_EQ(0, ::listen(fd, 1));
+  ASSERT_EQ(0, ::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len));
+
+  tcp_t a(1, options);
+  a.peer_add(2, "127.0.0.1", ntohs(addr.sin_port));
+  a.start();
+
+  /* refused for good once the socket buffers are full, whatever was written */
+  std::string frame(64 << 10, 'x');
+  std::size_t sent = 0;
+  unsigned int refused = 0;
+
+  while (refused < 10 && sent < (std::size_t(64) << 20))
+  {
+    if (a.send(2, frame.data(), frame.size()) == status_t::ok)
+    {
+      sent += frame.size();
+      refused = 0;
+    }
+    else
+    {
+      ++refused;
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+
+  EXPECT_EQ(10u, refused);
+  EXPECT_LT(sent, std::size_t(64) << 20);
+
+  a.stop();
+  ::close(fd);
+}
+
+TEST(TestTcp, CarriesEncodedMessages)
+{
+  tcp_t a(1), b(2);
+  inbox ib;
+
+  ASSERT_EQ(status_t::ok, b.listen("127.0.0.1", 0));
+  a.peer_add(2, "127.0.0.1", b.port());
+  b.on_message(ib.handler());
+  a.start();
+  b.start();
+
+  raft::rpc::vote_request_t<unsigned long int, unsigned long int, unsigned long int> req{3, 1, 10, 2};
+  std::uint8_t buf[ 64 ];
+  std::size_t written = 0, read;
+
+  ASSERT_EQ(raft::codec::status_t::ok, raft::codec::encode(req, buf, sizeof(buf), written));
+  ASSERT_EQ(status_t::ok, a.send(2, buf, written));
+  ASSERT_TRUE(ib.wait(1));
+
+  decltype(req) out;
+  auto & data = ib.msgs[ 0 ].second;
+  ASSERT_EQ(raft::codec::status_t::ok, raft::codec::decode(data.data(), data.size(), out, read));
+  EXPECT_EQ(3u, out.term);
+  EXPECT_EQ(1u, out.candidate_id);
+}
+
+TEST(TestTcp, ControlFramesOvertakeBulk)
+{
+  tcp_t a(1), b(2);
+  inbox ib;
+
+  ASSERT_EQ(status_t::ok, b.listen("127.0.0.1", 0));
+  a.peer_add(2, "127.0.0.1", b.port());
+  b.on_message(ib.handler());
+
+  /* queued before the connection exists, scheduled at once */
+  std::string bulk(1024, 'b');
+  for (unsigned int i = 0; i < 200; ++i)
+    ASSERT_EQ(status_t::ok, a.send(2, bulk.data(), bulk.size(), raft::transport::lane_t::bulk));
+  for (unsigned int i = 0; i < 3; ++i)
+    ASSERT_EQ(status_t::ok, a.send(2, "vote", 4, raft::transport::lane_t::control));
+
+  a.start();
+  b.start();
+
+  ASSERT_TRUE(ib.wait(203));
+  for (unsigned int i = 0; i < 3; ++i)
+    EXPECT_EQ("vote", ib.msgs[ i ].second);
+}
+
+TEST(TestTcp, BulkFramesAreNotStarved)
+{
+  tcp_t::options_t options;
+  options.control_burst = 4;
+
+  tcp_t a(1, options), b(2);
+  inbox ib;
+
+  ASSERT_EQ(status_t::ok, b.listen("127.0.0.1", 0));
+  a.peer_add(2, "127.0.0.1", b.port());
+  b.on_message(ib.handler());
+
+  for (unsigned int i = 0; i < 10; ++i)
+    ASSERT_EQ(status_t::ok, a.send(2, "bulk", 4, raft::transport::lane_t::bulk));
+  for (unsigned int i = 0; i < 40; ++i)
+    ASSERT_EQ(status_t::ok, a.send(2, "ctrl", 4, raft::transport::lane_t::control));
+
+  a.start();
+  b.start();
+
+  ASSERT_TRUE(ib.wait(50));
+
+  /* the hello frame counts in the first burst */
+  EXPECT_EQ("ctrl", ib.msgs[ 0 ].second);
+  EXPECT_EQ("bulk", ib.msgs[ 3 ].second);
+  EXPECT_EQ("bulk", ib.msgs[ 8 ].second);
+}
+
+TEST(TestTcp, HeartbeatOvertakesBulkBacklogOfSlowReader)
+{
+  tcp_t a(1), b(2);
+  inbox ib;
+
+  ASSERT_EQ(status_t::ok, b.listen("127.0.0.1", 0));
+  a.peer_add(2, "127.0.0.1", b.port());
+
+  /* the reader takes a while over each bulk frame */
+  auto handler = ib.handler();
+  b.on_message([&](unsigned long int from, std::uint8_t const * data, std::size_t len) {
+    if (1 < len)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    handler(from, data, len);
+  });
+
+  a.start();
+  b.start();
+
+  unsigned int const n = 256;
+  std::string bulk(64 << 10, 'b');
+  for (unsigned int i = 0; i < n; ++i)
+    ASSERT_EQ(status_t::ok, a.send(2, bulk.data(), bulk.size(), raft::transport::lane_t::bulk));
+
+  /* the socket buffers are full by now */
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  std::size_t received;
+  {
+    std::lock_guard<std::mutex> guard(ib.lock);
+    received = ib.msgs.size();
+  }
+  ASSERT_EQ(status_t::ok, a.send(2, "h", 1, raft::transport::lane_t::control));
+
+  ASSERT_TRUE(ib.wait(n + 1));
+
+  std::size_t pos = received;
+  while (ib.msgs[ pos ].second != "h")
+    ++pos;
+
+  /* behind what the socket buffers held, not the whole backlog */
+  EXPECT_LT(pos - received, 32u);
+}
+
+TEST(TestTcp, RpcMessagesPickTheirLane)
+{
+  using lane_t = raft::transport::lane_t;
+
+  raft::rpc::vote_request_t<unsigned long int, unsigned long int, unsigned long int> vote{3, 1, 10, 2};
+  raft::rpc::appendentries_request_t<int, unsigned long int, unsigned long int, unsigned long int> ae{
+    3, 10, 2, 9, {}};
+  std::uint8_t buf[ 64 ];
+  std::size_t written = 0;
+
+  ASSERT_EQ(raft::codec::status_t::ok, raft::codec::encode(vote, buf, sizeof(buf), written));
+  EXPECT_EQ(lane_t::control, raft::transport::lane_of(buf, written));
+
+  ASSERT_EQ(raft::codec::status_t::ok, raft::codec::encode(ae, buf, sizeof(buf), written));
+  EXPECT_EQ(lane_t::bulk, raft::transport::lane_of(buf, written));
+
+  EXPECT_EQ(lane_t::bulk, raft::transport::lane_of("raw", 3));
+}
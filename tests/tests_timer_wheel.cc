@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include <utils/timer_wheel.hh>
+
+TEST(TestTimerWheel, FiresAtDeadline)
+{
+  utils::timer_wheel<int> w;
+  std::vector<std::pair<int, unsigned long int>> fired;
+
+  w.schedule(1, 10);
+  w.schedule(2, 5);
+  EXPECT_EQ(w.size(), 2);
+
+  w.advance(4, [&](int k) { fired.emplace_back(k, w.now()); });
+  EXPECT_TRUE(fired.empty());
+
+  w.advance(10, [&](int k) { fired.emplace_back(k, w.now()); });
+  ASSERT_EQ(fired.size(), 2);
+  EXPECT_EQ(fired[ 0 ].first, 2);
+  EXPECT_EQ(fired[ 0 ].second, 5);
+  EXPECT_EQ(fired[ 1 ].first, 1);
+  EXPECT_EQ(fired[ 1 ].second, 10);
+  EXPECT_EQ(w.size(), 0);
+}
+
+TEST(TestTimerWheel, PastDeadlineFiresOnNextTick)
+{
+  utils::timer_wheel<int> w(100);
+  unsigned int calls = 0;
+
+  w.schedule(1, 50);
+  w.advance(101, [&](int) { ++calls; });
+
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(TestTimerWheel, CancelAndReschedule)
+{
+  utils::timer_wheel<int> w;
+  std::map<int, unsigned long int> fired;
+
+  w.schedule(1, 10);
+  w.schedule(2, 10);
+  w.cancel(1);
+  w.schedule(2, 300);
+
+  EXPECT_EQ(w.deadline(1), utils::timer_wheel<int>::never);
+  EXPECT_EQ(w.deadline(2), 300);
+
+  w.advance(1000, [&](int k) { fired[ k ] = w.now(); });
+
+  EXPECT_EQ(fired.size(), 1);
+  EXPECT_EQ(fired[ 2 ], 300);
+}
+
+TEST(TestTimerWheel, RearmFromCallback)
+{
+  utils::timer_wheel<int> w;
+  std::vector<unsigned long int> fired;
+
+  w.schedule(1, 100);
+  w.advance(1000, [&](int k) {
+    fired.push_back(w.now());
+    w.schedule(k, w.now() + 100);
+  });
+
+  EXPECT_EQ(fired.size(), 10);
+  EXPECT_EQ(fired.back(), 1000);
+}
+
+TEST(TestTimerWheel, FarDeadlinesCascade)
+{
+  utils::timer_wheel<int, 2, 2> w;
+  std::map<int, unsigned long int> fired;
+
+  /* 16 ticks are covered by this tiny wheel, later timers are parked */
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> dis(1, 200);
+  std::map<int, unsigned long int> deadlines;
+
+  for (int k = 0; k < 100; ++k)
+  {
+    deadlines[ k ] = dis(gen);
+    w.schedule(k, deadlines[ k ]);
+  }
+
+  w.advance(250, [&](int k) { fired[ k ] = w.now(); });
+
+  EXPECT_EQ(fired, deadlines);
+}
+
+TEST(TestTimerWheel, NextExpiryIsALowerBound)
+{
+  utils::timer_wheel<int> w;
+
+  EXPECT_EQ(w.next_expiry(), utils::timer_wheel<int>::never);
+
+  w.schedule(1, 5000);
+  w.schedule(2, 70);
+  EXPECT_LE(w.next_expiry(), 70);
+  EXPECT_GT(w.next_expiry(), 0);
+
+  w.advance(70, [](int) {});
+  EXPECT_LE(w.next_expiry(), 5000);
+  EXPECT_GT(w.next_expiry(), 70);
+}
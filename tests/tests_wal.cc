@@ -0,0 +1,363 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <raft/wal/journal.hh>
+
+namespace wal = raft::wal;
+
+namespace
+{
+
+std::string
+make_dir()
+{
+  char path[] = "/tmp/raft-wal-XXXXXX";
+  return mkdtemp(path);
+}
+
+void
+remove_dir(std::string const & path)
+{
+  DIR * dir = opendir(path.c_str());
+  if (dir == nullptr)
+    return;
+
+  while (struct dirent * e = readdir(dir))
+  {
+    std::string name = e->d_name;
+    if (name != "." && name != "..")
+      unlink((path + "/" + name).c_str());
+  }
+
+  closedir(dir);
+  rmdir(path.c_str());
+}
+
+std::size_t
+count_segments(std::string const & path)
+{
+  std::size_t n = 0;
+  DIR * dir = opendir(path.c_str());
+
+  while (struct dirent * e = readdir(dir))
+    n += std::string(e->d_name).find(".wal") != std::string::npos;
+
+  closedir(dir);
+  return n;
+}
+
+/* rebuilds the log the way a follower would */
+struct replayed_t
+{
+  std::vector<std::string> entries;
+  unsigned long int first = 0;
+
+  void
+  operator()(unsigned long int idx, std::uint8_t const * data, std::size_t len)
+  {
+    if (entries.empty())
+      first = idx;
+    else
+      entries.resize(idx - first);
+
+    entries.emplace_back(reinterpret_cast<char const *>(data), len);
+  }
+};
+
+/* the first submit hands nothing over, as an interrupted one */
+template <typename backend_t>
+struct short_submit : backend_t
+{
+  explicit short_submit(unsigned int depth) : backend_t(depth) {}
+
+  bool
+  submit()
+  {
+    if (shorted)
+      return backend_t::submit();
+
+    shorted = true;
+    return true;
+  }
+
+  bool shorted = false;
+};
+
+} // namespace
+
+template <typename backend_t>
+class TestWal : public ::testing::Test
+{
+protected:
+  using journal_t = wal::journal<backend_t>;
+
+  void
+  SetUp() override
+  {
+    options.path = make_dir();
+    options.buffer_size = 64 << 10;
+  }
+
+  void
+  TearDown() override
+  {
+    remove_dir(options.path);
+  }
+
+  /**
+   * @brief Flush and poll until the journal is durable
+   */
+  static void
+  sync(journal_t & j)
+  {
+    ASSERT_FALSE(raft::any(j.flush()));
+
+    while (j.durable_index() != j.last_index() && !j.failed())
+      j.poll([](unsigned long int) {});
+  }
+
+  /**
+   * @brief Append records from..to, polling when all buffers are in flight
+   */
+  static void
+  fill(journal_t & j, unsigned long int from, unsigned long int to)
+  {
+    for (unsigned long int i = from; i <= to; ++i)
+    {
+      std::string data = "entry " + std::to_string(i);
+      wal::status_t ret;
+
+      while ((ret = j.append(i, data.data(), data.size())) == wal::status_t::full)
+        j.poll([](unsigned long int) {});
+
+      ASSERT_EQ(wal::status_t::ok, ret);
+    }
+  }
+
+  wal::options_t options;
+};
+
+using backends = ::testing::Types<wal::uring, wal::posix>;
+TYPED_TEST_CASE(TestWal, backends);
+
+TYPED_TEST(TestWal, ReplaysWhatWasMadeDurable)
+{
+  {
+    typename TestFixture::journal_t j(this->options);
+    if (!j.ok())
+      return; /* no io_uring in this kernel */
+
+    replayed_t r;
+    ASSERT_EQ(wal::status_t::ok, j.open(r));
+    EXPECT_TRUE(r.entries.empty());
+
+    this->fill(j, 1, 5000);
+    this->sync(j);
+
+    EXPECT_FALSE(j.failed());
+    EXPECT_EQ(5000u, j.durable_index());
+  }
+
+  typename TestFixture::journal_t j(this->options);
+  replayed_t r;
+
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+  ASSERT_EQ(5000u, r.entries.size());
+  EXPECT_EQ(1u, r.first);
+  EXPECT_EQ("entry 1", r.entries.front());
+  EXPECT_EQ("entry 5000", r.entries.back());
+  EXPECT_EQ(5000u, j.durable_index());
+
+  /* appending goes on after the replayed records */
+  this->fill(j, 5001, 5010);
+  this->sync(j);
+}
+
+TYPED_TEST(TestWal, OverwriteTruncates)
+{
+  {
+    typename TestFixture::journal_t j(this->options);
+    if (!j.ok())
+      return;
+
+    replayed_t r;
+    ASSERT_EQ(wal::status_t::ok, j.open(r));
+
+    this->fill(j, 1, 10);
+    this->sync(j);
+
+    ASSERT_EQ(wal::status_t::ok, j.append(6, "other", 5));
+    EXPECT_EQ(5u, j.durable_index());
+    this->sync(j);
+    EXPECT_EQ(6u, j.durable_index());
+
+    /* a gap is refused */
+    EXPECT_EQ(wal::status_t::fail, j.append(8, "gap", 3));
+  }
+
+  typename TestFixture::journal_t j(this->options);
+  replayed_t r;
+
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+  ASSERT_EQ(6u, r.entries.size());
+  EXPECT_EQ("entry 5", r.entries[ 4 ]);
+  EXPECT_EQ("other", r.entries[ 5 ]);
+}
+
+TYPED_TEST(TestWal, TornTailIsCut)
+{
+  {
+    typename TestFixture::journal_t j(this->options);
+    if (!j.ok())
+      return;
+
+    replayed_t r;
+    ASSERT_EQ(wal::status_t::ok, j.open(r));
+    this->fill(j, 1, 100);
+    this->sync(j);
+  }
+
+  /* half a record header */
+  {
+    std::ofstream f(this->options.path + "/0000000000000000.wal", std::ios::app | std::ios::binary);
+    f.write("\x20\x00\x00\x00\x12\x34", 6);
+  }
+
+  {
+    typename TestFixture::journal_t j(this->options);
+    replayed_t r;
+
+    ASSERT_EQ(wal::status_t::ok, j.open(r));
+    ASSERT_EQ(100u, r.entries.size());
+
+    this->fill(j, 101, 110);
+    this->sync(j);
+  }
+
+  typename TestFixture::journal_t j(this->options);
+  replayed_t r;
+
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+  ASSERT_EQ(110u, r.entries.size());
+  EXPECT_EQ("entry 110", r.entries.back());
+}
+
+TYPED_TEST(TestWal, RollsSegments)
+{
+  this->options.segment_size = 16 << 10;
+  this->options.preallocate = true;
+
+  {
+    typename TestFixture::journal_t j(this->options);
+    if (!j.ok())
+      return;
+
+    replayed_t r;
+    ASSERT_EQ(wal::status_t::ok, j.open(r));
+    this->fill(j, 1, 3000);
+    this->sync(j);
+    EXPECT_EQ(3000u, j.durable_index());
+  }
+
+  EXPECT_LT(1u, count_segments(this->options.path));
+
+  typename TestFixture::journal_t j(this->options);
+  replayed_t r;
+
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+  ASSERT_EQ(3000u, r.entries.size());
+  EXPECT_EQ("entry 3000", r.entries.back());
+}
+
+TYPED_TEST(TestWal, DirectIo)
+{
+  this->options.direct = true;
+  this->options.segment_size = 64 << 10;
+
+  {
+    typename TestFixture::journal_t j(this->options);
+    replayed_t r;
+
+    /* not every file system supports O_DIRECT */
+    if (!j.ok() || raft::any(j.open(r)))
+      return;
+
+    for (unsigned long int i = 1; i <= 2000; i += 100)
+    {
+      this->fill(j, i, i + 99);
+      this->sync(j);
+    }
+
+    EXPECT_FALSE(j.failed());
+  }
+
+  typename TestFixture::journal_t j(this->options);
+  replayed_t r;
+
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+  ASSERT_EQ(2000u, r.entries.size());
+  EXPECT_EQ("entry 2000", r.entries.back());
+}
+
+TYPED_TEST(TestWal, ReleaseRemovesCompactedSegments)
+{
+  this->options.segment_size = 16 << 10;
+
+  {
+    typename TestFixture::journal_t j(this->options);
+    if (!j.ok())
+      return;
+
+    replayed_t r;
+    ASSERT_EQ(wal::status_t::ok, j.open(r));
+    this->fill(j, 1, 3000);
+    this->sync(j);
+
+    std::size_t before = count_segments(this->options.path);
+    EXPECT_LT(0u, j.release(2000));
+    EXPECT_GT(before, count_segments(this->options.path));
+  }
+
+  typename TestFixture::journal_t j(this->options);
+  replayed_t r;
+
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+  EXPECT_LT(1u, r.first);
+  EXPECT_GE(2001u, r.first);
+  EXPECT_EQ(3000u, r.first + r.entries.size() - 1);
+
+  /* segments found at open can be released too */
+  EXPECT_LT(0u, j.release(2999));
+}
+
+TYPED_TEST(TestWal, IdleJournalSubmitsWhatWasRefused)
+{
+  wal::journal<short_submit<TypeParam>> j(this->options);
+  if (!j.ok())
+    return;
+
+  replayed_t r;
+  ASSERT_EQ(wal::status_t::ok, j.open(r));
+
+  std::string data = "entry 1";
+  ASSERT_EQ(wal::status_t::ok, j.append(1, data.data(), data.size()));
+  ASSERT_EQ(wal::status_t::ok, j.flush());
+
+  /* nothing else is written, polling alone makes the record durable */
+  unsigned long int durable = 0;
+  for (unsigned int i = 0; i < 10000 && durable == 0; ++i)
+  {
+    j.poll([&](unsigned long int idx) { durable = idx; });
+    usleep(100);
+  }
+
+  EXPECT_EQ(1u, durable);
+  EXPECT_FALSE(j.failed());
+}